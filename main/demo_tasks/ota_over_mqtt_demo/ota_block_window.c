@@ -0,0 +1,353 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_block_window.c
+ * @brief Adaptive number of blocks requested per OTA stream request.
+ *
+ * The OTA library encodes stream requests as a CBOR map whose last entry is
+ * the number of blocks, "n". For block counts below 24 the value is a single
+ * byte, so the window is applied by rewriting the last byte of the request.
+ * The OTA agent asks again every otaconfigMAX_NUM_BLOCKS_REQUEST blocks it
+ * accepts, counting across requests, so its own requests do not line up with
+ * the rounds. The demo signals the end of every round instead, and requests
+ * of the agent made while a round is in flight are not sent, unless the
+ * round is old enough for the request to be a retry after the request timer
+ * of the agent expired.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* OTA library includes. */
+#include "ota.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* CBOR helpers include. */
+#include "ota_cbor.h"
+
+/* Public functions include. */
+#include "ota_block_window.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Suffix of the stream request topic,
+ * "$aws/things/<thing>/streams/<stream>/get/cbor".
+ */
+#define BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX           "/get/cbor"
+#define BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX_LENGTH    ( sizeof( BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX ) - 1U )
+
+/**
+ * @brief Key of the block count in stream requests.
+ */
+#define BLOCK_WINDOW_CBOR_KEY                       ( ( uint8_t ) 'n' )
+
+/**
+ * @brief Maximum size of a stream request. Dominated by the block bitmap.
+ */
+#define BLOCK_WINDOW_REQUEST_MAX_SIZE               ( 3U * OTA_MAX_BLOCK_BITMAP_SIZE )
+
+/**
+ * @brief Upper bound of the window: the block count the OTA library was built
+ * with, and no more blocks than there are event buffers to receive them.
+ */
+#define BLOCK_WINDOW_MAX                                                   \
+    ( ( otaconfigMAX_NUM_BLOCKS_REQUEST < otaconfigMAX_NUM_OTA_DATA_BUFFERS ) ? \
+      otaconfigMAX_NUM_BLOCKS_REQUEST : otaconfigMAX_NUM_OTA_DATA_BUFFERS )
+
+/**
+ * @brief Age of a round from which a request of the OTA agent is taken as a
+ * retry after its request timer expired, rather than as a request for blocks
+ * already in flight.
+ */
+#define BLOCK_WINDOW_RETRY_TICKS                    ( pdMS_TO_TICKS( ( otaconfigFILE_REQUEST_WAIT_MS * 3U ) / 4U ) )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Guards the controller state, which is updated from the OTA agent task
+ * and the coreMQTT-Agent task.
+ */
+static portMUX_TYPE xWindowLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Current window and statistics.
+ */
+static OtaBlockWindowStats_t xWindowStats = { 0 };
+
+/**
+ * @brief State of the current round, from a request to its last block.
+ */
+static bool xRoundOpen = false;
+static bool xRoundDecreased = false;
+static uint32_t ulRoundRequested = 0U;
+static uint32_t ulRoundReceived = 0U;
+static TickType_t xRoundStartTick = 0U;
+
+/**
+ * @brief Dropped packet count of the OTA agent at the last request.
+ */
+static uint32_t ulLastDroppedPackets = 0U;
+
+/**
+ * @brief Copy of the last stream request with the window applied.
+ */
+static uint8_t ucRequestBuffer[ BLOCK_WINDOW_REQUEST_MAX_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Halve the window, at most once per round. Must be called in the
+ * critical section.
+ */
+static void prvDecreaseWindow( void );
+
+/**
+ * @brief Start a new round with the current window, unless the current round
+ * is still in flight.
+ *
+ * @return The number of blocks to request, or 0 if the request must not be
+ * sent.
+ */
+static uint32_t prvOpenRound( void );
+
+/**
+ * @brief Count a block of the current round. Must be called in the critical
+ * section.
+ *
+ * @return true if the round is complete.
+ */
+static bool prvCountBlock( void );
+
+/* Static function definitions ************************************************/
+
+static void prvDecreaseWindow( void )
+{
+    if( xRoundDecreased == false )
+    {
+        xRoundDecreased = true;
+        xWindowStats.ulWindow = ( xWindowStats.ulWindow > 1U ) ? ( xWindowStats.ulWindow / 2U ) : 1U;
+        xWindowStats.ulDecreases++;
+    }
+}
+
+static uint32_t prvOpenRound( void )
+{
+    OtaAgentStatistics_t xOtaStatistics = { 0 };
+    uint32_t ulWindow = 0U;
+    TickType_t xNow = xTaskGetTickCount();
+
+    ( void ) OTA_GetStatistics( &xOtaStatistics );
+
+    taskENTER_CRITICAL( &xWindowLock );
+    {
+        if( ( xRoundOpen == true ) && ( ( xNow - xRoundStartTick ) < BLOCK_WINDOW_RETRY_TICKS ) )
+        {
+            /* The agent counted its own number of blocks, and the blocks of
+             * the round are still on their way. */
+            xWindowStats.ulSuppressed++;
+        }
+        else
+        {
+            /* Blocks dropped by the agent, or a round the stream did not
+             * complete before the request timer of the agent expired, mean
+             * the link or the device fell behind. */
+            if( ( xOtaStatistics.otaPacketsDropped != ulLastDroppedPackets ) || ( xRoundOpen == true ) )
+            {
+                prvDecreaseWindow();
+            }
+
+            ulLastDroppedPackets = xOtaStatistics.otaPacketsDropped;
+
+            xRoundOpen = true;
+            xRoundDecreased = false;
+            ulRoundRequested = xWindowStats.ulWindow;
+            ulRoundReceived = 0U;
+            xRoundStartTick = xNow;
+            ulWindow = xWindowStats.ulWindow;
+        }
+    }
+    taskEXIT_CRITICAL( &xWindowLock );
+
+    return ulWindow;
+}
+
+static bool prvCountBlock( void )
+{
+    bool xComplete = false;
+
+    if( xRoundOpen == true )
+    {
+        ulRoundReceived++;
+
+        if( ulRoundReceived == ulRoundRequested )
+        {
+            xRoundOpen = false;
+            xComplete = true;
+        }
+    }
+
+    return xComplete;
+}
+
+/* Public function definitions ************************************************/
+
+void vOtaBlockWindowInit( void )
+{
+    taskENTER_CRITICAL( &xWindowLock );
+    {
+        memset( &xWindowStats, 0x00, sizeof( xWindowStats ) );
+        xWindowStats.ulMaxWindow = BLOCK_WINDOW_MAX;
+        xWindowStats.ulWindow = ( otademoconfigBLOCK_WINDOW_INITIAL < BLOCK_WINDOW_MAX ) ?
+                                otademoconfigBLOCK_WINDOW_INITIAL : BLOCK_WINDOW_MAX;
+        xRoundOpen = false;
+        ulLastDroppedPackets = 0U;
+    }
+    taskEXIT_CRITICAL( &xWindowLock );
+}
+
+const char * pcOtaBlockWindowApply( const char * pcTopic,
+                                    uint16_t usTopicLength,
+                                    const char * pcMessage,
+                                    uint32_t ulMessageLength )
+{
+    const char * pcRet = pcMessage;
+    const uint8_t * pucTail;
+    uint32_t ulWindow;
+
+    if( ( usTopicLength > BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX_LENGTH ) &&
+        ( memcmp( &pcTopic[ usTopicLength - BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX_LENGTH ],
+                  BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX,
+                  BLOCK_WINDOW_REQUEST_TOPIC_SUFFIX_LENGTH ) == 0 ) &&
+        ( ulMessageLength >= 3U ) &&
+        ( ulMessageLength <= sizeof( ucRequestBuffer ) ) &&
+        ( otaconfigMAX_NUM_BLOCKS_REQUEST <= OTA_CBOR_MAX_INLINE_UINT ) )
+    {
+        pucTail = ( const uint8_t * ) &pcMessage[ ulMessageLength - 3U ];
+
+        /* Requests encoded differently are left unchanged. */
+        if( ( pucTail[ 0 ] == OTA_CBOR_KEY_HEADER ) &&
+            ( pucTail[ 1 ] == BLOCK_WINDOW_CBOR_KEY ) &&
+            ( pucTail[ 2 ] == otaconfigMAX_NUM_BLOCKS_REQUEST ) )
+        {
+            ulWindow = prvOpenRound();
+
+            if( ulWindow == 0U )
+            {
+                pcRet = NULL;
+            }
+            else
+            {
+                memcpy( ucRequestBuffer, pcMessage, ulMessageLength );
+                ucRequestBuffer[ ulMessageLength - 1U ] = ( uint8_t ) ulWindow;
+                pcRet = ( const char * ) ucRequestBuffer;
+            }
+        }
+    }
+
+    return pcRet;
+}
+
+bool xOtaBlockWindowOnBlock( void )
+{
+    bool xRequestNext = false;
+    uint32_t ulRttMs;
+
+    taskENTER_CRITICAL( &xWindowLock );
+    {
+        if( ( xRoundOpen == true ) && ( ulRoundReceived == 0U ) )
+        {
+            ulRttMs = pdTICKS_TO_MS( xTaskGetTickCount() - xRoundStartTick );
+
+            if( xWindowStats.ulSmoothedRttMs == 0U )
+            {
+                xWindowStats.ulSmoothedRttMs = ulRttMs;
+                xWindowStats.ulMinRttMs = ulRttMs;
+            }
+            else
+            {
+                xWindowStats.ulSmoothedRttMs = ( ( 7U * xWindowStats.ulSmoothedRttMs ) + ulRttMs ) / 8U;
+                xWindowStats.ulMinRttMs = ( ulRttMs < xWindowStats.ulMinRttMs ) ? ulRttMs : xWindowStats.ulMinRttMs;
+            }
+        }
+
+        if( prvCountBlock() == true )
+        {
+            /* Grow while requests are not queueing up behind each other. */
+            if( ( xRoundDecreased == false ) &&
+                ( xWindowStats.ulWindow < xWindowStats.ulMaxWindow ) &&
+                ( xWindowStats.ulSmoothedRttMs <= ( 2U * xWindowStats.ulMinRttMs ) + 1U ) )
+            {
+                xWindowStats.ulWindow++;
+                xWindowStats.ulIncreases++;
+            }
+
+            xRequestNext = true;
+        }
+    }
+    taskEXIT_CRITICAL( &xWindowLock );
+
+    return xRequestNext;
+}
+
+bool xOtaBlockWindowOnDrop( void )
+{
+    bool xRequestNext = false;
+
+    taskENTER_CRITICAL( &xWindowLock );
+    {
+        prvDecreaseWindow();
+
+        /* The agent still has the block in its bitmap, so the next request
+         * asks for it again. */
+        xRequestNext = prvCountBlock();
+    }
+    taskEXIT_CRITICAL( &xWindowLock );
+
+    return xRequestNext;
+}
+
+void vOtaBlockWindowGetStats( OtaBlockWindowStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL( &xWindowLock );
+    {
+        *pxStats = xWindowStats;
+    }
+    taskEXIT_CRITICAL( &xWindowLock );
+}
@@ -0,0 +1,116 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_block_window.h
+ * @brief Adaptive number of blocks requested per OTA stream request.
+ *
+ * An AIMD controller picks how many blocks each stream request asks for,
+ * between one and the number the OTA library was built with, bounded by the
+ * number of OTA event buffers. The window grows by one block after every
+ * complete round while the block round trip time stays near its minimum, and
+ * halves when blocks are dropped or a round is not delivered in full.
+ */
+#ifndef OTA_BLOCK_WINDOW_H
+#define OTA_BLOCK_WINDOW_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief State of the block window controller.
+ */
+typedef struct OtaBlockWindowStats
+{
+    uint32_t ulWindow;        /**< Blocks asked for by the next request. */
+    uint32_t ulMaxWindow;     /**< Upper bound of the window. */
+    uint32_t ulSmoothedRttMs; /**< Smoothed delay from request to first block. */
+    uint32_t ulMinRttMs;      /**< Lowest delay from request to first block. */
+    uint32_t ulIncreases;     /**< Number of additive increases. */
+    uint32_t ulDecreases;     /**< Number of multiplicative decreases. */
+    uint32_t ulSuppressed;    /**< Requests of the OTA agent not sent. */
+} OtaBlockWindowStats_t;
+
+/**
+ * @brief Set the window to its initial size and clear the statistics.
+ */
+void vOtaBlockWindowInit( void );
+
+/**
+ * @brief Apply the current window to an outgoing OTA publish.
+ *
+ * Stream requests ending with the block count the OTA library was built with
+ * are copied with the count replaced by the current window, and open a new
+ * round. While a round is in flight, stream requests are not sent unless
+ * the round is old enough for the request to be a retry after the request
+ * timer of the OTA agent expired. Other publishes are returned unchanged.
+ *
+ * @note Only call from the OTA agent task. The returned message stays valid
+ * until the next call.
+ *
+ * @return The message to publish, of length ulMessageLength, or NULL if the
+ * request must not be sent.
+ */
+const char * pcOtaBlockWindowApply( const char * pcTopic,
+                                    uint16_t usTopicLength,
+                                    const char * pcMessage,
+                                    uint32_t ulMessageLength );
+
+/**
+ * @brief Account for a data block received on the stream.
+ *
+ * @return true if the round is complete, in which case the caller must signal
+ * OtaAgentEventRequestFileBlock after the block.
+ */
+bool xOtaBlockWindowOnBlock( void );
+
+/**
+ * @brief Account for a data block dropped because no event buffer was free.
+ *
+ * @return true if the round is complete, in which case the caller must signal
+ * OtaAgentEventRequestFileBlock.
+ */
+bool xOtaBlockWindowOnDrop( void );
+
+/**
+ * @brief Get the state of the controller.
+ */
+void vOtaBlockWindowGetStats( OtaBlockWindowStats_t * pxStats );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_BLOCK_WINDOW_H */
@@ -0,0 +1,581 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_bundle.c
+ * @brief Firmware and data files updated together by one OTA job.
+ *
+ * The header is the first OTA_BUNDLE_HEADER_SIZE bytes of the file, so every
+ * payload byte maps to its slot offset by a constant shift and blocks can be
+ * written in the order they arrive. The header is checked as soon as it is
+ * complete, and kept in RAM until the file is closed.
+ *
+ * The record of the data files to copy lives in NVS until every file has
+ * been copied, so a copy interrupted by a reset starts again on the next
+ * boot.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_bundle.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Magic and version of the bundle header.
+ */
+#define BUNDLE_MAGIC                   "GRIBUNDL"
+#define BUNDLE_MAGIC_LENGTH            ( sizeof( BUNDLE_MAGIC ) - 1U )
+#define BUNDLE_VERSION                 ( 1U )
+
+/**
+ * @brief Layout of the header and of its entries.
+ */
+#define BUNDLE_ENTRIES_OFFSET          ( 16U )
+#define BUNDLE_ENTRY_SIZE              ( 32U )
+#define BUNDLE_LABEL_LENGTH            ( 16U )
+
+/**
+ * @brief Entry types.
+ */
+#define BUNDLE_ENTRY_TYPE_IMAGE        ( 0U )
+#define BUNDLE_ENTRY_TYPE_DATA         ( 1U )
+
+/**
+ * @brief Size of a flash sector, the unit data file targets are erased in.
+ */
+#define BUNDLE_SECTOR_SIZE             ( 4096U )
+
+/**
+ * @brief Size of the reads copying a data file to its partition.
+ */
+#define BUNDLE_COPY_SIZE               ( 256U )
+
+/**
+ * @brief NVS namespace and key holding the data files to copy.
+ */
+#define BUNDLE_NVS_NAMESPACE           "ota_bundle"
+#define BUNDLE_NVS_KEY_PENDING         "pending"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief An entry of the bundle header.
+ */
+typedef struct BundleEntry
+{
+    uint32_t ulType;
+    uint32_t ulLength;
+    uint32_t ulTargetOffset;
+    char cLabel[ BUNDLE_LABEL_LENGTH + 1U ];
+} BundleEntry_t;
+
+/**
+ * @brief Data files waiting for the image they came with to run.
+ */
+typedef struct BundlePending
+{
+    uint32_t ulSlotAddress;  /**< Address of the slot the bundle was written to. */
+    uint32_t ulHeaderOffset; /**< Offset of the header in the slot. */
+} BundlePending_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_bundle";
+
+/**
+ * @brief Header of the bundle being received, or of the pending data files
+ * being copied.
+ */
+static uint8_t ucHeader[ OTA_BUNDLE_HEADER_SIZE ];
+
+/**
+ * @brief Size of the bundle file being received, and header bytes received.
+ */
+static uint32_t ulBundleFileSize = 0U;
+static uint32_t ulHeaderBytes = 0U;
+
+/**
+ * @brief Set once the header of the bundle being received was checked.
+ */
+static bool xHeaderValid = false;
+
+/**
+ * @brief Total length of the payloads of the bundle.
+ */
+static uint32_t ulPayloadSize = 0U;
+
+/**
+ * @brief Set once the bundle was finished, until the next file is created.
+ */
+static bool xBundleFinished = false;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Read a little endian 32-bit value.
+ */
+static uint32_t prvReadUint32( const uint8_t * pucData );
+
+/**
+ * @brief Decode entry ulIndex of ucHeader.
+ */
+static void prvGetEntry( uint32_t ulIndex,
+                         BundleEntry_t * pxEntry );
+
+/**
+ * @brief Find the partition a data file is copied to.
+ *
+ * @return The partition, NULL if it does not exist or may not be written.
+ */
+static const esp_partition_t * prvFindTarget( const BundleEntry_t * pxEntry );
+
+/**
+ * @brief Check ucHeader and the targets of its data files.
+ *
+ * @param[out] pulPayloadSize Total length of the payloads.
+ *
+ * @return pdPASS if the header is valid, pdFAIL otherwise.
+ */
+static BaseType_t prvCheckHeader( uint32_t * pulPayloadSize );
+
+/**
+ * @brief Open the NVS namespace holding the pending data files.
+ */
+static bool prvOpenStore( nvs_handle_t * pxHandle );
+
+/**
+ * @brief Copy the data files of ucHeader from the running slot to their
+ * partitions.
+ */
+static BaseType_t prvCopyDataFiles( const esp_partition_t * pxSlot );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvReadUint32( const uint8_t * pucData )
+{
+    return ( ( uint32_t ) pucData[ 0 ] ) |
+           ( ( uint32_t ) pucData[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucData[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucData[ 3 ] << 24 );
+}
+
+static void prvGetEntry( uint32_t ulIndex,
+                         BundleEntry_t * pxEntry )
+{
+    const uint8_t * pucEntry = &ucHeader[ BUNDLE_ENTRIES_OFFSET + ( ulIndex * BUNDLE_ENTRY_SIZE ) ];
+
+    pxEntry->ulType = prvReadUint32( &pucEntry[ 0 ] );
+    pxEntry->ulLength = prvReadUint32( &pucEntry[ 4 ] );
+    pxEntry->ulTargetOffset = prvReadUint32( &pucEntry[ 8 ] );
+    memcpy( pxEntry->cLabel, &pucEntry[ 12 ], BUNDLE_LABEL_LENGTH );
+    pxEntry->cLabel[ BUNDLE_LABEL_LENGTH ] = '\0';
+}
+
+static const esp_partition_t * prvFindTarget( const BundleEntry_t * pxEntry )
+{
+    const esp_partition_t * pxTarget;
+
+    pxTarget = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, pxEntry->cLabel );
+
+    /* The OTA state, the NVS keys and the NVS partition holding the bundle
+     * record are never replaced by a bundle. */
+    if( ( pxTarget != NULL ) &&
+        ( ( pxTarget->subtype == ESP_PARTITION_SUBTYPE_DATA_OTA ) ||
+          ( pxTarget->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS ) ||
+          ( strcmp( pxTarget->label, NVS_DEFAULT_PART_NAME ) == 0 ) ) )
+    {
+        pxTarget = NULL;
+    }
+
+    return pxTarget;
+}
+
+static BaseType_t prvCheckHeader( uint32_t * pulPayloadSize )
+{
+    BaseType_t xRet = pdPASS;
+    BundleEntry_t xEntry;
+    const esp_partition_t * pxTarget;
+    uint32_t ulCount = prvReadUint32( &ucHeader[ 12 ] );
+    uint32_t ulIndex;
+    uint32_t ulTotal = 0U;
+
+    if( ( memcmp( ucHeader, BUNDLE_MAGIC, BUNDLE_MAGIC_LENGTH ) != 0 ) ||
+        ( prvReadUint32( &ucHeader[ 8 ] ) != BUNDLE_VERSION ) ||
+        ( ulCount == 0U ) ||
+        ( ulCount > OTA_BUNDLE_MAX_FILES ) )
+    {
+        ESP_LOGE( TAG, "Bundle header is not valid." );
+        xRet = pdFAIL;
+    }
+
+    for( ulIndex = 0U; ( xRet == pdPASS ) && ( ulIndex < ulCount ); ulIndex++ )
+    {
+        prvGetEntry( ulIndex, &xEntry );
+
+        if( ( xEntry.ulType != ( ( ulIndex == 0U ) ? BUNDLE_ENTRY_TYPE_IMAGE : BUNDLE_ENTRY_TYPE_DATA ) ) ||
+            ( xEntry.ulLength == 0U ) ||
+            ( xEntry.ulLength > ( UINT32_MAX - ulTotal ) ) )
+        {
+            ESP_LOGE( TAG, "Bundle entry %" PRIu32 " is not valid.", ulIndex );
+            xRet = pdFAIL;
+        }
+        else if( xEntry.ulType == BUNDLE_ENTRY_TYPE_DATA )
+        {
+            pxTarget = prvFindTarget( &xEntry );
+
+            if( ( pxTarget == NULL ) ||
+                ( ( xEntry.ulTargetOffset % BUNDLE_SECTOR_SIZE ) != 0U ) ||
+                ( xEntry.ulTargetOffset > pxTarget->size ) ||
+                ( xEntry.ulLength > ( pxTarget->size - xEntry.ulTargetOffset ) ) )
+            {
+                ESP_LOGE( TAG,
+                          "Bundle entry %" PRIu32 " does not fit partition \"%s\".",
+                          ulIndex,
+                          xEntry.cLabel );
+                xRet = pdFAIL;
+            }
+        }
+        else
+        {
+            /* The image is checked by the flash writer at close. */
+        }
+
+        ulTotal += xEntry.ulLength;
+    }
+
+    *pulPayloadSize = ulTotal;
+
+    return xRet;
+}
+
+static bool prvOpenStore( nvs_handle_t * pxHandle )
+{
+    esp_err_t xEspErrRet;
+
+    xEspErrRet = nvs_open( BUNDLE_NVS_NAMESPACE, NVS_READWRITE, pxHandle );
+
+    if( xEspErrRet != ESP_OK )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to open the bundle record. Error: %s",
+                  esp_err_to_name( xEspErrRet ) );
+    }
+
+    return xEspErrRet == ESP_OK;
+}
+
+static BaseType_t prvCopyDataFiles( const esp_partition_t * pxSlot )
+{
+    BaseType_t xRet = pdPASS;
+    esp_err_t xEspErrRet = ESP_OK;
+    BundleEntry_t xEntry;
+    const esp_partition_t * pxTarget;
+    uint8_t ucCopyBuffer[ BUNDLE_COPY_SIZE ];
+    uint32_t ulCount = prvReadUint32( &ucHeader[ 12 ] );
+    uint32_t ulIndex;
+    uint32_t ulSlotOffset = 0U;
+    uint32_t ulCopied;
+    uint32_t ulLength;
+
+    for( ulIndex = 0U; ( xRet == pdPASS ) && ( ulIndex < ulCount ); ulIndex++ )
+    {
+        prvGetEntry( ulIndex, &xEntry );
+
+        if( xEntry.ulType == BUNDLE_ENTRY_TYPE_DATA )
+        {
+            pxTarget = prvFindTarget( &xEntry );
+
+            /* Whole sectors are erased, so the rest of the last one is
+             * cleared. */
+            xEspErrRet = esp_partition_erase_range( pxTarget,
+                                                    xEntry.ulTargetOffset,
+                                                    ( ( xEntry.ulLength + BUNDLE_SECTOR_SIZE - 1U ) / BUNDLE_SECTOR_SIZE ) * BUNDLE_SECTOR_SIZE );
+
+            for( ulCopied = 0U; ( xEspErrRet == ESP_OK ) && ( ulCopied < xEntry.ulLength ); ulCopied += ulLength )
+            {
+                ulLength = xEntry.ulLength - ulCopied;
+                ulLength = ( ulLength < BUNDLE_COPY_SIZE ) ? ulLength : BUNDLE_COPY_SIZE;
+
+                xEspErrRet = esp_partition_read( pxSlot, ulSlotOffset + ulCopied, ucCopyBuffer, ulLength );
+
+                if( xEspErrRet == ESP_OK )
+                {
+                    xEspErrRet = esp_partition_write( pxTarget, xEntry.ulTargetOffset + ulCopied, ucCopyBuffer, ulLength );
+                }
+            }
+
+            if( xEspErrRet != ESP_OK )
+            {
+                ESP_LOGE( TAG,
+                          "Failed to copy bundle entry %" PRIu32 " to partition \"%s\". Error: %s",
+                          ulIndex,
+                          xEntry.cLabel,
+                          esp_err_to_name( xEspErrRet ) );
+                xRet = pdFAIL;
+            }
+            else
+            {
+                ESP_LOGI( TAG,
+                          "Copied %" PRIu32 " bytes to partition \"%s\" at offset %" PRIu32 ".",
+                          xEntry.ulLength,
+                          xEntry.cLabel,
+                          xEntry.ulTargetOffset );
+            }
+        }
+
+        ulSlotOffset += xEntry.ulLength;
+    }
+
+    return xRet;
+}
+
+/* Public function definitions ************************************************/
+
+bool xOtaBundleIsBundleFile( const OtaFileContext_t * pFileContext )
+{
+    return pFileContext->fileType == otademoconfigBUNDLE_FILE_TYPE;
+}
+
+void vOtaBundleStart( uint32_t ulFileSize )
+{
+    memset( ucHeader, 0x00, sizeof( ucHeader ) );
+    ulBundleFileSize = ulFileSize;
+    ulHeaderBytes = 0U;
+    xHeaderValid = false;
+    ulPayloadSize = 0U;
+    xBundleFinished = false;
+}
+
+BaseType_t xOtaBundleWrite( uint32_t ulOffset,
+                            const uint8_t * pucData,
+                            uint32_t ulLength,
+                            OtaBundleOutput_t xOutput )
+{
+    BaseType_t xRet = pdPASS;
+    uint32_t ulHeaderLength;
+
+    if( ulOffset < OTA_BUNDLE_HEADER_SIZE )
+    {
+        ulHeaderLength = OTA_BUNDLE_HEADER_SIZE - ulOffset;
+        ulHeaderLength = ( ulLength < ulHeaderLength ) ? ulLength : ulHeaderLength;
+
+        memcpy( &ucHeader[ ulOffset ], pucData, ulHeaderLength );
+        ulHeaderBytes += ulHeaderLength;
+        ulOffset += ulHeaderLength;
+        pucData += ulHeaderLength;
+        ulLength -= ulHeaderLength;
+
+        /* The OTA agent writes each block once. */
+        if( ulHeaderBytes == OTA_BUNDLE_HEADER_SIZE )
+        {
+            xRet = prvCheckHeader( &ulPayloadSize );
+
+            if( ( xRet == pdPASS ) && ( ( ulPayloadSize + OTA_BUNDLE_HEADER_SIZE ) != ulBundleFileSize ) )
+            {
+                ESP_LOGE( TAG,
+                          "Bundle payloads of %" PRIu32 " bytes do not match the file size of %" PRIu32 " bytes.",
+                          ulPayloadSize,
+                          ulBundleFileSize );
+                xRet = pdFAIL;
+            }
+
+            xHeaderValid = ( xRet == pdPASS );
+        }
+    }
+
+    if( ( xRet == pdPASS ) && ( ulLength > 0U ) )
+    {
+        xOutput( ulOffset - OTA_BUNDLE_HEADER_SIZE, pucData, ulLength );
+    }
+
+    return xRet;
+}
+
+BaseType_t xOtaBundleFinish( OtaBundleOutput_t xOutput,
+                             uint32_t * pulSlotSize )
+{
+    BaseType_t xRet = pdFAIL;
+
+    if( xHeaderValid == true )
+    {
+        xOutput( ulPayloadSize, ucHeader, OTA_BUNDLE_HEADER_SIZE );
+        *pulSlotSize = ulPayloadSize + OTA_BUNDLE_HEADER_SIZE;
+        xBundleFinished = true;
+        xRet = pdPASS;
+    }
+    else
+    {
+        ESP_LOGE( TAG, "Bundle closed without a valid header." );
+    }
+
+    return xRet;
+}
+
+BaseType_t xOtaBundleCommit( void )
+{
+    BaseType_t xRet = pdPASS;
+    esp_err_t xEspErrRet;
+    nvs_handle_t xHandle;
+    BundlePending_t xPending = { 0 };
+    const esp_partition_t * pxSlot = esp_ota_get_next_update_partition( NULL );
+
+    if( xBundleFinished == true )
+    {
+        xRet = pdFAIL;
+
+        if( ( pxSlot != NULL ) && ( prvOpenStore( &xHandle ) == true ) )
+        {
+            xPending.ulSlotAddress = pxSlot->address;
+            xPending.ulHeaderOffset = ulPayloadSize;
+
+            xEspErrRet = nvs_set_blob( xHandle, BUNDLE_NVS_KEY_PENDING, &xPending, sizeof( xPending ) );
+
+            if( xEspErrRet == ESP_OK )
+            {
+                xEspErrRet = nvs_commit( xHandle );
+            }
+
+            if( xEspErrRet == ESP_OK )
+            {
+                xRet = pdPASS;
+            }
+            else
+            {
+                ESP_LOGE( TAG,
+                          "Failed to record the bundle data files. Error: %s",
+                          esp_err_to_name( xEspErrRet ) );
+            }
+
+            nvs_close( xHandle );
+        }
+    }
+
+    return xRet;
+}
+
+BaseType_t xOtaBundleApplyPending( bool xSelfTest )
+{
+    BaseType_t xRet = pdPASS;
+    esp_err_t xEspErrRet;
+    nvs_handle_t xHandle;
+    BundlePending_t xPending = { 0 };
+    size_t xLength = sizeof( xPending );
+    const esp_partition_t * pxRunning = esp_ota_get_running_partition();
+    esp_ota_img_states_t xState = ESP_OTA_IMG_UNDEFINED;
+    uint32_t ulHeaderPayloadSize = 0U;
+    bool xDone = true;
+
+    if( prvOpenStore( &xHandle ) == false )
+    {
+        xRet = pdFAIL;
+    }
+    else
+    {
+        if( nvs_get_blob( xHandle, BUNDLE_NVS_KEY_PENDING, &xPending, &xLength ) != ESP_OK )
+        {
+            /* Nothing pending. */
+            xDone = false;
+        }
+        else if( ( pxRunning == NULL ) || ( pxRunning->address != xPending.ulSlotAddress ) )
+        {
+            /* The image of the bundle was rejected or never booted. */
+            ESP_LOGW( TAG, "Discarding the data files of an image that is not running." );
+        }
+        else if( ( xSelfTest == false ) &&
+                 ( esp_ota_get_state_partition( pxRunning, &xState ) == ESP_OK ) &&
+                 ( xState == ESP_OTA_IMG_PENDING_VERIFY ) )
+        {
+            /* Left to the self test. */
+            xDone = false;
+        }
+        else if( ( esp_partition_read( pxRunning, xPending.ulHeaderOffset, ucHeader, sizeof( ucHeader ) ) != ESP_OK ) ||
+                 ( prvCheckHeader( &ulHeaderPayloadSize ) != pdPASS ) ||
+                 ( ulHeaderPayloadSize != xPending.ulHeaderOffset ) )
+        {
+            /* The header is covered by the signature, so this is not
+             * expected. Retrying would not help. */
+            ESP_LOGE( TAG, "Bundle header in the running slot is not valid." );
+            xRet = pdFAIL;
+        }
+        else
+        {
+            xRet = prvCopyDataFiles( pxRunning );
+
+            /* Copied again on the next call. */
+            xDone = ( xRet == pdPASS );
+        }
+
+        if( xDone == true )
+        {
+            xEspErrRet = nvs_erase_key( xHandle, BUNDLE_NVS_KEY_PENDING );
+
+            if( xEspErrRet == ESP_OK )
+            {
+                xEspErrRet = nvs_commit( xHandle );
+            }
+
+            if( xEspErrRet != ESP_OK )
+            {
+                ESP_LOGW( TAG,
+                          "Failed to clear the bundle record. Error: %s",
+                          esp_err_to_name( xEspErrRet ) );
+            }
+        }
+
+        nvs_close( xHandle );
+    }
+
+    return xRet;
+}
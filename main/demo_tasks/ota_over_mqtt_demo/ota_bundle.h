@@ -0,0 +1,168 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_bundle.h
+ * @brief Firmware and data files updated together by one OTA job.
+ *
+ * A bundle file, produced by tools/ota_bundle/ota_bundle.py, carries the new
+ * image followed by data files for other partitions, so the whole set is
+ * streamed back to back in one job. The payloads are written contiguously to
+ * the inactive slot, the image first, followed by the bundle header:
+ *
+ *     slot: image | data 1 | ... | data n | header
+ *
+ * The code signing signature of a bundle job must be computed over this slot
+ * layout, so the data files and the header are covered along with the image.
+ * The data files are only copied to their partitions once the new image runs,
+ * so the device runs either the old image with the old data or the new image
+ * with the new data.
+ *
+ * Header format, little endian, OTA_BUNDLE_HEADER_SIZE bytes:
+ *
+ * | Field            | Size | Description                                  |
+ * |------------------|------|----------------------------------------------|
+ * | magic            | 8    | "GRIBUNDL"                                   |
+ * | version          | 4    | 1                                            |
+ * | count            | 4    | Number of entries, 1 to OTA_BUNDLE_MAX_FILES |
+ * | entries          | 32 * | One per payload, in payload order            |
+ * | padding          |      | Zeros up to OTA_BUNDLE_HEADER_SIZE           |
+ *
+ * Entry format:
+ *
+ * | Field            | Size | Description                                  |
+ * |------------------|------|----------------------------------------------|
+ * | type             | 4    | 0 image, 1 data. Only the first is the image |
+ * | length           | 4    | Length of the payload                        |
+ * | target offset    | 4    | Sector aligned offset in the target          |
+ * | target partition | 16   | Label of a data partition, NUL padded        |
+ * | reserved         | 4    | 0                                            |
+ */
+#ifndef OTA_BUNDLE_H
+#define OTA_BUNDLE_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library interface include. */
+#include "ota_platform_interface.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Size of the bundle header at the start of the file.
+ */
+#define OTA_BUNDLE_HEADER_SIZE    ( 256U )
+
+/**
+ * @brief Maximum number of payloads of a bundle, the image included.
+ */
+#define OTA_BUNDLE_MAX_FILES      ( 7U )
+
+/**
+ * @brief Receives the slot layout of the bundle, in any order.
+ */
+typedef void ( * OtaBundleOutput_t )( uint32_t ulOffset,
+                                      const uint8_t * pucData,
+                                      uint32_t ulLength );
+
+/**
+ * @brief Check whether the job declared a file as a bundle, with the file
+ * type otademoconfigBUNDLE_FILE_TYPE.
+ */
+bool xOtaBundleIsBundleFile( const OtaFileContext_t * pFileContext );
+
+/**
+ * @brief Forget the previous file, and prepare to receive a bundle. Called
+ * for every file, so a bundle closed earlier is never committed with another
+ * image.
+ *
+ * @param[in] ulFileSize Size of the file.
+ */
+void vOtaBundleStart( uint32_t ulFileSize );
+
+/**
+ * @brief Write a block of the bundle. Payload bytes are passed to xOutput at
+ * their slot offset, header bytes are kept until vOtaBundleFinish.
+ *
+ * @return pdPASS if the block was accepted. pdFAIL if the header is malformed,
+ * does not match the file size, or names a target that does not exist.
+ */
+BaseType_t xOtaBundleWrite( uint32_t ulOffset,
+                            const uint8_t * pucData,
+                            uint32_t ulLength,
+                            OtaBundleOutput_t xOutput );
+
+/**
+ * @brief Write the header after the payloads.
+ *
+ * @param[in] xOutput Receives the header.
+ * @param[out] pulSlotSize Length of the slot layout.
+ *
+ * @return pdPASS if the whole header was received, pdFAIL otherwise.
+ */
+BaseType_t xOtaBundleFinish( OtaBundleOutput_t xOutput,
+                             uint32_t * pulSlotSize );
+
+/**
+ * @brief Record that the data files of the bundle last closed must be copied
+ * once the new image runs. Call before activating the new image.
+ *
+ * @return pdPASS if nothing is to be recorded or the record was stored,
+ * pdFAIL otherwise.
+ */
+BaseType_t xOtaBundleCommit( void );
+
+/**
+ * @brief Copy the data files recorded by xOtaBundleCommit to their
+ * partitions if the image they came with is running, or forget them if
+ * another image is running.
+ *
+ * An image waiting for its self test only gets its data files from the self
+ * test, so a rejected image leaves the data files of the previous one.
+ *
+ * @param[in] xSelfTest true when called from the self test of the new image.
+ *
+ * @return pdPASS if nothing was pending or every file was copied, pdFAIL if a
+ * copy failed, in which case it is tried again on the next call.
+ */
+BaseType_t xOtaBundleApplyPending( bool xSelfTest );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_BUNDLE_H */
@@ -0,0 +1,181 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_cbor.c
+ * @brief Minimal CBOR decoding and encoding of the OTA stream messages.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Public functions include. */
+#include "ota_cbor.h"
+
+/* Public function definitions ************************************************/
+
+bool xOtaCborRead( const uint8_t * pucBuffer,
+                   uint32_t ulLength,
+                   uint32_t * pulPosition,
+                   OtaCborItem_t * pxItem )
+{
+    bool xRet = false;
+    uint32_t ulPosition = *pulPosition;
+    uint32_t ulSize = 0U;
+    uint8_t ucInfo;
+
+    if( ulPosition < ulLength )
+    {
+        pxItem->ucMajor = pucBuffer[ ulPosition ] >> 5;
+        ucInfo = pucBuffer[ ulPosition ] & 0x1FU;
+        ulPosition++;
+        xRet = true;
+
+        if( ucInfo < 24U )
+        {
+            pxItem->ulValue = ucInfo;
+        }
+        else if( ucInfo <= 26U )
+        {
+            /* Arguments of 1, 2 or 4 bytes follow the initial byte. */
+            ulSize = 1U << ( ucInfo - 24U );
+            pxItem->ulValue = 0U;
+
+            if( ( ulLength - ulPosition ) < ulSize )
+            {
+                xRet = false;
+            }
+
+            while( ( xRet == true ) && ( ulSize > 0U ) )
+            {
+                pxItem->ulValue = ( pxItem->ulValue << 8 ) | pucBuffer[ ulPosition ];
+                ulPosition++;
+                ulSize--;
+            }
+        }
+        else
+        {
+            xRet = false;
+        }
+    }
+
+    if( ( xRet == true ) && ( ( pxItem->ucMajor == OTA_CBOR_MAJOR_BYTES ) || ( pxItem->ucMajor == OTA_CBOR_MAJOR_TEXT ) ) )
+    {
+        if( ( ulLength - ulPosition ) < pxItem->ulValue )
+        {
+            xRet = false;
+        }
+        else
+        {
+            pxItem->pucData = &pucBuffer[ ulPosition ];
+            ulPosition += pxItem->ulValue;
+        }
+    }
+    else if( ( xRet == true ) && ( pxItem->ucMajor != OTA_CBOR_MAJOR_UINT ) && ( pxItem->ucMajor != OTA_CBOR_MAJOR_MAP ) )
+    {
+        xRet = false;
+    }
+    else
+    {
+        /* Integers and map heads have no content. */
+    }
+
+    *pulPosition = ulPosition;
+
+    return xRet;
+}
+
+uint32_t ulOtaCborHeadSize( uint32_t ulValue )
+{
+    uint32_t ulSize;
+
+    if( ulValue <= OTA_CBOR_MAX_INLINE_UINT )
+    {
+        ulSize = 1U;
+    }
+    else if( ulValue <= UINT8_MAX )
+    {
+        ulSize = 2U;
+    }
+    else if( ulValue <= UINT16_MAX )
+    {
+        ulSize = 3U;
+    }
+    else
+    {
+        ulSize = 5U;
+    }
+
+    return ulSize;
+}
+
+void vOtaCborWriteHead( uint8_t * pucBuffer,
+                        uint32_t * pulPosition,
+                        uint8_t ucMajor,
+                        uint32_t ulValue )
+{
+    uint32_t ulPosition = *pulPosition;
+    uint32_t ulSize = ulOtaCborHeadSize( ulValue ) - 1U;
+
+    if( ulSize == 0U )
+    {
+        pucBuffer[ ulPosition++ ] = ( uint8_t ) ( ( ucMajor << 5 ) | ulValue );
+    }
+    else
+    {
+        /* 1, 2 and 4 byte arguments are announced by 24, 25 and 26. */
+        pucBuffer[ ulPosition++ ] = ( uint8_t ) ( ( ucMajor << 5 ) | ( ( ulSize == 1U ) ? 24U : ( ( ulSize == 2U ) ? 25U : 26U ) ) );
+    }
+
+    while( ulSize > 0U )
+    {
+        ulSize--;
+        pucBuffer[ ulPosition++ ] = ( uint8_t ) ( ulValue >> ( 8U * ulSize ) );
+    }
+
+    *pulPosition = ulPosition;
+}
+
+void vOtaCborWriteUint( uint8_t * pucBuffer,
+                        uint32_t * pulPosition,
+                        char cKey,
+                        uint32_t ulValue )
+{
+    vOtaCborWriteHead( pucBuffer, pulPosition, OTA_CBOR_MAJOR_TEXT, 1U );
+    pucBuffer[ ( *pulPosition )++ ] = ( uint8_t ) cKey;
+    vOtaCborWriteHead( pucBuffer, pulPosition, OTA_CBOR_MAJOR_UINT, ulValue );
+}
+
+bool xOtaCborIsKey( const OtaCborItem_t * pxItem,
+                    char cKey )
+{
+    return ( pxItem->ucMajor == OTA_CBOR_MAJOR_TEXT ) &&
+           ( pxItem->ulValue == 1U ) &&
+           ( pxItem->pucData[ 0 ] == ( uint8_t ) cKey );
+}
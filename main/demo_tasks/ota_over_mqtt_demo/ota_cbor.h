@@ -0,0 +1,129 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_cbor.h
+ * @brief Minimal CBOR decoding and encoding of the OTA stream messages.
+ *
+ * Only the items found in stream requests and data messages are supported:
+ * unsigned integers, byte and text strings and map heads, with arguments of
+ * at most 4 bytes.
+ */
+#ifndef OTA_CBOR_H
+#define OTA_CBOR_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief CBOR major types used by stream messages.
+ */
+#define OTA_CBOR_MAJOR_UINT          ( 0U )
+#define OTA_CBOR_MAJOR_BYTES         ( 2U )
+#define OTA_CBOR_MAJOR_TEXT          ( 3U )
+#define OTA_CBOR_MAJOR_MAP           ( 5U )
+
+/**
+ * @brief CBOR encoding of a text string of one character, the keys of stream
+ * messages.
+ */
+#define OTA_CBOR_KEY_HEADER          ( 0x61U )
+
+/**
+ * @brief Largest unsigned integer CBOR encodes in its initial byte.
+ */
+#define OTA_CBOR_MAX_INLINE_UINT     ( 23U )
+
+/**
+ * @brief A decoded CBOR data item. For strings, the value is the length.
+ */
+typedef struct OtaCborItem
+{
+    uint8_t ucMajor;
+    uint32_t ulValue;
+    const uint8_t * pucData;
+} OtaCborItem_t;
+
+/**
+ * @brief Decode the data item at *pulPosition, and move past it.
+ *
+ * @param[in] pucBuffer The encoded message.
+ * @param[in] ulLength Length of the message.
+ * @param[in,out] pulPosition Offset of the item, then of the next one.
+ * @param[out] pxItem The decoded item. String contents are not copied.
+ *
+ * @return true if the item is an unsigned integer, a string or a map head
+ * within the buffer.
+ */
+bool xOtaCborRead( const uint8_t * pucBuffer,
+                   uint32_t ulLength,
+                   uint32_t * pulPosition,
+                   OtaCborItem_t * pxItem );
+
+/**
+ * @brief Size of the head of a data item with the given argument.
+ */
+uint32_t ulOtaCborHeadSize( uint32_t ulValue );
+
+/**
+ * @brief Encode the head of a data item at *pulPosition, and move past it.
+ *
+ * The buffer must have room for ulOtaCborHeadSize( ulValue ) bytes.
+ */
+void vOtaCborWriteHead( uint8_t * pucBuffer,
+                        uint32_t * pulPosition,
+                        uint8_t ucMajor,
+                        uint32_t ulValue );
+
+/**
+ * @brief Encode a one character text key and an unsigned integer value at
+ * *pulPosition, and move past them.
+ */
+void vOtaCborWriteUint( uint8_t * pucBuffer,
+                        uint32_t * pulPosition,
+                        char cKey,
+                        uint32_t ulValue );
+
+/**
+ * @brief Whether a decoded item is the one character text key cKey.
+ */
+bool xOtaCborIsKey( const OtaCborItem_t * pxItem,
+                    char cKey );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_CBOR_H */
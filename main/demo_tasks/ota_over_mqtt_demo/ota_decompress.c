@@ -0,0 +1,331 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_decompress.c
+ * @brief Streaming decompression of compressed OTA images.
+ *
+ * Decompressed bytes go to the window, which doubles as the output buffer:
+ * the produced part of the window is handed on whenever the window wraps,
+ * before it is overwritten, and when the image is complete.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_decompress.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Header layout.
+ */
+#define LZ_MAGIC                 "GRILZSS1"
+#define LZ_MAGIC_LENGTH          ( 8U )
+#define LZ_HEADER_LENGTH         ( LZ_MAGIC_LENGTH + 4U )
+
+/**
+ * @brief Window size, and the shortest match a reference encodes.
+ */
+#define LZ_WINDOW_SIZE           ( 4096U )
+#define LZ_MIN_MATCH             ( 3U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief States of the decompressor.
+ */
+typedef enum LzState
+{
+    LZ_STATE_HEADER,    /**< Collecting the header. */
+    LZ_STATE_FLAGS,     /**< Expecting a flag byte. */
+    LZ_STATE_ITEM,      /**< Expecting a literal or the first reference byte. */
+    LZ_STATE_REFERENCE, /**< Expecting the second reference byte. */
+    LZ_STATE_DONE,      /**< Image complete. */
+    LZ_STATE_FAILED     /**< File rejected. */
+} LzState_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_decompress";
+
+/**
+ * @brief Decompressor state.
+ */
+static LzState_t xLzState = LZ_STATE_HEADER;
+static uint8_t ucHeader[ LZ_HEADER_LENGTH ];
+static uint32_t ulHeaderLength = 0U;
+static uint8_t ucFlags = 0U;
+static uint32_t ulFlagsLeft = 0U;
+static uint8_t ucReferenceLow = 0U;
+
+/**
+ * @brief Image size, bytes produced, and bytes of the window not yet handed
+ * on.
+ */
+static uint32_t ulImageSize = 0U;
+static uint32_t ulProduced = 0U;
+static uint32_t ulPendingStart = 0U;
+
+/**
+ * @brief The last LZ_WINDOW_SIZE bytes of the image.
+ */
+static uint8_t ucWindow[ LZ_WINDOW_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Reject the file.
+ */
+static void prvFail( const char * pcReason );
+
+/**
+ * @brief Hand the produced part of the window to the output.
+ */
+static void prvFlush( OtaDecompressOutput_t xOutput );
+
+/**
+ * @brief Append one byte to the image.
+ */
+static void prvPutByte( uint8_t ucByte,
+                        OtaDecompressOutput_t xOutput );
+
+/**
+ * @brief Move to the next flag bit once an item is complete.
+ */
+static void prvNextItem( void );
+
+/**
+ * @brief Copy an earlier part of the image to its end.
+ */
+static void prvCopyReference( uint32_t ulDistance,
+                              uint32_t ulLength,
+                              OtaDecompressOutput_t xOutput );
+
+/* Static function definitions ************************************************/
+
+static void prvFail( const char * pcReason )
+{
+    ESP_LOGE( TAG, "Rejecting compressed image at image offset %" PRIu32 ": %s.", ulProduced, pcReason );
+    xLzState = LZ_STATE_FAILED;
+}
+
+static void prvFlush( OtaDecompressOutput_t xOutput )
+{
+    if( ulProduced > ulPendingStart )
+    {
+        xOutput( ulPendingStart,
+                 &ucWindow[ ulPendingStart % LZ_WINDOW_SIZE ],
+                 ulProduced - ulPendingStart );
+        ulPendingStart = ulProduced;
+    }
+}
+
+static void prvPutByte( uint8_t ucByte,
+                        OtaDecompressOutput_t xOutput )
+{
+    ucWindow[ ulProduced % LZ_WINDOW_SIZE ] = ucByte;
+    ulProduced++;
+
+    if( ulProduced == ulImageSize )
+    {
+        prvFlush( xOutput );
+        xLzState = LZ_STATE_DONE;
+    }
+    else if( ( ulProduced % LZ_WINDOW_SIZE ) == 0U )
+    {
+        prvFlush( xOutput );
+    }
+    else
+    {
+        /* Keep filling the window. */
+    }
+}
+
+static void prvNextItem( void )
+{
+    ucFlags >>= 1;
+    ulFlagsLeft--;
+
+    if( ( xLzState == LZ_STATE_ITEM ) && ( ulFlagsLeft == 0U ) )
+    {
+        xLzState = LZ_STATE_FLAGS;
+    }
+}
+
+static void prvCopyReference( uint32_t ulDistance,
+                              uint32_t ulLength,
+                              OtaDecompressOutput_t xOutput )
+{
+    if( ulDistance > ulProduced )
+    {
+        prvFail( "reference before the start of the image" );
+    }
+    else if( ulLength > ( ulImageSize - ulProduced ) )
+    {
+        prvFail( "image exceeds its declared size" );
+    }
+    else
+    {
+        /* Byte by byte, as a reference may overlap the bytes it produces. */
+        while( ulLength > 0U )
+        {
+            prvPutByte( ucWindow[ ( ulProduced - ulDistance ) % LZ_WINDOW_SIZE ], xOutput );
+            ulLength--;
+        }
+    }
+}
+
+/* Public function definitions ************************************************/
+
+bool xOtaDecompressIsCompressedFile( const OtaFileContext_t * pFileContext )
+{
+    return pFileContext->fileType == otademoconfigCOMPRESSED_FILE_TYPE;
+}
+
+void vOtaDecompressStart( void )
+{
+    xLzState = LZ_STATE_HEADER;
+    ulHeaderLength = 0U;
+    ulFlagsLeft = 0U;
+    ulImageSize = 0U;
+    ulProduced = 0U;
+    ulPendingStart = 0U;
+}
+
+BaseType_t xOtaDecompressApply( const uint8_t * pucData,
+                                uint32_t ulLength,
+                                OtaDecompressOutput_t xOutput )
+{
+    uint8_t ucByte;
+
+    while( ( ulLength > 0U ) && ( xLzState != LZ_STATE_FAILED ) && ( xLzState != LZ_STATE_DONE ) )
+    {
+        ucByte = *pucData;
+
+        switch( xLzState )
+        {
+            case LZ_STATE_HEADER:
+                ucHeader[ ulHeaderLength ] = ucByte;
+                ulHeaderLength++;
+
+                if( ulHeaderLength == LZ_HEADER_LENGTH )
+                {
+                    ulImageSize = ( uint32_t ) ucHeader[ LZ_MAGIC_LENGTH ] |
+                                  ( ( uint32_t ) ucHeader[ LZ_MAGIC_LENGTH + 1U ] << 8 ) |
+                                  ( ( uint32_t ) ucHeader[ LZ_MAGIC_LENGTH + 2U ] << 16 ) |
+                                  ( ( uint32_t ) ucHeader[ LZ_MAGIC_LENGTH + 3U ] << 24 );
+
+                    if( memcmp( ucHeader, LZ_MAGIC, LZ_MAGIC_LENGTH ) != 0 )
+                    {
+                        prvFail( "not a compressed image" );
+                    }
+                    else
+                    {
+                        ESP_LOGI( TAG, "Decompressing a %" PRIu32 " byte image.", ulImageSize );
+                        xLzState = ( ulImageSize > 0U ) ? LZ_STATE_FLAGS : LZ_STATE_DONE;
+                    }
+                }
+
+                break;
+
+            case LZ_STATE_FLAGS:
+                ucFlags = ucByte;
+                ulFlagsLeft = 8U;
+                xLzState = LZ_STATE_ITEM;
+                break;
+
+            case LZ_STATE_ITEM:
+
+                if( ( ucFlags & 0x01U ) != 0U )
+                {
+                    prvPutByte( ucByte, xOutput );
+                    prvNextItem();
+                }
+                else
+                {
+                    ucReferenceLow = ucByte;
+                    xLzState = LZ_STATE_REFERENCE;
+                }
+
+                break;
+
+            default:
+                xLzState = LZ_STATE_ITEM;
+                prvCopyReference( ( ( uint32_t ) ucReferenceLow | ( ( uint32_t ) ( ucByte & 0xF0U ) << 4 ) ) + 1U,
+                                  ( uint32_t ) ( ucByte & 0x0FU ) + LZ_MIN_MATCH,
+                                  xOutput );
+                prvNextItem();
+                break;
+        }
+
+        pucData++;
+        ulLength--;
+    }
+
+    return ( xLzState == LZ_STATE_FAILED ) ? pdFAIL : pdPASS;
+}
+
+BaseType_t xOtaDecompressFinish( uint32_t * pulImageSize )
+{
+    BaseType_t xRet = pdFAIL;
+
+    configASSERT( pulImageSize != NULL );
+
+    if( xLzState != LZ_STATE_DONE )
+    {
+        prvFail( "image is incomplete" );
+    }
+    else
+    {
+        *pulImageSize = ulImageSize;
+        xRet = pdPASS;
+    }
+
+    return xRet;
+}
@@ -0,0 +1,102 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_decompress.h
+ * @brief Streaming decompression of compressed OTA images.
+ *
+ * A compressed image is produced by tools/ota_compress/ota_compress.py with
+ * LZSS over a 4 KB window, so decompression needs 4 KB of RAM for the window.
+ *
+ * Format: the magic "GRILZSS1" and the image size (4 bytes, little endian),
+ * followed by groups of up to eight items. Each group starts with a flag byte
+ * whose bits, least significant first, mark a literal byte (1) or a two byte
+ * reference (0). A reference holds a 12 bit distance minus one and a 4 bit
+ * length minus three: distance low byte, then distance high nibble and length
+ * nibble. Decompression ends when the image size has been produced.
+ */
+#ifndef OTA_DECOMPRESS_H
+#define OTA_DECOMPRESS_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library interface include. */
+#include "ota_platform_interface.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Receives the decompressed image, in order.
+ */
+typedef void ( * OtaDecompressOutput_t )( uint32_t ulOffset,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength );
+
+/**
+ * @brief Check whether the job declared a file as a compressed image, with
+ * the file type otademoconfigCOMPRESSED_FILE_TYPE.
+ */
+bool xOtaDecompressIsCompressedFile( const OtaFileContext_t * pFileContext );
+
+/**
+ * @brief Prepare to decompress a new image.
+ */
+void vOtaDecompressStart( void );
+
+/**
+ * @brief Decompress the next bytes of the file, in order.
+ *
+ * @return pdPASS if the bytes were accepted, pdFAIL if the file is malformed.
+ */
+BaseType_t xOtaDecompressApply( const uint8_t * pucData,
+                                uint32_t ulLength,
+                                OtaDecompressOutput_t xOutput );
+
+/**
+ * @brief Check that the whole image was produced.
+ *
+ * @param[out] pulImageSize Length of the decompressed image.
+ *
+ * @return pdPASS if the image is complete, pdFAIL otherwise.
+ */
+BaseType_t xOtaDecompressFinish( uint32_t * pulImageSize );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_DECOMPRESS_H */
@@ -0,0 +1,454 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_delta.c
+ * @brief Streaming application of delta OTA updates.
+ *
+ * The patch is parsed with a byte-wise state machine, so headers and
+ * operations may span block boundaries. The new image is hashed as it is
+ * produced, and the running image is hashed once the header is known, before
+ * anything is written.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_delta.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Patch header layout.
+ */
+#define DELTA_MAGIC                  "GRIDELTA"
+#define DELTA_MAGIC_LENGTH           ( 8U )
+#define DELTA_VERSION                ( 1U )
+#define DELTA_HASH_LENGTH            ( 32U )
+#define DELTA_HEADER_LENGTH          ( DELTA_MAGIC_LENGTH + 12U + ( 2U * DELTA_HASH_LENGTH ) )
+
+/**
+ * @brief Opcodes and the length of their arguments.
+ */
+#define DELTA_OP_END                 ( 0x00U )
+#define DELTA_OP_COPY                ( 0x01U )
+#define DELTA_OP_INSERT              ( 0x02U )
+#define DELTA_COPY_ARGS_LENGTH       ( 8U )
+#define DELTA_INSERT_ARGS_LENGTH     ( 4U )
+
+/**
+ * @brief Size of the reads from the running image.
+ */
+#define DELTA_READ_SIZE              ( 1024U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief States of the patch parser.
+ */
+typedef enum DeltaState
+{
+    DELTA_STATE_HEADER,    /**< Collecting the header. */
+    DELTA_STATE_OPCODE,    /**< Expecting an opcode. */
+    DELTA_STATE_ARGUMENTS, /**< Collecting the arguments of an operation. */
+    DELTA_STATE_INSERT,    /**< Passing through the data of an INSERT. */
+    DELTA_STATE_DONE,      /**< END seen. */
+    DELTA_STATE_FAILED     /**< Patch rejected. */
+} DeltaState_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_delta";
+
+/**
+ * @brief Parser state.
+ */
+static DeltaState_t xDeltaState = DELTA_STATE_HEADER;
+static uint8_t ucOpcode = DELTA_OP_END;
+
+/**
+ * @brief Header or operation arguments being collected.
+ */
+static uint8_t ucField[ DELTA_HEADER_LENGTH ];
+static uint32_t ulFieldLength = 0U;
+static uint32_t ulFieldNeeded = DELTA_HEADER_LENGTH;
+
+/**
+ * @brief Sizes and position from the patch header.
+ */
+static uint32_t ulSourceSize = 0U;
+static uint32_t ulTargetSize = 0U;
+static uint32_t ulTargetOffset = 0U;
+static uint32_t ulInsertRemaining = 0U;
+static uint8_t ucTargetHash[ DELTA_HASH_LENGTH ];
+
+/**
+ * @brief Hash of the new image produced so far.
+ */
+static mbedtls_sha256_context xTargetHashContext;
+
+/**
+ * @brief The running image.
+ */
+static const esp_partition_t * pxSourceSlot = NULL;
+
+/**
+ * @brief Buffer for reads from the running image.
+ */
+static uint8_t ucReadBuffer[ DELTA_READ_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Decode a little endian 32 bit value.
+ */
+static uint32_t prvReadUint32( const uint8_t * pucBuffer );
+
+/**
+ * @brief Reject the patch.
+ */
+static void prvFail( const char * pcReason );
+
+/**
+ * @brief Hash and output the next range of the new image.
+ */
+static void prvEmit( const uint8_t * pucData,
+                     uint32_t ulLength,
+                     OtaDeltaOutput_t xOutput );
+
+/**
+ * @brief Validate the header and check the running image against the source
+ * hash.
+ */
+static void prvProcessHeader( void );
+
+/**
+ * @brief Execute the operation whose arguments have been collected.
+ */
+static void prvProcessArguments( OtaDeltaOutput_t xOutput );
+
+/**
+ * @brief Copy a range of the running image to the new image.
+ */
+static void prvCopy( uint32_t ulSourceOffset,
+                     uint32_t ulLength,
+                     OtaDeltaOutput_t xOutput );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvReadUint32( const uint8_t * pucBuffer )
+{
+    return ( uint32_t ) pucBuffer[ 0 ] |
+           ( ( uint32_t ) pucBuffer[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucBuffer[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucBuffer[ 3 ] << 24 );
+}
+
+static void prvFail( const char * pcReason )
+{
+    ESP_LOGE( TAG, "Rejecting delta at image offset %" PRIu32 ": %s.", ulTargetOffset, pcReason );
+    xDeltaState = DELTA_STATE_FAILED;
+}
+
+static void prvEmit( const uint8_t * pucData,
+                     uint32_t ulLength,
+                     OtaDeltaOutput_t xOutput )
+{
+    if( ulLength > ( ulTargetSize - ulTargetOffset ) )
+    {
+        prvFail( "new image exceeds its declared size" );
+    }
+    else
+    {
+        ( void ) mbedtls_sha256_update( &xTargetHashContext, pucData, ulLength );
+        xOutput( ulTargetOffset, pucData, ulLength );
+        ulTargetOffset += ulLength;
+    }
+}
+
+static void prvProcessHeader( void )
+{
+    mbedtls_sha256_context xSourceHashContext;
+    uint8_t ucSourceHash[ DELTA_HASH_LENGTH ];
+    uint32_t ulOffset = 0U;
+    uint32_t ulReadLength;
+    esp_err_t xEspErrRet = ESP_OK;
+
+    ulSourceSize = prvReadUint32( &ucField[ DELTA_MAGIC_LENGTH + 4U ] );
+    ulTargetSize = prvReadUint32( &ucField[ DELTA_MAGIC_LENGTH + 8U ] );
+    memcpy( ucTargetHash, &ucField[ DELTA_MAGIC_LENGTH + 12U + DELTA_HASH_LENGTH ], DELTA_HASH_LENGTH );
+
+    if( ( memcmp( ucField, DELTA_MAGIC, DELTA_MAGIC_LENGTH ) != 0 ) ||
+        ( prvReadUint32( &ucField[ DELTA_MAGIC_LENGTH ] ) != DELTA_VERSION ) )
+    {
+        prvFail( "not a version 1 delta" );
+    }
+    else if( ( ulSourceSize > pxSourceSlot->size ) ||
+             ( ulTargetSize > esp_ota_get_next_update_partition( NULL )->size ) )
+    {
+        prvFail( "image sizes exceed the OTA slots" );
+    }
+    else
+    {
+        mbedtls_sha256_init( &xSourceHashContext );
+        ( void ) mbedtls_sha256_starts( &xSourceHashContext, 0 );
+
+        while( ( ulOffset < ulSourceSize ) && ( xEspErrRet == ESP_OK ) )
+        {
+            ulReadLength = ( ( ulSourceSize - ulOffset ) < DELTA_READ_SIZE ) ? ( ulSourceSize - ulOffset ) : DELTA_READ_SIZE;
+            xEspErrRet = esp_partition_read( pxSourceSlot, ulOffset, ucReadBuffer, ulReadLength );
+            ( void ) mbedtls_sha256_update( &xSourceHashContext, ucReadBuffer, ulReadLength );
+            ulOffset += ulReadLength;
+        }
+
+        ( void ) mbedtls_sha256_finish( &xSourceHashContext, ucSourceHash );
+        mbedtls_sha256_free( &xSourceHashContext );
+
+        if( ( xEspErrRet != ESP_OK ) ||
+            ( memcmp( ucSourceHash, &ucField[ DELTA_MAGIC_LENGTH + 12U ], DELTA_HASH_LENGTH ) != 0 ) )
+        {
+            prvFail( "patch does not apply to the running image" );
+        }
+        else
+        {
+            ESP_LOGI( TAG,
+                      "Applying delta to %s: %" PRIu32 " byte source, %" PRIu32 " byte target.",
+                      pxSourceSlot->label,
+                      ulSourceSize,
+                      ulTargetSize );
+            xDeltaState = DELTA_STATE_OPCODE;
+        }
+    }
+}
+
+static void prvProcessArguments( OtaDeltaOutput_t xOutput )
+{
+    if( ucOpcode == DELTA_OP_COPY )
+    {
+        xDeltaState = DELTA_STATE_OPCODE;
+        prvCopy( prvReadUint32( &ucField[ 0 ] ), prvReadUint32( &ucField[ 4 ] ), xOutput );
+    }
+    else
+    {
+        ulInsertRemaining = prvReadUint32( &ucField[ 0 ] );
+        xDeltaState = ( ulInsertRemaining > 0U ) ? DELTA_STATE_INSERT : DELTA_STATE_OPCODE;
+    }
+}
+
+static void prvCopy( uint32_t ulSourceOffset,
+                     uint32_t ulLength,
+                     OtaDeltaOutput_t xOutput )
+{
+    uint32_t ulReadLength;
+    esp_err_t xEspErrRet = ESP_OK;
+
+    if( ( ulSourceOffset > ulSourceSize ) || ( ulLength > ( ulSourceSize - ulSourceOffset ) ) )
+    {
+        prvFail( "copy outside of the source image" );
+    }
+
+    while( ( ulLength > 0U ) && ( xDeltaState != DELTA_STATE_FAILED ) )
+    {
+        ulReadLength = ( ulLength < DELTA_READ_SIZE ) ? ulLength : DELTA_READ_SIZE;
+        xEspErrRet = esp_partition_read( pxSourceSlot, ulSourceOffset, ucReadBuffer, ulReadLength );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            prvFail( "failed to read the running image" );
+        }
+        else
+        {
+            prvEmit( ucReadBuffer, ulReadLength, xOutput );
+            ulSourceOffset += ulReadLength;
+            ulLength -= ulReadLength;
+        }
+    }
+}
+
+/* Public function definitions ************************************************/
+
+bool xOtaDeltaIsDeltaFile( const OtaFileContext_t * pFileContext )
+{
+    return pFileContext->fileType == otademoconfigDELTA_FILE_TYPE;
+}
+
+void vOtaDeltaStart( void )
+{
+    pxSourceSlot = esp_ota_get_running_partition();
+    xDeltaState = DELTA_STATE_HEADER;
+    ulFieldLength = 0U;
+    ulFieldNeeded = DELTA_HEADER_LENGTH;
+    ulTargetOffset = 0U;
+    ulTargetSize = 0U;
+
+    /* Release the hash of a patch that was aborted. */
+    mbedtls_sha256_free( &xTargetHashContext );
+    mbedtls_sha256_init( &xTargetHashContext );
+    ( void ) mbedtls_sha256_starts( &xTargetHashContext, 0 );
+}
+
+BaseType_t xOtaDeltaApply( const uint8_t * pucData,
+                           uint32_t ulLength,
+                           OtaDeltaOutput_t xOutput )
+{
+    uint32_t ulTake;
+
+    while( ( ulLength > 0U ) && ( xDeltaState != DELTA_STATE_FAILED ) )
+    {
+        switch( xDeltaState )
+        {
+            case DELTA_STATE_HEADER:
+            case DELTA_STATE_ARGUMENTS:
+                ulTake = ( ( ulFieldNeeded - ulFieldLength ) < ulLength ) ? ( ulFieldNeeded - ulFieldLength ) : ulLength;
+                memcpy( &ucField[ ulFieldLength ], pucData, ulTake );
+                ulFieldLength += ulTake;
+
+                if( ulFieldLength == ulFieldNeeded )
+                {
+                    if( xDeltaState == DELTA_STATE_HEADER )
+                    {
+                        prvProcessHeader();
+                    }
+                    else
+                    {
+                        prvProcessArguments( xOutput );
+                    }
+                }
+
+                break;
+
+            case DELTA_STATE_OPCODE:
+                ulTake = 1U;
+                ucOpcode = pucData[ 0 ];
+                ulFieldLength = 0U;
+
+                if( ucOpcode == DELTA_OP_END )
+                {
+                    xDeltaState = DELTA_STATE_DONE;
+                }
+                else if( ucOpcode == DELTA_OP_COPY )
+                {
+                    ulFieldNeeded = DELTA_COPY_ARGS_LENGTH;
+                    xDeltaState = DELTA_STATE_ARGUMENTS;
+                }
+                else if( ucOpcode == DELTA_OP_INSERT )
+                {
+                    ulFieldNeeded = DELTA_INSERT_ARGS_LENGTH;
+                    xDeltaState = DELTA_STATE_ARGUMENTS;
+                }
+                else
+                {
+                    prvFail( "unknown operation" );
+                }
+
+                break;
+
+            case DELTA_STATE_INSERT:
+                ulTake = ( ulInsertRemaining < ulLength ) ? ulInsertRemaining : ulLength;
+                prvEmit( pucData, ulTake, xOutput );
+                ulInsertRemaining -= ulTake;
+
+                if( ( ulInsertRemaining == 0U ) && ( xDeltaState == DELTA_STATE_INSERT ) )
+                {
+                    xDeltaState = DELTA_STATE_OPCODE;
+                }
+
+                break;
+
+            default:
+                /* Padding after END is ignored. */
+                ulTake = ulLength;
+                break;
+        }
+
+        pucData += ulTake;
+        ulLength -= ulTake;
+    }
+
+    return ( xDeltaState == DELTA_STATE_FAILED ) ? pdFAIL : pdPASS;
+}
+
+BaseType_t xOtaDeltaFinish( uint32_t * pulTargetSize )
+{
+    BaseType_t xRet = pdFAIL;
+    uint8_t ucHash[ DELTA_HASH_LENGTH ];
+
+    configASSERT( pulTargetSize != NULL );
+
+    if( xDeltaState != DELTA_STATE_DONE )
+    {
+        prvFail( "patch is incomplete" );
+    }
+    else if( ulTargetOffset != ulTargetSize )
+    {
+        prvFail( "new image is shorter than its declared size" );
+    }
+    else
+    {
+        ( void ) mbedtls_sha256_finish( &xTargetHashContext, ucHash );
+
+        if( memcmp( ucHash, ucTargetHash, DELTA_HASH_LENGTH ) != 0 )
+        {
+            prvFail( "new image does not match the target hash" );
+        }
+        else
+        {
+            ESP_LOGI( TAG, "Delta applied, new image verified." );
+            *pulTargetSize = ulTargetSize;
+            xRet = pdPASS;
+        }
+    }
+
+    mbedtls_sha256_free( &xTargetHashContext );
+
+    return xRet;
+}
@@ -0,0 +1,115 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_delta.h
+ * @brief Streaming application of delta OTA updates.
+ *
+ * A delta file is a patch against the running image, produced by
+ * tools/ota_delta/ota_delta.py. It is applied as it is received: the new
+ * image is assembled from ranges of the running image and literal data from
+ * the patch, and handed to the flash writer for the inactive slot.
+ *
+ * Patch format, little endian:
+ *
+ * | Field            | Size | Description                                  |
+ * |------------------|------|----------------------------------------------|
+ * | magic            | 8    | "GRIDELTA"                                   |
+ * | version          | 4    | 1                                            |
+ * | source size      | 4    | Length of the running image the patch needs  |
+ * | target size      | 4    | Length of the new image                      |
+ * | source SHA-256   | 32   | Hash of the first source size bytes          |
+ * | target SHA-256   | 32   | Hash of the new image                        |
+ *
+ * followed by operations, each starting with an opcode byte:
+ * - 0x01 COPY: source offset (4), length (4). Copy from the running image.
+ * - 0x02 INSERT: length (4), then length bytes of data.
+ * - 0x00 END: last operation.
+ */
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library interface include. */
+#include "ota_platform_interface.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Receives the new image, in order.
+ */
+typedef void ( * OtaDeltaOutput_t )( uint32_t ulOffset,
+                                     const uint8_t * pucData,
+                                     uint32_t ulLength );
+
+/**
+ * @brief Check whether the job declared a file as a delta file, with the file
+ * type otademoconfigDELTA_FILE_TYPE.
+ */
+bool xOtaDeltaIsDeltaFile( const OtaFileContext_t * pFileContext );
+
+/**
+ * @brief Prepare to apply a new patch to the running image.
+ */
+void vOtaDeltaStart( void );
+
+/**
+ * @brief Apply the next bytes of the patch, in order.
+ *
+ * @return pdPASS if the bytes were accepted. pdFAIL if the patch is malformed
+ * or does not apply to the running image.
+ */
+BaseType_t xOtaDeltaApply( const uint8_t * pucData,
+                           uint32_t ulLength,
+                           OtaDeltaOutput_t xOutput );
+
+/**
+ * @brief Check that the whole patch was applied and the new image matches the
+ * target hash.
+ *
+ * @param[out] pulTargetSize Length of the new image.
+ *
+ * @return pdPASS if the new image is complete and correct, pdFAIL otherwise.
+ */
+BaseType_t xOtaDeltaFinish( uint32_t * pulTargetSize );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_DELTA_H */
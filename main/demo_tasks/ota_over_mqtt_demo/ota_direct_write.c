@@ -0,0 +1,320 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_direct_write.c
+ * @brief Programming of image blocks straight from the OTA event buffers.
+ *
+ * Stream data messages are CBOR maps with the file ID "f", the block ID "i"
+ * and the payload "p", among others. The entries other than the payload are
+ * copied as they are, followed by a padding byte string "_" sized so that the
+ * payload, encoded last, starts on a word boundary. The OTA library decodes
+ * the map by key, so it reads the same block from the copy.
+ *
+ * The OTA agent processes its events in order, so among the recorded buffers
+ * holding the block it writes, the oldest is the one it decoded.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* OTA library includes. */
+#include "ota.h"
+
+/* CBOR helpers include. */
+#include "ota_cbor.h"
+
+/* Public functions include. */
+#include "ota_direct_write.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Alignment of the payload in the event buffer, as needed by the flash
+ * driver to program straight from a buffer.
+ */
+#define DIRECT_WRITE_ALIGNMENT    ( 4U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A block copied to an event buffer and not yet processed by the OTA
+ * agent. Unused while pxBuffer is NULL.
+ */
+typedef struct DirectBlock
+{
+    OtaEventData_t * pxBuffer;
+    uint32_t ulSequence;
+    uint32_t ulFileId;
+    uint32_t ulBlockId;
+    uint32_t ulPayloadOffset;
+    uint32_t ulPayloadLength;
+} DirectBlock_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Lock of every variable below.
+ */
+static portMUX_TYPE xDirectWriteLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief The recorded blocks, at most one per event buffer.
+ */
+static DirectBlock_t xBlocks[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
+
+/**
+ * @brief Sequence number of the next recorded block.
+ */
+static uint32_t ulNextSequence = 0U;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Record the block copied to an event buffer.
+ */
+static void prvRecordBlock( OtaEventData_t * pxBuffer,
+                            uint32_t ulFileId,
+                            uint32_t ulBlockId,
+                            uint32_t ulPayloadOffset,
+                            uint32_t ulPayloadLength );
+
+/* Static function definitions ************************************************/
+
+static void prvRecordBlock( OtaEventData_t * pxBuffer,
+                            uint32_t ulFileId,
+                            uint32_t ulBlockId,
+                            uint32_t ulPayloadOffset,
+                            uint32_t ulPayloadLength )
+{
+    DirectBlock_t * pxBlock = NULL;
+    uint32_t ulIndex;
+
+    taskENTER_CRITICAL( &xDirectWriteLock );
+    {
+        /* A buffer is only recorded once, the OTA agent processes its
+         * previous block before it is reused. */
+        for( ulIndex = 0U; ( ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS ) && ( pxBlock == NULL ); ulIndex++ )
+        {
+            if( ( xBlocks[ ulIndex ].pxBuffer == NULL ) || ( xBlocks[ ulIndex ].pxBuffer == pxBuffer ) )
+            {
+                pxBlock = &xBlocks[ ulIndex ];
+            }
+        }
+
+        configASSERT( pxBlock != NULL );
+
+        pxBlock->pxBuffer = pxBuffer;
+        pxBlock->ulSequence = ulNextSequence++;
+        pxBlock->ulFileId = ulFileId;
+        pxBlock->ulBlockId = ulBlockId;
+        pxBlock->ulPayloadOffset = ulPayloadOffset;
+        pxBlock->ulPayloadLength = ulPayloadLength;
+    }
+    taskEXIT_CRITICAL( &xDirectWriteLock );
+}
+
+/* Public function definitions ************************************************/
+
+void vOtaDirectWriteInit( void )
+{
+    taskENTER_CRITICAL( &xDirectWriteLock );
+    {
+        memset( xBlocks, 0x00, sizeof( xBlocks ) );
+        ulNextSequence = 0U;
+    }
+    taskEXIT_CRITICAL( &xDirectWriteLock );
+}
+
+BaseType_t xOtaDirectWriteCopyBlock( const uint8_t * pucMessage,
+                                     size_t xMessageLength,
+                                     OtaEventData_t * pxBuffer )
+{
+    BaseType_t xRet = pdFAIL;
+    uint32_t ulLength = ( uint32_t ) xMessageLength;
+    uint32_t ulPosition = 0U;
+    uint32_t ulEntriesStart = 0U;
+    uint32_t ulEntryStart = 0U;
+    uint32_t ulPayloadEntryStart = 0U;
+    uint32_t ulPayloadEntryEnd = 0U;
+    uint32_t ulHeaderLength = 0U;
+    uint32_t ulPadding = 0U;
+    uint32_t ulFileId = 0U;
+    uint32_t ulBlockId = 0U;
+    uint32_t ulEntries = 0U;
+    uint32_t ulEntry;
+    uint8_t ucFound = 0U;
+    const uint8_t * pucPayload = NULL;
+    uint32_t ulPayloadLength = 0U;
+    OtaCborItem_t xMap = { 0 };
+    OtaCborItem_t xKey = { 0 };
+    OtaCborItem_t xValue = { 0 };
+    bool xValid;
+
+    xValid = ( xOtaCborRead( pucMessage, ulLength, &ulPosition, &xMap ) == true ) &&
+             ( xMap.ucMajor == OTA_CBOR_MAJOR_MAP );
+    ulEntries = xMap.ulValue;
+    ulEntriesStart = ulPosition;
+
+    for( ulEntry = 0U; ( xValid == true ) && ( ulEntry < ulEntries ); ulEntry++ )
+    {
+        ulEntryStart = ulPosition;
+
+        xValid = ( xOtaCborRead( pucMessage, ulLength, &ulPosition, &xKey ) == true ) &&
+                 ( xKey.ucMajor == OTA_CBOR_MAJOR_TEXT ) &&
+                 ( xOtaCborRead( pucMessage, ulLength, &ulPosition, &xValue ) == true ) &&
+                 ( xValue.ucMajor != OTA_CBOR_MAJOR_MAP );
+
+        if( xValid == false )
+        {
+            /* Not a stream data message this module can copy. */
+        }
+        else if( xOtaCborIsKey( &xKey, 'f' ) && ( xValue.ucMajor == OTA_CBOR_MAJOR_UINT ) )
+        {
+            ulFileId = xValue.ulValue;
+            ucFound |= 1U;
+        }
+        else if( xOtaCborIsKey( &xKey, 'i' ) && ( xValue.ucMajor == OTA_CBOR_MAJOR_UINT ) )
+        {
+            ulBlockId = xValue.ulValue;
+            ucFound |= 2U;
+        }
+        else if( xOtaCborIsKey( &xKey, 'p' ) && ( xValue.ucMajor == OTA_CBOR_MAJOR_BYTES ) )
+        {
+            ulPayloadEntryStart = ulEntryStart;
+            ulPayloadEntryEnd = ulPosition;
+            pucPayload = xValue.pucData;
+            ulPayloadLength = xValue.ulValue;
+            ucFound |= 4U;
+        }
+        else
+        {
+            /* Copied as it is. */
+        }
+    }
+
+    if( ( xValid == true ) && ( ucFound == 7U ) && ( ulPosition == ulLength ) )
+    {
+        /* Map head, the other entries, the padding entry and the payload
+         * entry head. */
+        ulHeaderLength = ulOtaCborHeadSize( ulEntries + 1U ) +
+                         ( ulLength - ( ulPayloadEntryEnd - ulPayloadEntryStart ) - ulEntriesStart ) +
+                         3U + 2U + ulOtaCborHeadSize( ulPayloadLength );
+        ulPadding = ( DIRECT_WRITE_ALIGNMENT - ( ulHeaderLength % DIRECT_WRITE_ALIGNMENT ) ) % DIRECT_WRITE_ALIGNMENT;
+
+        if( ( ulHeaderLength + ulPadding + ulPayloadLength ) <= sizeof( pxBuffer->data ) )
+        {
+            ulPosition = 0U;
+            vOtaCborWriteHead( pxBuffer->data, &ulPosition, OTA_CBOR_MAJOR_MAP, ulEntries + 1U );
+
+            memcpy( &pxBuffer->data[ ulPosition ], &pucMessage[ ulEntriesStart ], ulPayloadEntryStart - ulEntriesStart );
+            ulPosition += ulPayloadEntryStart - ulEntriesStart;
+            memcpy( &pxBuffer->data[ ulPosition ], &pucMessage[ ulPayloadEntryEnd ], ulLength - ulPayloadEntryEnd );
+            ulPosition += ulLength - ulPayloadEntryEnd;
+
+            pxBuffer->data[ ulPosition++ ] = OTA_CBOR_KEY_HEADER;
+            pxBuffer->data[ ulPosition++ ] = ( uint8_t ) '_';
+            vOtaCborWriteHead( pxBuffer->data, &ulPosition, OTA_CBOR_MAJOR_BYTES, ulPadding );
+            memset( &pxBuffer->data[ ulPosition ], 0x00, ulPadding );
+            ulPosition += ulPadding;
+
+            pxBuffer->data[ ulPosition++ ] = OTA_CBOR_KEY_HEADER;
+            pxBuffer->data[ ulPosition++ ] = ( uint8_t ) 'p';
+            vOtaCborWriteHead( pxBuffer->data, &ulPosition, OTA_CBOR_MAJOR_BYTES, ulPayloadLength );
+            configASSERT( ( ulPosition % DIRECT_WRITE_ALIGNMENT ) == 0U );
+
+            memcpy( &pxBuffer->data[ ulPosition ], pucPayload, ulPayloadLength );
+            pxBuffer->dataLength = ulPosition + ulPayloadLength;
+
+            prvRecordBlock( pxBuffer, ulFileId, ulBlockId, ulPosition, ulPayloadLength );
+            xRet = pdPASS;
+        }
+    }
+
+    return xRet;
+}
+
+void vOtaDirectWriteForget( const OtaEventData_t * pxBuffer )
+{
+    uint32_t ulIndex;
+
+    taskENTER_CRITICAL( &xDirectWriteLock );
+    {
+        for( ulIndex = 0U; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
+        {
+            if( xBlocks[ ulIndex ].pxBuffer == pxBuffer )
+            {
+                xBlocks[ ulIndex ].pxBuffer = NULL;
+            }
+        }
+    }
+    taskEXIT_CRITICAL( &xDirectWriteLock );
+}
+
+const uint8_t * pucOtaDirectWriteFind( uint32_t ulFileId,
+                                       uint32_t ulOffset,
+                                       uint32_t ulLength,
+                                       OtaEventData_t ** ppxBuffer )
+{
+    const uint8_t * pucPayload = NULL;
+    const DirectBlock_t * pxOldest = NULL;
+    uint32_t ulIndex;
+
+    taskENTER_CRITICAL( &xDirectWriteLock );
+    {
+        for( ulIndex = 0U; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
+        {
+            /* Ages are compared relative to the next sequence number, so the
+             * counter may wrap. */
+            if( ( xBlocks[ ulIndex ].pxBuffer != NULL ) &&
+                ( xBlocks[ ulIndex ].ulFileId == ulFileId ) &&
+                ( ( xBlocks[ ulIndex ].ulBlockId * OTA_FILE_BLOCK_SIZE ) == ulOffset ) &&
+                ( xBlocks[ ulIndex ].ulPayloadLength == ulLength ) &&
+                ( ( pxOldest == NULL ) ||
+                  ( ( ulNextSequence - xBlocks[ ulIndex ].ulSequence ) > ( ulNextSequence - pxOldest->ulSequence ) ) ) )
+            {
+                pxOldest = &xBlocks[ ulIndex ];
+            }
+        }
+
+        if( pxOldest != NULL )
+        {
+            *ppxBuffer = pxOldest->pxBuffer;
+            pucPayload = &pxOldest->pxBuffer->data[ pxOldest->ulPayloadOffset ];
+        }
+    }
+    taskEXIT_CRITICAL( &xDirectWriteLock );
+
+    return pucPayload;
+}
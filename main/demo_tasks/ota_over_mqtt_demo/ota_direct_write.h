@@ -0,0 +1,107 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_direct_write.h
+ * @brief Programming of image blocks straight from the OTA event buffers.
+ *
+ * The OTA agent decodes each block from its event buffer into its decode
+ * memory and hands that to the flash writer, which would have to copy it
+ * again to keep it past the call. Instead, the block message is re-encoded
+ * when it is copied out of the network buffer, with a padding entry that
+ * places the payload on a word boundary of the event buffer. The flash writer
+ * then looks the block up and programs it from the event buffer, which it
+ * keeps a reference to until the write completes.
+ */
+#ifndef OTA_DIRECT_WRITE_H
+#define OTA_DIRECT_WRITE_H
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library include. */
+#include "ota.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Forget every recorded block.
+ */
+void vOtaDirectWriteInit( void );
+
+/**
+ * @brief Copy a stream data message into an event buffer with its payload
+ * aligned, and record the block.
+ *
+ * @param[in] pucMessage The CBOR encoded message, in the network buffer.
+ * @param[in] xMessageLength Length of the message.
+ * @param[out] pxBuffer The event buffer.
+ *
+ * @return pdPASS if the message was copied. pdFAIL if it has an unexpected
+ * shape, in which case the buffer is untouched.
+ */
+BaseType_t xOtaDirectWriteCopyBlock( const uint8_t * pucMessage,
+                                     size_t xMessageLength,
+                                     OtaEventData_t * pxBuffer );
+
+/**
+ * @brief Forget the block of an event buffer, once the OTA agent processed it
+ * or if it could not be sent to the OTA agent.
+ *
+ * @param[in] pxBuffer The event buffer.
+ */
+void vOtaDirectWriteForget( const OtaEventData_t * pxBuffer );
+
+/**
+ * @brief Find the event buffer holding the block the OTA agent is writing.
+ *
+ * @param[in] ulFileId Server file ID of the file being received.
+ * @param[in] ulOffset Offset of the block in the file.
+ * @param[in] ulLength Length of the block.
+ * @param[out] ppxBuffer The event buffer holding the block.
+ *
+ * @return The payload in the event buffer, NULL if the block is not recorded.
+ */
+const uint8_t * pucOtaDirectWriteFind( uint32_t ulFileId,
+                                       uint32_t ulOffset,
+                                       uint32_t ulLength,
+                                       OtaEventData_t ** ppxBuffer );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_DIRECT_WRITE_H */
@@ -0,0 +1,219 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_event_buffer_pool.c
+ * @brief Lock-free pool of the event buffers passed to the OTA agent.
+ *
+ * Free buffers form a stack of indices. The head of the stack is a single
+ * 32-bit word holding the index of the top buffer in its low half and a
+ * modification tag in its high half, so get and free are one compare-and-swap
+ * each and a stale head cannot be swapped in after the same buffer has been
+ * taken and returned in between (ABA). A buffer goes back to the stack once
+ * every reference to it is released.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library include. */
+#include "ota.h"
+
+/* Public functions include. */
+#include "ota_event_buffer_pool.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Index marking the end of the free stack.
+ */
+#define POOL_EMPTY_INDEX                  ( 0xFFFFU )
+
+#define POOL_HEAD_INDEX( ulHead )         ( ( uint16_t ) ( ( ulHead ) & 0xFFFFU ) )
+#define POOL_HEAD_TAG( ulHead )           ( ( ulHead ) >> 16 )
+#define POOL_MAKE_HEAD( ulTag, usIndex )  ( ( ( uint32_t ) ( ulTag ) << 16 ) | ( uint32_t ) ( usIndex ) )
+
+#if ( otaconfigMAX_NUM_OTA_DATA_BUFFERS >= POOL_EMPTY_INDEX )
+    #error "otaconfigMAX_NUM_OTA_DATA_BUFFERS must be less than 65535."
+#endif
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief A statically allocated array of event buffers used by the OTA agent.
+ * Maximum number of buffers are determined by how many chunks are requested
+ * by OTA agent at a time along with an extra buffer to handle control message.
+ * The size of each buffer is determined by the maximum size of firmware image
+ * chunk, and other metadata send along with the chunk.
+ */
+static OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ] = { 0 };
+
+/**
+ * @brief Index of the next free buffer below each free buffer of the stack.
+ */
+static _Atomic uint16_t usNextFree[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
+
+/**
+ * @brief Number of references to each buffer in use.
+ */
+static _Atomic uint8_t ucReferences[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
+
+/**
+ * @brief Tagged head of the free stack.
+ */
+static _Atomic uint32_t ulFreeHead = POOL_MAKE_HEAD( 0U, POOL_EMPTY_INDEX );
+
+/**
+ * @brief Number of free buffers.
+ */
+static _Atomic uint32_t ulFreeCount = 0U;
+
+/**
+ * @brief Lowest value of ulFreeCount since init.
+ */
+static _Atomic uint32_t ulLowWaterMark = 0U;
+
+/**
+ * @brief Number of gets that found the pool empty.
+ */
+static _Atomic uint32_t ulExhaustedCount = 0U;
+
+/* Public function definitions ************************************************/
+
+void vOtaEventBufferPoolInit( void )
+{
+    uint16_t usIndex;
+
+    memset( eventBuffer, 0x00, sizeof( eventBuffer ) );
+
+    for( usIndex = 0U; usIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; usIndex++ )
+    {
+        atomic_store( &usNextFree[ usIndex ],
+                      ( usIndex + 1U < otaconfigMAX_NUM_OTA_DATA_BUFFERS ) ? ( uint16_t ) ( usIndex + 1U ) : POOL_EMPTY_INDEX );
+        atomic_store( &ucReferences[ usIndex ], 0U );
+    }
+
+    atomic_store( &ulFreeHead, POOL_MAKE_HEAD( 0U, 0U ) );
+    atomic_store( &ulFreeCount, otaconfigMAX_NUM_OTA_DATA_BUFFERS );
+    atomic_store( &ulLowWaterMark, otaconfigMAX_NUM_OTA_DATA_BUFFERS );
+    atomic_store( &ulExhaustedCount, 0U );
+}
+
+OtaEventData_t * pxOtaEventBufferGet( void )
+{
+    OtaEventData_t * pFreeBuffer = NULL;
+    uint32_t ulOldHead = atomic_load( &ulFreeHead );
+    uint32_t ulNewHead;
+    uint32_t ulFree, ulLow;
+    uint16_t usIndex;
+
+    do
+    {
+        usIndex = POOL_HEAD_INDEX( ulOldHead );
+
+        if( usIndex == POOL_EMPTY_INDEX )
+        {
+            break;
+        }
+
+        ulNewHead = POOL_MAKE_HEAD( POOL_HEAD_TAG( ulOldHead ) + 1U,
+                                    atomic_load( &usNextFree[ usIndex ] ) );
+    } while( atomic_compare_exchange_weak( &ulFreeHead, &ulOldHead, ulNewHead ) == false );
+
+    if( usIndex == POOL_EMPTY_INDEX )
+    {
+        atomic_fetch_add( &ulExhaustedCount, 1U );
+    }
+    else
+    {
+        pFreeBuffer = &eventBuffer[ usIndex ];
+        pFreeBuffer->bufferUsed = true;
+        atomic_store( &ucReferences[ usIndex ], 1U );
+
+        /* Track the lowest number of free buffers. */
+        ulFree = atomic_fetch_sub( &ulFreeCount, 1U ) - 1U;
+        ulLow = atomic_load( &ulLowWaterMark );
+
+        while( ( ulFree < ulLow ) &&
+               ( atomic_compare_exchange_weak( &ulLowWaterMark, &ulLow, ulFree ) == false ) )
+        {
+            /* ulLow was reloaded by the failed exchange, compare again. */
+        }
+    }
+
+    return pFreeBuffer;
+}
+
+void vOtaEventBufferFree( OtaEventData_t * const pxBuffer )
+{
+    uint16_t usIndex = ( uint16_t ) ( pxBuffer - eventBuffer );
+    uint32_t ulOldHead = atomic_load( &ulFreeHead );
+    uint32_t ulNewHead;
+
+    configASSERT( usIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS );
+    configASSERT( atomic_load( &ucReferences[ usIndex ] ) > 0U );
+
+    if( atomic_fetch_sub( &ucReferences[ usIndex ], 1U ) == 1U )
+    {
+        pxBuffer->bufferUsed = false;
+
+        do
+        {
+            atomic_store( &usNextFree[ usIndex ], POOL_HEAD_INDEX( ulOldHead ) );
+            ulNewHead = POOL_MAKE_HEAD( POOL_HEAD_TAG( ulOldHead ) + 1U, usIndex );
+        } while( atomic_compare_exchange_weak( &ulFreeHead, &ulOldHead, ulNewHead ) == false );
+
+        atomic_fetch_add( &ulFreeCount, 1U );
+    }
+}
+
+void vOtaEventBufferRetain( OtaEventData_t * const pxBuffer )
+{
+    uint16_t usIndex = ( uint16_t ) ( pxBuffer - eventBuffer );
+
+    configASSERT( usIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS );
+    configASSERT( atomic_load( &ucReferences[ usIndex ] ) > 0U );
+
+    atomic_fetch_add( &ucReferences[ usIndex ], 1U );
+}
+
+void vOtaEventBufferPoolGetStats( OtaEventBufferPoolStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    pxStats->ulCapacity = otaconfigMAX_NUM_OTA_DATA_BUFFERS;
+    pxStats->ulFree = atomic_load( &ulFreeCount );
+    pxStats->ulLowWaterMark = atomic_load( &ulLowWaterMark );
+    pxStats->ulExhaustedCount = atomic_load( &ulExhaustedCount );
+}
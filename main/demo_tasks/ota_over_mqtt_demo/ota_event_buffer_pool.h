@@ -0,0 +1,101 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_event_buffer_pool.h
+ * @brief Lock-free pool of the event buffers passed to the OTA agent.
+ */
+#ifndef OTA_EVENT_BUFFER_POOL_H
+#define OTA_EVENT_BUFFER_POOL_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* OTA library include. */
+#include "ota.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Usage statistics of the event buffer pool.
+ */
+typedef struct OtaEventBufferPoolStats
+{
+    uint32_t ulCapacity;       /**< Number of buffers in the pool. */
+    uint32_t ulFree;           /**< Number of buffers currently free. */
+    uint32_t ulLowWaterMark;   /**< Lowest number of free buffers since init. */
+    uint32_t ulExhaustedCount; /**< Number of gets that found the pool empty. */
+} OtaEventBufferPoolStats_t;
+
+/**
+ * @brief Mark every buffer of the pool free and reset the statistics.
+ *
+ * @note Must not be called while buffers are in use.
+ */
+void vOtaEventBufferPoolInit( void );
+
+/**
+ * @brief Take a buffer from the pool. Lock-free and O(1), safe to call from
+ * any task.
+ *
+ * @return A pointer to an unused buffer. NULL if there are no buffers available.
+ */
+OtaEventData_t * pxOtaEventBufferGet( void );
+
+/**
+ * @brief Release a reference to a buffer, and return it to the pool with the
+ * last one. Lock-free and O(1), safe to call from any task.
+ *
+ * @param[in] pxBuffer Buffer taken with pxOtaEventBufferGet.
+ */
+void vOtaEventBufferFree( OtaEventData_t * const pxBuffer );
+
+/**
+ * @brief Take another reference to a buffer in use, so it stays out of the
+ * pool until vOtaEventBufferFree is called once more.
+ *
+ * @param[in] pxBuffer Buffer taken with pxOtaEventBufferGet.
+ */
+void vOtaEventBufferRetain( OtaEventData_t * const pxBuffer );
+
+/**
+ * @brief Get the usage statistics of the pool.
+ *
+ * @param[out] pxStats The statistics.
+ */
+void vOtaEventBufferPoolGetStats( OtaEventBufferPoolStats_t * pxStats );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_EVENT_BUFFER_POOL_H */
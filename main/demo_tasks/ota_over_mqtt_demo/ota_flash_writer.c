@@ -0,0 +1,1364 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_flash_writer.c
+ * @brief Flash writer stage of the OTA download.
+ *
+ * Decoded blocks are copied into sector sized chunks, at their offset in the
+ * sector, so blocks of a sector received out of order are assembled before it
+ * is programmed. Up to otademoconfigFLASH_WRITER_OPEN_SECTORS sectors are
+ * assembled at once. A chunk is handed to the writer task once its sector is
+ * complete, once a block of another sector needs its place, or when the file
+ * is closed, and the writer programs each contiguous run of it. A fixed
+ * number of chunks circulate between a free queue and a write queue, so with
+ * two chunks one is filled while the other is programmed, and the OTA agent
+ * task only waits on flash when every chunk is in use.
+ *
+ * The writer owns the inactive OTA slot. Each sector is erased just before it
+ * is first programmed, unless it was already erased, and the signature of the
+ * image is checked at close, so the slot is only ever erased once per image.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA platform abstraction layer include. */
+#include "ota_pal.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Image signature verification include. */
+#include "ota_image_hash.h"
+
+/* Public functions include. */
+#include "ota_flash_writer.h"
+
+#if otademoconfigENABLE_PRE_ERASE
+    /* Inactive slot pre-erase include. */
+    #include "ota_pre_erase.h"
+#endif /* otademoconfigENABLE_PRE_ERASE */
+
+#if otademoconfigENABLE_RESUME
+    /* Interrupted download resumption include. */
+    #include "ota_resume.h"
+#endif /* otademoconfigENABLE_RESUME */
+
+#if otademoconfigENABLE_EARLY_IMAGE_CHECK
+    /* Early image header check include. */
+    #include "ota_image_check.h"
+#endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+
+#if otademoconfigENABLE_DELTA
+    /* Delta update include. */
+    #include "ota_delta.h"
+#endif /* otademoconfigENABLE_DELTA */
+
+#if otademoconfigENABLE_COMPRESSION
+    /* Compressed image include. */
+    #include "ota_decompress.h"
+#endif /* otademoconfigENABLE_COMPRESSION */
+
+#if otademoconfigENABLE_BUNDLE
+    /* Firmware and data file bundle include. */
+    #include "ota_bundle.h"
+#endif /* otademoconfigENABLE_BUNDLE */
+
+#if otademoconfigENABLE_DIRECT_WRITE
+    /* OTA event buffer pool include. */
+    #include "ota_event_buffer_pool.h"
+
+    /* Direct block write include. */
+    #include "ota_direct_write.h"
+#endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+#if otademoconfigENABLE_METRICS
+    /* ESP-IDF timer include. */
+    #include "esp_timer.h"
+
+    /* OTA metrics include. */
+    #include "ota_metrics.h"
+#endif /* otademoconfigENABLE_METRICS */
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of a flash sector, the unit chunks are aligned to.
+ */
+#define FLASH_WRITER_SECTOR_SIZE    ( 4096U )
+
+/**
+ * @brief Largest slot, in sectors, whose erased sectors are tracked. 16 MiB,
+ * the largest flash of the ESP32-C3.
+ */
+#define FLASH_WRITER_MAX_SLOT_SECTORS    ( 4096U )
+
+/**
+ * @brief Size of a chunk. At least one sector, and at least one block.
+ */
+#define FLASH_WRITER_CHUNK_SIZE                                  \
+    ( ( OTA_FILE_BLOCK_SIZE > FLASH_WRITER_SECTOR_SIZE ) ?       \
+      OTA_FILE_BLOCK_SIZE : FLASH_WRITER_SECTOR_SIZE )
+
+/**
+ * @brief Number of chunks, so that with every sector being assembled the
+ * writer task still has otademoconfigFLASH_WRITER_NUM_CHUNKS - 1 to program.
+ */
+#define FLASH_WRITER_POOL_CHUNKS                                     \
+    ( otademoconfigFLASH_WRITER_NUM_CHUNKS +                         \
+      otademoconfigFLASH_WRITER_OPEN_SECTORS - 1U )
+
+/**
+ * @brief Maximum number of separate runs of data in a chunk. A chunk with no
+ * room for another run is handed to the writer task as it is.
+ */
+#define FLASH_WRITER_MAX_RUNS      ( 8U )
+
+/**
+ * @brief Whether files are transformed into the image, which requires them to
+ * be consumed in order.
+ */
+#define FLASH_WRITER_TRANSFORMS                                  \
+    ( ( otademoconfigENABLE_DELTA == 1 ) ||                      \
+      ( otademoconfigENABLE_COMPRESSION == 1 ) )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief How the received file maps to the image written to flash.
+ */
+typedef enum FileFormat
+{
+    FILE_FORMAT_IMAGE,     /**< The file is the image. */
+    FILE_FORMAT_DELTA,     /**< The file is a patch against the running image. */
+    FILE_FORMAT_COMPRESSED, /**< The file is the compressed image. */
+    FILE_FORMAT_BUNDLE     /**< The file is the image followed by data files. */
+} FileFormat_t;
+
+#if FLASH_WRITER_TRANSFORMS
+
+/**
+ * @brief A block of a transformed file received ahead of the next expected
+ * one.
+ */
+    typedef struct HeldBlock
+    {
+        bool xUsed;
+        uint32_t ulOffset;
+        uint32_t ulLength;
+        uint8_t ucData[ OTA_FILE_BLOCK_SIZE ];
+    } HeldBlock_t;
+#endif /* FLASH_WRITER_TRANSFORMS */
+
+/**
+ * @brief A contiguous range of a chunk, from ulStart up to ulEnd.
+ */
+typedef struct ChunkRun
+{
+    uint32_t ulStart;
+    uint32_t ulEnd;
+} ChunkRun_t;
+
+/**
+ * @brief A sector of the image waiting to be programmed. Its runs are sorted
+ * and do not touch each other.
+ */
+typedef struct FlashChunk
+{
+    uint32_t ulOffset;
+    uint32_t ulRunCount;
+    ChunkRun_t xRuns[ FLASH_WRITER_MAX_RUNS ];
+    uint8_t ucData[ FLASH_WRITER_CHUNK_SIZE ];
+} FlashChunk_t;
+
+/**
+ * @brief Message to the writer task, to program the runs of pxChunk, or
+ * ulLength bytes of pucData at ulOffset held in pxBlockBuffer, and then
+ * release them. A message with xSyncTask set instead asks the writer to
+ * notify that task once every earlier message has been processed.
+ */
+typedef struct WriterMessage
+{
+    FlashChunk_t * pxChunk;
+    TaskHandle_t xSyncTask;
+
+    #if otademoconfigENABLE_DIRECT_WRITE
+        uint32_t ulOffset;
+        const uint8_t * pucData;
+        uint32_t ulLength;
+        OtaEventData_t * pxBlockBuffer;
+    #endif /* otademoconfigENABLE_DIRECT_WRITE */
+} WriterMessage_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_flash_writer";
+
+/**
+ * @brief The chunk buffers.
+ */
+static FlashChunk_t xChunks[ FLASH_WRITER_POOL_CHUNKS ];
+
+/**
+ * @brief Chunks waiting to be programmed, and sync requests.
+ */
+static QueueHandle_t xWriteQueue;
+
+/**
+ * @brief Chunks available to be filled.
+ */
+static QueueHandle_t xFreeQueue;
+
+/**
+ * @brief Chunks being filled by the OTA agent task, oldest first.
+ */
+static FlashChunk_t * pxOpenChunks[ otademoconfigFLASH_WRITER_OPEN_SECTORS ];
+static uint32_t ulOpenChunkCount = 0U;
+
+/**
+ * @brief File context of the file being received.
+ */
+static OtaFileContext_t * pxWriterFileContext = NULL;
+
+/**
+ * @brief Slot the image is programmed to, and its sectors erased since the
+ * file was created. Only the writer task uses the bitmap while a file is
+ * open.
+ */
+static const esp_partition_t * pxImageSlot = NULL;
+static uint8_t ucPreparedSectors[ FLASH_WRITER_MAX_SLOT_SECTORS / 8U ];
+
+/**
+ * @brief Set once a file was created since boot, and while the image of the
+ * last file closed passed its signature check and can be activated.
+ */
+static bool xFileCreated = false;
+static bool xImageVerified = false;
+
+/**
+ * @brief Format of the file being received.
+ */
+static FileFormat_t xFileFormat = FILE_FORMAT_IMAGE;
+
+#if FLASH_WRITER_TRANSFORMS
+
+/**
+ * @brief Offset of the next block of a transformed file, and the blocks held
+ * until it arrives.
+ */
+    static uint32_t ulNextFileOffset = 0U;
+    static HeldBlock_t xHeldBlocks[ otademoconfigSTREAM_REORDER_BLOCKS ];
+#endif /* FLASH_WRITER_TRANSFORMS */
+
+/**
+ * @brief Set once a write failed, until the next file is created.
+ */
+static atomic_bool xWriteFailed = false;
+
+/**
+ * @brief Set while an abort discards the chunks in the write queue.
+ */
+static atomic_bool xDiscardChunks = false;
+
+/**
+ * @brief Throughput statistics of the current file.
+ */
+static TickType_t xFileStartTick;
+static _Atomic uint32_t ulBytesProgrammed = 0U;
+static _Atomic uint32_t ulFlashWrites = 0U;
+static _Atomic uint32_t ulFlashBusyTicks = 0U;
+static _Atomic uint32_t ulSectorsErased = 0U;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief The flash writer task.
+ */
+static void prvFlashWriterTask( void * pvParameters );
+
+/**
+ * @brief Program a range of the image, unless an earlier write failed or the
+ * file is being aborted.
+ */
+static void prvProgramRange( uint32_t ulOffset,
+                             const uint8_t * pucData,
+                             uint32_t ulLength );
+
+/**
+ * @brief Erase the sectors of a range of the slot that have not been erased
+ * since the file was created.
+ */
+static esp_err_t prvPrepareRange( uint32_t ulOffset,
+                                  uint32_t ulLength );
+
+/**
+ * @brief Find the sectors of the slot that need no erase before they are
+ * programmed, because they were erased in the background or restored from a
+ * download interrupted by a reboot.
+ */
+static void prvFindPreparedSectors( void );
+
+/**
+ * @brief Check whether a sector of the slot is erased or already holds data of
+ * the current file.
+ */
+static bool prvIsSectorPrepared( uint32_t ulSector );
+
+/**
+ * @brief Record that a sector of the slot is erased or holds data of the
+ * current file.
+ */
+static void prvSetSectorPrepared( uint32_t ulSector );
+
+/**
+ * @brief Copy image data into the chunks of its sectors, handing each chunk to
+ * the writer task once its sector is complete.
+ */
+static void prvQueueImageData( uint32_t ulOffset,
+                               const uint8_t * pucData,
+                               uint32_t ulLength );
+
+#if FLASH_WRITER_TRANSFORMS
+
+/**
+ * @brief Pass the next bytes of a transformed file to its transform.
+ */
+    static BaseType_t prvTransformInOrder( const uint8_t * pucData,
+                                           uint32_t ulLength );
+
+/**
+ * @brief Transform a block of the file, holding it if an earlier block is
+ * still missing.
+ */
+    static BaseType_t prvTransformBlock( uint32_t ulOffset,
+                                         const uint8_t * pucData,
+                                         uint32_t ulLength );
+
+/**
+ * @brief Check that the transform produced a complete image.
+ */
+    static BaseType_t prvTransformFinish( uint32_t * pulImageSize );
+#endif /* FLASH_WRITER_TRANSFORMS */
+
+#if otademoconfigENABLE_DIRECT_WRITE
+
+/**
+ * @brief Hand a block of the image to the writer task in the event buffer the
+ * OTA agent decoded it from, if that buffer is known.
+ *
+ * @return pdPASS if the block was handled, pdFAIL if it has to be copied.
+ */
+    static BaseType_t prvQueueDirectBlock( OtaFileContext_t * const pFileContext,
+                                           uint32_t ulOffset,
+                                           uint32_t ulLength );
+#endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+/**
+ * @brief Get the chunk of the sector at ulSectorOffset, with room for another
+ * run. Opens a chunk for the sector if needed, handing the oldest one to the
+ * writer task if every sector being assembled is in use.
+ */
+static FlashChunk_t * prvGetOpenChunk( uint32_t ulSectorOffset );
+
+/**
+ * @brief Add a run to a chunk, merging it with the runs it touches.
+ */
+static void prvAddRun( FlashChunk_t * pxChunk,
+                       uint32_t ulStart,
+                       uint32_t ulEnd );
+
+/**
+ * @brief Remove a chunk from the open chunks.
+ */
+static FlashChunk_t * prvTakeOpenChunk( uint32_t ulIndex );
+
+/**
+ * @brief Hand a chunk to the writer task.
+ */
+static void prvSubmitChunk( FlashChunk_t * pxChunk );
+
+/**
+ * @brief Hand every open chunk to the writer task.
+ */
+static void prvSubmitOpenChunks( void );
+
+/**
+ * @brief Wait until the writer task has processed every submitted chunk.
+ */
+static void prvWaitForWriter( void );
+
+/* Static function definitions ************************************************/
+
+static void prvFlashWriterTask( void * pvParameters )
+{
+    WriterMessage_t xMessage;
+    uint32_t ulIndex;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        ( void ) xQueueReceive( xWriteQueue, &xMessage, portMAX_DELAY );
+
+        if( xMessage.xSyncTask != NULL )
+        {
+            xTaskNotifyGive( xMessage.xSyncTask );
+        }
+        else if( xMessage.pxChunk != NULL )
+        {
+            for( ulIndex = 0U; ulIndex < xMessage.pxChunk->ulRunCount; ulIndex++ )
+            {
+                prvProgramRange( xMessage.pxChunk->ulOffset + xMessage.pxChunk->xRuns[ ulIndex ].ulStart,
+                                 &xMessage.pxChunk->ucData[ xMessage.pxChunk->xRuns[ ulIndex ].ulStart ],
+                                 xMessage.pxChunk->xRuns[ ulIndex ].ulEnd - xMessage.pxChunk->xRuns[ ulIndex ].ulStart );
+            }
+
+            ( void ) xQueueSend( xFreeQueue, &xMessage.pxChunk, portMAX_DELAY );
+        }
+
+        #if otademoconfigENABLE_DIRECT_WRITE
+            else
+            {
+                prvProgramRange( xMessage.ulOffset, xMessage.pucData, xMessage.ulLength );
+                vOtaEventBufferFree( xMessage.pxBlockBuffer );
+            }
+        #endif /* otademoconfigENABLE_DIRECT_WRITE */
+    }
+}
+
+static void prvProgramRange( uint32_t ulOffset,
+                             const uint8_t * pucData,
+                             uint32_t ulLength )
+{
+    TickType_t xStartTick;
+    esp_err_t xEspErrRet;
+
+    #if otademoconfigENABLE_METRICS
+        int64_t llStartUs;
+    #endif /* otademoconfigENABLE_METRICS */
+
+    if( ( atomic_load( &xWriteFailed ) == false ) && ( atomic_load( &xDiscardChunks ) == false ) )
+    {
+        #if otademoconfigENABLE_PRE_ERASE
+            vOtaPreEraseMarkWritten( ulOffset );
+        #endif /* otademoconfigENABLE_PRE_ERASE */
+
+        xStartTick = xTaskGetTickCount();
+
+        #if otademoconfigENABLE_METRICS
+            llStartUs = esp_timer_get_time();
+        #endif /* otademoconfigENABLE_METRICS */
+
+        if( ( ulOffset > pxImageSlot->size ) || ( ulLength > ( pxImageSlot->size - ulOffset ) ) )
+        {
+            xEspErrRet = ESP_ERR_INVALID_SIZE;
+        }
+        else
+        {
+            xEspErrRet = prvPrepareRange( ulOffset, ulLength );
+        }
+
+        if( xEspErrRet == ESP_OK )
+        {
+            xEspErrRet = esp_partition_write( pxImageSlot, ulOffset, pucData, ulLength );
+        }
+
+        atomic_fetch_add( &ulFlashBusyTicks, xTaskGetTickCount() - xStartTick );
+        atomic_fetch_add( &ulFlashWrites, 1U );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to write %" PRIu32 " bytes at offset %" PRIu32 ". Error: %s",
+                      ulLength,
+                      ulOffset,
+                      esp_err_to_name( xEspErrRet ) );
+            atomic_store( &xWriteFailed, true );
+        }
+        else
+        {
+            atomic_fetch_add( &ulBytesProgrammed, ulLength );
+
+            #if otademoconfigENABLE_METRICS
+                vOtaMetricsOnFlashWrite( ulLength,
+                                         ( uint32_t ) ( esp_timer_get_time() - llStartUs ) );
+            #endif /* otademoconfigENABLE_METRICS */
+
+            #if otademoconfigENABLE_RESUME
+                vOtaResumeRecordWrite( ulOffset, pucData, ulLength );
+            #endif /* otademoconfigENABLE_RESUME */
+
+            #if otademoconfigENABLE_INCREMENTAL_HASH
+                vOtaImageHashRecordWrite( ulOffset, pucData, ulLength );
+            #endif /* otademoconfigENABLE_INCREMENTAL_HASH */
+        }
+    }
+}
+
+static esp_err_t prvPrepareRange( uint32_t ulOffset,
+                                  uint32_t ulLength )
+{
+    esp_err_t xEspErrRet = ESP_OK;
+    uint32_t ulSector;
+
+    for( ulSector = ulOffset / FLASH_WRITER_SECTOR_SIZE;
+         ( ulSector <= ( ( ulOffset + ulLength - 1U ) / FLASH_WRITER_SECTOR_SIZE ) ) && ( xEspErrRet == ESP_OK );
+         ulSector++ )
+    {
+        if( prvIsSectorPrepared( ulSector ) == false )
+        {
+            xEspErrRet = esp_partition_erase_range( pxImageSlot,
+                                                    ulSector * FLASH_WRITER_SECTOR_SIZE,
+                                                    FLASH_WRITER_SECTOR_SIZE );
+
+            if( xEspErrRet == ESP_OK )
+            {
+                prvSetSectorPrepared( ulSector );
+                atomic_fetch_add( &ulSectorsErased, 1U );
+            }
+        }
+    }
+
+    return xEspErrRet;
+}
+
+static void prvFindPreparedSectors( void )
+{
+    uint32_t ulSector;
+    uint32_t ulErasedSectors = 0U;
+    uint32_t ulRestoredSectors = 0U;
+
+    memset( ucPreparedSectors, 0x00, sizeof( ucPreparedSectors ) );
+
+    for( ulSector = 0U; ulSector < ( pxImageSlot->size / FLASH_WRITER_SECTOR_SIZE ); ulSector++ )
+    {
+        #if otademoconfigENABLE_PRE_ERASE
+            if( xOtaPreEraseIsRangeErased( ulSector * FLASH_WRITER_SECTOR_SIZE, FLASH_WRITER_SECTOR_SIZE ) == true )
+            {
+                prvSetSectorPrepared( ulSector );
+                ulErasedSectors++;
+            }
+        #endif /* otademoconfigENABLE_PRE_ERASE */
+
+        #if otademoconfigENABLE_RESUME
+            if( xOtaResumeIsRangeRestored( ulSector * FLASH_WRITER_SECTOR_SIZE, FLASH_WRITER_SECTOR_SIZE ) == true )
+            {
+                prvSetSectorPrepared( ulSector );
+                ulRestoredSectors++;
+            }
+        #endif /* otademoconfigENABLE_RESUME */
+    }
+
+    ESP_LOGI( TAG,
+              "%" PRIu32 " sectors of %s already erased, %" PRIu32 " restored.",
+              ulErasedSectors,
+              pxImageSlot->label,
+              ulRestoredSectors );
+}
+
+static bool prvIsSectorPrepared( uint32_t ulSector )
+{
+    return ( ucPreparedSectors[ ulSector / 8U ] & ( 1U << ( ulSector % 8U ) ) ) != 0U;
+}
+
+static void prvSetSectorPrepared( uint32_t ulSector )
+{
+    ucPreparedSectors[ ulSector / 8U ] |= ( uint8_t ) ( 1U << ( ulSector % 8U ) );
+}
+
+static void prvQueueImageData( uint32_t ulOffset,
+                               const uint8_t * pucData,
+                               uint32_t ulLength )
+{
+    FlashChunk_t * pxChunk;
+    uint32_t ulSectorStart;
+    uint32_t ulCopyLength;
+
+    #if otademoconfigENABLE_EARLY_IMAGE_CHECK
+        /* Fail the file as soon as its header shows it cannot be used. */
+        if( xOtaImageCheckFeed( ulOffset, pucData, ulLength ) > OtaImageCheckPassed )
+        {
+            atomic_store( &xWriteFailed, true );
+            ulLength = 0U;
+        }
+    #endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+
+    while( ulLength > 0U )
+    {
+        /* A chunk never crosses a sector boundary. */
+        ulSectorStart = ulOffset % FLASH_WRITER_CHUNK_SIZE;
+        ulCopyLength = FLASH_WRITER_CHUNK_SIZE - ulSectorStart;
+        ulCopyLength = ( ulLength < ulCopyLength ) ? ulLength : ulCopyLength;
+
+        pxChunk = prvGetOpenChunk( ulOffset - ulSectorStart );
+        memcpy( &pxChunk->ucData[ ulSectorStart ], pucData, ulCopyLength );
+        prvAddRun( pxChunk, ulSectorStart, ulSectorStart + ulCopyLength );
+        ulOffset += ulCopyLength;
+        pucData += ulCopyLength;
+        ulLength -= ulCopyLength;
+
+        /* Submit as soon as the sector is complete. */
+        if( ( pxChunk->ulRunCount == 1U ) &&
+            ( pxChunk->xRuns[ 0 ].ulStart == 0U ) &&
+            ( pxChunk->xRuns[ 0 ].ulEnd == FLASH_WRITER_CHUNK_SIZE ) )
+        {
+            prvSubmitChunk( prvTakeOpenChunk( ulOpenChunkCount - 1U ) );
+        }
+    }
+}
+
+static FlashChunk_t * prvGetOpenChunk( uint32_t ulSectorOffset )
+{
+    FlashChunk_t * pxChunk = NULL;
+    uint32_t ulIndex = 0U;
+
+    while( ( ulIndex < ulOpenChunkCount ) && ( pxOpenChunks[ ulIndex ]->ulOffset != ulSectorOffset ) )
+    {
+        ulIndex++;
+    }
+
+    if( ulIndex < ulOpenChunkCount )
+    {
+        pxChunk = prvTakeOpenChunk( ulIndex );
+
+        /* A chunk with every run in use is programmed as it is, and the
+         * sector assembled again in a new one. */
+        if( pxChunk->ulRunCount == FLASH_WRITER_MAX_RUNS )
+        {
+            prvSubmitChunk( pxChunk );
+            pxChunk = NULL;
+        }
+    }
+
+    if( pxChunk == NULL )
+    {
+        if( ulOpenChunkCount == otademoconfigFLASH_WRITER_OPEN_SECTORS )
+        {
+            prvSubmitChunk( prvTakeOpenChunk( 0U ) );
+        }
+
+        #if otademoconfigENABLE_METRICS
+            if( uxQueueMessagesWaiting( xFreeQueue ) == 0U )
+            {
+                vOtaMetricsOnChunkWait();
+            }
+        #endif /* otademoconfigENABLE_METRICS */
+
+        /* Only waits when every chunk is waiting to be programmed. */
+        ( void ) xQueueReceive( xFreeQueue, &pxChunk, portMAX_DELAY );
+        pxChunk->ulOffset = ulSectorOffset;
+        pxChunk->ulRunCount = 0U;
+    }
+
+    /* The most recently used chunk is the newest. */
+    pxOpenChunks[ ulOpenChunkCount ] = pxChunk;
+    ulOpenChunkCount++;
+
+    return pxChunk;
+}
+
+static void prvAddRun( FlashChunk_t * pxChunk,
+                       uint32_t ulStart,
+                       uint32_t ulEnd )
+{
+    ChunkRun_t * pxRuns = pxChunk->xRuns;
+    uint32_t ulIndex = 0U;
+    uint32_t ulKept = 0U;
+
+    configASSERT( pxChunk->ulRunCount < FLASH_WRITER_MAX_RUNS );
+
+    /* Insert the run in order of start. */
+    while( ( ulIndex < pxChunk->ulRunCount ) && ( pxRuns[ ulIndex ].ulStart < ulStart ) )
+    {
+        ulIndex++;
+    }
+
+    memmove( &pxRuns[ ulIndex + 1U ], &pxRuns[ ulIndex ], ( pxChunk->ulRunCount - ulIndex ) * sizeof( ChunkRun_t ) );
+    pxRuns[ ulIndex ].ulStart = ulStart;
+    pxRuns[ ulIndex ].ulEnd = ulEnd;
+    pxChunk->ulRunCount++;
+
+    /* Merge the runs that touch or overlap. */
+    for( ulIndex = 1U; ulIndex < pxChunk->ulRunCount; ulIndex++ )
+    {
+        if( pxRuns[ ulIndex ].ulStart <= pxRuns[ ulKept ].ulEnd )
+        {
+            if( pxRuns[ ulIndex ].ulEnd > pxRuns[ ulKept ].ulEnd )
+            {
+                pxRuns[ ulKept ].ulEnd = pxRuns[ ulIndex ].ulEnd;
+            }
+        }
+        else
+        {
+            ulKept++;
+            pxRuns[ ulKept ] = pxRuns[ ulIndex ];
+        }
+    }
+
+    pxChunk->ulRunCount = ulKept + 1U;
+}
+
+#if FLASH_WRITER_TRANSFORMS
+
+    static BaseType_t prvTransformInOrder( const uint8_t * pucData,
+                                           uint32_t ulLength )
+    {
+        BaseType_t xRet = pdFAIL;
+
+        #if otademoconfigENABLE_DELTA
+            if( xFileFormat == FILE_FORMAT_DELTA )
+            {
+                xRet = xOtaDeltaApply( pucData, ulLength, prvQueueImageData );
+            }
+        #endif /* otademoconfigENABLE_DELTA */
+
+        #if otademoconfigENABLE_COMPRESSION
+            if( xFileFormat == FILE_FORMAT_COMPRESSED )
+            {
+                xRet = xOtaDecompressApply( pucData, ulLength, prvQueueImageData );
+            }
+        #endif /* otademoconfigENABLE_COMPRESSION */
+
+        return xRet;
+    }
+
+    static BaseType_t prvTransformBlock( uint32_t ulOffset,
+                                         const uint8_t * pucData,
+                                         uint32_t ulLength )
+    {
+        BaseType_t xRet = pdPASS;
+        HeldBlock_t * pxHeld = NULL;
+        uint32_t ulIndex;
+        bool xProgress = true;
+
+        if( ulOffset == ulNextFileOffset )
+        {
+            xRet = prvTransformInOrder( pucData, ulLength );
+            ulNextFileOffset += ulLength;
+
+            /* Transform the held blocks that are now in order. */
+            while( ( xProgress == true ) && ( xRet == pdPASS ) )
+            {
+                xProgress = false;
+
+                for( ulIndex = 0U; ( ulIndex < otademoconfigSTREAM_REORDER_BLOCKS ) && ( xRet == pdPASS ); ulIndex++ )
+                {
+                    pxHeld = &xHeldBlocks[ ulIndex ];
+
+                    if( ( pxHeld->xUsed == true ) && ( pxHeld->ulOffset == ulNextFileOffset ) )
+                    {
+                        xRet = prvTransformInOrder( pxHeld->ucData, pxHeld->ulLength );
+                        ulNextFileOffset += pxHeld->ulLength;
+                        pxHeld->xUsed = false;
+                        xProgress = true;
+                    }
+                }
+            }
+        }
+        else if( ulOffset < ulNextFileOffset )
+        {
+            /* A block delivered again after it was transformed. */
+        }
+        else
+        {
+            for( ulIndex = 0U; ( ulIndex < otademoconfigSTREAM_REORDER_BLOCKS ) && ( pxHeld == NULL ); ulIndex++ )
+            {
+                if( xHeldBlocks[ ulIndex ].xUsed == false )
+                {
+                    pxHeld = &xHeldBlocks[ ulIndex ];
+                }
+            }
+
+            if( pxHeld == NULL )
+            {
+                ESP_LOGE( TAG, "Too many blocks out of order, missing offset %" PRIu32 ".", ulNextFileOffset );
+                xRet = pdFAIL;
+            }
+            else
+            {
+                pxHeld->xUsed = true;
+                pxHeld->ulOffset = ulOffset;
+                pxHeld->ulLength = ulLength;
+                memcpy( pxHeld->ucData, pucData, ulLength );
+            }
+        }
+
+        return xRet;
+    }
+
+    static BaseType_t prvTransformFinish( uint32_t * pulImageSize )
+    {
+        BaseType_t xRet = pdFAIL;
+
+        #if otademoconfigENABLE_DELTA
+            if( xFileFormat == FILE_FORMAT_DELTA )
+            {
+                xRet = xOtaDeltaFinish( pulImageSize );
+            }
+        #endif /* otademoconfigENABLE_DELTA */
+
+        #if otademoconfigENABLE_COMPRESSION
+            if( xFileFormat == FILE_FORMAT_COMPRESSED )
+            {
+                xRet = xOtaDecompressFinish( pulImageSize );
+            }
+        #endif /* otademoconfigENABLE_COMPRESSION */
+
+        return xRet;
+    }
+
+#endif /* FLASH_WRITER_TRANSFORMS */
+
+#if otademoconfigENABLE_DIRECT_WRITE
+
+    static BaseType_t prvQueueDirectBlock( OtaFileContext_t * const pFileContext,
+                                           uint32_t ulOffset,
+                                           uint32_t ulLength )
+    {
+        BaseType_t xRet = pdFAIL;
+        WriterMessage_t xMessage = { 0 };
+        OtaEventData_t * pxBuffer = NULL;
+        const uint8_t * pucPayload = NULL;
+
+        /* Only whole sectors, or the end of the image, are programmed in
+         * place of a chunk. */
+        if( ( ( ulOffset % FLASH_WRITER_CHUNK_SIZE ) == 0U ) &&
+            ( ( ulLength == FLASH_WRITER_CHUNK_SIZE ) || ( ( ulOffset + ulLength ) == pFileContext->fileSize ) ) )
+        {
+            pucPayload = pucOtaDirectWriteFind( pFileContext->serverFileID, ulOffset, ulLength, &pxBuffer );
+        }
+
+        if( pucPayload != NULL )
+        {
+            xRet = pdPASS;
+
+            #if otademoconfigENABLE_EARLY_IMAGE_CHECK
+                /* Fail the file as soon as its header shows it cannot be used. */
+                if( xOtaImageCheckFeed( ulOffset, pucPayload, ulLength ) > OtaImageCheckPassed )
+                {
+                    atomic_store( &xWriteFailed, true );
+                    pucPayload = NULL;
+                }
+            #endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+        }
+
+        if( pucPayload != NULL )
+        {
+            /* The OTA agent releases the buffer once this call returns, the
+             * writer task once the block is programmed. */
+            vOtaEventBufferRetain( pxBuffer );
+
+            xMessage.ulOffset = ulOffset;
+            xMessage.pucData = pucPayload;
+            xMessage.ulLength = ulLength;
+            xMessage.pxBlockBuffer = pxBuffer;
+            ( void ) xQueueSend( xWriteQueue, &xMessage, portMAX_DELAY );
+        }
+
+        return xRet;
+    }
+
+#endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+static FlashChunk_t * prvTakeOpenChunk( uint32_t ulIndex )
+{
+    FlashChunk_t * pxChunk = pxOpenChunks[ ulIndex ];
+
+    for( ulIndex++; ulIndex < ulOpenChunkCount; ulIndex++ )
+    {
+        pxOpenChunks[ ulIndex - 1U ] = pxOpenChunks[ ulIndex ];
+    }
+
+    ulOpenChunkCount--;
+
+    return pxChunk;
+}
+
+static void prvSubmitChunk( FlashChunk_t * pxChunk )
+{
+    WriterMessage_t xMessage = { .pxChunk = pxChunk };
+
+    ( void ) xQueueSend( xWriteQueue, &xMessage, portMAX_DELAY );
+}
+
+static void prvSubmitOpenChunks( void )
+{
+    while( ulOpenChunkCount > 0U )
+    {
+        prvSubmitChunk( prvTakeOpenChunk( 0U ) );
+    }
+}
+
+static void prvWaitForWriter( void )
+{
+    WriterMessage_t xMessage = { .xSyncTask = xTaskGetCurrentTaskHandle() };
+
+    ( void ) xQueueSend( xWriteQueue, &xMessage, portMAX_DELAY );
+    ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xOtaFlashWriterInit( void )
+{
+    BaseType_t xRet = pdPASS;
+    FlashChunk_t * pxChunk;
+    uint32_t ulIndex;
+
+    /* Room for every chunk and event buffer plus one sync request. */
+    #if otademoconfigENABLE_DIRECT_WRITE
+        xWriteQueue = xQueueCreate( FLASH_WRITER_POOL_CHUNKS + otaconfigMAX_NUM_OTA_DATA_BUFFERS + 1U, sizeof( WriterMessage_t ) );
+    #else
+        xWriteQueue = xQueueCreate( FLASH_WRITER_POOL_CHUNKS + 1U, sizeof( WriterMessage_t ) );
+    #endif /* otademoconfigENABLE_DIRECT_WRITE */
+    xFreeQueue = xQueueCreate( FLASH_WRITER_POOL_CHUNKS, sizeof( FlashChunk_t * ) );
+
+    if( ( xWriteQueue == NULL ) || ( xFreeQueue == NULL ) )
+    {
+        ESP_LOGE( TAG, "Failed to create flash writer queues." );
+        xRet = pdFAIL;
+    }
+    else
+    {
+        for( ulIndex = 0U; ulIndex < FLASH_WRITER_POOL_CHUNKS; ulIndex++ )
+        {
+            pxChunk = &xChunks[ ulIndex ];
+            ( void ) xQueueSend( xFreeQueue, &pxChunk, 0 );
+        }
+
+        xRet = xTaskCreate( prvFlashWriterTask,
+                            "OTAFlashWriter",
+                            otademoconfigFLASH_WRITER_TASK_STACK_SIZE,
+                            NULL,
+                            otademoconfigFLASH_WRITER_TASK_PRIORITY,
+                            NULL );
+
+        if( xRet != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to create flash writer task." );
+        }
+    }
+
+    return xRet;
+}
+
+OtaPalStatus_t xOtaFlashWriterCreateFile( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t xRet = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+
+    pxWriterFileContext = pFileContext;
+    xFileCreated = true;
+    xImageVerified = false;
+    pxImageSlot = esp_ota_get_next_update_partition( NULL );
+
+    if( pxImageSlot == NULL )
+    {
+        ESP_LOGE( TAG, "No inactive OTA slot in the partition table." );
+        xRet = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+    }
+    else if( ( pFileContext->fileSize > pxImageSlot->size ) ||
+             ( pxImageSlot->size > ( FLASH_WRITER_MAX_SLOT_SECTORS * FLASH_WRITER_SECTOR_SIZE ) ) )
+    {
+        ESP_LOGE( TAG,
+                  "File of %" PRIu32 " bytes does not fit slot %s.",
+                  pFileContext->fileSize,
+                  pxImageSlot->label );
+        xRet = OTA_PAL_COMBINE_ERR( OtaPalRxFileTooLarge, 0 );
+    }
+    else
+    {
+        atomic_store( &xWriteFailed, false );
+        atomic_store( &ulBytesProgrammed, 0U );
+        atomic_store( &ulFlashWrites, 0U );
+        atomic_store( &ulFlashBusyTicks, 0U );
+        atomic_store( &ulSectorsErased, 0U );
+        xFileStartTick = xTaskGetTickCount();
+
+        #if otademoconfigENABLE_PRE_ERASE
+            /* The job owns the inactive slot until it is aborted or fails. */
+            vOtaPreEraseSuspend();
+        #endif /* otademoconfigENABLE_PRE_ERASE */
+
+        vOtaImageHashStart();
+
+        #if otademoconfigENABLE_EARLY_IMAGE_CHECK
+            vOtaImageCheckStart();
+        #endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+
+        #if otademoconfigENABLE_METRICS
+            vOtaMetricsStartFile( pFileContext->fileSize );
+        #endif /* otademoconfigENABLE_METRICS */
+
+        xFileFormat = FILE_FORMAT_IMAGE;
+
+        #if otademoconfigENABLE_DELTA
+            if( xOtaDeltaIsDeltaFile( pFileContext ) == true )
+            {
+                xFileFormat = FILE_FORMAT_DELTA;
+                vOtaDeltaStart();
+            }
+        #endif /* otademoconfigENABLE_DELTA */
+
+        #if otademoconfigENABLE_COMPRESSION
+            if( xOtaDecompressIsCompressedFile( pFileContext ) == true )
+            {
+                xFileFormat = FILE_FORMAT_COMPRESSED;
+                vOtaDecompressStart();
+            }
+        #endif /* otademoconfigENABLE_COMPRESSION */
+
+        #if otademoconfigENABLE_BUNDLE
+            /* Also forgets a bundle closed by an earlier job. */
+            vOtaBundleStart( pFileContext->fileSize );
+
+            if( xOtaBundleIsBundleFile( pFileContext ) == true )
+            {
+                xFileFormat = FILE_FORMAT_BUNDLE;
+            }
+        #endif /* otademoconfigENABLE_BUNDLE */
+
+        #if FLASH_WRITER_TRANSFORMS
+            ulNextFileOffset = 0U;
+            memset( xHeldBlocks, 0x00, sizeof( xHeldBlocks ) );
+        #endif /* FLASH_WRITER_TRANSFORMS */
+
+        #if otademoconfigENABLE_RESUME
+            /* Checkpoints record image blocks, which only map to file blocks
+             * when the file is the image. */
+            if( xFileFormat == FILE_FORMAT_IMAGE )
+            {
+                vOtaResumeStart( pFileContext );
+            }
+        #endif /* otademoconfigENABLE_RESUME */
+
+        prvFindPreparedSectors();
+
+        /* The OTA library only writes to a file with a handle. */
+        pFileContext->pFile = ( void * ) pxImageSlot;
+    }
+
+    return xRet;
+}
+
+int16_t sOtaFlashWriterWriteBlock( OtaFileContext_t * const pFileContext,
+                                   uint32_t ulOffset,
+                                   uint8_t * const pData,
+                                   uint32_t ulBlockSize )
+{
+    int16_t sRet = ( int16_t ) ulBlockSize;
+
+    configASSERT( pFileContext == pxWriterFileContext );
+    configASSERT( ulBlockSize <= FLASH_WRITER_CHUNK_SIZE );
+
+    if( atomic_load( &xWriteFailed ) == true )
+    {
+        sRet = -1;
+    }
+
+    #if otademoconfigENABLE_DIRECT_WRITE
+        else if( ( xFileFormat == FILE_FORMAT_IMAGE ) &&
+                 ( prvQueueDirectBlock( pFileContext, ulOffset, ulBlockSize ) == pdPASS ) )
+        {
+            /* Programmed from the event buffer. */
+        }
+    #endif /* otademoconfigENABLE_DIRECT_WRITE */
+    else if( xFileFormat == FILE_FORMAT_IMAGE )
+    {
+        prvQueueImageData( ulOffset, pData, ulBlockSize );
+    }
+
+    #if otademoconfigENABLE_BUNDLE
+        else if( xFileFormat == FILE_FORMAT_BUNDLE )
+        {
+            /* Payloads map to the slot by a shift, in any order. */
+            if( xOtaBundleWrite( ulOffset, pData, ulBlockSize, prvQueueImageData ) != pdPASS )
+            {
+                atomic_store( &xWriteFailed, true );
+                sRet = -1;
+            }
+        }
+    #endif /* otademoconfigENABLE_BUNDLE */
+
+    #if FLASH_WRITER_TRANSFORMS
+        else if( prvTransformBlock( ulOffset, pData, ulBlockSize ) != pdPASS )
+        {
+            atomic_store( &xWriteFailed, true );
+            sRet = -1;
+        }
+    #endif /* FLASH_WRITER_TRANSFORMS */
+    else
+    {
+        /* Block handed to the transform. */
+    }
+
+    /* The image data of this block may have been rejected. */
+    if( atomic_load( &xWriteFailed ) == true )
+    {
+        sRet = -1;
+    }
+
+    #if otademoconfigENABLE_METRICS
+        /* The OTA agent only writes blocks it did not have. */
+        if( sRet > 0 )
+        {
+            vOtaMetricsOnBlockWritten( ulBlockSize );
+        }
+    #endif /* otademoconfigENABLE_METRICS */
+
+    return sRet;
+}
+
+OtaPalStatus_t xOtaFlashWriterCloseFile( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t xRet;
+    uint32_t ulElapsedMs;
+    uint32_t ulBytes;
+
+    #if otademoconfigENABLE_BUNDLE
+        uint32_t ulSlotSize = 0U;
+    #endif /* otademoconfigENABLE_BUNDLE */
+
+    #if FLASH_WRITER_TRANSFORMS
+        uint32_t ulFileSize = pFileContext->fileSize;
+        uint32_t ulImageSize = 0U;
+
+        if( ( ( xFileFormat == FILE_FORMAT_DELTA ) || ( xFileFormat == FILE_FORMAT_COMPRESSED ) ) && ( atomic_load( &xWriteFailed ) == false ) )
+        {
+            if( prvTransformFinish( &ulImageSize ) != pdPASS )
+            {
+                atomic_store( &xWriteFailed, true );
+            }
+            else
+            {
+                /* The signature covers fileSize bytes of the slot, which is
+                 * now the image rather than the file. */
+                pFileContext->fileSize = ulImageSize;
+            }
+        }
+    #endif /* FLASH_WRITER_TRANSFORMS */
+
+    #if otademoconfigENABLE_BUNDLE
+        if( ( xFileFormat == FILE_FORMAT_BUNDLE ) && ( atomic_load( &xWriteFailed ) == false ) )
+        {
+            if( xOtaBundleFinish( prvQueueImageData, &ulSlotSize ) != pdPASS )
+            {
+                atomic_store( &xWriteFailed, true );
+            }
+            else
+            {
+                /* The signature covers the slot layout, which includes the
+                 * data files and the header. */
+                pFileContext->fileSize = ulSlotSize;
+            }
+        }
+    #endif /* otademoconfigENABLE_BUNDLE */
+
+    prvSubmitOpenChunks();
+    prvWaitForWriter();
+
+    ulElapsedMs = pdTICKS_TO_MS( xTaskGetTickCount() - xFileStartTick );
+    ulBytes = atomic_load( &ulBytesProgrammed );
+
+    ESP_LOGI( TAG,
+              "Programmed %" PRIu32 " bytes in %" PRIu32 " writes and %" PRIu32 " ms (%" PRIu32 " B/s), %" PRIu32 " sectors erased, flash busy %" PRIu32 " ms.",
+              ulBytes,
+              atomic_load( &ulFlashWrites ),
+              ulElapsedMs,
+              ( ulElapsedMs > 0U ) ? ( uint32_t ) ( ( ( uint64_t ) ulBytes * 1000U ) / ulElapsedMs ) : 0U,
+              atomic_load( &ulSectorsErased ),
+              ( uint32_t ) pdTICKS_TO_MS( atomic_load( &ulFlashBusyTicks ) ) );
+
+    #if FLASH_WRITER_TRANSFORMS
+        /* Estimate the time the full image would have taken at the same
+         * transfer rate. */
+        if( ( ulImageSize > ulFileSize ) && ( ulFileSize > 0U ) )
+        {
+            ESP_LOGI( TAG,
+                      "Transferred %" PRIu32 " bytes for a %" PRIu32 " byte image, saving about %" PRIu32 " ms.",
+                      ulFileSize,
+                      ulImageSize,
+                      ( uint32_t ) ( ( ( uint64_t ) ulElapsedMs * ( ulImageSize - ulFileSize ) ) / ulFileSize ) );
+        }
+    #endif /* FLASH_WRITER_TRANSFORMS */
+
+    if( atomic_load( &xWriteFailed ) == true )
+    {
+        xRet = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+    else if( xOtaImageHashVerify( pFileContext ) != pdPASS )
+    {
+        xRet = OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
+    }
+    else
+    {
+        xRet = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+        xImageVerified = true;
+    }
+
+    pFileContext->pFile = NULL;
+
+    #if otademoconfigENABLE_RESUME
+        vOtaResumeFinish();
+    #endif /* otademoconfigENABLE_RESUME */
+
+    #if otademoconfigENABLE_METRICS
+        vOtaMetricsFinishFile();
+    #endif /* otademoconfigENABLE_METRICS */
+
+    #if otademoconfigENABLE_PRE_ERASE
+        /* A closed image waits in the inactive slot for activation. */
+        if( OTA_PAL_MAIN_ERR( xRet ) != OtaPalSuccess )
+        {
+            vOtaPreEraseResume();
+        }
+    #endif /* otademoconfigENABLE_PRE_ERASE */
+
+    return xRet;
+}
+
+OtaPalStatus_t xOtaFlashWriterAbort( OtaFileContext_t * const pFileContext )
+{
+    /* A closed file has released the slot already. */
+    if( pFileContext->pFile != NULL )
+    {
+        /* Return the chunks being filled, and have the writer drop the queued
+         * ones. */
+        while( ulOpenChunkCount > 0U )
+        {
+            ulOpenChunkCount--;
+            ( void ) xQueueSend( xFreeQueue, &pxOpenChunks[ ulOpenChunkCount ], portMAX_DELAY );
+        }
+
+        atomic_store( &xDiscardChunks, true );
+        prvWaitForWriter();
+        atomic_store( &xDiscardChunks, false );
+
+        pFileContext->pFile = NULL;
+
+        #if otademoconfigENABLE_RESUME
+            vOtaResumeFinish();
+        #endif /* otademoconfigENABLE_RESUME */
+
+        #if otademoconfigENABLE_METRICS
+            vOtaMetricsFinishFile();
+        #endif /* otademoconfigENABLE_METRICS */
+
+        #if otademoconfigENABLE_PRE_ERASE
+            vOtaPreEraseResume();
+        #endif /* otademoconfigENABLE_PRE_ERASE */
+    }
+
+    return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+}
+
+OtaPalStatus_t xOtaFlashWriterActivateNewImage( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t xRet = OTA_PAL_COMBINE_ERR( OtaPalActivateFailed, 0 );
+    esp_err_t xEspErrRet;
+
+    if( xImageVerified == false )
+    {
+        ESP_LOGE( TAG, "No verified image to activate." );
+    }
+    else
+    {
+        /* Checks the image format, the signature was checked at close. */
+        xEspErrRet = esp_ota_set_boot_partition( pxImageSlot );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to boot from %s. Error: %s",
+                      pxImageSlot->label,
+                      esp_err_to_name( xEspErrRet ) );
+        }
+        else
+        {
+            xRet = otaPal_ResetDevice( pFileContext );
+        }
+    }
+
+    return xRet;
+}
+
+OtaPalStatus_t xOtaFlashWriterSetPlatformImageState( OtaFileContext_t * const pFileContext,
+                                                     OtaImageState_t eState )
+{
+    OtaPalStatus_t xRet = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+
+    /* The PAL applies a rejection without a file of its own to the running
+     * image. The image of this boot's file is only in the inactive slot. */
+    if( ( xFileCreated == true ) &&
+        ( ( eState == OtaImageStateRejected ) || ( eState == OtaImageStateAborted ) ) )
+    {
+        ESP_LOGI( TAG,
+                  "Image in %s %s.",
+                  ( pxImageSlot != NULL ) ? pxImageSlot->label : "the inactive slot",
+                  ( eState == OtaImageStateRejected ) ? "rejected" : "aborted" );
+
+        #if otademoconfigENABLE_PRE_ERASE
+            /* A closed image kept the slot from being erased until it was
+             * activated, which it no longer will be. */
+            if( xImageVerified == true )
+            {
+                vOtaPreEraseResume();
+            }
+        #endif /* otademoconfigENABLE_PRE_ERASE */
+
+        xImageVerified = false;
+    }
+    else
+    {
+        xRet = otaPal_SetPlatformImageState( pFileContext, eState );
+    }
+
+    return xRet;
+}
@@ -0,0 +1,122 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_flash_writer.h
+ * @brief Flash writer stage of the OTA download.
+ *
+ * Replaces the write, create, close, abort and activate functions of the OTA
+ * PAL. Flash programming runs in a dedicated task, overlapping with network
+ * receive in the coreMQTT-Agent task and block decoding in the OTA agent task,
+ * and the writer erases and programs the inactive OTA slot itself.
+ */
+#ifndef OTA_FLASH_WRITER_H
+#define OTA_FLASH_WRITER_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library interface include. */
+#include "ota_platform_interface.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Create the flash writer task and its chunk buffers.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xOtaFlashWriterInit( void );
+
+/**
+ * @brief PAL create file function. Resets the writer for the inactive OTA
+ * slot. Sectors are erased as they are first programmed, except those
+ * already erased in the background with otademoconfigENABLE_PRE_ERASE.
+ */
+OtaPalStatus_t xOtaFlashWriterCreateFile( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief PAL write block function. Copies the block into the chunk of its
+ * sector and hands complete sectors to the writer task.
+ *
+ * Only blocks when every chunk is waiting to be programmed.
+ *
+ * @return The block size if the block was accepted, -1 if an earlier write
+ * failed or, with otademoconfigENABLE_EARLY_IMAGE_CHECK, the image header was
+ * rejected.
+ */
+int16_t sOtaFlashWriterWriteBlock( OtaFileContext_t * const pFileContext,
+                                   uint32_t ulOffset,
+                                   uint8_t * const pData,
+                                   uint32_t ulBlockSize );
+
+/**
+ * @brief PAL close file function. Waits for every chunk to be programmed, then
+ * checks the signature of the file against the image in the slot.
+ *
+ * @return OtaPalSuccess if the image can be activated, OtaPalFileClose if a
+ * write failed and OtaPalSignatureCheckFailed if the signature does not
+ * match.
+ */
+OtaPalStatus_t xOtaFlashWriterCloseFile( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief PAL abort function. Discards the chunks not yet programmed and
+ * releases the slot, unless the file was closed already.
+ */
+OtaPalStatus_t xOtaFlashWriterAbort( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief PAL activate function. Boots from the slot of the image last closed,
+ * if it passed its signature check, then calls otaPal_ResetDevice.
+ */
+OtaPalStatus_t xOtaFlashWriterActivateNewImage( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief PAL set image state function. Keeps a rejected or aborted image of a
+ * file created since boot from being activated, and passes every other state
+ * to otaPal_SetPlatformImageState.
+ *
+ * Without a file of its own, the OTA PAL would apply the rejection to the
+ * running image.
+ */
+OtaPalStatus_t xOtaFlashWriterSetPlatformImageState( OtaFileContext_t * const pFileContext,
+                                                     OtaImageState_t eState );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_FLASH_WRITER_H */
@@ -0,0 +1,348 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_image_check.c
+ * @brief Early validation of the header of OTA images.
+ *
+ * Collects the image header, the first segment header and the application
+ * descriptor, then checks the chip the image was built for, its version
+ * against the version of the running application and, with anti-rollback,
+ * its secure version. Both versions come from the application descriptors,
+ * so they are set the same way, with PROJECT_VER.
+ *
+ * The OTA agent reports a rejected block write without a reason, so the
+ * reason is added to the details of the job status update that fails the
+ * job.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+#include "esp_app_format.h"
+#include "esp_app_desc.h"
+#include "hal/efuse_hal.h"
+#include "sdkconfig.h"
+
+#if CONFIG_BOOTLOADER_APP_ANTI_ROLLBACK
+    #include "esp_efuse.h"
+#endif /* CONFIG_BOOTLOADER_APP_ANTI_ROLLBACK */
+
+/* OTA library include. */
+#include "ota_appversion32.h"
+
+/* Public functions include. */
+#include "ota_image_check.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Offset of the application descriptor, which starts the first
+ * segment of an application image.
+ */
+#define IMAGE_CHECK_APP_DESC_OFFSET \
+    ( sizeof( esp_image_header_t ) + sizeof( esp_image_segment_header_t ) )
+
+/**
+ * @brief Length of the start of the image that is checked.
+ */
+#define IMAGE_CHECK_LENGTH    ( IMAGE_CHECK_APP_DESC_OFFSET + sizeof( esp_app_desc_t ) )
+
+/**
+ * @brief Suffix of the topic of job status updates.
+ */
+#define IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX           "/update"
+#define IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX_LENGTH    ( sizeof( IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX ) - 1U )
+
+/**
+ * @brief Start of the job status updates that fail a job.
+ */
+#define IMAGE_CHECK_JOB_FAILED_PREFIX                 "{\"status\":\"FAILED\""
+#define IMAGE_CHECK_JOB_FAILED_PREFIX_LENGTH          ( sizeof( IMAGE_CHECK_JOB_FAILED_PREFIX ) - 1U )
+
+/**
+ * @brief Size of the job status update with the reason added.
+ */
+#define IMAGE_CHECK_JOB_UPDATE_MAX_SIZE               ( 256U )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_image_check";
+
+/**
+ * @brief The start of the image, and the number of its bytes received in
+ * order.
+ */
+static uint8_t ucImageStart[ IMAGE_CHECK_LENGTH ];
+static uint32_t ulImageStartLength = 0U;
+
+/**
+ * @brief Outcome of the check of the current image.
+ */
+static OtaImageCheckResult_t xResult = OtaImageCheckPending;
+
+/**
+ * @brief Whether the rejection of the current image was added to a job
+ * status update.
+ */
+static bool xReported = false;
+
+/**
+ * @brief Job status update with the reason of the rejection added.
+ */
+static char cJobUpdateBuffer[ IMAGE_CHECK_JOB_UPDATE_MAX_SIZE ];
+
+/**
+ * @brief Reasons reported in job status updates, indexed by
+ * OtaImageCheckResult_t.
+ */
+static const char * const pcResultNames[] =
+{
+    "pending",
+    "passed",
+    "bad_magic",
+    "wrong_chip",
+    "bad_app_descriptor",
+    "not_newer",
+    "revoked_secure_version"
+};
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Parse a "major.minor.build" version, optionally prefixed with 'v'
+ * and followed by a '-' suffix, as set with PROJECT_VER.
+ *
+ * @return true if the version was parsed.
+ */
+static bool prvParseVersion( const char * pcVersion,
+                             AppVersion32_t * pxVersion );
+
+/**
+ * @brief Check the collected start of the image.
+ */
+static OtaImageCheckResult_t prvCheckImage( void );
+
+/* Static function definitions ************************************************/
+
+static bool prvParseVersion( const char * pcVersion,
+                             AppVersion32_t * pxVersion )
+{
+    unsigned int uMajor = 0U;
+    unsigned int uMinor = 0U;
+    unsigned int uBuild = 0U;
+    char cNext = '\0';
+    int lFields;
+    bool xRet = false;
+
+    if( pcVersion[ 0 ] == 'v' )
+    {
+        pcVersion++;
+    }
+
+    lFields = sscanf( pcVersion, "%u.%u.%u%c", &uMajor, &uMinor, &uBuild, &cNext );
+
+    if( ( ( lFields == 3 ) || ( ( lFields == 4 ) && ( cNext == '-' ) ) ) &&
+        ( uMajor <= UINT8_MAX ) && ( uMinor <= UINT8_MAX ) && ( uBuild <= UINT16_MAX ) )
+    {
+        pxVersion->u.x.major = ( uint8_t ) uMajor;
+        pxVersion->u.x.minor = ( uint8_t ) uMinor;
+        pxVersion->u.x.build = ( uint16_t ) uBuild;
+        xRet = true;
+    }
+
+    return xRet;
+}
+
+static OtaImageCheckResult_t prvCheckImage( void )
+{
+    OtaImageCheckResult_t xRet = OtaImageCheckPassed;
+    esp_image_header_t xHeader;
+    esp_app_desc_t xAppDesc;
+    const esp_app_desc_t * pxRunningAppDesc = esp_app_get_description();
+    AppVersion32_t xVersion = { 0 };
+    AppVersion32_t xRunningVersion = { 0 };
+    unsigned int uChipRevision = efuse_hal_chip_revision();
+
+    memcpy( &xHeader, ucImageStart, sizeof( xHeader ) );
+    memcpy( &xAppDesc, &ucImageStart[ IMAGE_CHECK_APP_DESC_OFFSET ], sizeof( xAppDesc ) );
+
+    /* Ensure the version string is terminated. */
+    xAppDesc.version[ sizeof( xAppDesc.version ) - 1U ] = '\0';
+
+    if( xHeader.magic != ESP_IMAGE_HEADER_MAGIC )
+    {
+        ESP_LOGE( TAG, "Not an application image, magic 0x%02x.", xHeader.magic );
+        xRet = OtaImageCheckBadMagic;
+    }
+    else if( xHeader.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID )
+    {
+        ESP_LOGE( TAG, "Image built for chip ID %u, this device is %u.",
+                  ( unsigned int ) xHeader.chip_id,
+                  ( unsigned int ) CONFIG_IDF_FIRMWARE_CHIP_ID );
+        xRet = OtaImageCheckWrongChip;
+    }
+    else if( ( uChipRevision < xHeader.min_chip_rev_full ) || ( uChipRevision > xHeader.max_chip_rev_full ) )
+    {
+        ESP_LOGE( TAG, "Image supports chip revisions %u to %u, this device is %u.",
+                  ( unsigned int ) xHeader.min_chip_rev_full,
+                  ( unsigned int ) xHeader.max_chip_rev_full,
+                  uChipRevision );
+        xRet = OtaImageCheckWrongChip;
+    }
+    else if( xAppDesc.magic_word != ESP_APP_DESC_MAGIC_WORD )
+    {
+        ESP_LOGE( TAG, "Image has no application descriptor." );
+        xRet = OtaImageCheckBadAppDescriptor;
+    }
+    else if( prvParseVersion( xAppDesc.version, &xVersion ) == false )
+    {
+        /* The OTA agent still checks the version during the self test. */
+        ESP_LOGW( TAG, "Image version \"%s\" is not major.minor.build, not checked.", xAppDesc.version );
+    }
+    else if( prvParseVersion( pxRunningAppDesc->version, &xRunningVersion ) == false )
+    {
+        ESP_LOGW( TAG, "Running version \"%s\" is not major.minor.build, image version not checked.",
+                  pxRunningAppDesc->version );
+    }
+    else if( xVersion.u.unsignedVersion32 <= xRunningVersion.u.unsignedVersion32 )
+    {
+        ESP_LOGE( TAG, "Image version %s is not newer than the running %s.",
+                  xAppDesc.version,
+                  pxRunningAppDesc->version );
+        xRet = OtaImageCheckNotNewer;
+    }
+    else
+    {
+        /* Version checked. */
+    }
+
+    #if CONFIG_BOOTLOADER_APP_ANTI_ROLLBACK
+        if( ( xRet == OtaImageCheckPassed ) && ( esp_efuse_check_secure_version( xAppDesc.secure_version ) == false ) )
+        {
+            ESP_LOGE( TAG, "Image secure version %" PRIu32 " is revoked.", xAppDesc.secure_version );
+            xRet = OtaImageCheckRevokedSecureVersion;
+        }
+    #endif /* CONFIG_BOOTLOADER_APP_ANTI_ROLLBACK */
+
+    if( xRet == OtaImageCheckPassed )
+    {
+        ESP_LOGI( TAG, "Image %s version %s accepted.", xAppDesc.project_name, xAppDesc.version );
+    }
+
+    return xRet;
+}
+
+/* Public function definitions ************************************************/
+
+void vOtaImageCheckStart( void )
+{
+    ulImageStartLength = 0U;
+    xResult = OtaImageCheckPending;
+    xReported = false;
+}
+
+OtaImageCheckResult_t xOtaImageCheckFeed( uint32_t ulOffset,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength )
+{
+    uint32_t ulCopyLength;
+
+    /* Only data extending the collected start is needed. */
+    if( ( xResult == OtaImageCheckPending ) &&
+        ( ulOffset <= ulImageStartLength ) &&
+        ( ( ulOffset + ulLength ) > ulImageStartLength ) )
+    {
+        ulCopyLength = ( ulOffset + ulLength ) - ulImageStartLength;
+        ulCopyLength = ( ulCopyLength < ( IMAGE_CHECK_LENGTH - ulImageStartLength ) ) ?
+                       ulCopyLength : ( IMAGE_CHECK_LENGTH - ulImageStartLength );
+
+        memcpy( &ucImageStart[ ulImageStartLength ], &pucData[ ulImageStartLength - ulOffset ], ulCopyLength );
+        ulImageStartLength += ulCopyLength;
+
+        if( ulImageStartLength == IMAGE_CHECK_LENGTH )
+        {
+            xResult = prvCheckImage();
+        }
+    }
+
+    return xResult;
+}
+
+OtaImageCheckResult_t xOtaImageCheckGetResult( void )
+{
+    return xResult;
+}
+
+const char * pcOtaImageCheckApplyJobStatus( const char * pcTopic,
+                                            uint16_t usTopicLength,
+                                            const char * pcMessage,
+                                            uint32_t * pulMessageLength )
+{
+    const char * pcRet = pcMessage;
+    uint32_t ulLength = *pulMessageLength;
+    int lAdded;
+
+    if( ( xResult > OtaImageCheckPassed ) &&
+        ( xReported == false ) &&
+        ( usTopicLength > IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX_LENGTH ) &&
+        ( memcmp( &pcTopic[ usTopicLength - IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX_LENGTH ],
+                  IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX,
+                  IMAGE_CHECK_JOB_UPDATE_TOPIC_SUFFIX_LENGTH ) == 0 ) &&
+        ( ulLength > IMAGE_CHECK_JOB_FAILED_PREFIX_LENGTH ) &&
+        ( ulLength < sizeof( cJobUpdateBuffer ) ) &&
+        ( memcmp( pcMessage, IMAGE_CHECK_JOB_FAILED_PREFIX, IMAGE_CHECK_JOB_FAILED_PREFIX_LENGTH ) == 0 ) &&
+        ( pcMessage[ ulLength - 2U ] == '}' ) &&
+        ( pcMessage[ ulLength - 1U ] == '}' ) )
+    {
+        /* The status details are the last object of the update. */
+        memcpy( cJobUpdateBuffer, pcMessage, ulLength - 2U );
+        lAdded = snprintf( &cJobUpdateBuffer[ ulLength - 2U ],
+                           sizeof( cJobUpdateBuffer ) - ( ulLength - 2U ),
+                           ",\"image_check\":\"%s\"}}",
+                           pcResultNames[ xResult ] );
+
+        if( ( lAdded > 0 ) && ( ( uint32_t ) lAdded < ( sizeof( cJobUpdateBuffer ) - ( ulLength - 2U ) ) ) )
+        {
+            *pulMessageLength = ( ulLength - 2U ) + ( uint32_t ) lAdded;
+            pcRet = cJobUpdateBuffer;
+            xReported = true;
+        }
+    }
+
+    return pcRet;
+}
@@ -0,0 +1,113 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_image_check.h
+ * @brief Early validation of the header of OTA images.
+ *
+ * The image header and the application descriptor sit in the first few
+ * hundred bytes of an image. Checking them as soon as they are received fails
+ * a job for the wrong chip, an older version or a revoked secure version
+ * after one block instead of after the whole download.
+ */
+#ifndef OTA_IMAGE_CHECK_H
+#define OTA_IMAGE_CHECK_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Outcome of the image check. Values from OtaImageCheckBadMagic on
+ * reject the image.
+ */
+typedef enum OtaImageCheckResult
+{
+    OtaImageCheckPending = 0,        /**< The start of the image has not been received yet. */
+    OtaImageCheckPassed,             /**< The image can run on this device. */
+    OtaImageCheckBadMagic,           /**< The file is not an ESP-IDF application image. */
+    OtaImageCheckWrongChip,          /**< The image targets another chip or chip revision. */
+    OtaImageCheckBadAppDescriptor,   /**< The application descriptor is missing. */
+    OtaImageCheckNotNewer,           /**< The image version is not newer than the running one. */
+    OtaImageCheckRevokedSecureVersion /**< The secure version is below the anti-rollback eFuse. */
+} OtaImageCheckResult_t;
+
+/**
+ * @brief Start checking a new image.
+ */
+void vOtaImageCheckStart( void );
+
+/**
+ * @brief Pass a range of the image to the check. Ranges past the start of the
+ * image are ignored, and the check runs once the start is complete.
+ *
+ * @param[in] ulOffset Offset of the range in the image.
+ * @param[in] pucData Content of the range.
+ * @param[in] ulLength Length of the range in bytes.
+ *
+ * @return The outcome of the check so far.
+ */
+OtaImageCheckResult_t xOtaImageCheckFeed( uint32_t ulOffset,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength );
+
+/**
+ * @brief Get the outcome of the check of the current image.
+ */
+OtaImageCheckResult_t xOtaImageCheckGetResult( void );
+
+/**
+ * @brief Add the reason the current image was rejected to the job status
+ * update that fails its job, as "image_check" in the status details. Other
+ * messages are returned unchanged.
+ *
+ * The returned message stays valid until the next call.
+ *
+ * @param[in] pcTopic Topic of the message.
+ * @param[in] usTopicLength Length of the topic.
+ * @param[in] pcMessage The message the OTA agent publishes.
+ * @param[in,out] pulMessageLength Length of the message, updated to the
+ * length of the returned message.
+ *
+ * @return The message to publish.
+ */
+const char * pcOtaImageCheckApplyJobStatus( const char * pcTopic,
+                                            uint16_t usTopicLength,
+                                            const char * pcMessage,
+                                            uint32_t * pulMessageLength );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_IMAGE_CHECK_H */
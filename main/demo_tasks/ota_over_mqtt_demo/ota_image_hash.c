@@ -0,0 +1,333 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_image_hash.c
+ * @brief Incremental hashing and signature verification of OTA images.
+ *
+ * Ranges are recorded by the flash writer task once they are programmed. The
+ * digest covers the contiguous prefix of the image hashed so far. A range
+ * programmed ahead of the prefix is remembered in a bitmap of whole units and
+ * read back from flash once the prefix reaches it, so out of order blocks cost
+ * one read each and in order images are never read back. Hashing is started
+ * before any range is queued and verified after the writer has drained, so the
+ * state needs no locking.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* MbedTLS includes. */
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_image_hash.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Granularity at which ranges programmed ahead of the prefix are
+ * tracked. Programmed ranges start on a block or sector boundary, so either
+ * is a multiple of it.
+ */
+#define HASH_UNIT_SIZE                                  \
+    ( ( OTA_FILE_BLOCK_SIZE < 4096U ) ? OTA_FILE_BLOCK_SIZE : 4096U )
+
+/**
+ * @brief Number of units tracked, enough for the largest file the block
+ * bitmap of the OTA library allows. Units beyond it are read back at close.
+ */
+#define HASH_MAX_UNITS                                  \
+    ( OTA_MAX_BLOCK_BITMAP_SIZE * 8U * ( OTA_FILE_BLOCK_SIZE / HASH_UNIT_SIZE ) )
+
+/**
+ * @brief Size of the reads used to hash ranges from flash.
+ */
+#define HASH_READ_SIZE       ( 512U )
+
+/**
+ * @brief Length of a SHA-256 digest.
+ */
+#define HASH_DIGEST_LENGTH    ( 32U )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_image_hash";
+
+/**
+ * @brief PEM code signing certificate.
+ */
+static const char * pcCodeSigningCertificate = NULL;
+
+/**
+ * @brief Digest of the first ulHashedLength bytes of the image.
+ */
+static mbedtls_sha256_context xImageHashContext;
+static uint32_t ulHashedLength = 0U;
+
+/**
+ * @brief Units programmed ahead of the hashed prefix.
+ */
+static uint8_t ucPendingUnits[ ( HASH_MAX_UNITS + 7U ) / 8U ];
+
+/**
+ * @brief Slot the image is programmed to.
+ */
+static const esp_partition_t * pxImageSlot = NULL;
+
+/**
+ * @brief Bytes read back from flash, and whether a read failed.
+ */
+static uint32_t ulReadBackLength = 0U;
+static bool xReadFailed = false;
+
+/**
+ * @brief Buffer for reads from flash.
+ */
+static uint8_t ucReadBuffer[ HASH_READ_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Remember that a unit has been programmed.
+ */
+static void prvSetPending( uint32_t ulUnit );
+
+/**
+ * @brief Check whether a unit has been programmed, forgetting it if so.
+ */
+static bool prvTakePending( uint32_t ulUnit );
+
+/**
+ * @brief Extend the digest up to ulEnd with the content of the slot.
+ */
+static void prvHashFromFlash( uint32_t ulEnd );
+
+/* Static function definitions ************************************************/
+
+static void prvSetPending( uint32_t ulUnit )
+{
+    if( ulUnit < HASH_MAX_UNITS )
+    {
+        ucPendingUnits[ ulUnit / 8U ] |= ( uint8_t ) ( 1U << ( ulUnit % 8U ) );
+    }
+}
+
+static bool prvTakePending( uint32_t ulUnit )
+{
+    bool xRet = false;
+
+    if( ulUnit < HASH_MAX_UNITS )
+    {
+        xRet = ( ucPendingUnits[ ulUnit / 8U ] & ( 1U << ( ulUnit % 8U ) ) ) != 0U;
+        ucPendingUnits[ ulUnit / 8U ] &= ( uint8_t ) ~( 1U << ( ulUnit % 8U ) );
+    }
+
+    return xRet;
+}
+
+static void prvHashFromFlash( uint32_t ulEnd )
+{
+    uint32_t ulReadLength;
+    esp_err_t xEspErrRet;
+
+    if( ( pxImageSlot == NULL ) && ( ulHashedLength < ulEnd ) )
+    {
+        ESP_LOGE( TAG, "No OTA slot to read the image from." );
+        xReadFailed = true;
+    }
+
+    while( ( ulHashedLength < ulEnd ) && ( xReadFailed == false ) )
+    {
+        ulReadLength = ( ( ulEnd - ulHashedLength ) < HASH_READ_SIZE ) ? ( ulEnd - ulHashedLength ) : HASH_READ_SIZE;
+        xEspErrRet = esp_partition_read( pxImageSlot, ulHashedLength, ucReadBuffer, ulReadLength );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG, "Failed to read the image at offset %" PRIu32 ": %s.", ulHashedLength, esp_err_to_name( xEspErrRet ) );
+            xReadFailed = true;
+        }
+        else
+        {
+            ( void ) mbedtls_sha256_update( &xImageHashContext, ucReadBuffer, ulReadLength );
+            ulHashedLength += ulReadLength;
+            ulReadBackLength += ulReadLength;
+        }
+    }
+}
+
+/* Public function definitions ************************************************/
+
+void vOtaImageHashSetCertificate( const char * pcCertificatePem )
+{
+    pcCodeSigningCertificate = pcCertificatePem;
+}
+
+void vOtaImageHashStart( void )
+{
+    mbedtls_sha256_free( &xImageHashContext );
+    mbedtls_sha256_init( &xImageHashContext );
+    ( void ) mbedtls_sha256_starts( &xImageHashContext, 0 );
+    ulHashedLength = 0U;
+    ulReadBackLength = 0U;
+    xReadFailed = false;
+    memset( ucPendingUnits, 0x00, sizeof( ucPendingUnits ) );
+    pxImageSlot = esp_ota_get_next_update_partition( NULL );
+}
+
+void vOtaImageHashRecordWrite( uint32_t ulOffset,
+                               const uint8_t * pucData,
+                               uint32_t ulLength )
+{
+    uint32_t ulEnd = ulOffset + ulLength;
+    uint32_t ulUnit;
+
+    if( ( ulOffset <= ulHashedLength ) && ( ulEnd > ulHashedLength ) )
+    {
+        ( void ) mbedtls_sha256_update( &xImageHashContext,
+                                        &pucData[ ulHashedLength - ulOffset ],
+                                        ulEnd - ulHashedLength );
+        ulHashedLength = ulEnd;
+
+        /* Catch up over the units programmed ahead of the prefix. */
+        while( ( ( ulHashedLength % HASH_UNIT_SIZE ) == 0U ) &&
+               ( xReadFailed == false ) &&
+               ( prvTakePending( ulHashedLength / HASH_UNIT_SIZE ) == true ) )
+        {
+            prvHashFromFlash( ulHashedLength + HASH_UNIT_SIZE );
+        }
+    }
+    else if( ulOffset > ulHashedLength )
+    {
+        /* Only whole units are tracked. A partial unit is read back at
+         * close. */
+        for( ulUnit = ( ulOffset + HASH_UNIT_SIZE - 1U ) / HASH_UNIT_SIZE;
+             ( ( ulUnit + 1U ) * HASH_UNIT_SIZE ) <= ulEnd;
+             ulUnit++ )
+        {
+            prvSetPending( ulUnit );
+        }
+    }
+    else
+    {
+        /* Already hashed. */
+    }
+}
+
+BaseType_t xOtaImageHashVerify( const OtaFileContext_t * pFileContext )
+{
+    BaseType_t xRet = pdFAIL;
+    uint8_t ucDigest[ HASH_DIGEST_LENGTH ];
+    mbedtls_x509_crt xCertificate;
+    int lMbedtlsRet;
+    TickType_t xStartTick = xTaskGetTickCount();
+
+    configASSERT( pFileContext != NULL );
+
+    prvHashFromFlash( pFileContext->fileSize );
+
+    if( xReadFailed == true )
+    {
+        ESP_LOGE( TAG, "Image digest is incomplete." );
+    }
+    else if( ulHashedLength != pFileContext->fileSize )
+    {
+        ESP_LOGE( TAG,
+                  "Programmed %" PRIu32 " bytes for a %" PRIu32 " byte file.",
+                  ulHashedLength,
+                  pFileContext->fileSize );
+    }
+    else if( ( pcCodeSigningCertificate == NULL ) || ( pFileContext->pSignature == NULL ) )
+    {
+        ESP_LOGE( TAG, "No code signing certificate or signature to verify the image with." );
+    }
+    else
+    {
+        ( void ) mbedtls_sha256_finish( &xImageHashContext, ucDigest );
+
+        mbedtls_x509_crt_init( &xCertificate );
+        lMbedtlsRet = mbedtls_x509_crt_parse( &xCertificate,
+                                              ( const unsigned char * ) pcCodeSigningCertificate,
+                                              strlen( pcCodeSigningCertificate ) + 1U );
+
+        if( lMbedtlsRet == 0 )
+        {
+            lMbedtlsRet = mbedtls_pk_verify( &xCertificate.pk,
+                                             MBEDTLS_MD_SHA256,
+                                             ucDigest,
+                                             sizeof( ucDigest ),
+                                             pFileContext->pSignature->data,
+                                             pFileContext->pSignature->size );
+        }
+
+        if( lMbedtlsRet != 0 )
+        {
+            ESP_LOGE( TAG, "Image signature verification failed: -0x%04x.", ( unsigned int ) -lMbedtlsRet );
+        }
+        else
+        {
+            ESP_LOGI( TAG,
+                      "Image signature verified in %" PRIu32 " ms, %" PRIu32 " of %" PRIu32 " bytes read back.",
+                      ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() - xStartTick ),
+                      ulReadBackLength,
+                      pFileContext->fileSize );
+            xRet = pdPASS;
+        }
+
+        mbedtls_x509_crt_free( &xCertificate );
+    }
+
+    mbedtls_sha256_free( &xImageHashContext );
+
+    return xRet;
+}
@@ -0,0 +1,93 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_image_hash.h
+ * @brief Incremental hashing and signature verification of OTA images.
+ *
+ * The flash writer checks the signature of every image it closes. With
+ * otademoconfigENABLE_INCREMENTAL_HASH the digest is updated as the image is
+ * programmed, so the signature can be checked without reading the image
+ * back. Ranges programmed ahead of the hashed prefix are read back from flash
+ * once the prefix reaches them, and anything not recorded, such as blocks
+ * restored after a reboot or the whole image without the option, is read
+ * back at close.
+ */
+#ifndef OTA_IMAGE_HASH_H
+#define OTA_IMAGE_HASH_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library interface include. */
+#include "ota_platform_interface.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Set the PEM code signing certificate that signatures are checked
+ * against. Must be called before the OTA demo is started.
+ */
+void vOtaImageHashSetCertificate( const char * pcCertificatePem );
+
+/**
+ * @brief Start hashing a new image.
+ */
+void vOtaImageHashStart( void );
+
+/**
+ * @brief Record a range of the image that has been programmed to flash.
+ *
+ * @param[in] ulOffset Offset of the range in the image.
+ * @param[in] pucData Content of the range.
+ * @param[in] ulLength Length of the range in bytes.
+ */
+void vOtaImageHashRecordWrite( uint32_t ulOffset,
+                               const uint8_t * pucData,
+                               uint32_t ulLength );
+
+/**
+ * @brief Complete the digest over the first fileSize bytes of the image and
+ * check the signature of the file against it.
+ *
+ * @return pdPASS if the signature is valid, pdFAIL otherwise.
+ */
+BaseType_t xOtaImageHashVerify( const OtaFileContext_t * pFileContext );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_IMAGE_HASH_H */
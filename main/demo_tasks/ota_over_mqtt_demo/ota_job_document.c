@@ -0,0 +1,462 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_job_document.c
+ * @brief Handling of job documents larger than an OTA event buffer.
+ *
+ * The document is searched in place with coreJSON, so no copy of it is made
+ * besides the smaller document handed to the OTA agent.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+
+/* coreJSON include. */
+#include "core_json.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* coreMQTT-Agent network manager configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+#if configMQTT_AGENT_RPC
+    /* coreMQTT-Agent request/response layer include. */
+    #include "core_mqtt_agent_rpc.h"
+#endif /* configMQTT_AGENT_RPC */
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_job_document.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Maximum length of an AWS IoT job ID.
+ */
+#define JOB_DOCUMENT_MAX_JOB_ID_LENGTH    ( 64U )
+
+/**
+ * @brief Job status update topic, "$aws/things/<thing>/jobs/<job ID>/update".
+ */
+#define JOB_DOCUMENT_TOPIC_PREFIX         "$aws/things/" CONFIG_GRI_THING_NAME "/jobs/"
+#define JOB_DOCUMENT_TOPIC_SUFFIX         "/update"
+#define JOB_DOCUMENT_TOPIC_SIZE                           \
+    ( sizeof( JOB_DOCUMENT_TOPIC_PREFIX ) - 1U +          \
+      JOB_DOCUMENT_MAX_JOB_ID_LENGTH +                    \
+      sizeof( JOB_DOCUMENT_TOPIC_SUFFIX ) )
+
+/**
+ * @brief Job status update failing the job.
+ */
+#define JOB_DOCUMENT_REJECT_FORMAT \
+    "{\"status\":\"FAILED\",\"statusDetails\":{\"reason\":\"job document too large\",\"size\":\"%u\"}}"
+#define JOB_DOCUMENT_REJECT_SIZE          ( sizeof( JOB_DOCUMENT_REJECT_FORMAT ) + 10U )
+
+#if configMQTT_AGENT_RPC
+
+/**
+ * @brief Time to wait for the response to the job status update.
+ */
+    #define JOB_DOCUMENT_RESPONSE_TIMEOUT_MS    ( 10000U )
+#endif /* configMQTT_AGENT_RPC */
+
+/* Type definitions ***********************************************************/
+
+/**
+ * @brief Buffer the smaller job document is appended to.
+ */
+typedef struct JobDocumentWriter
+{
+    uint8_t * pucBuffer;
+    size_t xSize;
+    size_t xLength;
+    bool xOverflow;
+} JobDocumentWriter_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_job_document";
+
+#if !configMQTT_AGENT_RPC
+
+/**
+ * @brief Global MQTT Agent context used to publish the job status update.
+ */
+    extern MQTTAgentContext_t xGlobalMqttAgentContext;
+#endif /* !configMQTT_AGENT_RPC */
+
+/**
+ * @brief Topic and payload of the job status update, kept until it is
+ * acknowledged.
+ */
+static char cRejectTopic[ JOB_DOCUMENT_TOPIC_SIZE ];
+static char cRejectPayload[ JOB_DOCUMENT_REJECT_SIZE ];
+
+/**
+ * @brief Set while the job status update is in flight.
+ */
+static volatile bool xRejectInFlight = false;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Find a value in the job document.
+ *
+ * @param[in] pcDocument The job document.
+ * @param[in] xDocumentLength Length of the job document.
+ * @param[in] pcQuery coreJSON query of the value.
+ * @param[out] ppcValue The value, including the quotes of a string.
+ * @param[out] pxValueLength Length of the value.
+ *
+ * @return true if the value is found.
+ */
+static bool prvFind( const char * pcDocument,
+                     size_t xDocumentLength,
+                     const char * pcQuery,
+                     const char ** ppcValue,
+                     size_t * pxValueLength );
+
+/**
+ * @brief Append text to the smaller document.
+ */
+static void prvAppend( JobDocumentWriter_t * pxWriter,
+                       const char * pcText,
+                       size_t xLength );
+
+/**
+ * @brief Append a member of the job document to the smaller document.
+ *
+ * @param[in] pxWriter The smaller document.
+ * @param[in] pcDocument The job document.
+ * @param[in] xDocumentLength Length of the job document.
+ * @param[in] pcQuery coreJSON query of the value.
+ * @param[in] pcKey Key of the member, quoted and followed by a colon.
+ * @param[in,out] pxFirst Whether the member is the first of its object.
+ *
+ * @return true if the value is found.
+ */
+static bool prvAppendMember( JobDocumentWriter_t * pxWriter,
+                             const char * pcDocument,
+                             size_t xDocumentLength,
+                             const char * pcQuery,
+                             const char * pcKey,
+                             bool * pxFirst );
+
+#if configMQTT_AGENT_RPC
+
+/**
+ * @brief Callback of the job status update request, logging its result.
+ */
+    static void prvRejectResponseCallback( CoreMqttAgentRpcStatus_t xStatus,
+                                           const MQTTPublishInfo_t * pxResponse,
+                                           void * pvContext );
+#else
+
+/**
+ * @brief Command completion callback of the job status update.
+ */
+    static void prvRejectCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo );
+#endif /* configMQTT_AGENT_RPC */
+
+/* Static function definitions ************************************************/
+
+static bool prvFind( const char * pcDocument,
+                     size_t xDocumentLength,
+                     const char * pcQuery,
+                     const char ** ppcValue,
+                     size_t * pxValueLength )
+{
+    char * pcValue = NULL;
+    size_t xValueLength = 0U;
+    bool xFound = false;
+
+    if( JSON_Search( ( char * ) pcDocument,
+                     xDocumentLength,
+                     pcQuery,
+                     strlen( pcQuery ),
+                     &pcValue,
+                     &xValueLength ) == JSONSuccess )
+    {
+        /* Strings are returned without their quotes. Any other value follows
+         * the colon of its key. */
+        if( ( pcValue > pcDocument ) && ( pcValue[ -1 ] == '"' ) )
+        {
+            pcValue--;
+            xValueLength += 2U;
+        }
+
+        *ppcValue = pcValue;
+        *pxValueLength = xValueLength;
+        xFound = true;
+    }
+
+    return xFound;
+}
+
+static void prvAppend( JobDocumentWriter_t * pxWriter,
+                       const char * pcText,
+                       size_t xLength )
+{
+    if( ( pxWriter->xOverflow == false ) &&
+        ( xLength <= ( pxWriter->xSize - pxWriter->xLength ) ) )
+    {
+        memcpy( &pxWriter->pucBuffer[ pxWriter->xLength ], pcText, xLength );
+        pxWriter->xLength += xLength;
+    }
+    else
+    {
+        pxWriter->xOverflow = true;
+    }
+}
+
+static bool prvAppendMember( JobDocumentWriter_t * pxWriter,
+                             const char * pcDocument,
+                             size_t xDocumentLength,
+                             const char * pcQuery,
+                             const char * pcKey,
+                             bool * pxFirst )
+{
+    const char * pcValue = NULL;
+    size_t xValueLength = 0U;
+    bool xFound = prvFind( pcDocument, xDocumentLength, pcQuery, &pcValue, &xValueLength );
+
+    if( xFound == true )
+    {
+        if( *pxFirst == false )
+        {
+            prvAppend( pxWriter, ",", 1U );
+        }
+
+        prvAppend( pxWriter, pcKey, strlen( pcKey ) );
+        prvAppend( pxWriter, pcValue, xValueLength );
+        *pxFirst = false;
+    }
+
+    return xFound;
+}
+
+#if configMQTT_AGENT_RPC
+    static void prvRejectResponseCallback( CoreMqttAgentRpcStatus_t xStatus,
+                                           const MQTTPublishInfo_t * pxResponse,
+                                           void * pvContext )
+    {
+        ( void ) pxResponse;
+        ( void ) pvContext;
+
+        switch( xStatus )
+        {
+            case CORE_MQTT_AGENT_RPC_ACCEPTED:
+                ESP_LOGI( TAG, "Job status update accepted." );
+                break;
+
+            case CORE_MQTT_AGENT_RPC_REJECTED:
+                ESP_LOGW( TAG, "Job status update rejected." );
+                break;
+
+            case CORE_MQTT_AGENT_RPC_TIMEOUT:
+                ESP_LOGW( TAG, "No response to the job status update." );
+                break;
+
+            default:
+                ESP_LOGW( TAG, "Failed to send the job status update." );
+                break;
+        }
+
+        xRejectInFlight = false;
+    }
+#else /* if configMQTT_AGENT_RPC */
+    static void prvRejectCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+    {
+        ( void ) pxCommandContext;
+
+        if( pxReturnInfo->returnCode != MQTTSuccess )
+        {
+            ESP_LOGW( TAG, "Failed to send the job status update with error %d.",
+                      ( int ) pxReturnInfo->returnCode );
+        }
+
+        xRejectInFlight = false;
+    }
+#endif /* configMQTT_AGENT_RPC */
+
+/* Public function definitions ************************************************/
+
+OtaJobDocumentResult_t xOtaJobDocumentCompact( const char * pcDocument,
+                                               size_t xDocumentLength,
+                                               uint8_t * pucOutput,
+                                               size_t xOutputSize,
+                                               uint32_t * pulOutputLength )
+{
+    OtaJobDocumentResult_t xRet = OtaJobDocumentNotOta;
+    JobDocumentWriter_t xWriter = { 0 };
+    const char * pcFile = NULL;
+    size_t xFileLength = 0U;
+    bool xFirst = true;
+    bool xRequired = true;
+
+    xWriter.pucBuffer = pucOutput;
+    xWriter.xSize = xOutputSize;
+
+    prvAppend( &xWriter, "{", 1U );
+    ( void ) prvAppendMember( &xWriter, pcDocument, xDocumentLength, "clientToken", "\"clientToken\":", &xFirst );
+    ( void ) prvAppendMember( &xWriter, pcDocument, xDocumentLength, "timestamp", "\"timestamp\":", &xFirst );
+
+    if( xFirst == false )
+    {
+        prvAppend( &xWriter, ",", 1U );
+    }
+
+    /* The OTA agent reads the first file only. */
+    xFirst = true;
+    prvAppend( &xWriter, "\"execution\":{", sizeof( "\"execution\":{" ) - 1U );
+    xRequired &= prvAppendMember( &xWriter, pcDocument, xDocumentLength, "execution.jobId", "\"jobId\":", &xFirst );
+    ( void ) prvAppendMember( &xWriter, pcDocument, xDocumentLength, "execution.statusDetails", "\"statusDetails\":", &xFirst );
+    prvAppend( &xWriter, ",\"jobDocument\":{\"afr_ota\":{", sizeof( ",\"jobDocument\":{\"afr_ota\":{" ) - 1U );
+    xFirst = true;
+    xRequired &= prvAppendMember( &xWriter, pcDocument, xDocumentLength, "execution.jobDocument.afr_ota.protocols", "\"protocols\":", &xFirst );
+    ( void ) prvAppendMember( &xWriter, pcDocument, xDocumentLength, "execution.jobDocument.afr_ota.streamname", "\"streamname\":", &xFirst );
+    xRequired &= prvFind( pcDocument, xDocumentLength, "execution.jobDocument.afr_ota.files[0]", &pcFile, &xFileLength );
+
+    if( xRequired == true )
+    {
+        prvAppend( &xWriter, ",\"files\":[", sizeof( ",\"files\":[" ) - 1U );
+        prvAppend( &xWriter, pcFile, xFileLength );
+        prvAppend( &xWriter, "]}}}}", sizeof( "]}}}}" ) - 1U );
+
+        if( xWriter.xOverflow == false )
+        {
+            *pulOutputLength = ( uint32_t ) xWriter.xLength;
+            xRet = OtaJobDocumentCompacted;
+        }
+        else
+        {
+            xRet = OtaJobDocumentTooLarge;
+            ESP_LOGE( TAG, "OTA fields of the job document do not fit %u bytes.",
+                      ( unsigned ) xOutputSize );
+        }
+    }
+    else
+    {
+        ESP_LOGW( TAG, "Job document is not an OTA job." );
+    }
+
+    return xRet;
+}
+
+void vOtaJobDocumentReject( const char * pcDocument,
+                            size_t xDocumentLength )
+{
+    #if !configMQTT_AGENT_RPC
+        static MQTTPublishInfo_t xPublishInfo = { 0 };
+        MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    #endif /* !configMQTT_AGENT_RPC */
+    const char * pcJobId = NULL;
+    size_t xJobIdLength = 0U;
+    int lTopicLength;
+    int lPayloadLength;
+    BaseType_t xQueued;
+
+    if( ( prvFind( pcDocument, xDocumentLength, "execution.jobId", &pcJobId, &xJobIdLength ) == false ) ||
+        ( xJobIdLength < 3U ) || ( pcJobId[ 0 ] != '"' ) ||
+        ( ( xJobIdLength - 2U ) > JOB_DOCUMENT_MAX_JOB_ID_LENGTH ) )
+    {
+        ESP_LOGE( TAG, "Job document has no valid job ID, ignoring it." );
+    }
+    else if( xRejectInFlight == true )
+    {
+        ESP_LOGW( TAG, "Previous job status update in flight, ignoring the job document." );
+    }
+    else
+    {
+        lTopicLength = snprintf( cRejectTopic, sizeof( cRejectTopic ),
+                                 JOB_DOCUMENT_TOPIC_PREFIX "%.*s" JOB_DOCUMENT_TOPIC_SUFFIX,
+                                 ( int ) ( xJobIdLength - 2U ), &pcJobId[ 1 ] );
+        lPayloadLength = snprintf( cRejectPayload, sizeof( cRejectPayload ),
+                                   JOB_DOCUMENT_REJECT_FORMAT,
+                                   ( unsigned ) xDocumentLength );
+
+        xRejectInFlight = true;
+
+        #if configMQTT_AGENT_RPC
+            ( void ) lTopicLength;
+
+            /* The request layer copies the topic and payload, and reports
+             * whether AWS IoT accepted the update. */
+            xQueued = xCoreMqttAgentRpcRequest( cRejectTopic,
+                                                cRejectPayload,
+                                                ( size_t ) lPayloadLength,
+                                                JOB_DOCUMENT_RESPONSE_TIMEOUT_MS,
+                                                prvRejectResponseCallback,
+                                                NULL );
+        #else
+            xPublishInfo.qos = MQTTQoS1;
+            xPublishInfo.pTopicName = cRejectTopic;
+            xPublishInfo.topicNameLength = ( uint16_t ) lTopicLength;
+            xPublishInfo.pPayload = cRejectPayload;
+            xPublishInfo.payloadLength = ( size_t ) lPayloadLength;
+
+            /* Called from the coreMQTT-Agent task, so the command is queued
+             * without waiting for its completion. */
+            xCommandParams.blockTimeMs = 0U;
+            xCommandParams.cmdCompleteCallback = prvRejectCompleteCallback;
+            xCommandParams.pCmdCompleteCallbackContext = NULL;
+
+            xQueued = ( MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                           &xPublishInfo,
+                                           &xCommandParams ) == MQTTSuccess ) ? pdPASS : pdFAIL;
+        #endif /* configMQTT_AGENT_RPC */
+
+        if( xQueued != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to queue the job status update." );
+            xRejectInFlight = false;
+        }
+        else
+        {
+            ESP_LOGW( TAG, "Failing job %.*s.", ( int ) ( xJobIdLength - 2U ), &pcJobId[ 1 ] );
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_job_document.h
+ * @brief Handling of job documents larger than an OTA event buffer.
+ *
+ * Job documents are handed to the OTA agent in an OTA event buffer of
+ * OTA_DATA_BLOCK_SIZE bytes. A larger document, such as one carrying custom
+ * fields or several files, is parsed in place in the network buffer and only
+ * the fields read by the OTA agent are copied to the event buffer. A document
+ * that still does not fit, or that is not an OTA job, is failed with a job
+ * status update.
+ */
+#ifndef OTA_JOB_DOCUMENT_H
+#define OTA_JOB_DOCUMENT_H
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Result of compacting a job document.
+ */
+typedef enum OtaJobDocumentResult
+{
+    OtaJobDocumentCompacted = 0, /**< The smaller document is in the buffer. */
+    OtaJobDocumentNotOta,        /**< The document is not an OTA job. */
+    OtaJobDocumentTooLarge       /**< The OTA fields do not fit the buffer. */
+} OtaJobDocumentResult_t;
+
+/**
+ * @brief Copy the fields of a job document read by the OTA agent into a
+ * smaller document.
+ *
+ * The copy keeps the clientToken, the timestamp, the job ID and status details
+ * of the execution, and the protocols, stream name and first file of the
+ * afr_ota job document.
+ *
+ * @param[in] pcDocument The job document, in the network buffer.
+ * @param[in] xDocumentLength Length of the job document.
+ * @param[out] pucOutput Buffer receiving the smaller document.
+ * @param[in] xOutputSize Size of the buffer.
+ * @param[out] pulOutputLength Length of the smaller document.
+ *
+ * @return OtaJobDocumentCompacted if the copy fits the buffer,
+ * OtaJobDocumentNotOta if a field required by the OTA agent is missing, and
+ * OtaJobDocumentTooLarge otherwise.
+ */
+OtaJobDocumentResult_t xOtaJobDocumentCompact( const char * pcDocument,
+                                   size_t xDocumentLength,
+                                   uint8_t * pucOutput,
+                                   size_t xOutputSize,
+                                   uint32_t * pulOutputLength );
+
+/**
+ * @brief Fail the job of an OTA job document whose fields do not fit the
+ * buffer handed to the OTA agent.
+ *
+ * The status update is queued without waiting for its completion, so this
+ * can be called from the coreMQTT-Agent task. With the MQTT request/response
+ * layer enabled, it is sent through it and its response is logged. It is
+ * skipped if the document has no job ID, or
+ * while the previous update is still in flight, in which case the job is
+ * failed when its document is received again.
+ *
+ * @param[in] pcDocument The job document, in the network buffer.
+ * @param[in] xDocumentLength Length of the job document.
+ */
+void vOtaJobDocumentReject( const char * pcDocument,
+                            size_t xDocumentLength );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_JOB_DOCUMENT_H */
@@ -0,0 +1,563 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_metrics.c
+ * @brief Progress, rate and ETA metrics of the OTA download.
+ *
+ * Counters are updated under a lock by the coreMQTT-Agent task, the OTA agent
+ * task and the flash writer task. A timer samples the distinct bytes received
+ * once per period into an exponentially weighted moving average, from which
+ * the ETA is derived, and publishes the metrics while a file is being
+ * received.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* coreMQTT-Agent manager events include. */
+#include "core_mqtt_agent_manager_events.h"
+
+/* coreMQTT-Agent manager configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+#if configMQTT_AGENT_TRAFFIC_SHAPER
+    /* Traffic shaper include. */
+    #include "core_mqtt_agent_shaper.h"
+#endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
+/* OTA library includes. */
+#include "ota.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_metrics.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Period of the throughput samples in milliseconds.
+ */
+#define METRICS_SAMPLE_PERIOD_MS                ( 1000U )
+
+/**
+ * @brief Weight of the previous average in the throughput average, out of
+ * METRICS_EWMA_SCALE. A sample weighs a quarter.
+ */
+#define METRICS_EWMA_WEIGHT                     ( 3U )
+#define METRICS_EWMA_SCALE                      ( 4U )
+
+/**
+ * @brief Suffix of the stream request topic,
+ * "$aws/things/<thing>/streams/<stream>/get/cbor".
+ */
+#define METRICS_REQUEST_TOPIC_SUFFIX            "/get/cbor"
+#define METRICS_REQUEST_TOPIC_SUFFIX_LENGTH     ( sizeof( METRICS_REQUEST_TOPIC_SUFFIX ) - 1U )
+
+/**
+ * @brief Size of the buffer holding the published metrics.
+ */
+#define METRICS_PAYLOAD_SIZE                    ( 384U )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_metrics";
+
+/**
+ * @brief Global MQTT Agent context used to publish the metrics.
+ */
+extern MQTTAgentContext_t xGlobalMqttAgentContext;
+
+/**
+ * @brief Lock of every variable below.
+ */
+static portMUX_TYPE xMetricsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief The metrics. ulElapsedMs, ulEtaSeconds, ulDuplicateBlocks and
+ * ulFlashWriteUsPerBlock are derived when a snapshot is taken.
+ */
+static OtaMetrics_t xMetrics;
+
+/**
+ * @brief Set while a file is being received.
+ */
+static bool xFileActive = false;
+
+/**
+ * @brief Time the file was created, and time it was closed.
+ */
+static TickType_t xFileStartTick = 0U;
+static TickType_t xFileEndTick = 0U;
+
+/**
+ * @brief Blocks processed by the OTA agent before the file was created.
+ */
+static uint32_t ulProcessedAtStart = 0U;
+
+/**
+ * @brief Blocks of the last stream request that have not arrived.
+ */
+static uint32_t ulRequestOutstanding = 0U;
+
+/**
+ * @brief Flash programming totals of the file.
+ */
+static uint32_t ulFlashBytes = 0U;
+static uint64_t ullFlashTimeUs = 0U;
+
+/**
+ * @brief Distinct bytes at the previous throughput sample, and whether the
+ * average has been seeded.
+ */
+static uint32_t ulSampledBytes = 0U;
+static bool xThroughputSeeded = false;
+
+#if ( otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 )
+
+/**
+ * @brief Buffer holding the published metrics.
+ */
+    static char cMetricsPayload[ METRICS_PAYLOAD_SIZE ];
+
+/**
+ * @brief Set while a publish of the metrics is in the agent.
+ */
+    static volatile bool xPublishInFlight = false;
+
+/**
+ * @brief Time since the metrics were last published.
+ */
+    static uint32_t ulTimeSincePublishMs = 0U;
+
+/**
+ * @brief Set when a file closed, so the final metrics are published once.
+ */
+    static bool xFinalPublishPending = false;
+#endif /* otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 */
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Timer callback sampling the throughput, and publishing the metrics if
+ * enabled.
+ *
+ * @param[in] xTimer The timer.
+ */
+static void prvMetricsTimerCallback( TimerHandle_t xTimer );
+
+#if ( otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 )
+
+/**
+ * @brief Publish a snapshot of the metrics.
+ */
+    static void prvPublishMetrics( void );
+
+/**
+ * @brief Completion callback of the metrics publish.
+ */
+    static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                            MQTTAgentReturnInfo_t * pxReturnInfo );
+#endif /* otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 */
+
+/* Static function definitions ************************************************/
+
+static void prvMetricsTimerCallback( TimerHandle_t xTimer )
+{
+    uint32_t ulSampleBps;
+    bool xPublish = false;
+
+    ( void ) xTimer;
+
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        if( xFileActive == true )
+        {
+            ulSampleBps = ( uint32_t ) ( ( ( uint64_t ) ( xMetrics.ulBytesWritten - ulSampledBytes ) * 1000U ) /
+                                         METRICS_SAMPLE_PERIOD_MS );
+            ulSampledBytes = xMetrics.ulBytesWritten;
+
+            /* The first sample seeds the average. */
+            if( xThroughputSeeded == false )
+            {
+                xMetrics.ulThroughputBps = ulSampleBps;
+                xThroughputSeeded = true;
+            }
+            else
+            {
+                xMetrics.ulThroughputBps = ( uint32_t ) ( ( ( ( uint64_t ) xMetrics.ulThroughputBps * METRICS_EWMA_WEIGHT ) +
+                                                            ulSampleBps ) / METRICS_EWMA_SCALE );
+            }
+        }
+
+        #if ( otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 )
+            ulTimeSincePublishMs += METRICS_SAMPLE_PERIOD_MS;
+
+            if( ( ( xFileActive == true ) && ( ulTimeSincePublishMs >= otademoconfigMETRICS_PUBLISH_INTERVAL_MS ) ) ||
+                ( xFinalPublishPending == true ) )
+            {
+                xPublish = true;
+            }
+        #endif /* otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 */
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+
+    #if ( otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 )
+        if( xPublish == true )
+        {
+            prvPublishMetrics();
+        }
+    #else
+        ( void ) xPublish;
+    #endif /* otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 */
+}
+
+#if ( otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 )
+
+    static void prvPublishMetrics( void )
+    {
+        static MQTTPublishInfo_t xPublishInfo = { 0 };
+        MQTTAgentCommandInfo_t xCommandParams = { 0 };
+        OtaMetrics_t xSnapshot;
+        BaseType_t xLinkReady = pdPASS;
+        int lLength;
+
+        /* Only publish while connected, and never queue more than one. */
+        if( ( ( ulCoreMqttAgentManagerGetState() & CORE_MQTT_AGENT_CONNECTED_BIT ) != 0U ) &&
+            ( xPublishInFlight == false ) )
+        {
+            vOtaMetricsGet( &xSnapshot );
+
+            lLength = snprintf( cMetricsPayload, sizeof( cMetricsPayload ),
+                                "{\"file_size\":%" PRIu32 ",\"elapsed_ms\":%" PRIu32 ",\"bytes_received\":%" PRIu32
+                                ",\"bytes_written\":%" PRIu32 ",\"blocks_received\":%" PRIu32 ",\"throughput_bps\":%" PRIu32
+                                ",\"eta_s\":%" PRId32 ",\"retransmitted_blocks\":%" PRIu32 ",\"duplicate_blocks\":%" PRIu32
+                                ",\"flash_us_per_block\":%" PRIu32 ",\"event_buffer_starvation\":%" PRIu32
+                                ",\"flash_chunk_starvation\":%" PRIu32 "}",
+                                xSnapshot.ulFileSize,
+                                xSnapshot.ulElapsedMs,
+                                xSnapshot.ulBytesReceived,
+                                xSnapshot.ulBytesWritten,
+                                xSnapshot.ulBlocksReceived,
+                                xSnapshot.ulThroughputBps,
+                                ( xSnapshot.ulEtaSeconds == OTA_METRICS_ETA_UNKNOWN ) ? -1 : ( int32_t ) xSnapshot.ulEtaSeconds,
+                                xSnapshot.ulRetransmittedBlocks,
+                                xSnapshot.ulDuplicateBlocks,
+                                xSnapshot.ulFlashWriteUsPerBlock,
+                                xSnapshot.ulEventBufferStarvation,
+                                xSnapshot.ulFlashChunkStarvation );
+
+            #if configMQTT_AGENT_TRAFFIC_SHAPER
+                /* Skip this period rather than delay the timer task. */
+                xLinkReady = xCoreMqttAgentShaperAcquire( CORE_MQTT_AGENT_TRAFFIC_TELEMETRY,
+                                                          ( uint32_t ) strlen( otademoconfigMETRICS_TOPIC ) + ( uint32_t ) lLength,
+                                                          0U );
+            #endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
+            /* The buffer holds the worst case, the check only guards against
+             * later changes of the format. */
+            if( ( lLength < 0 ) || ( ( size_t ) lLength >= sizeof( cMetricsPayload ) ) )
+            {
+                ESP_LOGE( TAG, "OTA metrics do not fit the payload buffer." );
+            }
+            else if( xLinkReady == pdPASS )
+            {
+                xPublishInfo.qos = MQTTQoS0;
+                xPublishInfo.pTopicName = otademoconfigMETRICS_TOPIC;
+                xPublishInfo.topicNameLength = ( uint16_t ) strlen( otademoconfigMETRICS_TOPIC );
+                xPublishInfo.pPayload = cMetricsPayload;
+                xPublishInfo.payloadLength = ( size_t ) lLength;
+
+                xCommandParams.blockTimeMs = 0U;
+                xCommandParams.cmdCompleteCallback = prvPublishCompleteCallback;
+                xCommandParams.pCmdCompleteCallbackContext = NULL;
+
+                xPublishInFlight = true;
+
+                if( MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                       &xPublishInfo,
+                                       &xCommandParams ) != MQTTSuccess )
+                {
+                    xPublishInFlight = false;
+                }
+                else
+                {
+                    taskENTER_CRITICAL( &xMetricsLock );
+                    {
+                        ulTimeSincePublishMs = 0U;
+                        xFinalPublishPending = false;
+                    }
+                    taskEXIT_CRITICAL( &xMetricsLock );
+                }
+            }
+            else
+            {
+                /* No room in the telemetry share this period. */
+            }
+        }
+    }
+
+    static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                            MQTTAgentReturnInfo_t * pxReturnInfo )
+    {
+        ( void ) pxCommandContext;
+        ( void ) pxReturnInfo;
+
+        xPublishInFlight = false;
+    }
+
+#endif /* otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 */
+
+/* Public function definitions ************************************************/
+
+BaseType_t xOtaMetricsInit( void )
+{
+    BaseType_t xRet = pdPASS;
+    TimerHandle_t xMetricsTimer;
+
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        memset( &xMetrics, 0x00, sizeof( xMetrics ) );
+        xMetrics.ulEtaSeconds = OTA_METRICS_ETA_UNKNOWN;
+        xFileActive = false;
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+
+    xMetricsTimer = xTimerCreate( "OTAMetrics",
+                                  pdMS_TO_TICKS( METRICS_SAMPLE_PERIOD_MS ),
+                                  pdTRUE,
+                                  NULL,
+                                  prvMetricsTimerCallback );
+
+    if( xMetricsTimer == NULL )
+    {
+        ESP_LOGE( TAG, "Failed to create OTA metrics timer." );
+        xRet = pdFAIL;
+    }
+    else if( xTimerStart( xMetricsTimer, 0 ) != pdPASS )
+    {
+        ESP_LOGE( TAG, "Failed to start OTA metrics timer." );
+        xRet = pdFAIL;
+    }
+
+    return xRet;
+}
+
+void vOtaMetricsStartFile( uint32_t ulFileSize )
+{
+    OtaAgentStatistics_t xStatistics = { 0 };
+
+    ( void ) OTA_GetStatistics( &xStatistics );
+
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        memset( &xMetrics, 0x00, sizeof( xMetrics ) );
+        xMetrics.ulFileSize = ulFileSize;
+        xMetrics.ulEtaSeconds = OTA_METRICS_ETA_UNKNOWN;
+        xFileStartTick = xTaskGetTickCount();
+        ulProcessedAtStart = xStatistics.otaPacketsProcessed;
+        ulRequestOutstanding = 0U;
+        ulFlashBytes = 0U;
+        ullFlashTimeUs = 0U;
+        ulSampledBytes = 0U;
+        xThroughputSeeded = false;
+        xFileActive = true;
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsFinishFile( void )
+{
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        if( xFileActive == true )
+        {
+            xFileActive = false;
+            xFileEndTick = xTaskGetTickCount();
+
+            #if ( otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 )
+                xFinalPublishPending = true;
+            #endif /* otademoconfigMETRICS_PUBLISH_INTERVAL_MS > 0 */
+        }
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsOnRequest( const char * pcTopic,
+                           uint16_t usTopicLength,
+                           uint32_t ulBlocks )
+{
+    if( ( usTopicLength > METRICS_REQUEST_TOPIC_SUFFIX_LENGTH ) &&
+        ( memcmp( &pcTopic[ usTopicLength - METRICS_REQUEST_TOPIC_SUFFIX_LENGTH ],
+                  METRICS_REQUEST_TOPIC_SUFFIX,
+                  METRICS_REQUEST_TOPIC_SUFFIX_LENGTH ) == 0 ) )
+    {
+        taskENTER_CRITICAL( &xMetricsLock );
+        {
+            /* The OTA agent only asks before a round is complete when its
+             * request timer expired, and asks for the missing blocks first. */
+            xMetrics.ulRetransmittedBlocks += ulRequestOutstanding;
+            ulRequestOutstanding = ulBlocks;
+        }
+        taskEXIT_CRITICAL( &xMetricsLock );
+    }
+}
+
+void vOtaMetricsOnRetransmit( uint32_t ulBlocks )
+{
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        xMetrics.ulRetransmittedBlocks += ulBlocks;
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsOnBlockReceived( uint32_t ulLength,
+                                 BaseType_t xDropped )
+{
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        xMetrics.ulBlocksReceived++;
+        xMetrics.ulBytesReceived += ulLength;
+
+        if( xDropped == pdTRUE )
+        {
+            /* The block will be requested again. */
+            xMetrics.ulEventBufferStarvation++;
+        }
+        else if( ulRequestOutstanding > 0U )
+        {
+            ulRequestOutstanding--;
+        }
+        else
+        {
+            /* More blocks than requested, such as a late round. */
+        }
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsOnBlockWritten( uint32_t ulLength )
+{
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        xMetrics.ulBytesWritten += ulLength;
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsOnFlashWrite( uint32_t ulLength,
+                              uint32_t ulTimeUs )
+{
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        ulFlashBytes += ulLength;
+        ullFlashTimeUs += ulTimeUs;
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsOnChunkWait( void )
+{
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        xMetrics.ulFlashChunkStarvation++;
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
+
+void vOtaMetricsGet( OtaMetrics_t * pxMetrics )
+{
+    OtaAgentStatistics_t xStatistics = { 0 };
+    uint32_t ulProcessed;
+    uint32_t ulBlocksWritten;
+    uint32_t ulRemaining;
+
+    configASSERT( pxMetrics != NULL );
+
+    ( void ) OTA_GetStatistics( &xStatistics );
+
+    taskENTER_CRITICAL( &xMetricsLock );
+    {
+        memcpy( pxMetrics, &xMetrics, sizeof( xMetrics ) );
+
+        if( xMetrics.ulFileSize > 0U )
+        {
+            pxMetrics->ulElapsedMs = ( uint32_t ) pdTICKS_TO_MS( ( ( xFileActive == true ) ? xTaskGetTickCount() : xFileEndTick ) -
+                                                                 xFileStartTick );
+        }
+
+        /* Blocks the OTA agent processed without passing them to the flash
+         * writer were already received. The statistics restart with a job. */
+        ulProcessed = xStatistics.otaPacketsProcessed;
+        ulProcessed -= ( ulProcessed >= ulProcessedAtStart ) ? ulProcessedAtStart : 0U;
+        ulBlocksWritten = ( xMetrics.ulBytesWritten + OTA_FILE_BLOCK_SIZE - 1U ) / OTA_FILE_BLOCK_SIZE;
+        pxMetrics->ulDuplicateBlocks = ( ulProcessed > ulBlocksWritten ) ? ( ulProcessed - ulBlocksWritten ) : 0U;
+
+        if( ulFlashBytes > 0U )
+        {
+            pxMetrics->ulFlashWriteUsPerBlock = ( uint32_t ) ( ( ullFlashTimeUs * OTA_FILE_BLOCK_SIZE ) / ulFlashBytes );
+        }
+
+        ulRemaining = ( xMetrics.ulFileSize > xMetrics.ulBytesWritten ) ? ( xMetrics.ulFileSize - xMetrics.ulBytesWritten ) : 0U;
+
+        if( ulRemaining == 0U )
+        {
+            pxMetrics->ulEtaSeconds = ( xMetrics.ulFileSize > 0U ) ? 0U : OTA_METRICS_ETA_UNKNOWN;
+        }
+        else if( ( xFileActive == true ) && ( xMetrics.ulThroughputBps > 0U ) )
+        {
+            pxMetrics->ulEtaSeconds = ( ulRemaining + xMetrics.ulThroughputBps - 1U ) / xMetrics.ulThroughputBps;
+        }
+        else
+        {
+            pxMetrics->ulEtaSeconds = OTA_METRICS_ETA_UNKNOWN;
+        }
+    }
+    taskEXIT_CRITICAL( &xMetricsLock );
+}
@@ -0,0 +1,163 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_metrics.h
+ * @brief Progress, rate and ETA metrics of the OTA download.
+ *
+ * The MQTT callbacks, the OTA agent task and the flash writer report every
+ * stream request, received block and flash write here. A timer updates the
+ * smoothed throughput and, while a file is being received, publishes the
+ * metrics as JSON at a bounded rate. vOtaMetricsGet gives the same snapshot to
+ * local callers.
+ */
+#ifndef OTA_METRICS_H
+#define OTA_METRICS_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief ETA reported while the throughput is not known yet.
+ */
+#define OTA_METRICS_ETA_UNKNOWN    ( UINT32_MAX )
+
+/**
+ * @brief Snapshot of the metrics of the file being received, or of the last
+ * one once it is closed.
+ */
+typedef struct OtaMetrics
+{
+    uint32_t ulFileSize;              /**< Size of the file, 0 before the first file. */
+    uint32_t ulElapsedMs;             /**< Time since the file was created. */
+    uint32_t ulBytesReceived;         /**< Block bytes received on the stream, duplicates included. */
+    uint32_t ulBytesWritten;          /**< Bytes of distinct blocks accepted by the flash writer. */
+    uint32_t ulBlocksReceived;        /**< Blocks received on the stream, duplicates included. */
+    uint32_t ulThroughputBps;         /**< Smoothed rate of distinct block bytes, in bytes per second. */
+    uint32_t ulEtaSeconds;            /**< Time to receive the rest of the file, or OTA_METRICS_ETA_UNKNOWN. */
+    uint32_t ulRetransmittedBlocks;   /**< Blocks requested again after their request timed out. */
+    uint32_t ulDuplicateBlocks;       /**< Blocks the OTA agent already had. */
+    uint32_t ulFlashWriteUsPerBlock;  /**< Flash programming time per block. */
+    uint32_t ulEventBufferStarvation; /**< Blocks dropped because no OTA event buffer was free. */
+    uint32_t ulFlashChunkStarvation;  /**< Waits of the OTA agent for a free flash writer chunk. */
+} OtaMetrics_t;
+
+/**
+ * @brief Clear the metrics and start the timer updating and publishing them.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xOtaMetricsInit( void );
+
+/**
+ * @brief Clear the metrics for a new file.
+ *
+ * @param[in] ulFileSize Size of the file.
+ */
+void vOtaMetricsStartFile( uint32_t ulFileSize );
+
+/**
+ * @brief Mark the file as closed, which stops the publishes.
+ */
+void vOtaMetricsFinishFile( void );
+
+/**
+ * @brief Account for a publish of the OTA agent. Stream requests sent while
+ * blocks of the previous one are still missing count those blocks as
+ * retransmitted. Other publishes are ignored.
+ *
+ * @note Not used with otademoconfigENABLE_STREAM_PIPELINES, where each
+ * pipeline reports its timeouts with vOtaMetricsOnRetransmit.
+ *
+ * @param[in] pcTopic Topic of the publish.
+ * @param[in] usTopicLength Length of the topic.
+ * @param[in] ulBlocks Number of blocks the request asks for.
+ */
+void vOtaMetricsOnRequest( const char * pcTopic,
+                           uint16_t usTopicLength,
+                           uint32_t ulBlocks );
+
+/**
+ * @brief Account for blocks requested again.
+ *
+ * @param[in] ulBlocks Number of blocks.
+ */
+void vOtaMetricsOnRetransmit( uint32_t ulBlocks );
+
+/**
+ * @brief Account for a block received on the stream.
+ *
+ * @param[in] ulLength Length of the data message.
+ * @param[in] xDropped pdTRUE if the block was dropped because no OTA event
+ * buffer was free.
+ */
+void vOtaMetricsOnBlockReceived( uint32_t ulLength,
+                                 BaseType_t xDropped );
+
+/**
+ * @brief Account for a distinct block accepted by the flash writer.
+ *
+ * @param[in] ulLength Length of the block.
+ */
+void vOtaMetricsOnBlockWritten( uint32_t ulLength );
+
+/**
+ * @brief Account for a chunk programmed to flash.
+ *
+ * @param[in] ulLength Length of the chunk.
+ * @param[in] ulTimeUs Time spent programming it.
+ */
+void vOtaMetricsOnFlashWrite( uint32_t ulLength,
+                              uint32_t ulTimeUs );
+
+/**
+ * @brief Account for the OTA agent waiting for a free flash writer chunk.
+ */
+void vOtaMetricsOnChunkWait( void );
+
+/**
+ * @brief Get a snapshot of the metrics.
+ *
+ * @param[out] pxMetrics The metrics.
+ */
+void vOtaMetricsGet( OtaMetrics_t * pxMetrics );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_METRICS_H */
@@ -49,11 +49,9 @@
 /* FreeRTOS includes. */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 
 /* ESP-IDF includes. */
 #include "esp_log.h"
-#include "esp_event.h"
 #include "sdkconfig.h"
 
 /* OTA library configuration include. */
@@ -79,10 +77,64 @@
 /* OTA platform abstraction layer include. */
 #include "ota_pal.h"
 
+/* OTA event buffer pool include. */
+#include "ota_event_buffer_pool.h"
+
+/* Job document handling include. */
+#include "ota_job_document.h"
+
+/* OTA flash writer stage include. */
+#include "ota_flash_writer.h"
+
+#if otademoconfigENABLE_PRE_ERASE
+    /* Inactive slot pre-erase include. */
+    #include "ota_pre_erase.h"
+#endif /* otademoconfigENABLE_PRE_ERASE */
+
+#if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+    /* Adaptive block window include. */
+    #include "ota_block_window.h"
+#endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+#if otademoconfigENABLE_EARLY_IMAGE_CHECK
+    /* Early image header check include. */
+    #include "ota_image_check.h"
+#endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+
+#if otademoconfigENABLE_STREAM_PIPELINES
+    /* Concurrent stream pipelines include. */
+    #include "ota_stream_pipelines.h"
+#endif /* otademoconfigENABLE_STREAM_PIPELINES */
+
+#if otademoconfigENABLE_METRICS
+    /* OTA metrics include. */
+    #include "ota_metrics.h"
+#endif /* otademoconfigENABLE_METRICS */
+
+#if otademoconfigENABLE_BUNDLE
+    /* Firmware and data file bundle include. */
+    #include "ota_bundle.h"
+#endif /* otademoconfigENABLE_BUNDLE */
+
+#if otademoconfigENABLE_DIRECT_WRITE
+    /* Direct block write include. */
+    #include "ota_direct_write.h"
+#endif /* otademoconfigENABLE_DIRECT_WRITE */
+
 /* coreMQTT-Agent network manager includes. */
 #include "core_mqtt_agent_manager_events.h"
 #include "core_mqtt_agent_manager.h"
 
+#if configMQTT_AGENT_TRAFFIC_SHAPER
+    /* coreMQTT-Agent traffic shaper include. */
+    #include "core_mqtt_agent_shaper.h"
+#endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
+#if configMQTT_AGENT_RPC
+    /* coreMQTT-Agent request/response layer include. */
+    #include "core_mqtt_agent_rpc.h"
+#endif /* configMQTT_AGENT_RPC */
+
 /* Public function include. */
 #include "ota_over_mqtt_demo.h"
 
@@ -92,74 +144,93 @@
 /* Preprocessor definitions ****************************************************/
 
 /**
- * @brief The common prefix for all OTA topics.
- *
- * Thing name is substituted with a wildcard symbol `+`. OTA agent
- * registers with MQTT broker with the thing name in the topic. This topic
- * filter is used to match incoming packet received and route them to OTA.
- * Thing name is not needed for this matching.
+ * @brief The common prefix of the OTA topics of this device,
+ * "$aws/things/<thing>/".
  */
-#define OTA_TOPIC_PREFIX                                 "$aws/things/+/"
+#define OTA_TOPIC_THING_PREFIX                           "$aws/things/" CONFIG_GRI_THING_NAME "/"
 
 /**
- * @brief Wildcard topic filter for job notification.
- * The filter is used to match the constructed job notify topic filter from OTA agent and register
- * appropriate callback for it.
+ * @brief Length of the OTA topic prefix.
  */
-#define OTA_JOB_NOTIFY_TOPIC_FILTER                      OTA_TOPIC_PREFIX "jobs/notify-next"
+#define OTA_TOPIC_THING_PREFIX_LENGTH                    ( sizeof( OTA_TOPIC_THING_PREFIX ) - 1U )
 
 /**
- * @brief Length of job notification topic filter.
+ * @brief Prefix of the stream data topics
+ * "$aws/things/<thing>/streams/<stream>/data/<format>".
  */
-#define OTA_JOB_NOTIFY_TOPIC_FILTER_LENGTH               ( ( uint16_t ) ( sizeof( OTA_JOB_NOTIFY_TOPIC_FILTER ) - 1 ) )
+#define OTA_TOPIC_STREAMS_PREFIX                         OTA_TOPIC_THING_PREFIX "streams/"
 
 /**
- * @brief Job update response topics filter for OTA.
- * This is used to route all the packets for OTA reserved topics which OTA agent has not subscribed for.
+ * @brief Length of the stream data topic prefix.
  */
-#define OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER             OTA_TOPIC_PREFIX "jobs/+/update/+"
+#define OTA_TOPIC_STREAMS_PREFIX_LENGTH                  ( sizeof( OTA_TOPIC_STREAMS_PREFIX ) - 1U )
 
 /**
- * @brief Length of Job update response topics filter.
+ * @brief Size of the buffer holding the stream data topic subscribed by the
+ * OTA agent.
  */
-#define OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER_LENGTH      ( ( uint16_t ) ( sizeof( OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER ) - 1 ) )
+#define OTA_TOPIC_STREAM_DATA_SIZE                       ( OTA_TOPIC_STREAMS_PREFIX_LENGTH + otademoconfigMAX_STREAM_NAME_SIZE + sizeof( "/data/cbor" ) )
 
 /**
- * @brief Wildcard topic filter for matching job response messages.
- * This topic filter is used to match the responses from OTA service for OTA agent job requests. THe
- * topic filter is a reserved topic which is not subscribed with MQTT broker.
- *
+ * @brief Level following the job ID in job update response topics
+ * `jobs/<job ID>/update/<accepted|rejected>`.
  */
-#define OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER           OTA_TOPIC_PREFIX "jobs/$next/get/accepted"
+#define OTA_JOB_UPDATE_RESPONSE_LEVEL                    "/update/"
 
 /**
- * @brief Length of job accepted response topic filter.
+ * @brief Length of the job update response level.
  */
-#define OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER_LENGTH    ( ( uint16_t ) ( sizeof( OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER ) - 1 ) )
+#define OTA_JOB_UPDATE_RESPONSE_LEVEL_LENGTH             ( sizeof( OTA_JOB_UPDATE_RESPONSE_LEVEL ) - 1U )
 
 /**
- * @brief Wildcard topic filter for matching OTA data packets.
- *  The filter is used to match the constructed data stream topic filter from OTA agent and register
- * appropriate callback for it.
+ * @brief Used to clear bits in a task's notification value.
  */
-#define OTA_DATA_STREAM_TOPIC_FILTER                     OTA_TOPIC_PREFIX  "streams/#"
+#define MAX_UINT32                                       ( 0xffffffff )
 
 /**
- * @brief Length of data stream topic filter.
+ * @brief Notification bits that wake the OTA demo task.
  */
-#define OTA_DATA_STREAM_TOPIC_FILTER_LENGTH              ( ( uint16_t ) ( sizeof( OTA_DATA_STREAM_TOPIC_FILTER ) - 1 ) )
+#define OTA_SUPERVISOR_CONNECTION_CHANGED                ( 1UL << 0 )
+#define OTA_SUPERVISOR_JOB_CHANGED                       ( 1UL << 1 )
+#define OTA_SUPERVISOR_AGENT_STOPPED                     ( 1UL << 2 )
+
+/* Struct definitions *********************************************************/
 
 /**
- * @brief Starting index of client identifier within OTA topic.
+ * @brief Kinds of OTA topics received by this demo.
  */
-#define OTA_TOPIC_CLIENT_IDENTIFIER_START_IDX            ( 12U )
+typedef enum OtaTopicType
+{
+    OtaTopicNone = 0,       /**< Not an OTA topic of this device. */
+    OtaTopicStreamData,     /**< `streams/<stream ID>/data/<format>`, file blocks. */
+    OtaTopicJobAccepted,    /**< `jobs/$next/get/accepted`, job document requested by the OTA agent. */
+    OtaTopicJobNotify,      /**< `jobs/notify-next`, job document pushed by the service. */
+    OtaTopicJobUpdate       /**< `jobs/<job ID>/update/<result>`, response to a job status update. */
+} OtaTopicType_t;
 
 /**
- * @brief Used to clear bits in a task's notification value.
+ * @brief Entry of the lookup on the OTA topics with a fixed name.
  */
-#define MAX_UINT32                                       ( 0xffffffff )
+typedef struct OtaTopic
+{
+    const char * pcTopic;
+    size_t xTopicLength;
+    OtaTopicType_t xType;
+} OtaTopic_t;
 
-/* Struct definitions *********************************************************/
+#if otademoconfigENABLE_STREAM_PIPELINES
+
+/**
+ * @brief Publish parameters of the stream request being split across the
+ * pipelines.
+ */
+    typedef struct OtaPipelineRequestContext
+    {
+        const char * pcTopic;
+        uint16_t usTopicLength;
+        uint8_t ucQoS;
+    } OtaPipelineRequestContext_t;
+#endif /* otademoconfigENABLE_STREAM_PIPELINES */
 
 /**
  * @brief Defines the structure to use as the command callback context in this
@@ -179,6 +250,30 @@ struct MQTTAgentCommandContext
  */
 static const char * TAG = "ota_over_mqtt_demo";
 
+/**
+ * @brief Job topics of this device, built for the configured thing name.
+ * Stream data topics carry the stream name and job update responses the job
+ * ID, so they are matched separately.
+ */
+static const OtaTopic_t xOtaJobTopics[] =
+{
+    { OTA_TOPIC_THING_PREFIX "jobs/$next/get/accepted", sizeof( OTA_TOPIC_THING_PREFIX "jobs/$next/get/accepted" ) - 1U, OtaTopicJobAccepted },
+    { OTA_TOPIC_THING_PREFIX "jobs/notify-next",        sizeof( OTA_TOPIC_THING_PREFIX "jobs/notify-next" ) - 1U,        OtaTopicJobNotify   }
+};
+
+/**
+ * @brief Stream data topic subscribed by the OTA agent, matched exactly while
+ * its length is not zero.
+ */
+static char cStreamDataTopic[ OTA_TOPIC_STREAM_DATA_SIZE ];
+static size_t xStreamDataTopicLength = 0U;
+
+/**
+ * @brief Lock of the stream data topic, which is set by the OTA agent task and
+ * read by the coreMQTT-Agent task.
+ */
+static portMUX_TYPE xStreamDataTopicLock = portMUX_INITIALIZER_UNLOCKED;
+
 /**
  * @brief Buffer used to store the firmware image file path.
  * Buffer is passed to the OTA agent during initialization.
@@ -209,20 +304,6 @@ static uint8_t decodeMem[ ( 1U << otaconfigLOG2_FILE_BLOCK_SIZE ) ];
  */
 static uint8_t bitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
 
-/**
- * @brief A statically allocated array of event buffers used by the OTA agent.
- * Maximum number of buffers are determined by how many chunks are requested
- * by OTA agent at a time along with an extra buffer to handle control message.
- * The size of each buffer is determined by the maximum size of firmware image
- * chunk, and other metadata send along with the chunk.
- */
-static OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ] = { 0 };
-
-/**
- * @brief Mutex used to manage thread safe access of OTA event buffers.
- */
-static SemaphoreHandle_t xBufferSemaphore;
-
 /**
  * @brief Static handle used for MQTT agent context.
  */
@@ -247,10 +328,31 @@ static OtaAppBuffer_t otaBuffer =
 };
 
 /**
- * @brief This boolean is set by the coreMQTT-Agent event handler and signals
- * the OTA demo task to suspend the OTA Agent.
+ * @brief Handle of the OTA demo task, which supervises the OTA agent.
+ */
+static TaskHandle_t xOtaDemoTaskHandle = NULL;
+
+/**
+ * @brief Latest MQTT connection state and OTA job state, set by the
+ * coreMQTT-Agent state callback before it notifies the OTA demo task.
  */
-BaseType_t xSuspendOta = pdFALSE;
+static volatile BaseType_t xMqttConnected = pdTRUE;
+static volatile BaseType_t xOtaJobActive = pdFALSE;
+
+/**
+ * @brief Handle of the OTA agent task, used to measure its CPU time.
+ */
+static TaskHandle_t xOtaAgentTaskHandle = NULL;
+
+/**
+ * @brief Measurements of the file transfer of the current job, started by the
+ * first block received and reported when the job ends.
+ */
+static volatile BaseType_t xTransferStarted = pdFALSE;
+static TickType_t xTransferStartTick = 0U;
+static uint32_t ulTransferStartRunTime = 0U;
+static volatile uint32_t ulTransferBlocks = 0U;
+static volatile uint32_t ulTransferBytes = 0U;
 
 /**
  * @brief Structure used for encoding firmware version.
@@ -286,6 +388,38 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
                                        uint32_t msgSize,
                                        uint8_t qos );
 
+/**
+ * @brief Publish a message through the MQTT agent and wait for the publish to
+ * complete.
+ *
+ * @param[in] pacTopic Topic to publish to.
+ * @param[in] topicLen Length of the topic string.
+ * @param[in] pMsg Message to publish.
+ * @param[in] msgSize Size of the message to publish.
+ * @param[in] qos Qos for the publish.
+ * @return OtaMqttSuccess if successful. Appropriate error code otherwise.
+ */
+static OtaMqttStatus_t prvPublishToBroker( const char * const pacTopic,
+                                           uint16_t topicLen,
+                                           const char * pMsg,
+                                           uint32_t msgSize,
+                                           uint8_t qos );
+
+#if otademoconfigENABLE_STREAM_PIPELINES
+
+/**
+ * @brief Publish one pipeline request on the stream request topic.
+ *
+ * @param[in] pucRequest The CBOR encoded request.
+ * @param[in] ulLength Length of the request.
+ * @param[in] pvContext The OtaPipelineRequestContext_t of the request.
+ * @return pdPASS if the request was sent, pdFAIL otherwise.
+ */
+    static BaseType_t prvSendPipelineRequest( const uint8_t * pucRequest,
+                                              uint32_t ulLength,
+                                              void * pvContext );
+#endif /* otademoconfigENABLE_STREAM_PIPELINES */
+
 /**
  * @brief Function used by OTA agent to subscribe for a control or data packet from the MQTT broker.
  *
@@ -325,31 +459,6 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
                                            uint16_t topicFilterLength,
                                            uint8_t ucQoS );
 
-/**
- * @brief Fetch an unused OTA event buffer from the pool.
- *
- * Demo uses a simple statically allocated array of fixed size event buffers. The
- * number of event buffers is configured by the param otaconfigMAX_NUM_OTA_DATA_BUFFERS
- * within ota_config.h. This function is used to fetch a free buffer from the pool for processing
- * by the OTA agent task. It uses a mutex for thread safe access to the pool.
- *
- * @return A pointer to an unused buffer. NULL if there are no buffers available.
- */
-static OtaEventData_t * prvOTAEventBufferGet( void );
-
-/**
- * @brief Free an event buffer back to pool
- *
- * OTA demo uses a statically allocated array of fixed size event buffers . The
- * number of event buffers is configured by the param otaconfigMAX_NUM_OTA_DATA_BUFFERS
- * within ota_config.h. The function is used by the OTA application callback to free a buffer,
- * after OTA agent has completed processing with the event. The access to the pool is made thread safe
- * using a mutex.
- *
- * @param[in] pxBuffer Pointer to the buffer to be freed.
- */
-static void prvOTAEventBufferFree( OtaEventData_t * const pxBuffer );
-
 /**
  * @brief The function which runs the OTA agent task.
  *
@@ -366,14 +475,41 @@ static void prvOTAAgentTask( void * pvParam );
 /**
  * @brief The function which runs the OTA demo task.
  *
- * The demo task initializes the OTA agent an loops until OTA agent is shutdown.
- * It reports OTA update statistics (which includes number of blocks received, processed and dropped),
- * at regular intervals.
+ * The demo task initializes the OTA agent and then supervises it until it is
+ * shutdown. It sleeps until notified of a connection change, an OTA job
+ * starting or stopping, or the agent stopping, and suspends or resumes the
+ * agent as soon as the connection changes. While a job is active it reports
+ * OTA update statistics (which includes number of blocks received, processed
+ * and dropped) at regular intervals.
  *
  * @param[in] pvParam Any parameters to be passed to OTA demo task.
  */
 static void prvOTADemoTask( void * pvParam );
 
+/**
+ * @brief Wake the OTA demo task with the given notification bits.
+ */
+static void prvNotifyOTADemoTask( uint32_t ulBits );
+
+/**
+ * @brief Log the OTA statistics of the current job.
+ */
+static void prvLogOTAStatistics( void );
+
+/**
+ * @brief Get the run time counter of the OTA agent task, 0 if run time
+ * statistics are not enabled.
+ */
+static uint32_t prvGetOTAAgentRunTime( void );
+
+/**
+ * @brief Log the throughput of the file transfer of the job that just ended:
+ * blocks per second, CPU time of the OTA agent per block, peak event buffer
+ * usage and total time. Compare with the report of
+ * tools/ota_stream_server when benchmarking OTA changes.
+ */
+static void prvLogOTATransferSummary( void );
+
 /**
  * @brief Callback invoked for firmware image chunks received from MQTT broker.
  *
@@ -404,19 +540,39 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
                                           MQTTPublishInfo_t * pPublishInfo );
 
 /**
- * @brief Matches a client identifier within an OTA topic.
- * This function is used to validate that topic is valid and intended for this device thing name.
+ * @brief Checks whether the part of an OTA topic following the thing name is
+ * a job update response, `jobs/<job ID>/update/<result>`.
+ *
+ * @param[in] pcSuffix Part of the topic following the thing name.
+ * @param[in] xSuffixLength Length of the suffix.
+ * @return true if the suffix is a job update response.
+ */
+static bool prvIsJobUpdateResponse( const char * pcSuffix,
+                                    size_t xSuffixLength );
+
+/**
+ * @brief Remember the stream data topic subscribed by the OTA agent, or
+ * forget it when it is unsubscribed.
  *
- * @param[in] pTopic Pointer to the topic
- * @param[in] topicNameLength length of the topic
- * @param[in] pClientIdentifier Client identifier, should be null terminated.
- * @param[in] clientIdentifierLength Length of the client identifier.
- * @return true if client identifier is found within the topic at the right index.
+ * @param[in] pcTopicFilter The topic filter.
+ * @param[in] usTopicFilterLength Length of the topic filter.
+ * @param[in] xSubscribed Whether the filter is subscribed or unsubscribed.
  */
-static bool prvMatchClientIdentifierInTopic( const char * pTopic,
-                                             size_t topicNameLength,
-                                             const char * pClientIdentifier,
-                                             size_t clientIdentifierLength );
+static void prvUpdateStreamDataTopic( const char * pcTopicFilter,
+                                      uint16_t usTopicFilterLength,
+                                      bool xSubscribed );
+
+/**
+ * @brief Classifies a topic by exact comparison with the topics of this
+ * device, with the job ID of job update responses skipped.
+ *
+ * @param[in] pcTopic Pointer to the topic, not null terminated.
+ * @param[in] xTopicLength Length of the topic.
+ * @return Kind of OTA topic, OtaTopicNone if the topic is not an OTA topic
+ * of this device.
+ */
+static OtaTopicType_t prvClassifyOtaTopic( const char * pcTopic,
+                                           size_t xTopicLength );
 
 /**
  * @brief The OTA agent has completed the update job or it is in
@@ -441,88 +597,186 @@ static void prvOtaAppCallback( OtaJobEvent_t event,
                                const void * pData );
 
 /**
- * @brief Suspends the OTA agent.
+ * @brief Suspends the OTA agent. The agent processes the request
+ * asynchronously, after any event already queued.
+ *
+ * @return pdTRUE if the request was sent to the agent.
  */
-static void prvSuspendOTACodeSigningDemo( void );
+static BaseType_t prvSuspendOTACodeSigningDemo( void );
 
 /**
- * @brief Resumes the OTA agent.
+ * @brief Resumes the OTA agent. The agent processes the request
+ * asynchronously, after any event already queued.
+ *
+ * @return pdTRUE if the request was sent to the agent.
  */
-static void prvResumeOTACodeSigningDemo( void );
+static BaseType_t prvResumeOTACodeSigningDemo( void );
 
 /**
- * @brief ESP Event Loop library handler for coreMQTT-Agent events.
+ * @brief Connection state callback for coreMQTT-Agent events.
  *
- * This handles events defined in core_mqtt_agent_events.h.
+ * This handles events defined in core_mqtt_agent_manager_events.h.
  */
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData );
+static void prvCoreMqttAgentStateCallback( int32_t lEventId,
+                                           uint32_t ulState,
+                                           void * pvContext );
 
 /* Static function definitions ************************************************/
 
-static void prvOTAEventBufferFree( OtaEventData_t * const pxBuffer )
+static void prvOTAAgentTask( void * pvParam )
 {
-    if( xSemaphoreTake( xBufferSemaphore, portMAX_DELAY ) == pdTRUE )
-    {
-        pxBuffer->bufferUsed = false;
-        ( void ) xSemaphoreGive( xBufferSemaphore );
-    }
-    else
+    OTA_EventProcessingTask( pvParam );
+    prvNotifyOTADemoTask( OTA_SUPERVISOR_AGENT_STOPPED );
+    vTaskDelete( NULL );
+}
+
+static void prvNotifyOTADemoTask( uint32_t ulBits )
+{
+    if( xOtaDemoTaskHandle != NULL )
     {
-        ESP_LOGE( TAG, "Failed to get buffer semaphore." );
+        ( void ) xTaskNotify( xOtaDemoTaskHandle, ulBits, eSetBits );
     }
 }
 
-static OtaEventData_t * prvOTAEventBufferGet( void )
+static void prvLogOTAStatistics( void )
 {
-    uint32_t ulIndex = 0;
-    OtaEventData_t * pFreeBuffer = NULL;
+    /* OTA library packet statistics per job.*/
+    OtaAgentStatistics_t otaStatistics = { 0 };
 
-    if( xSemaphoreTake( xBufferSemaphore, portMAX_DELAY ) == pdTRUE )
-    {
-        for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
+    /* OTA event buffer pool usage, to size otaconfigMAX_NUM_OTA_DATA_BUFFERS. */
+    OtaEventBufferPoolStats_t xPoolStats = { 0 };
+
+    #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+        /* State of the adaptive block window. */
+        OtaBlockWindowStats_t xWindowStats = { 0 };
+    #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+    #if otademoconfigENABLE_METRICS
+        /* Progress, rate and ETA of the download. */
+        OtaMetrics_t xMetrics = { 0 };
+    #endif /* otademoconfigENABLE_METRICS */
+
+    /* Get OTA statistics for currently executing job. */
+    OTA_GetStatistics( &otaStatistics );
+
+    ESP_LOGI( TAG,
+              " Received: %" PRIu32 "   Queued: %" PRIu32 "   Processed: %" PRIu32 "   Dropped: %" PRIu32 "",
+              otaStatistics.otaPacketsReceived,
+              otaStatistics.otaPacketsQueued,
+              otaStatistics.otaPacketsProcessed,
+              otaStatistics.otaPacketsDropped );
+
+    vOtaEventBufferPoolGetStats( &xPoolStats );
+
+    ESP_LOGI( TAG,
+              " Event buffers free: %" PRIu32 "/%" PRIu32 "   Low-water: %" PRIu32 "   Exhausted: %" PRIu32 "",
+              xPoolStats.ulFree,
+              xPoolStats.ulCapacity,
+              xPoolStats.ulLowWaterMark,
+              xPoolStats.ulExhaustedCount );
+
+    #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+        vOtaBlockWindowGetStats( &xWindowStats );
+
+        ESP_LOGI( TAG,
+                  " Block window: %" PRIu32 "/%" PRIu32 "   RTT: %" PRIu32 " ms (min %" PRIu32 " ms)   Increases: %" PRIu32 "   Decreases: %" PRIu32 "   Requests held back: %" PRIu32 "",
+                  xWindowStats.ulWindow,
+                  xWindowStats.ulMaxWindow,
+                  xWindowStats.ulSmoothedRttMs,
+                  xWindowStats.ulMinRttMs,
+                  xWindowStats.ulIncreases,
+                  xWindowStats.ulDecreases,
+                  xWindowStats.ulSuppressed );
+    #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+    #if otademoconfigENABLE_METRICS
+        vOtaMetricsGet( &xMetrics );
+
+        ESP_LOGI( TAG,
+                  " Progress: %" PRIu32 "/%" PRIu32 " bytes   Rate: %" PRIu32 " B/s   ETA: %" PRId32 " s   Retransmitted: %" PRIu32 "   Duplicates: %" PRIu32 "   Flash: %" PRIu32 " us/block",
+                  xMetrics.ulBytesWritten,
+                  xMetrics.ulFileSize,
+                  xMetrics.ulThroughputBps,
+                  ( xMetrics.ulEtaSeconds == OTA_METRICS_ETA_UNKNOWN ) ? -1 : ( int32_t ) xMetrics.ulEtaSeconds,
+                  xMetrics.ulRetransmittedBlocks,
+                  xMetrics.ulDuplicateBlocks,
+                  xMetrics.ulFlashWriteUsPerBlock );
+    #endif /* otademoconfigENABLE_METRICS */
+}
+
+static uint32_t prvGetOTAAgentRunTime( void )
+{
+    uint32_t ulRunTime = 0U;
+
+    #if ( configUSE_TRACE_FACILITY == 1 ) && ( configGENERATE_RUN_TIME_STATS == 1 )
+        TaskStatus_t xTaskStatus = { 0 };
+
+        if( xOtaAgentTaskHandle != NULL )
         {
-            if( eventBuffer[ ulIndex ].bufferUsed == false )
-            {
-                eventBuffer[ ulIndex ].bufferUsed = true;
-                pFreeBuffer = &eventBuffer[ ulIndex ];
-                break;
-            }
+            vTaskGetInfo( xOtaAgentTaskHandle, &xTaskStatus, pdFALSE, eRunning );
+            ulRunTime = xTaskStatus.ulRunTimeCounter;
         }
+    #endif /* ( configUSE_TRACE_FACILITY == 1 ) && ( configGENERATE_RUN_TIME_STATS == 1 ) */
 
-        ( void ) xSemaphoreGive( xBufferSemaphore );
-    }
-    else
-    {
-        ESP_LOGE( TAG, "Failed to get buffer semaphore." );
-    }
-
-    return pFreeBuffer;
+    return ulRunTime;
 }
 
-static void prvOTAAgentTask( void * pvParam )
+static void prvLogOTATransferSummary( void )
 {
-    OTA_EventProcessingTask( pvParam );
-    vTaskDelete( NULL );
+    OtaEventBufferPoolStats_t xPoolStats = { 0 };
+    uint32_t ulElapsedMs = 0U;
+    uint32_t ulBlocks = ulTransferBlocks;
+    uint32_t ulRunTime = 0U;
+
+    if( xTransferStarted == pdTRUE )
+    {
+        ulElapsedMs = ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() - xTransferStartTick );
+        ulRunTime = prvGetOTAAgentRunTime() - ulTransferStartRunTime;
+        vOtaEventBufferPoolGetStats( &xPoolStats );
+
+        ESP_LOGI( TAG,
+                  "OTA transfer: %" PRIu32 " blocks, %" PRIu32 " bytes in %" PRIu32 " ms, %" PRIu32 " blocks/s, "
+                  "agent CPU %" PRIu32 " us/block, peak event buffers %" PRIu32 "/%" PRIu32 ".",
+                  ulBlocks,
+                  ulTransferBytes,
+                  ulElapsedMs,
+                  ( ulElapsedMs > 0U ) ? ( uint32_t ) ( ( ( uint64_t ) ulBlocks * 1000U ) / ulElapsedMs ) : 0U,
+                  ( ulBlocks > 0U ) ? ( ulRunTime / ulBlocks ) : 0U,
+                  xPoolStats.ulCapacity - xPoolStats.ulLowWaterMark,
+                  xPoolStats.ulCapacity );
+
+        xTransferStarted = pdFALSE;
+    }
 }
 
 static void prvOtaAppCallback( OtaJobEvent_t event,
                                const void * pData )
 {
     OtaErr_t err = OtaErrUninitialized;
+    BaseType_t xActivate = pdPASS;
+    OtaImageState_t xImageState = OtaImageStateAccepted;
 
     switch( event )
     {
         case OtaJobEventActivate:
             ESP_LOGI( TAG, "Received OtaJobEventActivate callback from OTA Agent." );
 
+            /* Activation resets the device, so report the transfer first. */
+            prvLogOTATransferSummary();
+
+            #if otademoconfigENABLE_BUNDLE
+                /* The new image copies the data files of a bundle once it runs. */
+                xActivate = xOtaBundleCommit();
+            #endif /* otademoconfigENABLE_BUNDLE */
+
             /**
              * Activate the new firmware image immediately. Applications can choose to postpone
              * the activation to a later stage if needed.
              */
-            err = OTA_ActivateNewImage();
+            if( xActivate == pdPASS )
+            {
+                err = OTA_ActivateNewImage();
+            }
 
             /**
              * Activation of the new image failed. This indicates an error that requires a follow
@@ -545,6 +799,15 @@ static void prvOtaAppCallback( OtaJobEvent_t event,
         case OtaJobEventFail:
             ESP_LOGI( TAG, "Received an OtaJobEventFail notification from OTA Agent." );
 
+            #if otademoconfigENABLE_EARLY_IMAGE_CHECK
+                if( xOtaImageCheckGetResult() > OtaImageCheckPassed )
+                {
+                    ESP_LOGE( TAG, "Image rejected from its header, reason %d.", ( int ) xOtaImageCheckGetResult() );
+                }
+            #endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+
+            prvLogOTATransferSummary();
+
             /* Signal coreMQTT-Agent network manager that an OTA job has stopped. */
             xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_OTA_STOPPED_EVENT );
             break;
@@ -559,15 +822,29 @@ static void prvOtaAppCallback( OtaJobEvent_t event,
 
             ESP_LOGI( TAG, "Received OtaJobEventStartTest callback from OTA Agent." );
 
-            err = OTA_SetImageState( OtaImageStateAccepted );
+            #if otademoconfigENABLE_BUNDLE
+                /* The data files of a bundle are part of the update, so an
+                 * image whose data cannot be applied is rolled back. */
+                if( xOtaBundleApplyPending( true ) != pdPASS )
+                {
+                    ESP_LOGE( TAG, "Failed to apply the data files of the bundle." );
+                    xImageState = OtaImageStateRejected;
+                }
+            #endif /* otademoconfigENABLE_BUNDLE */
+
+            err = OTA_SetImageState( xImageState );
 
-            if( err == OtaErrNone )
+            if( ( err == OtaErrNone ) && ( xImageState == OtaImageStateAccepted ) )
             {
                 ESP_LOGI( TAG, "New image validation succeeded in self test mode." );
             }
+            else if( err == OtaErrNone )
+            {
+                ESP_LOGE( TAG, "New image rejected in self test mode." );
+            }
             else
             {
-                ESP_LOGE( TAG, "Failed to set image state as accepted with error %d.", err );
+                ESP_LOGE( TAG, "Failed to set image state with error %d.", err );
             }
 
             /* Signal coreMQTT-Agent network manager that an OTA job has stopped. */
@@ -578,7 +855,12 @@ static void prvOtaAppCallback( OtaJobEvent_t event,
 
             ESP_LOGI( TAG, "OTA Event processing completed. Freeing the event buffer to pool." );
             configASSERT( pData != NULL );
-            prvOTAEventBufferFree( ( OtaEventData_t * ) pData );
+
+            #if otademoconfigENABLE_DIRECT_WRITE
+                vOtaDirectWriteForget( ( OtaEventData_t * ) pData );
+            #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+            vOtaEventBufferFree( ( OtaEventData_t * ) pData );
 
             break;
 
@@ -597,6 +879,8 @@ static void prvOtaAppCallback( OtaJobEvent_t event,
 
         case OtaJobEventReceivedJob:
             ESP_LOGI( TAG, "Received OtaJobEventReceivedJob callback from OTA Agent." );
+            /* The transfer of the new job is measured from its first block. */
+            xTransferStarted = pdFALSE;
             /* Signal coreMQTT-Agent network manager that an OTA job has started. */
             xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_OTA_STARTED_EVENT );
             break;
@@ -623,26 +907,98 @@ static void prvProcessIncomingData( void * pxSubscriptionContext,
 
     OtaEventData_t * pData;
     OtaEventMsg_t eventMsg = { 0 };
+    bool xRequestMore = false;
+    BaseType_t xCopied = pdFAIL;
 
     ESP_LOGD( TAG, "Received OTA image block, size %d.\n\n", pPublishInfo->payloadLength );
 
     configASSERT( pPublishInfo->payloadLength <= OTA_DATA_BLOCK_SIZE );
 
-    pData = prvOTAEventBufferGet();
+    if( xTransferStarted == pdFALSE )
+    {
+        xTransferStartTick = xTaskGetTickCount();
+        ulTransferStartRunTime = prvGetOTAAgentRunTime();
+        ulTransferBlocks = 0U;
+        ulTransferBytes = 0U;
+        xTransferStarted = pdTRUE;
+    }
+
+    ulTransferBlocks++;
+    ulTransferBytes += pPublishInfo->payloadLength;
+
+    #if configMQTT_AGENT_TRAFFIC_SHAPER
+        /* Blocks use the link whether or not they are processed, so they are
+         * charged to the OTA share on arrival. */
+        vCoreMqttAgentShaperConsume( CORE_MQTT_AGENT_TRAFFIC_OTA,
+                                     ( uint32_t ) pPublishInfo->topicNameLength + pPublishInfo->payloadLength );
+    #endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
+    pData = pxOtaEventBufferGet();
+
+    #if otademoconfigENABLE_METRICS
+        /* Counted before the OTA agent can request more blocks. */
+        vOtaMetricsOnBlockReceived( ( uint32_t ) pPublishInfo->payloadLength,
+                                    ( pData == NULL ) ? pdTRUE : pdFALSE );
+    #endif /* otademoconfigENABLE_METRICS */
 
     if( pData != NULL )
     {
-        memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
-        pData->dataLength = pPublishInfo->payloadLength;
+        #if otademoconfigENABLE_DIRECT_WRITE
+            /* Lets the flash writer program the block from this buffer. */
+            xCopied = xOtaDirectWriteCopyBlock( ( const uint8_t * ) pPublishInfo->pPayload,
+                                                pPublishInfo->payloadLength,
+                                                pData );
+        #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+        if( xCopied != pdPASS )
+        {
+            memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+            pData->dataLength = pPublishInfo->payloadLength;
+        }
+
         eventMsg.eventId = OtaAgentEventReceivedFileBlock;
         eventMsg.pEventData = pData;
 
         /* Send job document received event. */
-        OTA_SignalEvent( &eventMsg );
+        if( OTA_SignalEvent( &eventMsg ) == false )
+        {
+            /* The OTA agent never sees the buffer, so it is not processed. */
+            #if otademoconfigENABLE_DIRECT_WRITE
+                vOtaDirectWriteForget( pData );
+            #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+            vOtaEventBufferFree( pData );
+        }
+
+        #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+            /* Rounds end here, not when the OTA agent counted its own
+             * number of blocks. */
+            xRequestMore = xOtaBlockWindowOnBlock();
+        #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+        #if otademoconfigENABLE_STREAM_PIPELINES
+            /* A drained pipeline is refilled without waiting for the others. */
+            if( xOtaStreamPipelinesOnBlock( ( const uint8_t * ) pPublishInfo->pPayload,
+                                            ( uint32_t ) pPublishInfo->payloadLength ) == true )
+            {
+                xRequestMore = true;
+            }
+        #endif /* otademoconfigENABLE_STREAM_PIPELINES */
     }
     else
     {
         ESP_LOGE( TAG, "Error: No OTA data buffers available.\r\n" );
+
+        #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+            xRequestMore = xOtaBlockWindowOnDrop();
+        #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+    }
+
+    if( xRequestMore == true )
+    {
+        eventMsg.eventId = OtaAgentEventRequestFileBlock;
+        eventMsg.pEventData = NULL;
+        OTA_SignalEvent( &eventMsg );
     }
 }
 
@@ -651,6 +1007,7 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
 {
     OtaEventData_t * pData;
     OtaEventMsg_t eventMsg = { 0 };
+    OtaJobDocumentResult_t xDocumentResult = OtaJobDocumentCompacted;
 
     ( void ) pxSubscriptionContext;
 
@@ -658,19 +1015,48 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
 
     ESP_LOGI( TAG, "Received job message callback, size %d.\n\n", pPublishInfo->payloadLength );
 
-    configASSERT( pPublishInfo->payloadLength <= OTA_DATA_BLOCK_SIZE );
-
-    pData = prvOTAEventBufferGet();
+    pData = pxOtaEventBufferGet();
 
     if( pData != NULL )
     {
-        memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
-        pData->dataLength = pPublishInfo->payloadLength;
-        eventMsg.eventId = OtaAgentEventReceivedJobDocument;
-        eventMsg.pEventData = pData;
+        if( pPublishInfo->payloadLength <= OTA_DATA_BLOCK_SIZE )
+        {
+            memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+            pData->dataLength = pPublishInfo->payloadLength;
+        }
+        else
+        {
+            /* Only the fields read by the OTA agent are handed to it. */
+            xDocumentResult = xOtaJobDocumentCompact( ( const char * ) pPublishInfo->pPayload,
+                                                      pPublishInfo->payloadLength,
+                                                      pData->data,
+                                                      sizeof( pData->data ),
+                                                      &pData->dataLength );
+        }
 
-        /* Send job document received event. */
-        OTA_SignalEvent( &eventMsg );
+        if( xDocumentResult == OtaJobDocumentCompacted )
+        {
+            eventMsg.eventId = OtaAgentEventReceivedJobDocument;
+            eventMsg.pEventData = pData;
+
+            /* Send job document received event. */
+            if( OTA_SignalEvent( &eventMsg ) == false )
+            {
+                /* The OTA agent never sees the buffer, so it is not processed. */
+                vOtaEventBufferFree( pData );
+            }
+        }
+        else
+        {
+            vOtaEventBufferFree( pData );
+
+            /* Jobs of other applications are left for them to handle. */
+            if( xDocumentResult == OtaJobDocumentTooLarge )
+            {
+                vOtaJobDocumentReject( ( const char * ) pPublishInfo->pPayload,
+                                       pPublishInfo->payloadLength );
+            }
+        }
     }
     else
     {
@@ -678,37 +1064,114 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
     }
 }
 
-static bool prvMatchClientIdentifierInTopic( const char * pTopic,
-                                             size_t topicNameLength,
-                                             const char * pClientIdentifier,
-                                             size_t clientIdentifierLength )
+static bool prvIsJobUpdateResponse( const char * pcSuffix,
+                                    size_t xSuffixLength )
 {
     bool isMatch = false;
-    size_t idx, matchIdx = 0;
+    size_t idx = sizeof( "jobs/" ) - 1U;
 
-    for( idx = OTA_TOPIC_CLIENT_IDENTIFIER_START_IDX; idx < topicNameLength; idx++ )
+    if( ( xSuffixLength > idx ) && ( memcmp( pcSuffix, "jobs/", idx ) == 0 ) )
     {
-        if( matchIdx == clientIdentifierLength )
+        /* Skip the job ID. */
+        while( ( idx < xSuffixLength ) && ( pcSuffix[ idx ] != '/' ) )
         {
-            if( pTopic[ idx ] == '/' )
-            {
-                isMatch = true;
-            }
+            idx++;
+        }
 
-            break;
+        if( ( xSuffixLength > ( idx + OTA_JOB_UPDATE_RESPONSE_LEVEL_LENGTH ) ) &&
+            ( memcmp( &pcSuffix[ idx ], OTA_JOB_UPDATE_RESPONSE_LEVEL, OTA_JOB_UPDATE_RESPONSE_LEVEL_LENGTH ) == 0 ) )
+        {
+            isMatch = ( memchr( &pcSuffix[ idx + OTA_JOB_UPDATE_RESPONSE_LEVEL_LENGTH ],
+                                '/',
+                                xSuffixLength - idx - OTA_JOB_UPDATE_RESPONSE_LEVEL_LENGTH ) == NULL );
         }
-        else
+    }
+
+    return isMatch;
+}
+
+static void prvUpdateStreamDataTopic( const char * pcTopicFilter,
+                                      uint16_t usTopicFilterLength,
+                                      bool xSubscribed )
+{
+    /* Only a stream data topic without wildcards is matched exactly. */
+    if( ( usTopicFilterLength > OTA_TOPIC_STREAMS_PREFIX_LENGTH ) &&
+        ( usTopicFilterLength < sizeof( cStreamDataTopic ) ) &&
+        ( memcmp( pcTopicFilter, OTA_TOPIC_STREAMS_PREFIX, OTA_TOPIC_STREAMS_PREFIX_LENGTH ) == 0 ) &&
+        ( memchr( pcTopicFilter, '+', usTopicFilterLength ) == NULL ) &&
+        ( memchr( pcTopicFilter, '#', usTopicFilterLength ) == NULL ) )
+    {
+        taskENTER_CRITICAL( &xStreamDataTopicLock );
         {
-            if( pClientIdentifier[ matchIdx ] != pTopic[ idx ] )
+            if( xSubscribed == true )
+            {
+                memcpy( cStreamDataTopic, pcTopicFilter, usTopicFilterLength );
+                xStreamDataTopicLength = usTopicFilterLength;
+            }
+            else if( ( xStreamDataTopicLength == usTopicFilterLength ) &&
+                     ( memcmp( cStreamDataTopic, pcTopicFilter, usTopicFilterLength ) == 0 ) )
             {
-                break;
+                xStreamDataTopicLength = 0U;
             }
         }
+        taskEXIT_CRITICAL( &xStreamDataTopicLock );
+    }
+}
+
+static OtaTopicType_t prvClassifyOtaTopic( const char * pcTopic,
+                                           size_t xTopicLength )
+{
+    OtaTopicType_t xType = OtaTopicNone;
+    bool xStreamDataTopicKnown = false;
+    size_t idx;
+
+    /* Blocks are the most frequent, and are only accepted from the stream the
+     * OTA agent subscribed to. */
+    taskENTER_CRITICAL( &xStreamDataTopicLock );
+    {
+        xStreamDataTopicKnown = ( xStreamDataTopicLength != 0U );
+
+        if( ( xTopicLength == xStreamDataTopicLength ) &&
+            ( memcmp( pcTopic, cStreamDataTopic, xTopicLength ) == 0 ) )
+        {
+            xType = OtaTopicStreamData;
+        }
+    }
+    taskEXIT_CRITICAL( &xStreamDataTopicLock );
 
-        matchIdx++;
+    for( idx = 0U; ( idx < ( sizeof( xOtaJobTopics ) / sizeof( xOtaJobTopics[ 0 ] ) ) ) && ( xType == OtaTopicNone ); idx++ )
+    {
+        if( ( xTopicLength == xOtaJobTopics[ idx ].xTopicLength ) &&
+            ( memcmp( pcTopic, xOtaJobTopics[ idx ].pcTopic, xTopicLength ) == 0 ) )
+        {
+            xType = xOtaJobTopics[ idx ].xType;
+        }
     }
 
-    return isMatch;
+    if( ( xType == OtaTopicNone ) &&
+        ( xTopicLength > OTA_TOPIC_THING_PREFIX_LENGTH ) &&
+        ( memcmp( pcTopic, OTA_TOPIC_THING_PREFIX, OTA_TOPIC_THING_PREFIX_LENGTH ) == 0 ) )
+    {
+        if( prvIsJobUpdateResponse( &pcTopic[ OTA_TOPIC_THING_PREFIX_LENGTH ],
+                                    xTopicLength - OTA_TOPIC_THING_PREFIX_LENGTH ) == true )
+        {
+            xType = OtaTopicJobUpdate;
+        }
+        else if( ( xStreamDataTopicKnown == false ) &&
+                 ( xTopicLength > OTA_TOPIC_STREAMS_PREFIX_LENGTH ) &&
+                 ( memcmp( pcTopic, OTA_TOPIC_STREAMS_PREFIX, OTA_TOPIC_STREAMS_PREFIX_LENGTH ) == 0 ) )
+        {
+            /* No exact stream data topic is known, as after a subscription
+             * with a wildcard. */
+            xType = OtaTopicStreamData;
+        }
+        else
+        {
+            /* Not an OTA topic. */
+        }
+    }
+
+    return xType;
 }
 
 static void prvCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
@@ -738,6 +1201,9 @@ static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
     configASSERT( pTopicFilter != NULL );
     configASSERT( topicFilterLength > 0 );
 
+    /* Set before the first block can arrive. */
+    prvUpdateStreamDataTopic( pTopicFilter, topicFilterLength, true );
+
     xSubscribeInfo.pTopicFilter = pTopicFilter;
     xSubscribeInfo.topicFilterLength = topicFilterLength;
     xSubscribeInfo.qos = ucQoS;
@@ -796,9 +1262,101 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
                                        const char * pMsg,
                                        uint32_t msgSize,
                                        uint8_t qos )
+{
+    OtaMqttStatus_t otaRet = OtaMqttSuccess;
+    const char * pcRequest = pMsg;
+    bool xHandled = false;
+
+    #if otademoconfigENABLE_EARLY_IMAGE_CHECK
+        /* Fail the job with the reason the image was rejected. */
+        pcRequest = pcOtaImageCheckApplyJobStatus( pacTopic, topicLen, pMsg, &msgSize );
+    #endif /* otademoconfigENABLE_EARLY_IMAGE_CHECK */
+
+    #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+        pcRequest = pcOtaBlockWindowApply( pacTopic, topicLen, pMsg, msgSize );
+
+        /* The blocks of the current round are still on their way. */
+        xHandled = ( pcRequest == NULL );
+    #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+    #if otademoconfigENABLE_METRICS && ( otademoconfigENABLE_STREAM_PIPELINES == 0 )
+        if( xHandled == false )
+        {
+            uint32_t ulBlocks = otaconfigMAX_NUM_BLOCKS_REQUEST;
+
+            #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+                OtaBlockWindowStats_t xWindowStats = { 0 };
+
+                /* The window the request was just sized with. */
+                vOtaBlockWindowGetStats( &xWindowStats );
+                ulBlocks = xWindowStats.ulWindow;
+            #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+            vOtaMetricsOnRequest( pacTopic, topicLen, ulBlocks );
+        }
+    #endif /* otademoconfigENABLE_METRICS && ( otademoconfigENABLE_STREAM_PIPELINES == 0 ) */
+
+    #if otademoconfigENABLE_STREAM_PIPELINES
+    {
+        OtaPipelineRequestContext_t xRequestContext;
+        BaseType_t xResult = pdPASS;
+
+        xRequestContext.pcTopic = pacTopic;
+        xRequestContext.usTopicLength = topicLen;
+        xRequestContext.ucQoS = qos;
+
+        if( xHandled == false )
+        {
+            xHandled = xOtaStreamPipelinesSend( pacTopic, topicLen, pcRequest, msgSize,
+                                                prvSendPipelineRequest, &xRequestContext,
+                                                &xResult );
+        }
+
+        if( ( xHandled == true ) && ( xResult != pdPASS ) )
+        {
+            otaRet = OtaMqttPublishFailed;
+        }
+    }
+    #endif /* otademoconfigENABLE_STREAM_PIPELINES */
+
+    if( xHandled == false )
+    {
+        otaRet = prvPublishToBroker( pacTopic, topicLen, pcRequest, msgSize, qos );
+    }
+
+    return otaRet;
+}
+
+#if otademoconfigENABLE_STREAM_PIPELINES
+    static BaseType_t prvSendPipelineRequest( const uint8_t * pucRequest,
+                                              uint32_t ulLength,
+                                              void * pvContext )
+    {
+        const OtaPipelineRequestContext_t * pxRequestContext = ( const OtaPipelineRequestContext_t * ) pvContext;
+        BaseType_t xRet = pdFAIL;
+
+        if( prvPublishToBroker( pxRequestContext->pcTopic,
+                                pxRequestContext->usTopicLength,
+                                ( const char * ) pucRequest,
+                                ulLength,
+                                pxRequestContext->ucQoS ) == OtaMqttSuccess )
+        {
+            xRet = pdPASS;
+        }
+
+        return xRet;
+    }
+#endif /* otademoconfigENABLE_STREAM_PIPELINES */
+
+static OtaMqttStatus_t prvPublishToBroker( const char * const pacTopic,
+                                           uint16_t topicLen,
+                                           const char * pMsg,
+                                           uint32_t msgSize,
+                                           uint8_t qos )
 {
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
     BaseType_t result;
+    BaseType_t xLinkReady = pdPASS;
     MQTTStatus_t mqttStatus = MQTTBadParameter;
     MQTTPublishInfo_t publishInfo = { 0 };
     MQTTAgentCommandInfo_t xCommandParams = { 0 };
@@ -817,9 +1375,27 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
     xCommandParams.cmdCompleteCallback = prvCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
 
-    mqttStatus = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                    &publishInfo,
-                                    &xCommandParams );
+    #if configMQTT_AGENT_TRAFFIC_SHAPER
+        /* Requests are sent within the OTA share of the link, which also
+         * paces the blocks they ask for. The debt of the blocks received
+         * may take longer than a command timeout to pay off, so the wait is
+         * as long as the OTA agent waits for blocks before it asks again. A
+         * request that fails here is retried by the agent. */
+        xLinkReady = xCoreMqttAgentShaperAcquire( CORE_MQTT_AGENT_TRAFFIC_OTA,
+                                                  ( uint32_t ) topicLen + publishInfo.payloadLength,
+                                                  pdMS_TO_TICKS( otaconfigFILE_REQUEST_WAIT_MS ) );
+    #endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
+    if( xLinkReady == pdPASS )
+    {
+        mqttStatus = MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                        &publishInfo,
+                                        &xCommandParams );
+    }
+    else
+    {
+        mqttStatus = MQTTSendFailed;
+    }
 
     /* Wait for command to complete so MQTTSubscribeInfo_t remains in scope for the
      * duration of the command. */
@@ -924,6 +1500,8 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
                   topicFilterLength,
                   pTopicFilter );
 
+        prvUpdateStreamDataTopic( pTopicFilter, topicFilterLength, false );
+
         otaRet = OtaMqttSuccess;
     }
 
@@ -952,13 +1530,13 @@ static void setOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
 
     /* Initialize the OTA library PAL Interface.*/
     pOtaInterfaces->pal.getPlatformImageState = otaPal_GetPlatformImageState;
-    pOtaInterfaces->pal.setPlatformImageState = otaPal_SetPlatformImageState;
-    pOtaInterfaces->pal.writeBlock = otaPal_WriteBlock;
-    pOtaInterfaces->pal.activate = otaPal_ActivateNewImage;
-    pOtaInterfaces->pal.closeFile = otaPal_CloseFile;
+    pOtaInterfaces->pal.setPlatformImageState = xOtaFlashWriterSetPlatformImageState;
+    pOtaInterfaces->pal.writeBlock = sOtaFlashWriterWriteBlock;
+    pOtaInterfaces->pal.activate = xOtaFlashWriterActivateNewImage;
+    pOtaInterfaces->pal.closeFile = xOtaFlashWriterCloseFile;
     pOtaInterfaces->pal.reset = otaPal_ResetDevice;
-    pOtaInterfaces->pal.abort = otaPal_Abort;
-    pOtaInterfaces->pal.createFile = otaPal_CreateFileForRx;
+    pOtaInterfaces->pal.abort = xOtaFlashWriterAbort;
+    pOtaInterfaces->pal.createFile = xOtaFlashWriterCreateFile;
 }
 
 static void prvOTADemoTask( void * pvParam )
@@ -976,11 +1554,23 @@ static void prvOTADemoTask( void * pvParam )
     /* OTA interface context required for library interface functions.*/
     OtaInterfaces_t otaInterfaces;
 
-    /* OTA library packet statistics per job.*/
-    OtaAgentStatistics_t otaStatistics = { 0 };
+    /* Notification bits received by the supervisor loop. */
+    uint32_t ulNotifiedValue = 0U;
+
+    /* Whether the OTA agent has been asked to suspend. */
+    BaseType_t xOtaSuspended = pdFALSE;
 
-    /* OTA Agent state returned from calling OTA_GetAgentState.*/
-    OtaState_t state = OtaAgentStateStopped;
+    /* Whether a job was active when the task last woke. */
+    BaseType_t xJobWasActive = pdFALSE;
+
+    /* How long to sleep, forever unless statistics are due. */
+    TickType_t xTicksToWait;
+
+    #if configMQTT_AGENT_RPC
+        /* Whether the responses to job status updates are subscribed to. The
+         * agent manager restores the subscription after a reconnect. */
+        BaseType_t xRpcStarted = pdFALSE;
+    #endif /* configMQTT_AGENT_RPC */
 
     /* Set OTA Library interfaces.*/
     setOtaInterfaces( &otaInterfaces );
@@ -992,17 +1582,48 @@ static void prvOTADemoTask( void * pvParam )
 
     /****************************** Init OTA Library. ******************************/
 
-    xBufferSemaphore = xSemaphoreCreateMutex();
+    vOtaEventBufferPoolInit();
 
-    if( xBufferSemaphore == NULL )
-    {
-        xResult = pdFAIL;
-    }
+    #if otademoconfigENABLE_DIRECT_WRITE
+        vOtaDirectWriteInit();
+    #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+    #if otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW
+        vOtaBlockWindowInit();
+    #endif /* otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW */
+
+    #if otademoconfigENABLE_STREAM_PIPELINES
+        vOtaStreamPipelinesInit();
+    #endif /* otademoconfigENABLE_STREAM_PIPELINES */
+
+    #if otademoconfigENABLE_METRICS
+        if( xOtaMetricsInit() != pdPASS )
+        {
+            ESP_LOGW( TAG, "OTA metrics are not updated." );
+        }
+    #endif /* otademoconfigENABLE_METRICS */
+
+    #if otademoconfigENABLE_BUNDLE
+        /* Copies data files left pending by an image accepted before they
+         * were applied. */
+        if( xOtaBundleApplyPending( false ) != pdPASS )
+        {
+            ESP_LOGW( TAG, "Failed to apply the pending data files of a bundle." );
+        }
+    #endif /* otademoconfigENABLE_BUNDLE */
+
+    xResult = xOtaFlashWriterInit();
+
+    #if otademoconfigENABLE_PRE_ERASE
+        /* Pre-erasing only speeds up the next update, so run without it. */
+        if( xOtaPreEraseInit() != pdPASS )
+        {
+            ESP_LOGW( TAG, "Inactive OTA slot will not be pre-erased." );
+        }
+    #endif /* otademoconfigENABLE_PRE_ERASE */
 
     if( xResult == pdPASS )
     {
-        memset( eventBuffer, 0x00, sizeof( eventBuffer ) );
-
         if( ( otaRet = OTA_Init( &otaBuffer,
                                  &otaInterfaces,
                                  ( const uint8_t * ) ( otademoconfigCLIENT_IDENTIFIER ),
@@ -1021,7 +1642,7 @@ static void prvOTADemoTask( void * pvParam )
                                      otademoconfigAGENT_TASK_STACK_SIZE,
                                      NULL,
                                      otademoconfigAGENT_TASK_PRIORITY,
-                                     NULL ) ) != pdPASS )
+                                     &xOtaAgentTaskHandle ) ) != pdPASS )
         {
             ESP_LOGE( TAG, "Failed to start OTA Agent task: errno=%d",
                       xResult );
@@ -1036,29 +1657,48 @@ static void prvOTADemoTask( void * pvParam )
         eventMsg.eventId = OtaAgentEventStart;
         OTA_SignalEvent( &eventMsg );
 
-        while( ( state = OTA_GetState() ) != OtaAgentStateStopped )
+        /* Connection changes that arrived before the agent started are
+         * handled on the first pass. */
+        ulNotifiedValue = OTA_SUPERVISOR_CONNECTION_CHANGED | OTA_SUPERVISOR_JOB_CHANGED;
+
+        while( ( ulNotifiedValue & OTA_SUPERVISOR_AGENT_STOPPED ) == 0U )
         {
-            if( ( state != OtaAgentStateSuspended ) && ( xSuspendOta == pdTRUE ) )
+            if( ( ulNotifiedValue & OTA_SUPERVISOR_CONNECTION_CHANGED ) != 0U )
             {
-                prvSuspendOTACodeSigningDemo();
+                if( ( xMqttConnected == pdFALSE ) && ( xOtaSuspended == pdFALSE ) )
+                {
+                    xOtaSuspended = prvSuspendOTACodeSigningDemo();
+                }
+                else if( ( xMqttConnected == pdTRUE ) && ( xOtaSuspended == pdTRUE ) )
+                {
+                    xOtaSuspended = ( prvResumeOTACodeSigningDemo() == pdTRUE ) ? pdFALSE : pdTRUE;
+                }
+                else
+                {
+                    /* The agent is already in the requested state. */
+                }
+
+                #if configMQTT_AGENT_RPC
+                    if( ( xMqttConnected == pdTRUE ) && ( xRpcStarted == pdFALSE ) )
+                    {
+                        xRpcStarted = xCoreMqttAgentRpcStart( "$aws/things/" CONFIG_GRI_THING_NAME "/jobs/+/update/+" );
+                    }
+                #endif /* configMQTT_AGENT_RPC */
             }
-            else if( ( state == OtaAgentStateSuspended ) && ( xSuspendOta == pdFALSE ) )
+
+            /* Report statistics while a job is active, and once when it
+             * stops. */
+            if( ( ulNotifiedValue == 0U ) ||
+                ( ( ( ulNotifiedValue & OTA_SUPERVISOR_JOB_CHANGED ) != 0U ) && ( xJobWasActive != xOtaJobActive ) ) )
             {
-                prvResumeOTACodeSigningDemo();
+                prvLogOTAStatistics();
             }
 
-            /* Get OTA statistics for currently executing job. */
-            OTA_GetStatistics( &otaStatistics );
-
-            ESP_LOGI( TAG,
-                      " Received: %" PRIu32 "   Queued: %" PRIu32 "   Processed: %" PRIu32 "   Dropped: %" PRIu32 "",
-                      otaStatistics.otaPacketsReceived,
-                      otaStatistics.otaPacketsQueued,
-                      otaStatistics.otaPacketsProcessed,
-                      otaStatistics.otaPacketsDropped );
+            xJobWasActive = xOtaJobActive;
+            xTicksToWait = ( xJobWasActive == pdTRUE ) ? pdMS_TO_TICKS( otademoconfigTASK_DELAY_MS ) : portMAX_DELAY;
 
-
-            vTaskDelay( pdMS_TO_TICKS( otademoconfigTASK_DELAY_MS ) );
+            ulNotifiedValue = 0U;
+            ( void ) xTaskNotifyWait( 0U, MAX_UINT32, &ulNotifiedValue, xTicksToWait );
         }
     }
 
@@ -1067,58 +1707,64 @@ static void prvOTADemoTask( void * pvParam )
     vTaskDelete( NULL );
 }
 
-static void prvSuspendOTACodeSigningDemo( void )
+static BaseType_t prvSuspendOTACodeSigningDemo( void )
 {
-    if( ( OTA_GetState() != OtaAgentStateSuspended ) && ( OTA_GetState() != OtaAgentStateStopped ) )
-    {
-        OTA_Suspend();
+    BaseType_t xRet = pdFALSE;
 
-        while( ( OTA_GetState() != OtaAgentStateSuspended ) &&
-               ( OTA_GetState() != OtaAgentStateStopped ) )
-        {
-            vTaskDelay( pdMS_TO_TICKS( otademoconfigTASK_DELAY_MS ) );
-        }
+    if( OTA_GetState() != OtaAgentStateStopped )
+    {
+        xRet = ( OTA_Suspend() == OtaErrNone ) ? pdTRUE : pdFALSE;
     }
+
+    return xRet;
 }
 
-static void prvResumeOTACodeSigningDemo( void )
+static BaseType_t prvResumeOTACodeSigningDemo( void )
 {
-    if( OTA_GetState() == OtaAgentStateSuspended )
-    {
-        OTA_Resume();
+    BaseType_t xRet = pdFALSE;
 
-        while( OTA_GetState() == OtaAgentStateSuspended )
-        {
-            vTaskDelay( pdMS_TO_TICKS( otademoconfigTASK_DELAY_MS ) );
-        }
+    if( OTA_GetState() != OtaAgentStateStopped )
+    {
+        xRet = ( OTA_Resume() == OtaErrNone ) ? pdTRUE : pdFALSE;
     }
+
+    return xRet;
 }
 
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData )
+static void prvCoreMqttAgentStateCallback( int32_t lEventId,
+                                           uint32_t ulState,
+                                           void * pvContext )
 {
-    ( void ) pvHandlerArg;
-    ( void ) xEventBase;
-    ( void ) pvEventData;
+    ( void ) ulState;
+    ( void ) pvContext;
 
     switch( lEventId )
     {
         case CORE_MQTT_AGENT_CONNECTED_EVENT:
             ESP_LOGI( TAG, "coreMQTT-Agent connected. Resuming OTA agent." );
-            xSuspendOta = pdFALSE;
+            xMqttConnected = pdTRUE;
+            prvNotifyOTADemoTask( OTA_SUPERVISOR_CONNECTION_CHANGED );
             break;
 
         case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
             ESP_LOGI( TAG, "coreMQTT-Agent disconnected. Suspending OTA agent." );
-            xSuspendOta = pdTRUE;
+            xMqttConnected = pdFALSE;
+            prvNotifyOTADemoTask( OTA_SUPERVISOR_CONNECTION_CHANGED );
             break;
 
         case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
+            xOtaJobActive = pdTRUE;
+            prvNotifyOTADemoTask( OTA_SUPERVISOR_JOB_CHANGED );
             break;
 
         case CORE_MQTT_AGENT_OTA_STOPPED_EVENT:
+            xOtaJobActive = pdFALSE;
+            prvNotifyOTADemoTask( OTA_SUPERVISOR_JOB_CHANGED );
+            break;
+
+        case CORE_MQTT_AGENT_WIFI_CONNECTED_EVENT:
+        case CORE_MQTT_AGENT_WIFI_DISCONNECTED_EVENT:
+        case CORE_MQTT_AGENT_STALLED_EVENT:
             break;
 
         default:
@@ -1134,14 +1780,14 @@ void vStartOTACodeSigningDemo( void )
 {
     BaseType_t xResult;
 
-    xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+    xCoreMqttAgentManagerRegisterStateCallback( prvCoreMqttAgentStateCallback, NULL );
 
     if( ( xResult = xTaskCreate( prvOTADemoTask,
                                  "OTADemoTask",
                                  otademoconfigDEMO_TASK_STACK_SIZE,
                                  NULL,
                                  otademoconfigDEMO_TASK_PRIORITY,
-                                 NULL ) ) != pdPASS )
+                                 &xOtaDemoTaskHandle ) ) != pdPASS )
     {
         ESP_LOGE( TAG, "Failed to start OTA task: errno=%d", xResult );
     }
@@ -1152,71 +1798,31 @@ void vStartOTACodeSigningDemo( void )
 bool vOTAProcessMessage( void * pvIncomingPublishCallbackContext,
                          MQTTPublishInfo_t * pxPublishInfo )
 {
-    bool isMatch = false;
-
-    ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                              pxPublishInfo->topicNameLength,
-                              OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER,
-                              OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER_LENGTH,
-                              &isMatch );
-
-    if( isMatch == true )
-    {
-        /* validate thing name */
-
-        isMatch = prvMatchClientIdentifierInTopic( pxPublishInfo->pTopicName,
-                                                   pxPublishInfo->topicNameLength,
-                                                   otademoconfigCLIENT_IDENTIFIER,
-                                                   strlen( otademoconfigCLIENT_IDENTIFIER ) );
-
-        if( isMatch == true )
-        {
-            prvProcessIncomingJobMessage( pvIncomingPublishCallbackContext, pxPublishInfo );
-        }
-    }
+    bool isMatch = true;
 
-    if( isMatch == false )
+    switch( prvClassifyOtaTopic( pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength ) )
     {
-        ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                  pxPublishInfo->topicNameLength,
-                                  OTA_JOB_NOTIFY_TOPIC_FILTER,
-                                  OTA_JOB_NOTIFY_TOPIC_FILTER_LENGTH,
-                                  &isMatch );
+        case OtaTopicStreamData:
+            prvProcessIncomingData( pvIncomingPublishCallbackContext, pxPublishInfo );
+            break;
 
-        if( isMatch == true )
-        {
+        case OtaTopicJobAccepted:
+        case OtaTopicJobNotify:
             prvProcessIncomingJobMessage( pvIncomingPublishCallbackContext, pxPublishInfo );
-        }
-    }
+            break;
 
-    if( isMatch == false )
-    {
-        ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                  pxPublishInfo->topicNameLength,
-                                  OTA_DATA_STREAM_TOPIC_FILTER,
-                                  OTA_DATA_STREAM_TOPIC_FILTER_LENGTH,
-                                  &isMatch );
+        case OtaTopicJobUpdate:
 
-        if( isMatch == true )
-        {
-            prvProcessIncomingData( pvIncomingPublishCallbackContext, pxPublishInfo );
-        }
-    }
+            /* Return true if receiving update/accepted or update/rejected to get rid of warning
+             * message "WARN:  Received an unsolicited publish from topic $aws/things/+/jobs/+/update/+". */
+            ESP_LOGI( TAG, "Received update response: %.*s.",
+                      pxPublishInfo->topicNameLength,
+                      pxPublishInfo->pTopicName );
+            break;
 
-    if( isMatch == false )
-    {
-        ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                  pxPublishInfo->topicNameLength,
-                                  OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER,
-                                  OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER_LENGTH,
-                                  &isMatch );
-
-        /* Return true if receiving update/accepted or update/rejected to get rid of warning
-         * message "WARN:  Received an unsolicited publish from topic $aws/things/+/jobs/+/update/+". */
-        if( isMatch == true )
-        {
-            ESP_LOGI( TAG, "Received update response: %s.", pxPublishInfo->pTopicName );
-        }
+        default:
+            isMatch = false;
+            break;
     }
 
     return isMatch;
@@ -89,6 +89,157 @@
  */
 #define otademoconfigDEMO_TASK_STACK_SIZE     ( CONFIG_GRI_OTA_DEMO_DEMO_TASK_STACK_SIZE )
 
+/**
+ * @brief Number of sector sized chunks between the OTA agent task and the
+ * flash writer task.
+ */
+#define otademoconfigFLASH_WRITER_NUM_CHUNKS          ( CONFIG_GRI_OTA_FLASH_WRITER_NUM_CHUNKS )
+
+/**
+ * @brief Number of sectors assembled at once from blocks received out of
+ * order, each taking one more chunk.
+ */
+#define otademoconfigFLASH_WRITER_OPEN_SECTORS        ( CONFIG_GRI_OTA_FLASH_WRITER_OPEN_SECTORS )
+
+/**
+ * @brief The task priority of the flash writer task.
+ */
+#define otademoconfigFLASH_WRITER_TASK_PRIORITY       ( CONFIG_GRI_OTA_FLASH_WRITER_TASK_PRIORITY )
+
+/**
+ * @brief The task stack size of the flash writer task.
+ */
+#define otademoconfigFLASH_WRITER_TASK_STACK_SIZE     ( CONFIG_GRI_OTA_FLASH_WRITER_TASK_STACK_SIZE )
+
+/**
+ * @brief Erase the inactive OTA slot in the background while no OTA job is
+ * active. The flash writer does not erase these sectors again.
+ */
+#ifdef CONFIG_GRI_OTA_PRE_ERASE
+    #define otademoconfigENABLE_PRE_ERASE                 ( 1 )
+    #define otademoconfigPRE_ERASE_TASK_PRIORITY          ( CONFIG_GRI_OTA_PRE_ERASE_TASK_PRIORITY )
+    #define otademoconfigPRE_ERASE_TASK_STACK_SIZE        ( CONFIG_GRI_OTA_PRE_ERASE_TASK_STACK_SIZE )
+    #define otademoconfigPRE_ERASE_SECTOR_DELAY_MS        ( CONFIG_GRI_OTA_PRE_ERASE_SECTOR_DELAY_MS )
+#else
+    #define otademoconfigENABLE_PRE_ERASE                 ( 0 )
+#endif
+
+/**
+ * @brief Adapt the number of blocks asked for by each stream request to the
+ * observed round trip time and losses, starting from the given window.
+ */
+#ifdef CONFIG_GRI_OTA_ADAPTIVE_BLOCK_WINDOW
+    #define otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW     ( 1 )
+    #define otademoconfigBLOCK_WINDOW_INITIAL             ( CONFIG_GRI_OTA_BLOCK_WINDOW_INITIAL )
+#else
+    #define otademoconfigENABLE_ADAPTIVE_BLOCK_WINDOW     ( 0 )
+#endif
+
+/**
+ * @brief Checkpoint the programmed blocks to NVS every given number of blocks,
+ * and resume interrupted downloads of the same file after a reboot.
+ */
+#ifdef CONFIG_GRI_OTA_RESUME
+    #define otademoconfigENABLE_RESUME                    ( 1 )
+    #define otademoconfigRESUME_CHECKPOINT_BLOCKS         ( CONFIG_GRI_OTA_RESUME_CHECKPOINT_BLOCKS )
+#else
+    #define otademoconfigENABLE_RESUME                    ( 0 )
+#endif
+
+/**
+ * @brief Hash the image as it is programmed, so its signature is checked at
+ * close without reading it back from flash.
+ */
+#ifdef CONFIG_GRI_OTA_INCREMENTAL_HASH
+    #define otademoconfigENABLE_INCREMENTAL_HASH          ( 1 )
+#else
+    #define otademoconfigENABLE_INCREMENTAL_HASH          ( 0 )
+#endif
+
+/**
+ * @brief Check the image header and application descriptor as soon as they
+ * are received, and fail the download of an image that cannot be used.
+ */
+#ifdef CONFIG_GRI_OTA_EARLY_IMAGE_CHECK
+    #define otademoconfigENABLE_EARLY_IMAGE_CHECK         ( 1 )
+#else
+    #define otademoconfigENABLE_EARLY_IMAGE_CHECK         ( 0 )
+#endif
+
+/**
+ * @brief Split each stream request across concurrent pipelines, each keeping
+ * its own window of blocks in flight.
+ */
+#ifdef CONFIG_GRI_OTA_STREAM_PIPELINES
+    #define otademoconfigENABLE_STREAM_PIPELINES          ( 1 )
+    #define otademoconfigSTREAM_PIPELINES                 ( CONFIG_GRI_OTA_STREAM_PIPELINE_COUNT )
+#else
+    #define otademoconfigENABLE_STREAM_PIPELINES          ( 0 )
+#endif
+
+/**
+ * @brief Collect progress, rate and ETA metrics of the download, and publish
+ * them to <thing name>/<topic> at the given interval in milliseconds while a
+ * file is being received. An interval of 0 keeps them local.
+ */
+#ifdef CONFIG_GRI_OTA_METRICS
+    #define otademoconfigENABLE_METRICS                   ( 1 )
+    #define otademoconfigMETRICS_PUBLISH_INTERVAL_MS      ( CONFIG_GRI_OTA_METRICS_PUBLISH_INTERVAL_MS )
+    #define otademoconfigMETRICS_TOPIC                    CONFIG_GRI_THING_NAME "/" CONFIG_GRI_OTA_METRICS_TOPIC
+#else
+    #define otademoconfigENABLE_METRICS                   ( 0 )
+#endif
+
+/**
+ * @brief Apply files of the given job file type as patches against the
+ * running image.
+ */
+#ifdef CONFIG_GRI_OTA_DELTA
+    #define otademoconfigENABLE_DELTA                     ( 1 )
+    #define otademoconfigDELTA_FILE_TYPE                  ( CONFIG_GRI_OTA_DELTA_FILE_TYPE )
+#else
+    #define otademoconfigENABLE_DELTA                     ( 0 )
+#endif
+
+/**
+ * @brief Decompress files of the given job file type into the image.
+ */
+#ifdef CONFIG_GRI_OTA_COMPRESSION
+    #define otademoconfigENABLE_COMPRESSION               ( 1 )
+    #define otademoconfigCOMPRESSED_FILE_TYPE             ( CONFIG_GRI_OTA_COMPRESSED_FILE_TYPE )
+#else
+    #define otademoconfigENABLE_COMPRESSION               ( 0 )
+#endif
+
+/**
+ * @brief Write files of the given job file type as an image followed by data
+ * files, and copy the data files to their partitions once the image runs.
+ */
+#ifdef CONFIG_GRI_OTA_BUNDLE
+    #define otademoconfigENABLE_BUNDLE                    ( 1 )
+    #define otademoconfigBUNDLE_FILE_TYPE                 ( CONFIG_GRI_OTA_BUNDLE_FILE_TYPE )
+#else
+    #define otademoconfigENABLE_BUNDLE                    ( 0 )
+#endif
+
+/**
+ * @brief Program image blocks from the OTA event buffers they were received
+ * in, instead of copying them into flash writer chunks.
+ */
+#ifdef CONFIG_GRI_OTA_DIRECT_BLOCK_WRITE
+    #define otademoconfigENABLE_DIRECT_WRITE              ( 1 )
+#else
+    #define otademoconfigENABLE_DIRECT_WRITE              ( 0 )
+#endif
+
+/**
+ * @brief Number of out of order blocks held while a delta or compressed file
+ * is transformed in order.
+ */
+#ifdef CONFIG_GRI_OTA_STREAM_REORDER_BLOCKS
+    #define otademoconfigSTREAM_REORDER_BLOCKS            ( CONFIG_GRI_OTA_STREAM_REORDER_BLOCKS )
+#endif
+
 /**
  * @brief The version for the firmware which is running. OTA agent uses this
  * version number to perform anti-rollback validation. The firmware version for the
@@ -0,0 +1,451 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pre_erase.c
+ * @brief Background erase of the inactive OTA slot.
+ *
+ * The erased part of the slot is tracked as a prefix [0, ulErasedBytes) which
+ * grows one sector at a time and shrinks when an OTA job writes into it. The
+ * slot is only erased while the running image is confirmed, so an image
+ * pending self test can still roll back to the one in the inactive slot.
+ *
+ * A suspension is kept in NVS too, so a download interrupted by a reboot is
+ * not erased before its OTA job resumes it.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "nvs.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_pre_erase.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Erase unit of the flash.
+ */
+#define PRE_ERASE_SECTOR_SIZE              ( 4096U )
+
+/**
+ * @brief Erase progress is written to NVS every this many bytes, to limit NVS
+ * wear. After a reboot at most this much is erased again.
+ */
+#define PRE_ERASE_PERSIST_INTERVAL         ( 16U * PRE_ERASE_SECTOR_SIZE )
+
+/**
+ * @brief Period at which an idle pre-erase task rechecks whether it can erase.
+ */
+#define PRE_ERASE_IDLE_POLL_MS             ( 5000U )
+
+/**
+ * @brief NVS namespace and keys holding the erase progress.
+ */
+#define PRE_ERASE_NVS_NAMESPACE            "ota_pre_erase"
+#define PRE_ERASE_NVS_KEY_ADDRESS          "addr"
+#define PRE_ERASE_NVS_KEY_ERASED           "erased"
+#define PRE_ERASE_NVS_KEY_SUSPENDED        "suspended"
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_pre_erase";
+
+/**
+ * @brief The inactive OTA slot.
+ */
+static const esp_partition_t * pxInactiveSlot = NULL;
+
+/**
+ * @brief Guards the variables below, and is held across each sector erase.
+ */
+static SemaphoreHandle_t xPreEraseMutex = NULL;
+
+/**
+ * @brief Length of the erased prefix of the inactive slot.
+ */
+static uint32_t ulErasedBytes = 0U;
+
+/**
+ * @brief Erased prefix length last written to NVS.
+ */
+static uint32_t ulPersistedBytes = 0U;
+
+/**
+ * @brief Set while an OTA job owns the inactive slot.
+ */
+static bool xSuspended = false;
+
+/**
+ * @brief Set when an erase failed. Erasing is not retried until reboot.
+ */
+static bool xEraseFailed = false;
+
+/**
+ * @brief Handle of the NVS namespace holding the erase progress.
+ */
+static nvs_handle_t xProgressHandle;
+
+/**
+ * @brief Handle of the pre-erase task.
+ */
+static TaskHandle_t xPreEraseTask = NULL;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief The pre-erase task.
+ */
+static void prvPreEraseTask( void * pvParameters );
+
+/**
+ * @brief Check whether the running image is confirmed, and so the image in the
+ * inactive slot is no longer needed for a rollback.
+ */
+static bool prvRunningImageIsConfirmed( void );
+
+/**
+ * @brief Erase the first sector after the erased prefix.
+ *
+ * @return true if there is more of the slot left to erase.
+ */
+static bool prvEraseNextSector( void );
+
+/**
+ * @brief Write the erase progress to NVS. Must be called with xPreEraseMutex
+ * held.
+ */
+static void prvPersistProgress( void );
+
+/**
+ * @brief Write whether an OTA job owns the inactive slot to NVS. Must be
+ * called with xPreEraseMutex held, or before the pre-erase task starts.
+ */
+static void prvPersistSuspended( void );
+
+/* Static function definitions ************************************************/
+
+static void prvPreEraseTask( void * pvParameters )
+{
+    bool xMoreToErase = true;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        if( ( xMoreToErase == true ) && ( prvRunningImageIsConfirmed() == true ) )
+        {
+            xMoreToErase = prvEraseNextSector();
+
+            /* Leave the flash to higher priority work between sectors. */
+            vTaskDelay( pdMS_TO_TICKS( otademoconfigPRE_ERASE_SECTOR_DELAY_MS ) );
+        }
+        else
+        {
+            ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( PRE_ERASE_IDLE_POLL_MS ) );
+            xMoreToErase = true;
+        }
+    }
+}
+
+static bool prvRunningImageIsConfirmed( void )
+{
+    esp_ota_img_states_t xState = ESP_OTA_IMG_UNDEFINED;
+    esp_err_t xEspErrRet;
+
+    /* An image without OTA state was flashed directly and is confirmed. */
+    xEspErrRet = esp_ota_get_state_partition( esp_ota_get_running_partition(), &xState );
+
+    return ( xEspErrRet != ESP_OK ) || ( xState != ESP_OTA_IMG_PENDING_VERIFY );
+}
+
+static bool prvEraseNextSector( void )
+{
+    esp_err_t xEspErrRet;
+    bool xMoreToErase = false;
+
+    ( void ) xSemaphoreTake( xPreEraseMutex, portMAX_DELAY );
+
+    if( ( xSuspended == false ) &&
+        ( xEraseFailed == false ) &&
+        ( ulErasedBytes < pxInactiveSlot->size ) )
+    {
+        xEspErrRet = esp_partition_erase_range( pxInactiveSlot, ulErasedBytes, PRE_ERASE_SECTOR_SIZE );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to erase %s at offset %" PRIu32 ". Error: %s",
+                      pxInactiveSlot->label,
+                      ulErasedBytes,
+                      esp_err_to_name( xEspErrRet ) );
+            xEraseFailed = true;
+        }
+        else
+        {
+            ulErasedBytes += PRE_ERASE_SECTOR_SIZE;
+
+            if( ulErasedBytes == pxInactiveSlot->size )
+            {
+                ESP_LOGI( TAG, "Inactive slot %s is erased.", pxInactiveSlot->label );
+                prvPersistProgress();
+            }
+            else
+            {
+                if( ( ulErasedBytes - ulPersistedBytes ) >= PRE_ERASE_PERSIST_INTERVAL )
+                {
+                    prvPersistProgress();
+                }
+
+                xMoreToErase = true;
+            }
+        }
+    }
+
+    ( void ) xSemaphoreGive( xPreEraseMutex );
+
+    return xMoreToErase;
+}
+
+static void prvPersistProgress( void )
+{
+    esp_err_t xEspErrRet;
+
+    xEspErrRet = nvs_set_u32( xProgressHandle, PRE_ERASE_NVS_KEY_ERASED, ulErasedBytes );
+
+    if( xEspErrRet == ESP_OK )
+    {
+        xEspErrRet = nvs_commit( xProgressHandle );
+    }
+
+    if( xEspErrRet != ESP_OK )
+    {
+        ESP_LOGW( TAG,
+                  "Failed to store pre-erase progress. Error: %s",
+                  esp_err_to_name( xEspErrRet ) );
+    }
+    else
+    {
+        ulPersistedBytes = ulErasedBytes;
+    }
+}
+
+static void prvPersistSuspended( void )
+{
+    esp_err_t xEspErrRet;
+
+    xEspErrRet = nvs_set_u32( xProgressHandle, PRE_ERASE_NVS_KEY_SUSPENDED, ( xSuspended == true ) ? 1U : 0U );
+
+    if( xEspErrRet == ESP_OK )
+    {
+        xEspErrRet = nvs_commit( xProgressHandle );
+    }
+
+    if( xEspErrRet != ESP_OK )
+    {
+        ESP_LOGW( TAG,
+                  "Failed to store pre-erase suspension. Error: %s",
+                  esp_err_to_name( xEspErrRet ) );
+    }
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xOtaPreEraseInit( void )
+{
+    BaseType_t xRet = pdFAIL;
+    esp_err_t xEspErrRet;
+    uint32_t ulStoredAddress = 0U;
+    uint32_t ulStoredErased = 0U;
+    uint32_t ulStoredSuspended = 0U;
+
+    pxInactiveSlot = esp_ota_get_next_update_partition( NULL );
+
+    if( pxInactiveSlot == NULL )
+    {
+        ESP_LOGE( TAG, "No inactive OTA slot in the partition table." );
+    }
+    else
+    {
+        xEspErrRet = nvs_open( PRE_ERASE_NVS_NAMESPACE, NVS_READWRITE, &xProgressHandle );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to open pre-erase progress. Error: %s",
+                      esp_err_to_name( xEspErrRet ) );
+        }
+        else
+        {
+            /* Progress only applies to the slot it was recorded for. The
+             * inactive slot changes after each successful update. */
+            ( void ) nvs_get_u32( xProgressHandle, PRE_ERASE_NVS_KEY_ADDRESS, &ulStoredAddress );
+            ( void ) nvs_get_u32( xProgressHandle, PRE_ERASE_NVS_KEY_ERASED, &ulStoredErased );
+            ( void ) nvs_get_u32( xProgressHandle, PRE_ERASE_NVS_KEY_SUSPENDED, &ulStoredSuspended );
+
+            if( ( ulStoredAddress == pxInactiveSlot->address ) &&
+                ( ulStoredErased <= pxInactiveSlot->size ) )
+            {
+                ulErasedBytes = ulStoredErased - ( ulStoredErased % PRE_ERASE_SECTOR_SIZE );
+                ulPersistedBytes = ulErasedBytes;
+                xSuspended = ( ulStoredSuspended != 0U );
+            }
+            else
+            {
+                ulErasedBytes = 0U;
+                xSuspended = false;
+                ( void ) nvs_set_u32( xProgressHandle, PRE_ERASE_NVS_KEY_ADDRESS, pxInactiveSlot->address );
+                prvPersistSuspended();
+                prvPersistProgress();
+            }
+
+            xPreEraseMutex = xSemaphoreCreateMutex();
+
+            if( xPreEraseMutex == NULL )
+            {
+                ESP_LOGE( TAG, "Failed to create pre-erase mutex." );
+            }
+            else
+            {
+                xRet = xTaskCreate( prvPreEraseTask,
+                                    "OTAPreErase",
+                                    otademoconfigPRE_ERASE_TASK_STACK_SIZE,
+                                    NULL,
+                                    otademoconfigPRE_ERASE_TASK_PRIORITY,
+                                    &xPreEraseTask );
+
+                if( xRet != pdPASS )
+                {
+                    ESP_LOGE( TAG, "Failed to create pre-erase task." );
+                }
+                else
+                {
+                    ESP_LOGI( TAG,
+                              "Pre-erasing %s, %" PRIu32 " of %" PRIu32 " bytes already erased%s.",
+                              pxInactiveSlot->label,
+                              ulErasedBytes,
+                              ( uint32_t ) pxInactiveSlot->size,
+                              ( xSuspended == true ) ? ", suspended by an unfinished download" : "" );
+                }
+            }
+        }
+    }
+
+    return xRet;
+}
+
+void vOtaPreEraseSuspend( void )
+{
+    if( xPreEraseTask != NULL )
+    {
+        ( void ) xSemaphoreTake( xPreEraseMutex, portMAX_DELAY );
+
+        if( xSuspended == false )
+        {
+            xSuspended = true;
+            prvPersistSuspended();
+        }
+
+        if( ulErasedBytes != ulPersistedBytes )
+        {
+            prvPersistProgress();
+        }
+
+        ( void ) xSemaphoreGive( xPreEraseMutex );
+    }
+}
+
+void vOtaPreEraseResume( void )
+{
+    if( xPreEraseTask != NULL )
+    {
+        ( void ) xSemaphoreTake( xPreEraseMutex, portMAX_DELAY );
+
+        if( xSuspended == true )
+        {
+            xSuspended = false;
+            prvPersistSuspended();
+        }
+
+        ( void ) xSemaphoreGive( xPreEraseMutex );
+
+        ( void ) xTaskNotifyGive( xPreEraseTask );
+    }
+}
+
+void vOtaPreEraseMarkWritten( uint32_t ulOffset )
+{
+    uint32_t ulSectorStart = ulOffset - ( ulOffset % PRE_ERASE_SECTOR_SIZE );
+
+    if( xPreEraseTask != NULL )
+    {
+        ( void ) xSemaphoreTake( xPreEraseMutex, portMAX_DELAY );
+
+        if( ulErasedBytes > ulSectorStart )
+        {
+            ulErasedBytes = ulSectorStart;
+            prvPersistProgress();
+        }
+
+        ( void ) xSemaphoreGive( xPreEraseMutex );
+    }
+}
+
+bool xOtaPreEraseIsRangeErased( uint32_t ulOffset,
+                                uint32_t ulLength )
+{
+    bool xErased = false;
+
+    if( xPreEraseTask != NULL )
+    {
+        ( void ) xSemaphoreTake( xPreEraseMutex, portMAX_DELAY );
+        xErased = ( ulLength <= ulErasedBytes ) && ( ulOffset <= ( ulErasedBytes - ulLength ) );
+        ( void ) xSemaphoreGive( xPreEraseMutex );
+    }
+
+    return xErased;
+}
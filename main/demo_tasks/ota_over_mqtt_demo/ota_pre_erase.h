@@ -0,0 +1,96 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pre_erase.h
+ * @brief Background erase of the inactive OTA slot.
+ *
+ * While no OTA job is active, the OTA slot that is not running (ota_0 or
+ * ota_1 in partitions.csv) is erased one sector at a time from a low priority
+ * task. Progress is kept in NVS so erasing resumes after a reboot, and the
+ * flash writer skips the sectors reported by xOtaPreEraseIsRangeErased().
+ */
+#ifndef OTA_PRE_ERASE_H
+#define OTA_PRE_ERASE_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Locate the inactive OTA slot, restore the erase progress from NVS and
+ * start the pre-erase task.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xOtaPreEraseInit( void );
+
+/**
+ * @brief Stop erasing because an OTA job is about to write the inactive slot.
+ *
+ * Returns once any sector erase in progress has finished. Erasing stays
+ * stopped across reboots until vOtaPreEraseResume() is called or another slot
+ * becomes the inactive one.
+ */
+void vOtaPreEraseSuspend( void );
+
+/**
+ * @brief Restart erasing after an OTA job ended without leaving an image to
+ * activate in the inactive slot.
+ */
+void vOtaPreEraseResume( void );
+
+/**
+ * @brief Record that the range starting at ulOffset of the inactive slot is
+ * about to be programmed, so it is no longer reported as erased.
+ */
+void vOtaPreEraseMarkWritten( uint32_t ulOffset );
+
+/**
+ * @brief Check whether a range of the inactive slot is known to be erased.
+ *
+ * @return true if every sector of the range has been erased and not written
+ * since.
+ */
+bool xOtaPreEraseIsRangeErased( uint32_t ulOffset,
+                                uint32_t ulLength );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_PRE_ERASE_H */
@@ -0,0 +1,509 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_resume.c
+ * @brief Resumption of OTA downloads interrupted by a reboot.
+ *
+ * Blocks are recorded by the flash writer task once they are programmed, and
+ * the checkpoint is restored from the OTA agent task when the file is created,
+ * before any block is written, so the state needs no locking.
+ *
+ * The slot is restored one sector at a time, as the flash writer erases it.
+ * Every checkpointed block of a sector is read back and compared with its CRC,
+ * and every other block of it must still read as erased, so the flash writer
+ * can program the missing blocks without erasing the sector. A sector with a
+ * block that was erased, partially programmed or programmed after the last
+ * checkpoint is requested again in full.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* Public functions include. */
+#include "ota_resume.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Maximum number of blocks of a file, as bounded by the block bitmap.
+ */
+#define RESUME_MAX_BLOCKS             ( OTA_MAX_BLOCK_BITMAP_SIZE * 8U )
+
+/**
+ * @brief Erase unit of the flash.
+ */
+#define RESUME_SECTOR_SIZE            ( 4096U )
+
+/**
+ * @brief Granularity at which the slot is restored, whole blocks and whole
+ * sectors.
+ */
+#define RESUME_UNIT_SIZE                                 \
+    ( ( OTA_FILE_BLOCK_SIZE > RESUME_SECTOR_SIZE ) ?     \
+      OTA_FILE_BLOCK_SIZE : RESUME_SECTOR_SIZE )
+
+/**
+ * @brief Number of blocks in a unit.
+ */
+#define RESUME_UNIT_BLOCKS            ( RESUME_UNIT_SIZE / OTA_FILE_BLOCK_SIZE )
+
+/**
+ * @brief Size of the reads used to verify a block against its CRC.
+ */
+#define RESUME_VERIFY_READ_SIZE       ( 256U )
+
+/**
+ * @brief NVS namespace and keys holding the checkpoint.
+ */
+#define RESUME_NVS_NAMESPACE          "ota_resume"
+#define RESUME_NVS_KEY_STATE          "state"
+#define RESUME_NVS_KEY_CRC            "crc"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Identity of the file being received and the blocks programmed so far.
+ */
+typedef struct ResumeState
+{
+    uint32_t ulSlotAddress;
+    uint32_t ulFileSize;
+    uint32_t ulServerFileId;
+    uint32_t ulSignatureCrc;
+    char cStreamName[ otademoconfigMAX_STREAM_NAME_SIZE ];
+    uint8_t ucProgrammed[ OTA_MAX_BLOCK_BITMAP_SIZE ]; /**< A set bit marks a programmed block. */
+} ResumeState_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "ota_resume";
+
+/**
+ * @brief State of the file being received.
+ */
+static ResumeState_t xResumeState;
+
+/**
+ * @brief CRC of each programmed block.
+ */
+static uint32_t ulBlockCrc[ RESUME_MAX_BLOCKS ];
+
+/**
+ * @brief Number of blocks of the file being received.
+ */
+static uint32_t ulNumBlocks = 0U;
+
+/**
+ * @brief Units of the slot restored from the checkpoint.
+ */
+static uint8_t ucRestoredUnits[ OTA_MAX_BLOCK_BITMAP_SIZE ];
+
+/**
+ * @brief Blocks recorded since the last checkpoint.
+ */
+static uint32_t ulUncheckpointedBlocks = 0U;
+
+/**
+ * @brief Set between vOtaResumeStart and vOtaResumeFinish.
+ */
+static bool xTracking = false;
+
+/**
+ * @brief Handle of the NVS namespace holding the checkpoint.
+ */
+static nvs_handle_t xResumeHandle;
+static bool xResumeStoreOpen = false;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Open the NVS namespace holding the checkpoint, if not already open.
+ */
+static bool prvOpenStore( void );
+
+/**
+ * @brief Write the state and block CRCs to NVS.
+ */
+static void prvSaveCheckpoint( void );
+
+/**
+ * @brief Remove the checkpoint from NVS.
+ */
+static void prvEraseCheckpoint( void );
+
+/**
+ * @brief Get the length of a block, accounting for a short last block.
+ */
+static uint32_t prvBlockLength( uint32_t ulBlockIndex );
+
+/**
+ * @brief Check whether a block is set in the programmed bitmap.
+ */
+static bool prvIsProgrammed( uint32_t ulBlockIndex );
+
+/**
+ * @brief Check that the content of a block in flash matches its CRC if it was
+ * programmed, or is erased otherwise.
+ */
+static bool prvVerifyBlock( const esp_partition_t * pxSlot,
+                            uint32_t ulBlockIndex );
+
+/**
+ * @brief Check that every block of a unit is verified, and at least one was
+ * programmed.
+ */
+static bool prvVerifyUnit( const esp_partition_t * pxSlot,
+                           uint32_t ulUnit );
+
+/**
+ * @brief Forget the blocks of a unit, so they are requested again.
+ */
+static void prvDropUnit( uint32_t ulUnit );
+
+/* Static function definitions ************************************************/
+
+static bool prvOpenStore( void )
+{
+    esp_err_t xEspErrRet;
+
+    if( xResumeStoreOpen == false )
+    {
+        xEspErrRet = nvs_open( RESUME_NVS_NAMESPACE, NVS_READWRITE, &xResumeHandle );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGW( TAG,
+                      "Failed to open OTA resume checkpoint. Error: %s",
+                      esp_err_to_name( xEspErrRet ) );
+        }
+        else
+        {
+            xResumeStoreOpen = true;
+        }
+    }
+
+    return xResumeStoreOpen;
+}
+
+static void prvSaveCheckpoint( void )
+{
+    esp_err_t xEspErrRet;
+
+    xEspErrRet = nvs_set_blob( xResumeHandle, RESUME_NVS_KEY_STATE, &xResumeState, sizeof( xResumeState ) );
+
+    if( xEspErrRet == ESP_OK )
+    {
+        xEspErrRet = nvs_set_blob( xResumeHandle, RESUME_NVS_KEY_CRC, ulBlockCrc, ulNumBlocks * sizeof( uint32_t ) );
+    }
+
+    if( xEspErrRet == ESP_OK )
+    {
+        xEspErrRet = nvs_commit( xResumeHandle );
+    }
+
+    if( xEspErrRet != ESP_OK )
+    {
+        ESP_LOGW( TAG,
+                  "Failed to store OTA resume checkpoint. Error: %s",
+                  esp_err_to_name( xEspErrRet ) );
+    }
+}
+
+static void prvEraseCheckpoint( void )
+{
+    esp_err_t xEspErrRet;
+
+    xEspErrRet = nvs_erase_all( xResumeHandle );
+
+    if( xEspErrRet == ESP_OK )
+    {
+        xEspErrRet = nvs_commit( xResumeHandle );
+    }
+
+    if( xEspErrRet != ESP_OK )
+    {
+        ESP_LOGW( TAG,
+                  "Failed to discard OTA resume checkpoint. Error: %s",
+                  esp_err_to_name( xEspErrRet ) );
+    }
+}
+
+static uint32_t prvBlockLength( uint32_t ulBlockIndex )
+{
+    uint32_t ulBlockOffset = ulBlockIndex * OTA_FILE_BLOCK_SIZE;
+
+    return ( ( xResumeState.ulFileSize - ulBlockOffset ) < OTA_FILE_BLOCK_SIZE ) ?
+           ( xResumeState.ulFileSize - ulBlockOffset ) : OTA_FILE_BLOCK_SIZE;
+}
+
+static bool prvIsProgrammed( uint32_t ulBlockIndex )
+{
+    return ( xResumeState.ucProgrammed[ ulBlockIndex / 8U ] & ( 1U << ( ulBlockIndex % 8U ) ) ) != 0U;
+}
+
+static bool prvVerifyBlock( const esp_partition_t * pxSlot,
+                            uint32_t ulBlockIndex )
+{
+    uint8_t ucReadBuffer[ RESUME_VERIFY_READ_SIZE ];
+    uint32_t ulOffset = ulBlockIndex * OTA_FILE_BLOCK_SIZE;
+    uint32_t ulRemaining = prvBlockLength( ulBlockIndex );
+    uint32_t ulReadLength;
+    uint32_t ulCrc = 0U;
+    uint32_t ulIndex;
+    bool xProgrammed = prvIsProgrammed( ulBlockIndex );
+    bool xErased = true;
+    esp_err_t xEspErrRet = ESP_OK;
+
+    while( ( ulRemaining > 0U ) && ( xEspErrRet == ESP_OK ) )
+    {
+        ulReadLength = ( ulRemaining < RESUME_VERIFY_READ_SIZE ) ? ulRemaining : RESUME_VERIFY_READ_SIZE;
+        xEspErrRet = esp_partition_read( pxSlot, ulOffset, ucReadBuffer, ulReadLength );
+
+        if( xProgrammed == true )
+        {
+            ulCrc = esp_rom_crc32_le( ulCrc, ucReadBuffer, ulReadLength );
+        }
+        else
+        {
+            for( ulIndex = 0U; ulIndex < ulReadLength; ulIndex++ )
+            {
+                xErased = xErased && ( ucReadBuffer[ ulIndex ] == 0xFFU );
+            }
+        }
+
+        ulOffset += ulReadLength;
+        ulRemaining -= ulReadLength;
+    }
+
+    return ( xEspErrRet == ESP_OK ) &&
+           ( ( xProgrammed == true ) ? ( ulCrc == ulBlockCrc[ ulBlockIndex ] ) : xErased );
+}
+
+static bool prvVerifyUnit( const esp_partition_t * pxSlot,
+                           uint32_t ulUnit )
+{
+    uint32_t ulBlockIndex = ulUnit * RESUME_UNIT_BLOCKS;
+    uint32_t ulEnd = ulBlockIndex + RESUME_UNIT_BLOCKS;
+    bool xValid = true;
+    bool xAnyProgrammed = false;
+
+    ulEnd = ( ulEnd < ulNumBlocks ) ? ulEnd : ulNumBlocks;
+
+    for( ; ( ulBlockIndex < ulEnd ) && ( xValid == true ); ulBlockIndex++ )
+    {
+        xAnyProgrammed = xAnyProgrammed || prvIsProgrammed( ulBlockIndex );
+        xValid = prvVerifyBlock( pxSlot, ulBlockIndex );
+    }
+
+    return xValid && xAnyProgrammed;
+}
+
+static void prvDropUnit( uint32_t ulUnit )
+{
+    uint32_t ulBlockIndex;
+
+    for( ulBlockIndex = ulUnit * RESUME_UNIT_BLOCKS;
+         ( ulBlockIndex < ( ( ulUnit + 1U ) * RESUME_UNIT_BLOCKS ) ) && ( ulBlockIndex < ulNumBlocks );
+         ulBlockIndex++ )
+    {
+        xResumeState.ucProgrammed[ ulBlockIndex / 8U ] &= ( uint8_t ) ~( 1U << ( ulBlockIndex % 8U ) );
+    }
+
+    ucRestoredUnits[ ulUnit / 8U ] &= ( uint8_t ) ~( 1U << ( ulUnit % 8U ) );
+}
+
+/* Public function definitions ************************************************/
+
+void vOtaResumeStart( OtaFileContext_t * const pFileContext )
+{
+    const esp_partition_t * pxSlot = esp_ota_get_next_update_partition( NULL );
+    size_t xLength = sizeof( xResumeState );
+    uint32_t ulNumUnits;
+    uint32_t ulUnit;
+    uint32_t ulBlockIndex;
+    uint32_t ulRestored = 0U;
+    uint32_t ulSignatureCrc = 0U;
+    bool xMatch = false;
+
+    ulNumBlocks = ( pFileContext->fileSize + OTA_FILE_BLOCK_SIZE - 1U ) / OTA_FILE_BLOCK_SIZE;
+    ulNumUnits = ( pFileContext->fileSize + RESUME_UNIT_SIZE - 1U ) / RESUME_UNIT_SIZE;
+    ulUncheckpointedBlocks = 0U;
+    memset( ucRestoredUnits, 0x00, sizeof( ucRestoredUnits ) );
+
+    if( pFileContext->pSignature != NULL )
+    {
+        ulSignatureCrc = esp_rom_crc32_le( 0U, pFileContext->pSignature->data, pFileContext->pSignature->size );
+    }
+
+    if( ( pxSlot != NULL ) && ( ulNumBlocks <= RESUME_MAX_BLOCKS ) && ( prvOpenStore() == true ) )
+    {
+        xTracking = true;
+
+        if( ( nvs_get_blob( xResumeHandle, RESUME_NVS_KEY_STATE, &xResumeState, &xLength ) == ESP_OK ) &&
+            ( xLength == sizeof( xResumeState ) ) &&
+            ( xResumeState.ulSlotAddress == pxSlot->address ) &&
+            ( xResumeState.ulFileSize == pFileContext->fileSize ) &&
+            ( xResumeState.ulServerFileId == pFileContext->serverFileID ) &&
+            ( xResumeState.ulSignatureCrc == ulSignatureCrc ) &&
+            ( strncmp( xResumeState.cStreamName,
+                       ( const char * ) pFileContext->pStreamName,
+                       sizeof( xResumeState.cStreamName ) ) == 0 ) )
+        {
+            xLength = ulNumBlocks * sizeof( uint32_t );
+            xMatch = ( nvs_get_blob( xResumeHandle, RESUME_NVS_KEY_CRC, ulBlockCrc, &xLength ) == ESP_OK ) &&
+                     ( xLength == ( ulNumBlocks * sizeof( uint32_t ) ) );
+        }
+
+        if( xMatch == true )
+        {
+            for( ulUnit = 0U; ulUnit < ulNumUnits; ulUnit++ )
+            {
+                if( prvVerifyUnit( pxSlot, ulUnit ) == true )
+                {
+                    ucRestoredUnits[ ulUnit / 8U ] |= ( uint8_t ) ( 1U << ( ulUnit % 8U ) );
+                    ulRestored++;
+                }
+                else
+                {
+                    prvDropUnit( ulUnit );
+                }
+            }
+
+            /* Leave at least one block to receive, so the OTA agent goes on
+             * to close the file. */
+            if( ( ulRestored == ulNumUnits ) && ( ulNumUnits > 0U ) )
+            {
+                prvDropUnit( ulNumUnits - 1U );
+                ulRestored--;
+            }
+
+            for( ulBlockIndex = 0U; ulBlockIndex < ulNumBlocks; ulBlockIndex++ )
+            {
+                if( prvIsProgrammed( ulBlockIndex ) == true )
+                {
+                    pFileContext->pRxBlockBitmap[ ulBlockIndex / 8U ] &= ( uint8_t ) ~( 1U << ( ulBlockIndex % 8U ) );
+                    pFileContext->blocksRemaining--;
+                }
+            }
+
+            ESP_LOGI( TAG,
+                      "Resuming download of stream %s, %" PRIu32 " of %" PRIu32 " sectors already in flash.",
+                      xResumeState.cStreamName,
+                      ulRestored,
+                      ulNumUnits );
+        }
+        else
+        {
+            memset( &xResumeState, 0x00, sizeof( xResumeState ) );
+            xResumeState.ulSlotAddress = pxSlot->address;
+            xResumeState.ulFileSize = pFileContext->fileSize;
+            xResumeState.ulServerFileId = pFileContext->serverFileID;
+            xResumeState.ulSignatureCrc = ulSignatureCrc;
+            ( void ) strncpy( xResumeState.cStreamName,
+                              ( const char * ) pFileContext->pStreamName,
+                              sizeof( xResumeState.cStreamName ) - 1U );
+            prvEraseCheckpoint();
+        }
+    }
+}
+
+bool xOtaResumeIsRangeRestored( uint32_t ulOffset,
+                                uint32_t ulLength )
+{
+    bool xRestored = ( xTracking == true ) && ( ulLength > 0U );
+    uint32_t ulUnit;
+
+    for( ulUnit = ulOffset / RESUME_UNIT_SIZE;
+         ( xRestored == true ) && ( ulUnit <= ( ( ulOffset + ulLength - 1U ) / RESUME_UNIT_SIZE ) );
+         ulUnit++ )
+    {
+        xRestored = ( ulUnit < RESUME_MAX_BLOCKS ) &&
+                    ( ( ucRestoredUnits[ ulUnit / 8U ] & ( 1U << ( ulUnit % 8U ) ) ) != 0U );
+    }
+
+    return xRestored;
+}
+
+void vOtaResumeRecordWrite( uint32_t ulOffset,
+                            const uint8_t * pucData,
+                            uint32_t ulLength )
+{
+    uint32_t ulBlockIndex = ulOffset / OTA_FILE_BLOCK_SIZE;
+    uint32_t ulDone = 0U;
+    uint32_t ulBlockLength;
+
+    if( xTracking == true )
+    {
+        while( ( ulDone < ulLength ) && ( ulBlockIndex < ulNumBlocks ) )
+        {
+            ulBlockLength = ( ( ulLength - ulDone ) < OTA_FILE_BLOCK_SIZE ) ? ( ulLength - ulDone ) : OTA_FILE_BLOCK_SIZE;
+            ulBlockCrc[ ulBlockIndex ] = esp_rom_crc32_le( 0U, &pucData[ ulDone ], ulBlockLength );
+            xResumeState.ucProgrammed[ ulBlockIndex / 8U ] |= ( uint8_t ) ( 1U << ( ulBlockIndex % 8U ) );
+            ulDone += ulBlockLength;
+            ulBlockIndex++;
+            ulUncheckpointedBlocks++;
+        }
+
+        if( ulUncheckpointedBlocks >= otademoconfigRESUME_CHECKPOINT_BLOCKS )
+        {
+            prvSaveCheckpoint();
+            ulUncheckpointedBlocks = 0U;
+        }
+    }
+}
+
+void vOtaResumeFinish( void )
+{
+    if( xTracking == true )
+    {
+        xTracking = false;
+        prvEraseCheckpoint();
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_resume.h
+ * @brief Resumption of OTA downloads interrupted by a reboot.
+ *
+ * The blocks programmed to the inactive OTA slot are checkpointed to NVS
+ * together with a CRC of each block and the identity of the file. When the
+ * same file is created again after a reboot, the sectors whose checkpointed
+ * blocks still match their CRC, and whose other blocks are still erased, are
+ * restored. Their blocks are marked received, so only the missing blocks are
+ * requested from the stream, and the flash writer does not erase them again.
+ */
+#ifndef OTA_RESUME_H
+#define OTA_RESUME_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* OTA library interface include. */
+#include "ota_platform_interface.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Start tracking a file that has just been created for reception.
+ *
+ * If the checkpoint in NVS belongs to the same file and slot, the blocks it
+ * lists are verified against flash and the blocks of the restored sectors
+ * cleared from the block bitmap of pFileContext. Otherwise the checkpoint is
+ * discarded.
+ */
+void vOtaResumeStart( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief Check whether a range of the inactive slot was restored by
+ * vOtaResumeStart(), so it holds data of the file and is erased elsewhere.
+ *
+ * @return true if every sector of the range was restored.
+ */
+bool xOtaResumeIsRangeRestored( uint32_t ulOffset,
+                                uint32_t ulLength );
+
+/**
+ * @brief Record blocks that have been programmed to flash, and checkpoint
+ * them every otademoconfigRESUME_CHECKPOINT_BLOCKS blocks.
+ *
+ * @param[in] ulOffset Offset of the first block in the file.
+ * @param[in] pucData Content of the blocks.
+ * @param[in] ulLength Length of the blocks in bytes.
+ */
+void vOtaResumeRecordWrite( uint32_t ulOffset,
+                            const uint8_t * pucData,
+                            uint32_t ulLength );
+
+/**
+ * @brief Stop tracking the file and discard the checkpoint, once the file is
+ * closed or aborted.
+ */
+void vOtaResumeFinish( void );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_RESUME_H */
@@ -0,0 +1,562 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_stream_pipelines.c
+ * @brief Concurrent OTA stream request pipelines.
+ *
+ * Stream requests are CBOR maps with the client token "c", file ID "f",
+ * block size "l", block offset "o", bitmap of the blocks wanted "b" and block
+ * count "n". Data messages carry the block ID in "i". A pipeline sends a new
+ * request once all the blocks of its previous one have arrived, and takes the
+ * lowest missing blocks not in flight, so blocks arrive close to in order.
+ * The OTA agent asks again by itself every otaconfigMAX_NUM_BLOCKS_REQUEST
+ * new blocks, counting across requests, so a drained pipeline is only
+ * signalled when its last block does not also complete the count of the
+ * agent.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* OTA library includes. */
+#include "ota.h"
+
+/* Demo task configurations include. */
+#include "ota_over_mqtt_demo_config.h"
+
+/* CBOR helpers include. */
+#include "ota_cbor.h"
+
+/* Public functions include. */
+#include "ota_stream_pipelines.h"
+
+#if otademoconfigENABLE_METRICS
+    /* OTA metrics include. */
+    #include "ota_metrics.h"
+#endif /* otademoconfigENABLE_METRICS */
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Suffix of the stream request topic,
+ * "$aws/things/<thing>/streams/<stream>/get/cbor".
+ */
+#define PIPELINE_REQUEST_TOPIC_SUFFIX           "/get/cbor"
+#define PIPELINE_REQUEST_TOPIC_SUFFIX_LENGTH    ( sizeof( PIPELINE_REQUEST_TOPIC_SUFFIX ) - 1U )
+
+/**
+ * @brief Largest number of blocks a pipeline has in flight.
+ */
+#define PIPELINE_WINDOW_MAX                     ( otaconfigMAX_NUM_BLOCKS_REQUEST )
+
+/**
+ * @brief Number of blocks the block bitmap covers.
+ */
+#define PIPELINE_MAX_BLOCKS                     ( OTA_MAX_BLOCK_BITMAP_SIZE * 8U )
+
+/**
+ * @brief Maximum size of a stream request. Dominated by the block bitmap.
+ */
+#define PIPELINE_REQUEST_MAX_SIZE               ( 3U * OTA_MAX_BLOCK_BITMAP_SIZE )
+
+/**
+ * @brief Time after which blocks in flight are requested again, shortly before
+ * the OTA agent requests again on its own.
+ */
+#define PIPELINE_RETRY_TICKS                    ( pdMS_TO_TICKS( ( otaconfigFILE_REQUEST_WAIT_MS * 3U ) / 4U ) )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A decoded stream request.
+ */
+typedef struct StreamRequest
+{
+    OtaCborItem_t xClientToken;
+    OtaCborItem_t xFileId;
+    OtaCborItem_t xBlockSize;
+    OtaCborItem_t xBlockOffset;
+    OtaCborItem_t xBitmap;
+    OtaCborItem_t xBlockCount;
+    bool xHasClientToken;
+    bool xHasBlockOffset;
+} StreamRequest_t;
+
+/**
+ * @brief Blocks a pipeline has in flight.
+ */
+typedef struct Pipeline
+{
+    uint32_t ulBlocks[ PIPELINE_WINDOW_MAX ];
+    uint32_t ulInFlight;
+    TickType_t xRequestTick;
+} Pipeline_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Guards the pipelines, which are updated from the OTA agent task and
+ * the coreMQTT-Agent task.
+ */
+static portMUX_TYPE xPipelineLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief The pipelines, and the blocks in flight in any of them.
+ */
+static Pipeline_t xPipelines[ otademoconfigSTREAM_PIPELINES ];
+static uint8_t ucInFlight[ OTA_MAX_BLOCK_BITMAP_SIZE ];
+
+/**
+ * @brief File the blocks in flight belong to.
+ */
+static uint32_t ulPipelineFileId = UINT32_MAX;
+
+/**
+ * @brief New blocks the OTA agent takes before it asks again by itself.
+ */
+static uint32_t ulAgentBlocksToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+
+/**
+ * @brief Bitmap and encoding of the request being sent.
+ */
+static uint8_t ucBitmapBuffer[ OTA_MAX_BLOCK_BITMAP_SIZE ];
+static uint8_t ucRequestBuffer[ PIPELINE_REQUEST_MAX_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Decode a stream request.
+ *
+ * @return true if the request has every field needed to split it.
+ */
+static bool prvDecodeRequest( const uint8_t * pucMessage,
+                              uint32_t ulLength,
+                              StreamRequest_t * pxRequest );
+
+/**
+ * @brief Encode a request for the blocks in ucBitmapBuffer.
+ *
+ * @return Length of the request in ucRequestBuffer.
+ */
+static uint32_t prvEncodeRequest( const StreamRequest_t * pxRequest,
+                                  uint32_t ulBlockCount );
+
+/**
+ * @brief Forget the blocks a pipeline has in flight. Called with the lock
+ * held.
+ */
+static void prvReleasePipeline( Pipeline_t * pxPipeline );
+
+/**
+ * @brief Assign the next missing blocks not in flight to an empty pipeline,
+ * and set them in ucBitmapBuffer. Called with the lock held.
+ *
+ * @return Number of blocks assigned.
+ */
+static uint32_t prvFillPipeline( Pipeline_t * pxPipeline,
+                                 const StreamRequest_t * pxRequest,
+                                 uint32_t ulWindow,
+                                 uint32_t * pulNextBit );
+
+/* Static function definitions ************************************************/
+
+static bool prvDecodeRequest( const uint8_t * pucMessage,
+                              uint32_t ulLength,
+                              StreamRequest_t * pxRequest )
+{
+    bool xRet = false;
+    uint32_t ulPosition = 0U;
+    uint32_t ulEntries = 0U;
+    uint32_t ulFound = 0U;
+    OtaCborItem_t xKey;
+    OtaCborItem_t xValue;
+
+    memset( pxRequest, 0x00, sizeof( *pxRequest ) );
+
+    if( ( xOtaCborRead( pucMessage, ulLength, &ulPosition, &xKey ) == true ) &&
+        ( xKey.ucMajor == OTA_CBOR_MAJOR_MAP ) )
+    {
+        ulEntries = xKey.ulValue;
+        xRet = true;
+    }
+
+    while( ( xRet == true ) && ( ulEntries > 0U ) )
+    {
+        xRet = ( xOtaCborRead( pucMessage, ulLength, &ulPosition, &xKey ) == true ) &&
+               ( xKey.ucMajor == OTA_CBOR_MAJOR_TEXT ) && ( xKey.ulValue == 1U ) &&
+               ( xOtaCborRead( pucMessage, ulLength, &ulPosition, &xValue ) == true );
+
+        if( xRet == true )
+        {
+            switch( ( char ) xKey.pucData[ 0 ] )
+            {
+                case 'c':
+                    pxRequest->xClientToken = xValue;
+                    pxRequest->xHasClientToken = true;
+                    break;
+
+                case 'f':
+                    pxRequest->xFileId = xValue;
+                    ulFound |= 1U;
+                    break;
+
+                case 'l':
+                    pxRequest->xBlockSize = xValue;
+                    ulFound |= 2U;
+                    break;
+
+                case 'o':
+                    pxRequest->xBlockOffset = xValue;
+                    pxRequest->xHasBlockOffset = true;
+                    break;
+
+                case 'b':
+                    pxRequest->xBitmap = xValue;
+                    ulFound |= 4U;
+                    break;
+
+                case 'n':
+                    pxRequest->xBlockCount = xValue;
+                    ulFound |= 8U;
+                    break;
+
+                default:
+                    /* A field this module would drop. */
+                    xRet = false;
+                    break;
+            }
+        }
+
+        ulEntries--;
+    }
+
+    if( xRet == true )
+    {
+        xRet = ( ulFound == 15U ) &&
+               ( pxRequest->xFileId.ucMajor == OTA_CBOR_MAJOR_UINT ) &&
+               ( pxRequest->xBlockSize.ucMajor == OTA_CBOR_MAJOR_UINT ) &&
+               ( pxRequest->xBlockOffset.ucMajor == OTA_CBOR_MAJOR_UINT ) &&
+               ( pxRequest->xBitmap.ucMajor == OTA_CBOR_MAJOR_BYTES ) &&
+               ( pxRequest->xBitmap.ulValue <= OTA_MAX_BLOCK_BITMAP_SIZE ) &&
+               ( pxRequest->xBlockCount.ucMajor == OTA_CBOR_MAJOR_UINT );
+    }
+
+    return xRet;
+}
+
+static uint32_t prvEncodeRequest( const StreamRequest_t * pxRequest,
+                                  uint32_t ulBlockCount )
+{
+    uint32_t ulPosition = 0U;
+
+    vOtaCborWriteHead( ucRequestBuffer, &ulPosition, OTA_CBOR_MAJOR_MAP,
+                      ( pxRequest->xHasClientToken ? 1U : 0U ) + ( pxRequest->xHasBlockOffset ? 1U : 0U ) + 4U );
+
+    if( pxRequest->xHasClientToken == true )
+    {
+        vOtaCborWriteHead( ucRequestBuffer, &ulPosition, OTA_CBOR_MAJOR_TEXT, 1U );
+        ucRequestBuffer[ ulPosition++ ] = ( uint8_t ) 'c';
+        vOtaCborWriteHead( ucRequestBuffer, &ulPosition, pxRequest->xClientToken.ucMajor, pxRequest->xClientToken.ulValue );
+
+        if( pxRequest->xClientToken.ucMajor != OTA_CBOR_MAJOR_UINT )
+        {
+            memcpy( &ucRequestBuffer[ ulPosition ], pxRequest->xClientToken.pucData, pxRequest->xClientToken.ulValue );
+            ulPosition += pxRequest->xClientToken.ulValue;
+        }
+    }
+
+    vOtaCborWriteUint( ucRequestBuffer, &ulPosition, 'f', pxRequest->xFileId.ulValue );
+    vOtaCborWriteUint( ucRequestBuffer, &ulPosition, 'l', pxRequest->xBlockSize.ulValue );
+
+    if( pxRequest->xHasBlockOffset == true )
+    {
+        vOtaCborWriteUint( ucRequestBuffer, &ulPosition, 'o', pxRequest->xBlockOffset.ulValue );
+    }
+
+    vOtaCborWriteHead( ucRequestBuffer, &ulPosition, OTA_CBOR_MAJOR_TEXT, 1U );
+    ucRequestBuffer[ ulPosition++ ] = ( uint8_t ) 'b';
+    vOtaCborWriteHead( ucRequestBuffer, &ulPosition, OTA_CBOR_MAJOR_BYTES, pxRequest->xBitmap.ulValue );
+    memcpy( &ucRequestBuffer[ ulPosition ], ucBitmapBuffer, pxRequest->xBitmap.ulValue );
+    ulPosition += pxRequest->xBitmap.ulValue;
+
+    vOtaCborWriteUint( ucRequestBuffer, &ulPosition, 'n', ulBlockCount );
+
+    return ulPosition;
+}
+
+static void prvReleasePipeline( Pipeline_t * pxPipeline )
+{
+    uint32_t ulBlock;
+
+    while( pxPipeline->ulInFlight > 0U )
+    {
+        pxPipeline->ulInFlight--;
+        ulBlock = pxPipeline->ulBlocks[ pxPipeline->ulInFlight ];
+        ucInFlight[ ulBlock / 8U ] &= ( uint8_t ) ~( 1U << ( ulBlock % 8U ) );
+    }
+}
+
+static uint32_t prvFillPipeline( Pipeline_t * pxPipeline,
+                                 const StreamRequest_t * pxRequest,
+                                 uint32_t ulWindow,
+                                 uint32_t * pulNextBit )
+{
+    uint32_t ulBit = *pulNextBit;
+    uint32_t ulBlock;
+
+    while( ( pxPipeline->ulInFlight < ulWindow ) && ( ulBit < ( pxRequest->xBitmap.ulValue * 8U ) ) )
+    {
+        ulBlock = pxRequest->xBlockOffset.ulValue + ulBit;
+
+        if( ulBlock >= PIPELINE_MAX_BLOCKS )
+        {
+            /* Past the end of the bitmap this module tracks. */
+            ulBit = pxRequest->xBitmap.ulValue * 8U;
+        }
+        else
+        {
+            if( ( ( pxRequest->xBitmap.pucData[ ulBit / 8U ] & ( 1U << ( ulBit % 8U ) ) ) != 0U ) &&
+                ( ( ucInFlight[ ulBlock / 8U ] & ( 1U << ( ulBlock % 8U ) ) ) == 0U ) )
+            {
+                ucInFlight[ ulBlock / 8U ] |= ( uint8_t ) ( 1U << ( ulBlock % 8U ) );
+                ucBitmapBuffer[ ulBit / 8U ] |= ( uint8_t ) ( 1U << ( ulBit % 8U ) );
+                pxPipeline->ulBlocks[ pxPipeline->ulInFlight ] = ulBlock;
+                pxPipeline->ulInFlight++;
+            }
+
+            ulBit++;
+        }
+    }
+
+    pxPipeline->xRequestTick = xTaskGetTickCount();
+    *pulNextBit = ulBit;
+
+    return pxPipeline->ulInFlight;
+}
+
+/* Public function definitions ************************************************/
+
+void vOtaStreamPipelinesInit( void )
+{
+    taskENTER_CRITICAL( &xPipelineLock );
+    {
+        memset( xPipelines, 0x00, sizeof( xPipelines ) );
+        memset( ucInFlight, 0x00, sizeof( ucInFlight ) );
+        ulPipelineFileId = UINT32_MAX;
+        ulAgentBlocksToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+    }
+    taskEXIT_CRITICAL( &xPipelineLock );
+}
+
+bool xOtaStreamPipelinesSend( const char * pcTopic,
+                              uint16_t usTopicLength,
+                              const char * pcMessage,
+                              uint32_t ulMessageLength,
+                              OtaStreamRequestSend_t xSend,
+                              void * pvContext,
+                              BaseType_t * pxResult )
+{
+    bool xHandled = false;
+    StreamRequest_t xRequest;
+    Pipeline_t * pxPipeline;
+    uint32_t ulIndex;
+    uint32_t ulWindow;
+    uint32_t ulNextBit = 0U;
+    uint32_t ulBlockCount;
+    uint32_t ulRequestLength;
+    TickType_t xNow = xTaskGetTickCount();
+
+    #if otademoconfigENABLE_METRICS
+        uint32_t ulRetransmitted = 0U;
+    #endif /* otademoconfigENABLE_METRICS */
+
+    *pxResult = pdPASS;
+
+    if( ( usTopicLength > PIPELINE_REQUEST_TOPIC_SUFFIX_LENGTH ) &&
+        ( memcmp( &pcTopic[ usTopicLength - PIPELINE_REQUEST_TOPIC_SUFFIX_LENGTH ],
+                  PIPELINE_REQUEST_TOPIC_SUFFIX,
+                  PIPELINE_REQUEST_TOPIC_SUFFIX_LENGTH ) == 0 ) &&
+        ( ulMessageLength <= ( sizeof( ucRequestBuffer ) - 16U ) ) &&
+        ( prvDecodeRequest( ( const uint8_t * ) pcMessage, ulMessageLength, &xRequest ) == true ) )
+    {
+        xHandled = true;
+        ulWindow = ( xRequest.xBlockCount.ulValue < PIPELINE_WINDOW_MAX ) ? xRequest.xBlockCount.ulValue : PIPELINE_WINDOW_MAX;
+
+        taskENTER_CRITICAL( &xPipelineLock );
+        {
+            /* Blocks in flight for another file will not arrive. */
+            if( xRequest.xFileId.ulValue != ulPipelineFileId )
+            {
+                memset( xPipelines, 0x00, sizeof( xPipelines ) );
+                memset( ucInFlight, 0x00, sizeof( ucInFlight ) );
+                ulPipelineFileId = xRequest.xFileId.ulValue;
+            }
+
+            /* Blocks in flight for too long are requested again. */
+            for( ulIndex = 0U; ulIndex < otademoconfigSTREAM_PIPELINES; ulIndex++ )
+            {
+                if( ( xPipelines[ ulIndex ].ulInFlight > 0U ) &&
+                    ( ( xNow - xPipelines[ ulIndex ].xRequestTick ) >= PIPELINE_RETRY_TICKS ) )
+                {
+                    #if otademoconfigENABLE_METRICS
+                        ulRetransmitted += xPipelines[ ulIndex ].ulInFlight;
+                    #endif /* otademoconfigENABLE_METRICS */
+
+                    prvReleasePipeline( &xPipelines[ ulIndex ] );
+                }
+            }
+        }
+        taskEXIT_CRITICAL( &xPipelineLock );
+
+        #if otademoconfigENABLE_METRICS
+            if( ulRetransmitted > 0U )
+            {
+                vOtaMetricsOnRetransmit( ulRetransmitted );
+            }
+        #endif /* otademoconfigENABLE_METRICS */
+
+        for( ulIndex = 0U; ulIndex < otademoconfigSTREAM_PIPELINES; ulIndex++ )
+        {
+            pxPipeline = &xPipelines[ ulIndex ];
+            ulBlockCount = 0U;
+            memset( ucBitmapBuffer, 0x00, sizeof( ucBitmapBuffer ) );
+
+            taskENTER_CRITICAL( &xPipelineLock );
+            {
+                /* A pipeline asks again once its whole window has arrived. */
+                if( pxPipeline->ulInFlight == 0U )
+                {
+                    ulBlockCount = prvFillPipeline( pxPipeline, &xRequest, ulWindow, &ulNextBit );
+                }
+            }
+            taskEXIT_CRITICAL( &xPipelineLock );
+
+            if( ulBlockCount > 0U )
+            {
+                ulRequestLength = prvEncodeRequest( &xRequest, ulBlockCount );
+
+                if( xSend( ucRequestBuffer, ulRequestLength, pvContext ) != pdPASS )
+                {
+                    taskENTER_CRITICAL( &xPipelineLock );
+                    {
+                        prvReleasePipeline( pxPipeline );
+                    }
+                    taskEXIT_CRITICAL( &xPipelineLock );
+
+                    *pxResult = pdFAIL;
+                }
+            }
+        }
+    }
+
+    return xHandled;
+}
+
+bool xOtaStreamPipelinesOnBlock( const uint8_t * pucPayload,
+                                 uint32_t ulLength )
+{
+    bool xRefill = false;
+    bool xAgentRequests = false;
+    uint32_t ulPosition = 0U;
+    uint32_t ulEntries = 0U;
+    uint32_t ulBlock = UINT32_MAX;
+    uint32_t ulIndex;
+    uint32_t ulSlot;
+    Pipeline_t * pxPipeline;
+    OtaCborItem_t xKey;
+    OtaCborItem_t xValue;
+
+    if( ( xOtaCborRead( pucPayload, ulLength, &ulPosition, &xKey ) == true ) &&
+        ( xKey.ucMajor == OTA_CBOR_MAJOR_MAP ) )
+    {
+        ulEntries = xKey.ulValue;
+    }
+
+    /* Find the block ID. */
+    while( ( ulEntries > 0U ) &&
+           ( xOtaCborRead( pucPayload, ulLength, &ulPosition, &xKey ) == true ) &&
+           ( xOtaCborRead( pucPayload, ulLength, &ulPosition, &xValue ) == true ) )
+    {
+        if( ( xOtaCborIsKey( &xKey, 'i' ) == true ) && ( xValue.ucMajor == OTA_CBOR_MAJOR_UINT ) )
+        {
+            ulBlock = xValue.ulValue;
+            ulEntries = 0U;
+        }
+        else
+        {
+            ulEntries--;
+        }
+    }
+
+    if( ulBlock < PIPELINE_MAX_BLOCKS )
+    {
+        taskENTER_CRITICAL( &xPipelineLock );
+        {
+            /* Blocks not in flight were requested again or are duplicates. */
+            if( ( ucInFlight[ ulBlock / 8U ] & ( 1U << ( ulBlock % 8U ) ) ) != 0U )
+            {
+                ucInFlight[ ulBlock / 8U ] &= ( uint8_t ) ~( 1U << ( ulBlock % 8U ) );
+
+                if( ulAgentBlocksToReceive > 1U )
+                {
+                    ulAgentBlocksToReceive--;
+                }
+                else
+                {
+                    ulAgentBlocksToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+                    xAgentRequests = true;
+                }
+
+                for( ulIndex = 0U; ulIndex < otademoconfigSTREAM_PIPELINES; ulIndex++ )
+                {
+                    pxPipeline = &xPipelines[ ulIndex ];
+
+                    for( ulSlot = 0U; ulSlot < pxPipeline->ulInFlight; ulSlot++ )
+                    {
+                        if( pxPipeline->ulBlocks[ ulSlot ] == ulBlock )
+                        {
+                            pxPipeline->ulInFlight--;
+                            pxPipeline->ulBlocks[ ulSlot ] = pxPipeline->ulBlocks[ pxPipeline->ulInFlight ];
+                            xRefill = ( pxPipeline->ulInFlight == 0U );
+                        }
+                    }
+                }
+            }
+        }
+        taskEXIT_CRITICAL( &xPipelineLock );
+    }
+
+    return ( xRefill == true ) && ( xAgentRequests == false );
+}
@@ -0,0 +1,121 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_stream_pipelines.h
+ * @brief Concurrent OTA stream request pipelines.
+ *
+ * A single stream request keeps at most one window of blocks in flight, so on
+ * a high latency link the transfer rate is bound by the window size over the
+ * round trip time. Each stream request of the OTA agent is split into one
+ * request per pipeline, each asking for the next run of missing blocks that
+ * are not already in flight. Every pipeline tracks the blocks it has in
+ * flight, and the received blocks merge into the block bitmap of the OTA
+ * agent as usual.
+ */
+#ifndef OTA_STREAM_PIPELINES_H
+#define OTA_STREAM_PIPELINES_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Send one pipeline request on the stream request topic.
+ *
+ * @param[in] pucRequest The CBOR encoded request.
+ * @param[in] ulLength Length of the request.
+ * @param[in] pvContext Context passed to xOtaStreamPipelinesSend.
+ *
+ * @return pdPASS if the request was sent, pdFAIL otherwise.
+ */
+typedef BaseType_t ( * OtaStreamRequestSend_t )( const uint8_t * pucRequest,
+                                                 uint32_t ulLength,
+                                                 void * pvContext );
+
+/**
+ * @brief Forget the blocks in flight.
+ */
+void vOtaStreamPipelinesInit( void );
+
+/**
+ * @brief Split a stream request of the OTA agent across the pipelines.
+ *
+ * Each pipeline with no blocks in flight sends a request for the next missing
+ * blocks not in flight, up to the block count of the original request.
+ * Blocks in flight for longer than most of otaconfigFILE_REQUEST_WAIT_MS are
+ * requested again.
+ *
+ * @note Only call from the OTA agent task.
+ *
+ * @param[in] pcTopic Topic of the publish.
+ * @param[in] usTopicLength Length of the topic.
+ * @param[in] pcMessage The publish as encoded by the OTA agent.
+ * @param[in] ulMessageLength Length of the publish.
+ * @param[in] xSend Function sending each pipeline request.
+ * @param[in] pvContext Context passed to xSend.
+ * @param[out] pxResult pdPASS if every request was sent, pdFAIL otherwise.
+ *
+ * @return true if the publish was a stream request and was handled, false if
+ * the caller must publish it unchanged.
+ */
+bool xOtaStreamPipelinesSend( const char * pcTopic,
+                              uint16_t usTopicLength,
+                              const char * pcMessage,
+                              uint32_t ulMessageLength,
+                              OtaStreamRequestSend_t xSend,
+                              void * pvContext,
+                              BaseType_t * pxResult );
+
+/**
+ * @brief Account for a data block received on the stream.
+ *
+ * @param[in] pucPayload The CBOR encoded data message.
+ * @param[in] ulLength Length of the message.
+ *
+ * @return true if a pipeline emptied its window and the OTA agent will not
+ * ask again after this block by itself, in which case the caller should
+ * signal OtaAgentEventRequestFileBlock to refill it.
+ */
+bool xOtaStreamPipelinesOnBlock( const uint8_t * pucPayload,
+                                 uint32_t ulLength );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* OTA_STREAM_PIPELINES_H */
@@ -56,7 +56,6 @@
 
 /* ESP-IDF includes. */
 #include "esp_log.h"
-#include "esp_event.h"
 #include "sdkconfig.h"
 
 /* coreMQTT library include. */
@@ -69,6 +68,11 @@
 #include "core_mqtt_agent_manager.h"
 #include "core_mqtt_agent_manager_events.h"
 
+#if configMQTT_AGENT_TRAFFIC_SHAPER
+    /* coreMQTT-Agent traffic shaper include. */
+    #include "core_mqtt_agent_shaper.h"
+#endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
 /* Subscription manager include. */
 #include "subscription_manager.h"
 
@@ -80,10 +84,6 @@
 
 /* Preprocessor definitions ***************************************************/
 
-/* coreMQTT-Agent event group bit definitions */
-#define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 0 )
-#define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 1 )
-
 /* MQTT event group bit definitions. */
 #define MQTT_INCOMING_PUBLISH_RECEIVED_BIT         ( 1 << 0 )
 #define MQTT_PUBLISH_COMMAND_COMPLETED_BIT         ( 1 << 1 )
@@ -143,7 +143,8 @@ extern MQTTAgentContext_t xGlobalMqttAgentContext;
 static char topicBuf[ subpubunsubconfigNUM_TASKS_TO_CREATE ][ subpubunsubconfigSTRING_BUFFER_LENGTH ];
 
 /**
- * @brief The event group used to manage coreMQTT-Agent events.
+ * @brief The event group shared by the coreMQTT-Agent manager to signal
+ * connection and OTA state.
  */
 static EventGroupHandle_t xNetworkEventGroup;
 
@@ -160,16 +161,6 @@ static uint32_t ulMessageId = 0;
 
 /* Static function declarations ***********************************************/
 
-/**
- * @brief ESP Event Loop library handler for coreMQTT-Agent events.
- *
- * This handles events defined in core_mqtt_agent_events.h.
- */
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData );
-
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
  * broker ACKs the SUBSCRIBE message.  Its implementation sends a notification
@@ -222,6 +213,16 @@ static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandCont
 static EventBits_t prvWaitForEvent( EventGroupHandle_t xMqttEventGroup,
                                     EventBits_t uxBitsToWaitFor );
 
+/**
+ * @brief Wait for the coreMQTT-Agent task to have a working network
+ * connection and for the link to have room for a message. With the traffic
+ * shaper, the message is sent during an OTA update within the telemetry share
+ * of the link; without it, the message waits for the OTA update to end.
+ *
+ * @param[in] ulBytes Size of the message about to be sent.
+ */
+static void prvWaitForLink( uint32_t ulBytes );
+
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when
  * there is an incoming publish on the topic being subscribed to.  Its
@@ -274,56 +275,6 @@ static void prvSubscribePublishUnsubscribeTask( void * pvParameters );
 
 /* Static function definitions ************************************************/
 
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData )
-{
-    ( void ) pvHandlerArg;
-    ( void ) xEventBase;
-    ( void ) pvEventData;
-
-    switch( lEventId )
-    {
-        case CORE_MQTT_AGENT_CONNECTED_EVENT:
-            ESP_LOGI( TAG,
-                      "coreMQTT-Agent connected." );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_CONNECTED_BIT );
-            break;
-
-        case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
-            ESP_LOGI( TAG,
-                      "coreMQTT-Agent disconnected. Preventing coreMQTT-Agent "
-                      "commands from being enqueued." );
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_CONNECTED_BIT );
-            break;
-
-        case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
-            ESP_LOGI( TAG,
-                      "OTA started. Preventing coreMQTT-Agent commands from "
-                      "being enqueued." );
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-            break;
-
-        case CORE_MQTT_AGENT_OTA_STOPPED_EVENT:
-            ESP_LOGI( TAG,
-                      "OTA stopped. No longer preventing coreMQTT-Agent "
-                      "commands from being enqueued." );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-            break;
-
-        default:
-            ESP_LOGE( TAG,
-                      "coreMQTT-Agent event handler received unexpected event: %" PRIu32 "",
-                      lEventId );
-            break;
-    }
-}
-
 static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
                                        MQTTAgentReturnInfo_t * pxReturnInfo )
 {
@@ -413,6 +364,27 @@ static EventBits_t prvWaitForEvent( EventGroupHandle_t xMqttEventGroup,
     return xReturn;
 }
 
+static void prvWaitForLink( uint32_t ulBytes )
+{
+    #if configMQTT_AGENT_TRAFFIC_SHAPER
+        xEventGroupWaitBits( xNetworkEventGroup,
+                             CORE_MQTT_AGENT_CONNECTED_BIT,
+                             pdFALSE,
+                             pdTRUE,
+                             portMAX_DELAY );
+        ( void ) xCoreMqttAgentShaperAcquire( CORE_MQTT_AGENT_TRAFFIC_TELEMETRY,
+                                              ulBytes,
+                                              portMAX_DELAY );
+    #else
+        ( void ) ulBytes;
+        xEventGroupWaitBits( xNetworkEventGroup,
+                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
+                             pdFALSE,
+                             pdTRUE,
+                             portMAX_DELAY );
+    #endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+}
+
 static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
                                         MQTTPublishInfo_t * pxPublishInfo )
 {
@@ -492,12 +464,8 @@ static void prvPublishToTopic( MQTTQoS_t xQoS,
     do
     {
         /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
+         * for the link to have room for the publish. */
+        prvWaitForLink( ( uint32_t ) xPublishInfo.topicNameLength + xPublishInfo.payloadLength );
 
         ESP_LOGI( TAG,
                   "Task \"%s\" sending publish request to coreMQTT-Agent with message \"%s\" on topic \"%s\" with ID %" PRIu32 ".",
@@ -604,12 +572,8 @@ static void prvSubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPu
     do
     {
         /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
+         * for the link to have room for the subscribe. */
+        prvWaitForLink( xSubscribeInfo.topicFilterLength );
 
         ESP_LOGI( TAG,
                   "Task \"%s\" sending subscribe request to coreMQTT-Agent for topic filter: %s with id %" PRIu32 "",
@@ -709,12 +673,8 @@ static void prvUnsubscribeToTopic( MQTTQoS_t xQoS,
     do
     {
         /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
+         * for the link to have room for the unsubscribe. */
+        prvWaitForLink( xUnsubscribeInfo.topicFilterLength );
         ESP_LOGI( TAG,
                   "Task \"%s\" sending unsubscribe request to coreMQTT-Agent for topic filter: %s with id %" PRIu32 "",
                   pcTaskGetName( NULL ),
@@ -832,12 +792,9 @@ void vStartSubscribePublishUnsubscribeDemo( void )
     uint32_t ulTaskNumber;
 
     xMessageIdSemaphore = xSemaphoreCreateMutex();
-    xNetworkEventGroup = xEventGroupCreate();
-    xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
 
-    /* Initialize the coreMQTT-Agent event group. */
-    xEventGroupSetBits( xNetworkEventGroup,
-                        CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+    /* Wait on the connection state shared by the coreMQTT-Agent manager. */
+    xNetworkEventGroup = xCoreMqttAgentManagerGetEventGroup();
 
     /* Each instance of prvSubscribePublishUnsubscribeTask() generates a unique
      * name and topic filter for itself from the number passed in as the task
@@ -58,7 +58,6 @@
 
 /* ESP-IDF includes. */
 #include "esp_log.h"
-#include "esp_event.h"
 #include "sdkconfig.h"
 
 /* coreMQTT library include. */
@@ -71,6 +70,11 @@
 #include "core_mqtt_agent_manager.h"
 #include "core_mqtt_agent_manager_events.h"
 
+#if configMQTT_AGENT_TRAFFIC_SHAPER
+    /* coreMQTT-Agent traffic shaper include. */
+    #include "core_mqtt_agent_shaper.h"
+#endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
+
 /* coreJSON include. */
 #include "core_json.h"
 
@@ -88,10 +92,6 @@
 
 /* Preprocessor definitions ***************************************************/
 
-/* coreMQTT-Agent event group bit definitions */
-#define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 0 )
-#define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 1 )
-
 /* Struct definitions *********************************************************/
 
 /**
@@ -128,22 +128,13 @@ extern MQTTAgentContext_t xGlobalMqttAgentContext;
 static char topicBuf[ temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH ];
 
 /**
- * @brief The event group used to manage coreMQTT-Agent events.
+ * @brief The event group shared by the coreMQTT-Agent manager to signal
+ * connection and OTA state.
  */
 static EventGroupHandle_t xNetworkEventGroup;
 
 /* Static function declarations ***********************************************/
 
-/**
- * @brief ESP Event Loop library handler for coreMQTT-Agent events.
- *
- * This handles events defined in core_mqtt_agent_events.h.
- */
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData );
-
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
  * broker ACKs the SUBSCRIBE message.  Its implementation sends a notification
@@ -468,13 +459,8 @@ static void prvTempSubPubAndLEDControlTask( void * pvParameters )
     /* Hardware initialisation */
     app_driver_init();
 
-    /* Initialize the coreMQTT-Agent event group. */
-    xNetworkEventGroup = xEventGroupCreate();
-    xEventGroupSetBits( xNetworkEventGroup,
-                        CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-
-    /* Register coreMQTT-Agent event handler. */
-    xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+    /* Wait on the connection state shared by the coreMQTT-Agent manager. */
+    xNetworkEventGroup = xCoreMqttAgentManagerGetEventGroup();
 
     xQoS = ( MQTTQoS_t ) temppubsubandledcontrolconfigQOS_LEVEL;
 
@@ -538,13 +524,27 @@ static void prvTempSubPubAndLEDControlTask( void * pvParameters )
          * is acknowledged. */
         xCommandContext.ulNotificationValue = ulValueToNotify;
 
-        /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
+        #if configMQTT_AGENT_TRAFFIC_SHAPER
+            /* Wait for coreMQTT-Agent task to have working network connection
+             * and, during an OTA update, for the telemetry share of the link
+             * to have room for the publish. */
+            xEventGroupWaitBits( xNetworkEventGroup,
+                                 CORE_MQTT_AGENT_CONNECTED_BIT,
+                                 pdFALSE,
+                                 pdTRUE,
+                                 portMAX_DELAY );
+            ( void ) xCoreMqttAgentShaperAcquire( CORE_MQTT_AGENT_TRAFFIC_TELEMETRY,
+                                                  ( uint32_t ) xPublishInfo.topicNameLength + xPublishInfo.payloadLength,
+                                                  portMAX_DELAY );
+        #else
+            /* Wait for coreMQTT-Agent task to have working network connection and
+             * not be performing an OTA update. */
+            xEventGroupWaitBits( xNetworkEventGroup,
+                                 CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
+                                 pdFALSE,
+                                 pdTRUE,
+                                 portMAX_DELAY );
+        #endif /* configMQTT_AGENT_TRAFFIC_SHAPER */
 
         ESP_LOGI( TAG,
                   "Sending publish request to agent with message \"%s\" on topic \"%s\"",
@@ -606,56 +606,6 @@ static void prvTempSubPubAndLEDControlTask( void * pvParameters )
     vTaskDelete( NULL );
 }
 
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData )
-{
-    ( void ) pvHandlerArg;
-    ( void ) xEventBase;
-    ( void ) pvEventData;
-
-    switch( lEventId )
-    {
-        case CORE_MQTT_AGENT_CONNECTED_EVENT:
-            ESP_LOGI( TAG,
-                      "coreMQTT-Agent connected." );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_CONNECTED_BIT );
-            break;
-
-        case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
-            ESP_LOGI( TAG,
-                      "coreMQTT-Agent disconnected. Preventing coreMQTT-Agent "
-                      "commands from being enqueued." );
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_CONNECTED_BIT );
-            break;
-
-        case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
-            ESP_LOGI( TAG,
-                      "OTA started. Preventing coreMQTT-Agent commands from "
-                      "being enqueued." );
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-            break;
-
-        case CORE_MQTT_AGENT_OTA_STOPPED_EVENT:
-            ESP_LOGI( TAG,
-                      "OTA stopped. No longer preventing coreMQTT-Agent "
-                      "commands from being enqueued." );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-            break;
-
-        default:
-            ESP_LOGE( TAG,
-                      "coreMQTT-Agent event handler received unexpected event: %" PRIu32 "",
-                      lEventId );
-            break;
-    }
-}
-
 /* Public function definitions ************************************************/
 
 void vStartTempSubPubAndLEDControlDemo( void )
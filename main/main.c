@@ -67,6 +67,7 @@
 #if CONFIG_GRI_ENABLE_OTA_DEMO
     #include "ota_pal.h"
     #include "ota_over_mqtt_demo.h"
+    #include "ota_image_hash.h"
 #endif /* CONFIG_GRI_ENABLE_OTA_DEMO */
 
 #if CONFIG_GRI_RUN_QUALIFICATION_TEST
@@ -264,6 +265,7 @@ static void prvStartEnabledDemos( void )
 
             if( otaPal_SetCodeSigningCertificate( pcAwsCodeSigningCertPem ) )
             {
+                vOtaImageHashSetCertificate( pcAwsCodeSigningCertPem );
                 vStartOTACodeSigningDemo();
             }
             else
@@ -345,6 +347,17 @@ void app_main( void )
      * starting WiFi and the coreMQTT-Agent network manager. */
     ESP_ERROR_CHECK( esp_event_loop_create_default() );
 
+    /* Initialize the coreMQTT-Agent connection state service. This needs to
+     * be done before starting demo tasks as they wait on the shared connection
+     * state event group and register state callbacks. */
+    xRet = xCoreMqttAgentManagerEventsInit();
+
+    if( xRet != pdPASS )
+    {
+        ESP_LOGE( TAG, "Failed to initialize coreMQTT-Agent connection state." );
+        return;
+    }
+
     /* Start demo tasks. This needs to be done before starting WiFi and
      * and the coreMQTT-Agent network manager so demos can
      * register their coreMQTT-Agent event handlers before events happen. */
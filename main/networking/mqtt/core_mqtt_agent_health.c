@@ -0,0 +1,625 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_health.c
+ * @brief Health monitor of the coreMQTT-Agent command loop.
+ *
+ * The coreMQTT-Agent manager reports every pool, queue and loop transition of
+ * its messaging interface here. Commands are tracked from send to release in a
+ * small table keyed by command pointer, and a timer checks that the command
+ * loop keeps turning while it is not waiting on the queue.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/timers.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* coreMQTT-Agent manager events include. */
+#include "core_mqtt_agent_manager_events.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_health.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Period of the stall check in milliseconds.
+ */
+#define HEALTH_CHECK_PERIOD_MS           ( 500U )
+
+/**
+ * @brief Number of commands that can be tracked from send to release. Bounded
+ * by the number of commands in the command pool.
+ */
+#define HEALTH_MAX_TRACKED_COMMANDS      ( MQTT_COMMAND_CONTEXTS_POOL_SIZE )
+
+/**
+ * @brief Topic the health statistics are published to.
+ */
+#define HEALTH_DEBUG_TOPIC               CONFIG_GRI_THING_NAME "/debug/agent_health"
+
+/**
+ * @brief Size of the buffer holding the published statistics.
+ */
+#define HEALTH_DEBUG_PAYLOAD_SIZE        ( 1024U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A command tracked from send to release.
+ */
+typedef struct TrackedCommand
+{
+    MQTTAgentCommand_t * pxCommand;
+    uint32_t ulSendTimeUs;
+    uint32_t ulReceiveTimeUs;
+    bool xReceived;
+} TrackedCommand_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_health";
+
+/**
+ * @brief Global MQTT Agent context used to publish the statistics.
+ */
+extern MQTTAgentContext_t xGlobalMqttAgentContext;
+
+/**
+ * @brief Lock of every variable below. Taken for a few instructions from the
+ * coreMQTT-Agent task, the tasks sending commands and the timer task.
+ */
+static portMUX_TYPE xHealthLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief The health statistics.
+ */
+static CoreMqttAgentHealthStats_t xStats;
+
+/**
+ * @brief Commands between send and release.
+ */
+static TrackedCommand_t xTrackedCommands[ HEALTH_MAX_TRACKED_COMMANDS ];
+
+/**
+ * @brief Queue of the coreMQTT-Agent messaging interface.
+ */
+static QueueHandle_t xHealthCommandQueue;
+
+/**
+ * @brief Set once the command loop returned from the queue, until it exits.
+ */
+static bool xLoopRunning = false;
+
+/**
+ * @brief Set while the command loop waits on the queue.
+ */
+static bool xInReceive = false;
+
+/**
+ * @brief Time the command loop last returned from the queue.
+ */
+static uint32_t ulLastReceiveTimeUs;
+
+/**
+ * @brief Set once the current stall has been reported.
+ */
+static bool xStallReported = false;
+
+#if ( configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 )
+
+/**
+ * @brief Buffer holding the published statistics.
+ */
+    static char cDebugPayload[ HEALTH_DEBUG_PAYLOAD_SIZE ];
+
+/**
+ * @brief Set while a publish of the statistics is in the agent.
+ */
+    static volatile bool xDebugPublishInFlight = false;
+
+/**
+ * @brief Time since the statistics were last published.
+ */
+    static uint32_t ulTimeSincePublishMs = 0U;
+#endif /* configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 */
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Get the current time in microseconds.
+ */
+static uint32_t prvGetTimeUs( void );
+
+/**
+ * @brief Add a latency to a histogram. Must be called with xHealthLock held.
+ *
+ * @param[in] pulHistogram The histogram.
+ * @param[in, out] pulMax Maximum latency of the histogram.
+ * @param[in] ulLatencyUs The latency in microseconds.
+ */
+static void prvRecordLatency( uint32_t * pulHistogram,
+                              uint32_t * pulMax,
+                              uint32_t ulLatencyUs );
+
+/**
+ * @brief Find the tracked entry of a command. Must be called with xHealthLock
+ * held.
+ *
+ * @param[in] pxCommand The command, NULL to find a free entry.
+ *
+ * @return The entry, NULL if not found.
+ */
+static TrackedCommand_t * prvFindTrackedCommand( const MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Timer callback checking the command loop for stalls, and publishing
+ * the statistics if enabled.
+ *
+ * @param[in] xTimer The timer.
+ */
+static void prvHealthTimerCallback( TimerHandle_t xTimer );
+
+#if ( configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 )
+
+/**
+ * @brief Append formatted text to the debug payload.
+ *
+ * @param[in] xLength Length of the payload so far.
+ * @param[in] pcFormat printf style format.
+ *
+ * @return The new length, capped to the size of the buffer once it is full.
+ */
+    static size_t prvAppendToPayload( size_t xLength,
+                                      const char * pcFormat,
+                                      ... );
+
+/**
+ * @brief Publish the statistics to the debug topic.
+ */
+    static void prvPublishStats( void );
+
+/**
+ * @brief Completion callback of the debug publish.
+ */
+    static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                            MQTTAgentReturnInfo_t * pxReturnInfo );
+#endif /* configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 */
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvGetTimeUs( void )
+{
+    /* Truncated, differences stay valid across the wrap. */
+    return ( uint32_t ) esp_timer_get_time();
+}
+
+static void prvRecordLatency( uint32_t * pulHistogram,
+                              uint32_t * pulMax,
+                              uint32_t ulLatencyUs )
+{
+    size_t xBucket = 0U;
+    uint32_t ulBound = CORE_MQTT_AGENT_HEALTH_FIRST_BUCKET_US;
+
+    while( ( xBucket < ( CORE_MQTT_AGENT_HEALTH_HISTOGRAM_BUCKETS - 1U ) ) &&
+           ( ulLatencyUs >= ulBound ) )
+    {
+        xBucket++;
+        ulBound <<= 1;
+    }
+
+    pulHistogram[ xBucket ]++;
+
+    if( ulLatencyUs > *pulMax )
+    {
+        *pulMax = ulLatencyUs;
+    }
+}
+
+static TrackedCommand_t * prvFindTrackedCommand( const MQTTAgentCommand_t * pxCommand )
+{
+    TrackedCommand_t * pxEntry = NULL;
+    size_t xIndex;
+
+    for( xIndex = 0U; xIndex < HEALTH_MAX_TRACKED_COMMANDS; xIndex++ )
+    {
+        if( xTrackedCommands[ xIndex ].pxCommand == pxCommand )
+        {
+            pxEntry = &xTrackedCommands[ xIndex ];
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+static void prvHealthTimerCallback( TimerHandle_t xTimer )
+{
+    bool xStalled = false;
+    uint32_t ulStalledForMs = 0U;
+
+    ( void ) xTimer;
+
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        if( ( xLoopRunning == true ) && ( xInReceive == false ) && ( xStallReported == false ) )
+        {
+            ulStalledForMs = ( prvGetTimeUs() - ulLastReceiveTimeUs ) / 1000U;
+
+            if( ulStalledForMs >= configMQTT_AGENT_STALL_THRESHOLD_MS )
+            {
+                xStallReported = true;
+                xStats.ulStallCount++;
+                xStalled = true;
+            }
+        }
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+
+    if( xStalled == true )
+    {
+        ESP_LOGW( TAG,
+                  "coreMQTT-Agent command loop has not turned for %" PRIu32 " ms.",
+                  ulStalledForMs );
+        xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_STALLED_EVENT );
+    }
+
+    #if ( configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 )
+        ulTimeSincePublishMs += HEALTH_CHECK_PERIOD_MS;
+
+        if( ulTimeSincePublishMs >= configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS )
+        {
+            ulTimeSincePublishMs = 0U;
+            prvPublishStats();
+        }
+    #endif /* configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 */
+}
+
+#if ( configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 )
+
+    static size_t prvAppendToPayload( size_t xLength,
+                                      const char * pcFormat,
+                                      ... )
+    {
+        va_list xArgs;
+        int lWritten = 0;
+
+        if( xLength < sizeof( cDebugPayload ) )
+        {
+            va_start( xArgs, pcFormat );
+            lWritten = vsnprintf( &cDebugPayload[ xLength ], sizeof( cDebugPayload ) - xLength, pcFormat, xArgs );
+            va_end( xArgs );
+        }
+
+        if( lWritten > 0 )
+        {
+            xLength += ( size_t ) lWritten;
+        }
+
+        return ( xLength > sizeof( cDebugPayload ) ) ? sizeof( cDebugPayload ) : xLength;
+    }
+
+    static void prvPublishStats( void )
+    {
+        static MQTTPublishInfo_t xPublishInfo = { 0 };
+        MQTTAgentCommandInfo_t xCommandParams = { 0 };
+        CoreMqttAgentHealthStats_t xSnapshot;
+        const uint32_t * pulHistograms[ 3 ];
+        const char * pcNames[ 3 ] = { "queue_us", "completion_us", "loop_us" };
+        size_t xLength = 0U;
+        size_t xHistogram, xBucket;
+
+        /* Only publish while connected, and never queue more than one. */
+        if( ( ( ulCoreMqttAgentManagerGetState() & CORE_MQTT_AGENT_CONNECTED_BIT ) != 0U ) &&
+            ( xDebugPublishInFlight == false ) )
+        {
+            vCoreMqttAgentHealthGetStats( &xSnapshot );
+
+            pulHistograms[ 0 ] = xSnapshot.ulQueueLatency;
+            pulHistograms[ 1 ] = xSnapshot.ulCompletionLatency;
+            pulHistograms[ 2 ] = xSnapshot.ulLoopTime;
+
+            xLength = prvAppendToPayload( xLength, "{\"first_bucket_us\":%u", CORE_MQTT_AGENT_HEALTH_FIRST_BUCKET_US );
+
+            for( xHistogram = 0U; xHistogram < 3U; xHistogram++ )
+            {
+                xLength = prvAppendToPayload( xLength, ",\"%s\":[", pcNames[ xHistogram ] );
+
+                for( xBucket = 0U; xBucket < CORE_MQTT_AGENT_HEALTH_HISTOGRAM_BUCKETS; xBucket++ )
+                {
+                    xLength = prvAppendToPayload( xLength,
+                                                  "%s%" PRIu32,
+                                                  ( xBucket == 0U ) ? "" : ",",
+                                                  pulHistograms[ xHistogram ][ xBucket ] );
+                }
+
+                xLength = prvAppendToPayload( xLength, "]" );
+            }
+
+            xLength = prvAppendToPayload( xLength,
+                                          ",\"max_queue_us\":%" PRIu32 ",\"max_completion_us\":%" PRIu32
+                                          ",\"max_loop_us\":%" PRIu32 ",\"queue_hwm\":%" PRIu32
+                                          ",\"pool_in_use\":%" PRIu32 ",\"pool_hwm\":%" PRIu32
+                                          ",\"stalls\":%" PRIu32 ",\"untracked\":%" PRIu32 "}",
+                                          xSnapshot.ulMaxQueueLatencyUs,
+                                          xSnapshot.ulMaxCompletionLatencyUs,
+                                          xSnapshot.ulMaxLoopTimeUs,
+                                          xSnapshot.ulQueueHighWaterMark,
+                                          xSnapshot.ulPoolInUse,
+                                          xSnapshot.ulPoolHighWaterMark,
+                                          xSnapshot.ulStallCount,
+                                          xSnapshot.ulUntrackedCommands );
+
+            /* The buffer holds the worst case, the check only guards against
+             * later changes of the format. */
+            if( xLength >= sizeof( cDebugPayload ) )
+            {
+                ESP_LOGE( TAG, "Health statistics do not fit the debug payload buffer." );
+            }
+            else
+            {
+                xPublishInfo.qos = MQTTQoS0;
+                xPublishInfo.pTopicName = HEALTH_DEBUG_TOPIC;
+                xPublishInfo.topicNameLength = ( uint16_t ) strlen( HEALTH_DEBUG_TOPIC );
+                xPublishInfo.pPayload = cDebugPayload;
+                xPublishInfo.payloadLength = xLength;
+
+                xCommandParams.blockTimeMs = 0U;
+                xCommandParams.cmdCompleteCallback = prvPublishCompleteCallback;
+                xCommandParams.pCmdCompleteCallbackContext = NULL;
+
+                xDebugPublishInFlight = true;
+
+                if( MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                       &xPublishInfo,
+                                       &xCommandParams ) != MQTTSuccess )
+                {
+                    xDebugPublishInFlight = false;
+                }
+            }
+        }
+    }
+
+    static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                            MQTTAgentReturnInfo_t * pxReturnInfo )
+    {
+        ( void ) pxCommandContext;
+        ( void ) pxReturnInfo;
+
+        xDebugPublishInFlight = false;
+    }
+
+#endif /* configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS > 0 */
+
+/* Public function definitions ************************************************/
+
+BaseType_t xCoreMqttAgentHealthInit( QueueHandle_t xCommandQueue )
+{
+    BaseType_t xRet = pdPASS;
+    TimerHandle_t xHealthTimer;
+
+    xHealthCommandQueue = xCommandQueue;
+
+    xHealthTimer = xTimerCreate( "AgentHealth",
+                                 pdMS_TO_TICKS( HEALTH_CHECK_PERIOD_MS ),
+                                 pdTRUE,
+                                 NULL,
+                                 prvHealthTimerCallback );
+
+    if( xHealthTimer == NULL )
+    {
+        ESP_LOGE( TAG, "Failed to create coreMQTT-Agent health timer." );
+        xRet = pdFAIL;
+    }
+    else if( xTimerStart( xHealthTimer, 0 ) != pdPASS )
+    {
+        ESP_LOGE( TAG, "Failed to start coreMQTT-Agent health timer." );
+        xRet = pdFAIL;
+    }
+
+    return xRet;
+}
+
+void vCoreMqttAgentHealthOnGetCommand( MQTTAgentCommand_t * pxCommand )
+{
+    if( pxCommand != NULL )
+    {
+        taskENTER_CRITICAL( &xHealthLock );
+        {
+            xStats.ulPoolInUse++;
+
+            if( xStats.ulPoolInUse > xStats.ulPoolHighWaterMark )
+            {
+                xStats.ulPoolHighWaterMark = xStats.ulPoolInUse;
+            }
+        }
+        taskEXIT_CRITICAL( &xHealthLock );
+    }
+}
+
+void vCoreMqttAgentHealthOnSend( MQTTAgentCommand_t * pxCommand )
+{
+    TrackedCommand_t * pxEntry;
+    uint32_t ulWaiting;
+
+    /* Count the command about to be added, as the agent may dequeue it
+     * before the send returns. */
+    ulWaiting = ( uint32_t ) uxQueueMessagesWaiting( xHealthCommandQueue ) + 1U;
+
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        if( ulWaiting > xStats.ulQueueHighWaterMark )
+        {
+            xStats.ulQueueHighWaterMark = ulWaiting;
+        }
+
+        pxEntry = prvFindTrackedCommand( NULL );
+
+        if( pxEntry != NULL )
+        {
+            pxEntry->pxCommand = pxCommand;
+            pxEntry->ulSendTimeUs = prvGetTimeUs();
+            pxEntry->xReceived = false;
+        }
+        else
+        {
+            xStats.ulUntrackedCommands++;
+        }
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+}
+
+void vCoreMqttAgentHealthOnReceiveStart( void )
+{
+    uint32_t ulNowUs = prvGetTimeUs();
+    bool xRecovered = false;
+
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        if( xLoopRunning == true )
+        {
+            prvRecordLatency( xStats.ulLoopTime,
+                              &xStats.ulMaxLoopTimeUs,
+                              ulNowUs - ulLastReceiveTimeUs );
+        }
+
+        xRecovered = xStallReported;
+        xStallReported = false;
+        xInReceive = true;
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+
+    if( xRecovered == true )
+    {
+        ESP_LOGW( TAG, "coreMQTT-Agent command loop recovered from stall." );
+    }
+}
+
+void vCoreMqttAgentHealthOnReceive( MQTTAgentCommand_t * pxCommand )
+{
+    uint32_t ulNowUs = prvGetTimeUs();
+    TrackedCommand_t * pxEntry;
+
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        xLoopRunning = true;
+        xInReceive = false;
+        ulLastReceiveTimeUs = ulNowUs;
+
+        if( pxCommand != NULL )
+        {
+            pxEntry = prvFindTrackedCommand( pxCommand );
+
+            if( pxEntry != NULL )
+            {
+                prvRecordLatency( xStats.ulQueueLatency,
+                                  &xStats.ulMaxQueueLatencyUs,
+                                  ulNowUs - pxEntry->ulSendTimeUs );
+                pxEntry->ulReceiveTimeUs = ulNowUs;
+                pxEntry->xReceived = true;
+            }
+        }
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+}
+
+void vCoreMqttAgentHealthOnRelease( MQTTAgentCommand_t * pxCommand )
+{
+    uint32_t ulNowUs = prvGetTimeUs();
+    TrackedCommand_t * pxEntry;
+
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        if( xStats.ulPoolInUse > 0U )
+        {
+            xStats.ulPoolInUse--;
+        }
+
+        pxEntry = prvFindTrackedCommand( pxCommand );
+
+        if( pxEntry != NULL )
+        {
+            /* Commands that failed to send are released without having been
+             * received. */
+            if( pxEntry->xReceived == true )
+            {
+                prvRecordLatency( xStats.ulCompletionLatency,
+                                  &xStats.ulMaxCompletionLatencyUs,
+                                  ulNowUs - pxEntry->ulReceiveTimeUs );
+            }
+
+            pxEntry->pxCommand = NULL;
+        }
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+}
+
+void vCoreMqttAgentHealthOnLoopExit( void )
+{
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        xLoopRunning = false;
+        xInReceive = false;
+        xStallReported = false;
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+}
+
+void vCoreMqttAgentHealthGetStats( CoreMqttAgentHealthStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL( &xHealthLock );
+    {
+        memcpy( pxStats, &xStats, sizeof( xStats ) );
+    }
+    taskEXIT_CRITICAL( &xHealthLock );
+}
@@ -0,0 +1,150 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_health.h
+ * @brief Health monitor of the coreMQTT-Agent command loop.
+ */
+#ifndef CORE_MQTT_AGENT_HEALTH_H
+#define CORE_MQTT_AGENT_HEALTH_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Number of buckets of each latency histogram.
+ *
+ * Bucket 0 counts latencies below CORE_MQTT_AGENT_HEALTH_FIRST_BUCKET_US, and
+ * every following bucket doubles the bound. The last bucket counts everything
+ * above the bound of the one before it.
+ */
+#define CORE_MQTT_AGENT_HEALTH_HISTOGRAM_BUCKETS    ( 16U )
+
+/**
+ * @brief Upper bound of the first histogram bucket in microseconds.
+ */
+#define CORE_MQTT_AGENT_HEALTH_FIRST_BUCKET_US      ( 128U )
+
+/**
+ * @brief Snapshot of the coreMQTT-Agent health statistics.
+ */
+typedef struct CoreMqttAgentHealthStats
+{
+    /* Time commands wait in the command queue, from send to dequeue. */
+    uint32_t ulQueueLatency[ CORE_MQTT_AGENT_HEALTH_HISTOGRAM_BUCKETS ];
+    uint32_t ulMaxQueueLatencyUs;
+
+    /* Time from dequeue to the command being released by the agent, which
+     * includes waiting for the broker acknowledgment. */
+    uint32_t ulCompletionLatency[ CORE_MQTT_AGENT_HEALTH_HISTOGRAM_BUCKETS ];
+    uint32_t ulMaxCompletionLatencyUs;
+
+    /* Time the command loop spends between two waits on the command queue. */
+    uint32_t ulLoopTime[ CORE_MQTT_AGENT_HEALTH_HISTOGRAM_BUCKETS ];
+    uint32_t ulMaxLoopTimeUs;
+
+    uint32_t ulQueueHighWaterMark;
+    uint32_t ulPoolInUse;
+    uint32_t ulPoolHighWaterMark;
+    uint32_t ulStallCount;
+    uint32_t ulUntrackedCommands;
+} CoreMqttAgentHealthStats_t;
+
+/**
+ * @brief Start the health monitor.
+ *
+ * @param[in] xCommandQueue The queue of the coreMQTT-Agent messaging interface.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xCoreMqttAgentHealthInit( QueueHandle_t xCommandQueue );
+
+/**
+ * @brief Record a command taken from the command pool.
+ *
+ * @param[in] pxCommand The command, NULL if the pool was empty.
+ */
+void vCoreMqttAgentHealthOnGetCommand( MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Record a command about to be sent to the command queue.
+ *
+ * @param[in] pxCommand The command.
+ */
+void vCoreMqttAgentHealthOnSend( MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Record the command loop starting to wait on the command queue.
+ */
+void vCoreMqttAgentHealthOnReceiveStart( void );
+
+/**
+ * @brief Record the command loop returning from the command queue.
+ *
+ * @param[in] pxCommand The received command, NULL if none was received.
+ */
+void vCoreMqttAgentHealthOnReceive( MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Record a command released back to the command pool.
+ *
+ * @param[in] pxCommand The command.
+ */
+void vCoreMqttAgentHealthOnRelease( MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Record the command loop returning, so the time until it next runs is
+ * not reported as a stall.
+ */
+void vCoreMqttAgentHealthOnLoopExit( void );
+
+/**
+ * @brief Get a snapshot of the health statistics.
+ *
+ * @param[out] pxStats The statistics.
+ */
+void vCoreMqttAgentHealthGetStats( CoreMqttAgentHealthStats_t * pxStats );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* CORE_MQTT_AGENT_HEALTH_H */
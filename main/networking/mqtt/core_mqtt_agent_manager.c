@@ -72,6 +72,16 @@
 /* Configurations include. */
 #include "core_mqtt_agent_manager_config.h"
 
+/* Health monitor include. */
+#if configMQTT_AGENT_HEALTH_MONITOR
+    #include "core_mqtt_agent_health.h"
+#endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
+/* Session store include. */
+#if configMQTT_AGENT_PERSIST_SESSION
+    #include "core_mqtt_agent_session_store.h"
+#endif /* configMQTT_AGENT_PERSIST_SESSION */
+
 /* OTA demo include. */
 #if CONFIG_GRI_ENABLE_OTA_DEMO
     #include "ota_over_mqtt_demo.h"
@@ -79,18 +89,16 @@
 
 /* Preprocessor definitions ***************************************************/
 
-/* Network event group bit definitions */
-#define WIFI_CONNECTED_BIT                  ( 1 << 0 )
-#define WIFI_DISCONNECTED_BIT               ( 1 << 1 )
-#define CORE_MQTT_AGENT_CONNECTED_BIT       ( 1 << 2 )
-#define CORE_MQTT_AGENT_DISCONNECTED_BIT    ( 1 << 3 )
-
 /* Timing definitions */
 #define MILLISECONDS_PER_SECOND             ( 1000U )
 #define MILLISECONDS_PER_TICK   \
     ( MILLISECONDS_PER_SECOND / \
       configTICK_RATE_HZ )
 
+/* Seed and prime of the 32-bit FNV-1a hash used by the duplicate window. */
+#define DEDUPE_HASH_SEED                    ( 2166136261UL )
+#define DEDUPE_HASH_PRIME                   ( 16777619UL )
+
 #define MUTEX_IS_OWNED( xHandle )    ( xTaskGetCurrentTaskHandle() == xSemaphoreGetMutexHolder( xHandle ) )
 
 /* Global variables ***********************************************************/
@@ -145,10 +153,42 @@ SemaphoreHandle_t xSubListMutex;
 static NetworkContext_t * pxNetworkContext;
 
 /**
- * @brief The event group used to manage network events.
+ * @brief The event group used to manage network events. This is the event
+ * group shared through the connection state service.
  */
 static EventGroupHandle_t xNetworkEventGroup;
 
+#if ( configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 )
+
+/**
+ * @brief An inbound QoS1/QoS2 publish remembered by the duplicate window.
+ */
+    typedef struct DedupeEntry
+    {
+        uint32_t ulHash;
+        uint16_t usPacketId;
+        bool xValid;
+    } DedupeEntry_t;
+
+/**
+ * @brief Ring of the most recent inbound QoS1/QoS2 publishes. Only accessed
+ * from the coreMQTT-Agent task, or from the connection task while the command
+ * loop is not running.
+ */
+    static DedupeEntry_t xDedupeWindow[ configMQTT_AGENT_DEDUPE_WINDOW_SIZE ];
+
+/**
+ * @brief Next entry of #xDedupeWindow to overwrite.
+ */
+    static size_t xDedupeWindowHead = 0U;
+#endif /* configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 */
+
+/**
+ * @brief Number of redelivered publishes that were acknowledged but not
+ * dispatched.
+ */
+static uint32_t ulSuppressedDuplicates = 0U;
+
 /* Static function declarations ***********************************************/
 
 /**
@@ -171,6 +211,27 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo );
 
+/**
+ * @brief Check an incoming publish against the duplicate window, and remember
+ * it if it is new.
+ *
+ * Only publishes with the DUP flag set are suppressed, so a packet ID legitimately
+ * reused by the broker for a new message is never dropped.
+ *
+ * @param[in] packetId Packet ID of publish.
+ * @param[in] pxPublishInfo Info of incoming publish.
+ *
+ * @return true if the publish is a redelivery of one already dispatched.
+ */
+static bool prvIsDuplicatePublish( uint16_t packetId,
+                                   const MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Forget every publish in the duplicate window. Called when the broker
+ * starts a new session, since nothing is redelivered from an old one.
+ */
+static void prvResetDuplicateWindow( void );
+
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
  * broker ACKs the SUBSCRIBE message. This callback implementation is used for
@@ -226,6 +287,59 @@ static BaseType_t prvStartCoreMqttAgent( void );
  */
 static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext );
 
+/**
+ * @brief Send function of the coreMQTT-Agent messaging interface.
+ *
+ * Wraps Agent_MessageSend to time commands from send to dequeue.
+ *
+ * @param[in] pMsgCtx The message context.
+ * @param[in] pCommandToSend The command to send.
+ * @param[in] blockTimeMs Time to wait for space in the queue.
+ *
+ * @return true if the command was sent, false otherwise.
+ */
+static bool prvAgentMessageSend( MQTTAgentMessageContext_t * pMsgCtx,
+                                 MQTTAgentCommand_t * const * pCommandToSend,
+                                 uint32_t blockTimeMs );
+
+/**
+ * @brief Receive function of the coreMQTT-Agent messaging interface.
+ *
+ * Wraps Agent_MessageReceive so the agent task can inspect every command
+ * before it is processed.
+ *
+ * @param[in] pMsgCtx The message context.
+ * @param[out] pReceivedCommand The received command.
+ * @param[in] blockTimeMs Time to wait for a command.
+ *
+ * @return true if a command was received, false otherwise.
+ */
+static bool prvAgentMessageReceive( MQTTAgentMessageContext_t * pMsgCtx,
+                                    MQTTAgentCommand_t ** pReceivedCommand,
+                                    uint32_t blockTimeMs );
+
+/**
+ * @brief Command allocation function of the coreMQTT-Agent messaging interface.
+ *
+ * Wraps Agent_GetCommand to track the command pool usage.
+ *
+ * @param[in] blockTimeMs Time to wait for a free command.
+ *
+ * @return The command, NULL if none is free.
+ */
+static MQTTAgentCommand_t * prvAgentGetCommand( uint32_t blockTimeMs );
+
+/**
+ * @brief Command release function of the coreMQTT-Agent messaging interface.
+ *
+ * Wraps Agent_ReleaseCommand to time commands from dequeue to completion.
+ *
+ * @param[in] pCommandToRelease The command to release.
+ *
+ * @return true if the command was released, false otherwise.
+ */
+static bool prvAgentReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
+
 /**
  * @brief Sends an MQTT Connect packet over the already connected TCP socket.
  *
@@ -269,14 +383,13 @@ static void prvWifiEventHandler( void * pvHandlerArg,
                                  void * pvEventData );
 
 /**
- * @brief ESP Event Loop library handler for coreMQTT-Agent events.
+ * @brief Connection state callback for coreMQTT-Agent events.
  *
- * This handles events defined in core_mqtt_agent_events.h.
+ * This handles events defined in core_mqtt_agent_manager_events.h.
  */
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData );
+static void prvCoreMqttAgentStateCallback( int32_t lEventId,
+                                           uint32_t ulState,
+                                           void * pvContext );
 
 /* Static function definitions ************************************************/
 
@@ -357,12 +470,23 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
     bool xPublishHandled = false;
     char cOriginalChar, * pcLocation;
 
-    ( void ) packetId;
-
-    /* Fan out the incoming publishes to the callbacks registered using
-     * subscription manager. */
-    xPublishHandled = handleIncomingPublishes( ( SubscriptionElement_t * ) pMqttAgentContext->pIncomingCallbackContext,
-                                               pxPublishInfo );
+    /* The agent acknowledges the publish once this callback returns, so a
+     * redelivery is only dropped here. */
+    if( prvIsDuplicatePublish( packetId, pxPublishInfo ) == true )
+    {
+        ulSuppressedDuplicates++;
+        ESP_LOGI( TAG,
+                  "Suppressed redelivered publish with packet ID %u.",
+                  packetId );
+        xPublishHandled = true;
+    }
+    else
+    {
+        /* Fan out the incoming publishes to the callbacks registered using
+         * subscription manager. */
+        xPublishHandled = handleIncomingPublishes( ( SubscriptionElement_t * ) pMqttAgentContext->pIncomingCallbackContext,
+                                                   pxPublishInfo );
+    }
 
     #if CONFIG_GRI_ENABLE_OTA_DEMO
 
@@ -391,6 +515,70 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
     }
 }
 
+static bool prvIsDuplicatePublish( uint16_t packetId,
+                                   const MQTTPublishInfo_t * pxPublishInfo )
+{
+    bool xDuplicate = false;
+
+    #if ( configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 )
+        uint32_t ulHash = DEDUPE_HASH_SEED;
+        const uint8_t * pucData;
+        size_t xIndex;
+
+        if( pxPublishInfo->qos != MQTTQoS0 )
+        {
+            pucData = ( const uint8_t * ) pxPublishInfo->pTopicName;
+
+            for( xIndex = 0U; xIndex < pxPublishInfo->topicNameLength; xIndex++ )
+            {
+                ulHash = ( ulHash ^ pucData[ xIndex ] ) * DEDUPE_HASH_PRIME;
+            }
+
+            pucData = ( const uint8_t * ) pxPublishInfo->pPayload;
+
+            for( xIndex = 0U; xIndex < pxPublishInfo->payloadLength; xIndex++ )
+            {
+                ulHash = ( ulHash ^ pucData[ xIndex ] ) * DEDUPE_HASH_PRIME;
+            }
+
+            if( pxPublishInfo->dup == true )
+            {
+                for( xIndex = 0U; xIndex < configMQTT_AGENT_DEDUPE_WINDOW_SIZE; xIndex++ )
+                {
+                    if( ( xDedupeWindow[ xIndex ].xValid == true ) &&
+                        ( xDedupeWindow[ xIndex ].usPacketId == packetId ) &&
+                        ( xDedupeWindow[ xIndex ].ulHash == ulHash ) )
+                    {
+                        xDuplicate = true;
+                        break;
+                    }
+                }
+            }
+
+            if( xDuplicate == false )
+            {
+                xDedupeWindow[ xDedupeWindowHead ].ulHash = ulHash;
+                xDedupeWindow[ xDedupeWindowHead ].usPacketId = packetId;
+                xDedupeWindow[ xDedupeWindowHead ].xValid = true;
+                xDedupeWindowHead = ( xDedupeWindowHead + 1U ) % configMQTT_AGENT_DEDUPE_WINDOW_SIZE;
+            }
+        }
+    #else /* configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 */
+        ( void ) packetId;
+        ( void ) pxPublishInfo;
+    #endif /* configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 */
+
+    return xDuplicate;
+}
+
+static void prvResetDuplicateWindow( void )
+{
+    #if ( configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 )
+        memset( xDedupeWindow, 0x00, sizeof( xDedupeWindow ) );
+        xDedupeWindowHead = 0U;
+    #endif /* configMQTT_AGENT_DEDUPE_WINDOW_SIZE > 0 */
+}
+
 static void prvSubscriptionCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
                                             MQTTAgentReturnInfo_t * pxReturnInfo )
 {
@@ -517,6 +705,10 @@ static void prvMQTTAgentTask( void * pvParameters )
          * clean up and reconnect however the application writer prefers. */
         xMQTTStatus = MQTTAgent_CommandLoop( &xGlobalMqttAgentContext );
 
+        #if configMQTT_AGENT_HEALTH_MONITOR
+            vCoreMqttAgentHealthOnLoopExit();
+        #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
         /* Success is returned for disconnect or termination. The socket should
          * be disconnected. */
         if( xMQTTStatus == MQTTSuccess )
@@ -526,10 +718,6 @@ static void prvMQTTAgentTask( void * pvParameters )
         /* Error. */
         else
         {
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_CONNECTED_BIT );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_DISCONNECTED_BIT );
             xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_DISCONNECTED_EVENT );
         }
     } while( xMQTTStatus != MQTTSuccess );
@@ -553,6 +741,66 @@ static BaseType_t prvStartCoreMqttAgent( void )
     return xRet;
 }
 
+static bool prvAgentMessageSend( MQTTAgentMessageContext_t * pMsgCtx,
+                                 MQTTAgentCommand_t * const * pCommandToSend,
+                                 uint32_t blockTimeMs )
+{
+    #if configMQTT_AGENT_HEALTH_MONITOR
+        vCoreMqttAgentHealthOnSend( *pCommandToSend );
+    #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
+    return Agent_MessageSend( pMsgCtx, pCommandToSend, blockTimeMs );
+}
+
+static bool prvAgentMessageReceive( MQTTAgentMessageContext_t * pMsgCtx,
+                                    MQTTAgentCommand_t ** pReceivedCommand,
+                                    uint32_t blockTimeMs )
+{
+    bool xReceived;
+
+    #if configMQTT_AGENT_HEALTH_MONITOR
+        vCoreMqttAgentHealthOnReceiveStart();
+    #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
+    xReceived = Agent_MessageReceive( pMsgCtx, pReceivedCommand, blockTimeMs );
+
+    #if configMQTT_AGENT_HEALTH_MONITOR
+        vCoreMqttAgentHealthOnReceive( ( xReceived == true ) ? *pReceivedCommand : NULL );
+    #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
+    #if configMQTT_AGENT_PERSIST_SESSION
+        if( ( xReceived == true ) && ( *pReceivedCommand != NULL ) )
+        {
+            /* Persist QoS1 publishes with the packet ID the agent is about to
+             * assign to them. */
+            vSessionStoreTrackCommand( *pReceivedCommand,
+                                       xGlobalMqttAgentContext.mqttContext.nextPacketId );
+        }
+    #endif /* configMQTT_AGENT_PERSIST_SESSION */
+
+    return xReceived;
+}
+
+static MQTTAgentCommand_t * prvAgentGetCommand( uint32_t blockTimeMs )
+{
+    MQTTAgentCommand_t * pxCommand = Agent_GetCommand( blockTimeMs );
+
+    #if configMQTT_AGENT_HEALTH_MONITOR
+        vCoreMqttAgentHealthOnGetCommand( pxCommand );
+    #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
+    return pxCommand;
+}
+
+static bool prvAgentReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
+{
+    #if configMQTT_AGENT_HEALTH_MONITOR
+        vCoreMqttAgentHealthOnRelease( pCommandToRelease );
+    #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
+    return Agent_ReleaseCommand( pCommandToRelease );
+}
+
 static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext )
 {
     TransportInterface_t xTransport = { 0 };
@@ -563,10 +811,10 @@ static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext )
     MQTTAgentMessageInterface_t xMessageInterface =
     {
         .pMsgCtx        = NULL,
-        .send           = Agent_MessageSend,
-        .recv           = Agent_MessageReceive,
-        .getCommand     = Agent_GetCommand,
-        .releaseCommand = Agent_ReleaseCommand
+        .send           = prvAgentMessageSend,
+        .recv           = prvAgentMessageReceive,
+        .getCommand     = prvAgentGetCommand,
+        .releaseCommand = prvAgentReleaseCommand
     };
 
     ulGlobalEntryTimeMs = prvGetTimeMs();
@@ -639,6 +887,12 @@ static MQTTStatus_t prvCoreMqttAgentConnect( bool xCleanSession )
               "Session present: %d\n",
               xSessionPresent );
 
+    /* A new session carries no redeliveries of earlier publishes. */
+    if( ( xResult == MQTTSuccess ) && ( xSessionPresent == false ) )
+    {
+        prvResetDuplicateWindow();
+    }
+
     /* Resume a session if desired. */
     if( ( xResult == MQTTSuccess ) && ( xCleanSession == false ) )
     {
@@ -651,6 +905,15 @@ static MQTTStatus_t prvCoreMqttAgentConnect( bool xCleanSession )
         }
     }
 
+    #if configMQTT_AGENT_PERSIST_SESSION
+        /* Publish again, as new publishes, those left unacknowledged by the
+         * previous boot. This does not depend on the broker session. */
+        if( ( xResult == MQTTSuccess ) && ( xSessionStoreHasPendingReplay() == pdTRUE ) )
+        {
+            xResult = xSessionStoreReplay( &xGlobalMqttAgentContext );
+        }
+    #endif /* configMQTT_AGENT_PERSIST_SESSION */
+
     return xResult;
 }
 
@@ -710,7 +973,7 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
         /* Wait for the device to be connected to WiFi and be disconnected from
          * MQTT broker. */
         xEventGroupWaitBits( xNetworkEventGroup,
-                             WIFI_CONNECTED_BIT | CORE_MQTT_AGENT_DISCONNECTED_BIT,
+                             CORE_MQTT_AGENT_WIFI_CONNECTED_BIT | CORE_MQTT_AGENT_DISCONNECTED_BIT,
                              pdFALSE,
                              pdTRUE,
                              portMAX_DELAY );
@@ -765,16 +1028,12 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
         {
             xCleanSession = false;
             /* Flag that an MQTT connection has been established. */
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_DISCONNECTED_BIT );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_CONNECTED_BIT );
             xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_CONNECTED_EVENT );
         }
 
         if( eMqttRet == MQTTSuccess )
         {
-            while( xEventGroupWaitBits( xNetworkEventGroup, CORE_MQTT_AGENT_DISCONNECTED_BIT, pdFALSE, pdFALSE, 0 ) != CORE_MQTT_AGENT_DISCONNECTED_BIT )
+            while( ( ulCoreMqttAgentManagerGetState() & CORE_MQTT_AGENT_DISCONNECTED_BIT ) == 0U )
             {
                 fd_set readSet;
                 fd_set errorSet;
@@ -803,10 +1062,6 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
                     }
                     else if( FD_ISSET( lSockFd, &errorSet ) )
                     {
-                        xEventGroupClearBits( xNetworkEventGroup,
-                                              CORE_MQTT_AGENT_CONNECTED_BIT );
-                        xEventGroupSetBits( xNetworkEventGroup,
-                                            CORE_MQTT_AGENT_DISCONNECTED_BIT );
                         xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_DISCONNECTED_EVENT );
                     }
                 }
@@ -836,8 +1091,7 @@ static void prvWifiEventHandler( void * pvHandlerArg,
                 ESP_LOGI( TAG, "WiFi disconnected." );
 
                 /* Notify networking tasks that WiFi is disconnected. */
-                xEventGroupClearBits( xNetworkEventGroup,
-                                      WIFI_CONNECTED_BIT );
+                xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_WIFI_DISCONNECTED_EVENT );
                 break;
 
             default:
@@ -851,8 +1105,7 @@ static void prvWifiEventHandler( void * pvHandlerArg,
             case IP_EVENT_STA_GOT_IP:
                 ESP_LOGI( TAG, "WiFi connected." );
                 /* Notify networking tasks that WiFi is connected. */
-                xEventGroupSetBits( xNetworkEventGroup,
-                                    WIFI_CONNECTED_BIT );
+                xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_WIFI_CONNECTED_EVENT );
                 break;
 
             default:
@@ -865,14 +1118,12 @@ static void prvWifiEventHandler( void * pvHandlerArg,
     }
 }
 
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData )
+static void prvCoreMqttAgentStateCallback( int32_t lEventId,
+                                           uint32_t ulState,
+                                           void * pvContext )
 {
-    ( void ) pvHandlerArg;
-    ( void ) xEventBase;
-    ( void ) pvEventData;
+    ( void ) ulState;
+    ( void ) pvContext;
 
     switch( lEventId )
     {
@@ -884,11 +1135,6 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
         case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
             ESP_LOGI( TAG,
                       "coreMQTT-Agent disconnected." );
-            /* Notify networking tasks of TLS and MQTT disconnection. */
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_CONNECTED_BIT );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_DISCONNECTED_BIT );
             break;
 
         case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
@@ -899,6 +1145,14 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
             ESP_LOGI( TAG, "OTA stopped." );
             break;
 
+        case CORE_MQTT_AGENT_STALLED_EVENT:
+            ESP_LOGW( TAG, "coreMQTT-Agent command loop stalled." );
+            break;
+
+        case CORE_MQTT_AGENT_WIFI_CONNECTED_EVENT:
+        case CORE_MQTT_AGENT_WIFI_DISCONNECTED_EVENT:
+            break;
+
         default:
             ESP_LOGE( TAG, "coreMQTT-Agent event handler received unexpected event: %" PRIu32 "",
                       lEventId );
@@ -908,42 +1162,9 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
 
 /* Public function definitions ************************************************/
 
-BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId )
-{
-    esp_err_t xEspErrRet;
-    BaseType_t xRet = pdPASS;
-
-    xEspErrRet = esp_event_post( CORE_MQTT_AGENT_EVENT,
-                                 lEventId,
-                                 NULL,
-                                 0,
-                                 portMAX_DELAY );
-
-    if( xEspErrRet != ESP_OK )
-    {
-        xRet = pdFAIL;
-    }
-
-    return xRet;
-}
-
-BaseType_t xCoreMqttAgentManagerRegisterHandler( esp_event_handler_t xEventHandler )
+uint32_t ulCoreMqttAgentManagerGetSuppressedDuplicates( void )
 {
-    esp_err_t xEspErrRet;
-    BaseType_t xRet = pdPASS;
-
-    xEspErrRet = esp_event_handler_instance_register( CORE_MQTT_AGENT_EVENT,
-                                                      ESP_EVENT_ANY_ID,
-                                                      xEventHandler,
-                                                      NULL,
-                                                      NULL );
-
-    if( xEspErrRet != ESP_OK )
-    {
-        xRet = pdFAIL;
-    }
-
-    return xRet;
+    return ulSuppressedDuplicates;
 }
 
 BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
@@ -966,25 +1187,27 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
 
     if( xRet != pdFAIL )
     {
-        xNetworkEventGroup = xEventGroupCreate();
+        xRet = xCoreMqttAgentManagerEventsInit();
 
-        if( xNetworkEventGroup == NULL )
+        if( xRet != pdPASS )
         {
             ESP_LOGE( TAG,
-                      "Failed to create coreMQTT-Agent network manager event group." );
-
-            xRet = pdFAIL;
+                      "Failed to initialize coreMQTT-Agent connection state." );
+        }
+        else
+        {
+            xNetworkEventGroup = xCoreMqttAgentManagerGetEventGroup();
         }
     }
 
     if( xRet != pdFAIL )
     {
-        xRet = xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+        xRet = xCoreMqttAgentManagerRegisterStateCallback( prvCoreMqttAgentStateCallback, NULL );
 
         if( xRet != pdPASS )
         {
             ESP_LOGE( TAG,
-                      "Failed to register coreMQTT-Agent event handler." );
+                      "Failed to register coreMQTT-Agent state callback." );
 
             xRet = pdFAIL;
         }
@@ -1024,6 +1247,19 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
         }
     }
 
+    #if configMQTT_AGENT_PERSIST_SESSION
+        if( xRet != pdFAIL )
+        {
+            xRet = xSessionStoreInit();
+
+            if( xRet != pdPASS )
+            {
+                ESP_LOGE( TAG,
+                          "Failed to initialize coreMQTT-Agent session store." );
+            }
+        }
+    #endif /* configMQTT_AGENT_PERSIST_SESSION */
+
     if( xRet != pdFAIL )
     {
         /* Initialize coreMQTT-Agent. */
@@ -1038,6 +1274,19 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
         }
     }
 
+    #if configMQTT_AGENT_HEALTH_MONITOR
+        if( xRet != pdFAIL )
+        {
+            xRet = xCoreMqttAgentHealthInit( xCommandQueue.queue );
+
+            if( xRet != pdPASS )
+            {
+                ESP_LOGE( TAG,
+                          "Failed to start coreMQTT-Agent health monitor." );
+            }
+        }
+    #endif /* configMQTT_AGENT_HEALTH_MONITOR */
+
     if( xRet != pdFAIL )
     {
         xSubListMutex = xSemaphoreCreateMutex();
@@ -1088,12 +1337,5 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
         }
     }
 
-    if( xRet != pdFAIL )
-    {
-        /* Set initial state of network connection */
-        xEventGroupSetBits( xNetworkEventGroup,
-                            CORE_MQTT_AGENT_DISCONNECTED_BIT );
-    }
-
     return xRet;
 }
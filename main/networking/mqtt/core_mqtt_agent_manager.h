@@ -29,7 +29,9 @@
 
 #include "network_transport.h"
 #include "freertos/FreeRTOS.h"
-#include "esp_event.h"
+
+/* Connection state service include. */
+#include "core_mqtt_agent_manager_events.h"
 
 /* *INDENT-OFF* */
     #ifdef __cplusplus
@@ -37,15 +39,6 @@
     #endif
 /* *INDENT-ON* */
 
-/**
- * @brief Register an event handler with coreMQTT-Agent events.
- *
- * @param[in] xEventHandler Event handling function.
- *
- * @return pdPASS if successful, pdFAIL otherwise.
- */
-BaseType_t xCoreMqttAgentManagerRegisterHandler( esp_event_handler_t xEventHandler );
-
 /**
  * @brief Start the coreMQTT-Agent manager.
  *
@@ -60,13 +53,12 @@ BaseType_t xCoreMqttAgentManagerRegisterHandler( esp_event_handler_t xEventHandl
 BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn );
 
 /**
- * @brief Posts a coreMQTT-Agent event to the default event loop.
+ * @brief Get the number of redelivered QoS1/QoS2 publishes that were
+ * acknowledged but not dispatched to subscription callbacks.
  *
- * @param[in] lEventId Event ID of the coreMQTT-Agent event to be posted.
- *
- * @return pdPASS if successful, pdFAIL otherwise.
+ * @return The number of suppressed duplicates since boot.
  */
-BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId );
+uint32_t ulCoreMqttAgentManagerGetSuppressedDuplicates( void );
 
 /* *INDENT-OFF* */
     #ifdef __cplusplus
@@ -106,6 +106,97 @@
  */
 #define configMQTT_AGENT_TASK_PRIORITY                  ( CONFIG_GRI_MQTT_AGENT_TASK_PRIORITY )
 
+/**
+ * @brief The maximum number of connection state callbacks that can be
+ * registered with the coreMQTT-Agent manager.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_MAX_STATE_CALLBACKS
+    #define configMQTT_AGENT_MAX_STATE_CALLBACKS        ( CONFIG_GRI_MQTT_AGENT_MAX_STATE_CALLBACKS )
+#else
+    #define configMQTT_AGENT_MAX_STATE_CALLBACKS        ( 4U )
+#endif
+
+/**
+ * @brief Also post coreMQTT-Agent events to the default ESP event loop.
+ *
+ * Registered state callbacks and the shared event group do not depend on it.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_POST_ESP_EVENTS
+    #define configMQTT_AGENT_POST_ESP_EVENTS            ( 1 )
+#else
+    #define configMQTT_AGENT_POST_ESP_EVENTS            ( 0 )
+#endif
+
+/**
+ * @brief Monitor the latencies of the coreMQTT-Agent command loop and detect
+ * stalls.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_HEALTH_MONITOR
+    #define configMQTT_AGENT_HEALTH_MONITOR                 ( 1 )
+    #define configMQTT_AGENT_STALL_THRESHOLD_MS             ( CONFIG_GRI_MQTT_AGENT_STALL_THRESHOLD_MS )
+    #define configMQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS     ( CONFIG_GRI_MQTT_AGENT_HEALTH_PUBLISH_INTERVAL_MS )
+#else
+    #define configMQTT_AGENT_HEALTH_MONITOR                 ( 0 )
+#endif
+
+/**
+ * @brief Number of recent inbound QoS1/QoS2 publishes remembered to suppress
+ * redeliveries. 0 disables duplicate suppression.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_DEDUPE_WINDOW_SIZE
+    #define configMQTT_AGENT_DEDUPE_WINDOW_SIZE             ( CONFIG_GRI_MQTT_AGENT_DEDUPE_WINDOW_SIZE )
+#else
+    #define configMQTT_AGENT_DEDUPE_WINDOW_SIZE             ( 16U )
+#endif
+
+/**
+ * @brief Persist unacknowledged QoS1 publishes in NVS and replay them after a
+ * reboot.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_PERSIST_SESSION
+    #define configMQTT_AGENT_PERSIST_SESSION                ( 1 )
+    #define configMQTT_AGENT_SESSION_STORE_PARTITION        CONFIG_GRI_MQTT_AGENT_SESSION_STORE_PARTITION
+    #define configMQTT_AGENT_SESSION_STORE_MAX_RECORDS      ( CONFIG_GRI_MQTT_AGENT_SESSION_STORE_MAX_RECORDS )
+    #define configMQTT_AGENT_SESSION_STORE_MAX_RECORD_SIZE  ( CONFIG_GRI_MQTT_AGENT_SESSION_STORE_MAX_RECORD_SIZE )
+    #define configMQTT_AGENT_SESSION_STORE_FLUSH_MS         ( CONFIG_GRI_MQTT_AGENT_SESSION_STORE_FLUSH_MS )
+    #define configMQTT_AGENT_SESSION_STORE_FLUSH_RECORDS    ( CONFIG_GRI_MQTT_AGENT_SESSION_STORE_FLUSH_RECORDS )
+#else
+    #define configMQTT_AGENT_PERSIST_SESSION                ( 0 )
+#endif
+
+/**
+ * @brief Enable the MQTT request/response layer. Its dimensions are the number
+ * of outstanding requests, and maximum request topic and payload length in
+ * bytes.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_RPC
+    #define configMQTT_AGENT_RPC                            ( 1 )
+    #define configMQTT_RPC_MAX_PENDING_REQUESTS             ( CONFIG_GRI_MQTT_RPC_MAX_PENDING_REQUESTS )
+    #define configMQTT_RPC_MAX_TOPIC_LENGTH                 ( CONFIG_GRI_MQTT_RPC_MAX_TOPIC_LENGTH )
+    #define configMQTT_RPC_MAX_PAYLOAD_LENGTH               ( CONFIG_GRI_MQTT_RPC_MAX_PAYLOAD_LENGTH )
+#else
+    #define configMQTT_AGENT_RPC                            ( 0 )
+    #define configMQTT_RPC_MAX_PENDING_REQUESTS             ( 8U )
+    #define configMQTT_RPC_MAX_TOPIC_LENGTH                 ( 128U )
+    #define configMQTT_RPC_MAX_PAYLOAD_LENGTH               ( 512U )
+#endif
+
+/**
+ * @brief Share the link between OTA and telemetry with a token bucket per
+ * traffic class while an OTA update is in progress. The link rate is in bytes
+ * per second, 0 leaving traffic unshaped, the shares in percent of it, and the
+ * burst in milliseconds of a class' rate.
+ */
+#ifdef CONFIG_GRI_MQTT_AGENT_TRAFFIC_SHAPER
+    #define configMQTT_AGENT_TRAFFIC_SHAPER                 ( 1 )
+    #define configMQTT_AGENT_SHAPER_LINK_RATE               ( CONFIG_GRI_MQTT_AGENT_SHAPER_LINK_RATE )
+    #define configMQTT_AGENT_SHAPER_OTA_SHARE               ( CONFIG_GRI_MQTT_AGENT_SHAPER_OTA_SHARE )
+    #define configMQTT_AGENT_SHAPER_TELEMETRY_SHARE         ( CONFIG_GRI_MQTT_AGENT_SHAPER_TELEMETRY_SHARE )
+    #define configMQTT_AGENT_SHAPER_BURST_MS                ( CONFIG_GRI_MQTT_AGENT_SHAPER_BURST_MS )
+#else
+    #define configMQTT_AGENT_TRAFFIC_SHAPER                 ( 0 )
+#endif
+
 /* *INDENT-OFF* */
     #ifdef __cplusplus
         } /* extern "C" */
@@ -24,8 +24,294 @@
  *
  */
 
+/**
+ * @file core_mqtt_agent_manager_events.c
+ * @brief Connection state service of the coreMQTT-Agent manager.
+ *
+ * A state change is applied to an atomic state word and to one event group
+ * shared by every waiting task, under one mutex so concurrent posts cannot
+ * leave them disagreeing, then fanned out to registered callbacks directly
+ * from the posting task. Posting to the ESP event loop is optional so
+ * this file only depends on FreeRTOS.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
 #include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+
+/* coreMQTT-Agent manager events include. */
 #include "core_mqtt_agent_manager_events.h"
-#include "esp_event_base.h"
 
-ESP_EVENT_DEFINE_BASE( CORE_MQTT_AGENT_EVENT );
+#if configMQTT_AGENT_POST_ESP_EVENTS
+    #include "esp_event_base.h"
+#endif /* configMQTT_AGENT_POST_ESP_EVENTS */
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A registered state change callback.
+ */
+typedef struct StateCallbackEntry
+{
+    CoreMqttAgentStateCallback_t xCallback;
+    void * pvContext;
+} StateCallbackEntry_t;
+
+/* Global variables ***********************************************************/
+
+#if configMQTT_AGENT_POST_ESP_EVENTS
+    ESP_EVENT_DEFINE_BASE( CORE_MQTT_AGENT_EVENT );
+#endif /* configMQTT_AGENT_POST_ESP_EVENTS */
+
+/**
+ * @brief The connection state word. Mirrors the bits of xStateEventGroup.
+ */
+static _Atomic uint32_t ulState;
+
+/**
+ * @brief The event group shared by all tasks waiting on the connection state.
+ */
+static EventGroupHandle_t xStateEventGroup;
+
+/**
+ * @brief Static storage of the shared event group.
+ */
+static StaticEventGroup_t xStateEventGroupBuffer;
+
+/**
+ * @brief Mutex serializing state updates and callback registration.
+ */
+static SemaphoreHandle_t xStateMutex;
+
+/**
+ * @brief Static storage of the state mutex.
+ */
+static StaticSemaphore_t xStateMutexBuffer;
+
+/**
+ * @brief Table of registered state change callbacks.
+ */
+static StateCallbackEntry_t xStateCallbacks[ configMQTT_AGENT_MAX_STATE_CALLBACKS ];
+
+/**
+ * @brief Number of valid entries in xStateCallbacks.
+ */
+static uint32_t ulNumStateCallbacks;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Get the state bits set and cleared by an event.
+ *
+ * @param[in] lEventId Event ID of the coreMQTT-Agent event.
+ * @param[out] pulSetBits Bits set by the event.
+ * @param[out] pulClearBits Bits cleared by the event.
+ *
+ * @return pdPASS if the event is known, pdFAIL otherwise.
+ */
+static BaseType_t prvGetEventTransition( int32_t lEventId,
+                                         uint32_t * pulSetBits,
+                                         uint32_t * pulClearBits );
+
+/* Static function definitions ************************************************/
+
+static BaseType_t prvGetEventTransition( int32_t lEventId,
+                                         uint32_t * pulSetBits,
+                                         uint32_t * pulClearBits )
+{
+    BaseType_t xRet = pdPASS;
+
+    *pulSetBits = 0U;
+    *pulClearBits = 0U;
+
+    switch( lEventId )
+    {
+        case CORE_MQTT_AGENT_CONNECTED_EVENT:
+            *pulSetBits = CORE_MQTT_AGENT_CONNECTED_BIT;
+            *pulClearBits = CORE_MQTT_AGENT_DISCONNECTED_BIT;
+            break;
+
+        case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
+            *pulSetBits = CORE_MQTT_AGENT_DISCONNECTED_BIT;
+            *pulClearBits = CORE_MQTT_AGENT_CONNECTED_BIT;
+            break;
+
+        case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
+            *pulClearBits = CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT;
+            break;
+
+        case CORE_MQTT_AGENT_OTA_STOPPED_EVENT:
+            *pulSetBits = CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT;
+            break;
+
+        case CORE_MQTT_AGENT_WIFI_CONNECTED_EVENT:
+            *pulSetBits = CORE_MQTT_AGENT_WIFI_CONNECTED_BIT;
+            break;
+
+        case CORE_MQTT_AGENT_WIFI_DISCONNECTED_EVENT:
+            *pulClearBits = CORE_MQTT_AGENT_WIFI_CONNECTED_BIT;
+            break;
+
+        case CORE_MQTT_AGENT_STALLED_EVENT:
+            /* Reported to callbacks only, the connection state is unchanged. */
+            break;
+
+        default:
+            xRet = pdFAIL;
+            break;
+    }
+
+    return xRet;
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xCoreMqttAgentManagerEventsInit( void )
+{
+    BaseType_t xRet = pdPASS;
+
+    if( xStateEventGroup == NULL )
+    {
+        xStateMutex = xSemaphoreCreateMutexStatic( &xStateMutexBuffer );
+        xStateEventGroup = xEventGroupCreateStatic( &xStateEventGroupBuffer );
+
+        if( ( xStateMutex == NULL ) || ( xStateEventGroup == NULL ) )
+        {
+            xRet = pdFAIL;
+        }
+        else
+        {
+            atomic_store( &ulState,
+                          CORE_MQTT_AGENT_DISCONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+            xEventGroupSetBits( xStateEventGroup,
+                                CORE_MQTT_AGENT_DISCONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+        }
+    }
+
+    return xRet;
+}
+
+BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId )
+{
+    BaseType_t xRet = pdPASS;
+    uint32_t ulSetBits, ulClearBits, ulNewState, ulIndex, ulNumCallbacks;
+    StateCallbackEntry_t xCallbacks[ configMQTT_AGENT_MAX_STATE_CALLBACKS ];
+
+    configASSERT( xStateEventGroup != NULL );
+
+    xRet = prvGetEventTransition( lEventId, &ulSetBits, &ulClearBits );
+
+    if( xRet == pdPASS )
+    {
+        /* Update the state word before the event group, so tasks woken by
+         * the event group observe the new state, and take the callbacks to
+         * call in the same step. */
+        ( void ) xSemaphoreTake( xStateMutex, portMAX_DELAY );
+        {
+            ulNewState = ( atomic_load( &ulState ) & ~ulClearBits ) | ulSetBits;
+            atomic_store( &ulState, ulNewState );
+
+            if( ulClearBits != 0U )
+            {
+                xEventGroupClearBits( xStateEventGroup, ulClearBits );
+            }
+
+            if( ulSetBits != 0U )
+            {
+                xEventGroupSetBits( xStateEventGroup, ulSetBits );
+            }
+
+            ulNumCallbacks = ulNumStateCallbacks;
+            memcpy( xCallbacks, xStateCallbacks, ulNumCallbacks * sizeof( StateCallbackEntry_t ) );
+        }
+        ( void ) xSemaphoreGive( xStateMutex );
+
+        /* Called without the mutex, so a callback may post an event. */
+        for( ulIndex = 0U; ulIndex < ulNumCallbacks; ulIndex++ )
+        {
+            xCallbacks[ ulIndex ].xCallback( lEventId,
+                                             ulNewState,
+                                             xCallbacks[ ulIndex ].pvContext );
+        }
+
+        #if configMQTT_AGENT_POST_ESP_EVENTS
+
+            /* Do not block the posting task on a busy event loop, the state
+             * above is authoritative. */
+            if( esp_event_post( CORE_MQTT_AGENT_EVENT,
+                                lEventId,
+                                NULL,
+                                0,
+                                0 ) != ESP_OK )
+            {
+                xRet = pdFAIL;
+            }
+        #endif /* configMQTT_AGENT_POST_ESP_EVENTS */
+    }
+
+    return xRet;
+}
+
+BaseType_t xCoreMqttAgentManagerRegisterStateCallback( CoreMqttAgentStateCallback_t xCallback,
+                                                       void * pvContext )
+{
+    BaseType_t xRet = pdFAIL;
+    uint32_t ulIndex;
+
+    configASSERT( xCallback != NULL );
+    configASSERT( xStateMutex != NULL );
+
+    ( void ) xSemaphoreTake( xStateMutex, portMAX_DELAY );
+    {
+        ulIndex = ulNumStateCallbacks;
+
+        if( ulIndex < configMQTT_AGENT_MAX_STATE_CALLBACKS )
+        {
+            xStateCallbacks[ ulIndex ].xCallback = xCallback;
+            xStateCallbacks[ ulIndex ].pvContext = pvContext;
+            ulNumStateCallbacks = ulIndex + 1U;
+            xRet = pdPASS;
+        }
+    }
+    ( void ) xSemaphoreGive( xStateMutex );
+
+    return xRet;
+}
+
+uint32_t ulCoreMqttAgentManagerGetState( void )
+{
+    return atomic_load( &ulState );
+}
+
+EventGroupHandle_t xCoreMqttAgentManagerGetEventGroup( void )
+{
+    configASSERT( xStateEventGroup != NULL );
+
+    return xStateEventGroup;
+}
+
+#if configMQTT_AGENT_POST_ESP_EVENTS
+    BaseType_t xCoreMqttAgentManagerRegisterHandler( esp_event_handler_t xEventHandler )
+    {
+        BaseType_t xRet = pdPASS;
+
+        if( esp_event_handler_instance_register( CORE_MQTT_AGENT_EVENT,
+                                                 ESP_EVENT_ANY_ID,
+                                                 xEventHandler,
+                                                 NULL,
+                                                 NULL ) != ESP_OK )
+        {
+            xRet = pdFAIL;
+        }
+
+        return xRet;
+    }
+#endif /* configMQTT_AGENT_POST_ESP_EVENTS */
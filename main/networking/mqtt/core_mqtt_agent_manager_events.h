@@ -27,7 +27,19 @@
 #ifndef CORE_MQTT_AGENT_MANAGER_EVENTS_H
 #define CORE_MQTT_AGENT_MANAGER_EVENTS_H
 
-#include "esp_event.h"
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+#if configMQTT_AGENT_POST_ESP_EVENTS
+    #include "esp_event.h"
+#endif /* configMQTT_AGENT_POST_ESP_EVENTS */
 
 /* *INDENT-OFF* */
     #ifdef __cplusplus
@@ -35,16 +47,116 @@
     #endif
 /* *INDENT-ON* */
 
-ESP_EVENT_DECLARE_BASE( CORE_MQTT_AGENT_EVENT );
+#if configMQTT_AGENT_POST_ESP_EVENTS
+    ESP_EVENT_DECLARE_BASE( CORE_MQTT_AGENT_EVENT );
+#endif /* configMQTT_AGENT_POST_ESP_EVENTS */
 
 enum
 {
     CORE_MQTT_AGENT_CONNECTED_EVENT,
     CORE_MQTT_AGENT_DISCONNECTED_EVENT,
     CORE_MQTT_AGENT_OTA_STARTED_EVENT,
-    CORE_MQTT_AGENT_OTA_STOPPED_EVENT
+    CORE_MQTT_AGENT_OTA_STOPPED_EVENT,
+    CORE_MQTT_AGENT_WIFI_CONNECTED_EVENT,
+    CORE_MQTT_AGENT_WIFI_DISCONNECTED_EVENT,
+    CORE_MQTT_AGENT_STALLED_EVENT
 };
 
+/**
+ * @brief Bits of the connection state word and of the shared event group.
+ *
+ * Both always hold the same value. The state word can be read without
+ * blocking, the event group can be waited on by any number of tasks.
+ */
+#define CORE_MQTT_AGENT_WIFI_CONNECTED_BIT         ( 1 << 0 )
+#define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 1 )
+#define CORE_MQTT_AGENT_DISCONNECTED_BIT           ( 1 << 2 )
+#define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 3 )
+
+/**
+ * @brief Callback invoked on every coreMQTT-Agent state change.
+ *
+ * The callback runs in the context of the task posting the event, after the
+ * state word and the event group have been updated. It must not block.
+ *
+ * @param[in] lEventId The event that caused the state change.
+ * @param[in] ulState The connection state after the change.
+ * @param[in] pvContext Context passed at registration.
+ */
+typedef void ( * CoreMqttAgentStateCallback_t )( int32_t lEventId,
+                                                 uint32_t ulState,
+                                                 void * pvContext );
+
+/**
+ * @brief Initialize the connection state service.
+ *
+ * Must be called once before any other function of this module, and before
+ * any task waits on the shared event group. The initial state is
+ * disconnected with no OTA in progress.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xCoreMqttAgentManagerEventsInit( void );
+
+/**
+ * @brief Posts a coreMQTT-Agent event.
+ *
+ * The state word and the shared event group are updated together under a
+ * mutex, then every registered callback is invoked directly from the calling
+ * task. If enabled, the event is also posted to the default ESP event loop.
+ * Must not be called from an ISR.
+ *
+ * @param[in] lEventId Event ID of the coreMQTT-Agent event to be posted.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId );
+
+/**
+ * @brief Register a callback for coreMQTT-Agent state changes.
+ *
+ * @note Callbacks should be registered before the coreMQTT-Agent manager is
+ * started so that no state change is missed.
+ *
+ * @param[in] xCallback Callback function.
+ * @param[in] pvContext Context passed to the callback.
+ *
+ * @return pdPASS if successful, pdFAIL if the callback table is full.
+ */
+BaseType_t xCoreMqttAgentManagerRegisterStateCallback( CoreMqttAgentStateCallback_t xCallback,
+                                                       void * pvContext );
+
+/**
+ * @brief Get the current connection state word.
+ *
+ * @return Bitwise OR of the CORE_MQTT_AGENT_*_BIT flags currently set.
+ */
+uint32_t ulCoreMqttAgentManagerGetState( void );
+
+/**
+ * @brief Get the event group shared by all tasks waiting on the connection
+ * state.
+ *
+ * Tasks must only wait on this event group, the bits are owned by
+ * #xCoreMqttAgentManagerPost.
+ *
+ * @return Handle of the shared event group.
+ */
+EventGroupHandle_t xCoreMqttAgentManagerGetEventGroup( void );
+
+#if configMQTT_AGENT_POST_ESP_EVENTS
+
+/**
+ * @brief Register an event handler with coreMQTT-Agent events on the default
+ * ESP event loop.
+ *
+ * @param[in] xEventHandler Event handling function.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+    BaseType_t xCoreMqttAgentManagerRegisterHandler( esp_event_handler_t xEventHandler );
+#endif /* configMQTT_AGENT_POST_ESP_EVENTS */
+
 /* *INDENT-OFF* */
     #ifdef __cplusplus
         } /* extern "C" */
@@ -0,0 +1,609 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_rpc.c
+ * @brief Asynchronous request/response over MQTT on top of coreMQTT-Agent.
+ *
+ * Outstanding requests live in a fixed table. Each entry owns a copy of the
+ * request topic and payload, since the publish may still be queued in the
+ * agent when the response or the timeout arrives. An entry is reused only
+ * once it has been completed and its publish has left the agent. A single
+ * periodic timer, running only while requests are outstanding, expires them.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* coreJSON include. */
+#include "core_json.h"
+
+/* Subscription manager include. */
+#include "subscription_manager.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_rpc.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Period of the timer expiring requests.
+ */
+#define RPC_TIMER_PERIOD_MS                ( 100U )
+
+/**
+ * @brief Time to wait for space in the agent command queue.
+ */
+#define RPC_COMMAND_SEND_BLOCK_TIME_MS     ( 500U )
+
+/**
+ * @brief Key of the correlation ID in request and response payloads.
+ */
+#define RPC_CLIENT_TOKEN_KEY               "clientToken"
+
+/**
+ * @brief Buffer length of a client token, including the terminator.
+ */
+#define RPC_CLIENT_TOKEN_LENGTH            ( 16U )
+
+/**
+ * @brief Suffixes appended to the request topic by the responder.
+ */
+#define RPC_ACCEPTED_SUFFIX                "/accepted"
+#define RPC_REJECTED_SUFFIX                "/rejected"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief An entry of the pending request table. Used as the command context of
+ * the request publish.
+ */
+struct MQTTAgentCommandContext
+{
+    bool xAwaitingResponse;
+    bool xPublishInFlight;
+    bool xDeadlineArmed;
+    TickType_t xDeadline;
+    CoreMqttAgentRpcCallback_t xCallback;
+    void * pvContext;
+    MQTTPublishInfo_t xPublishInfo;
+    size_t xTopicLength;
+    char cClientToken[ RPC_CLIENT_TOKEN_LENGTH ];
+    char cTopic[ configMQTT_RPC_MAX_TOPIC_LENGTH ];
+    char cPayload[ configMQTT_RPC_MAX_PAYLOAD_LENGTH ];
+};
+
+typedef struct MQTTAgentCommandContext RpcRequest_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_rpc";
+
+/**
+ * @brief Global MQTT Agent context used by every task.
+ */
+extern MQTTAgentContext_t xGlobalMqttAgentContext;
+
+/**
+ * @brief The pending request table.
+ */
+static RpcRequest_t xRequests[ configMQTT_RPC_MAX_PENDING_REQUESTS ];
+
+/**
+ * @brief Lock of the pending request table.
+ */
+static SemaphoreHandle_t xRequestsMutex;
+
+/**
+ * @brief Timer expiring requests.
+ */
+static TimerHandle_t xRequestTimer;
+
+/**
+ * @brief Counter the client tokens are generated from.
+ */
+static uint32_t ulNextClientToken = 0U;
+
+/**
+ * @brief Subscription to the response topics.
+ */
+static MQTTSubscribeInfo_t xResponseSubscribeInfo;
+static MQTTAgentSubscribeArgs_t xResponseSubscribeArgs;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Check if a request has finished and its entry can be reused. Must be
+ * called with xRequestsMutex held.
+ *
+ * @param[in] pxRequest The request.
+ *
+ * @return true if the entry is free.
+ */
+static bool prvIsRequestFree( const RpcRequest_t * pxRequest );
+
+/**
+ * @brief Build the request payload, with the client token inserted as the
+ * first member of the JSON object.
+ *
+ * @param[in] pxRequest The request, with its client token set.
+ * @param[in] pcPayload JSON object of the request.
+ * @param[in] xPayloadLength Length of the payload.
+ *
+ * @return pdPASS if the payload fits, pdFAIL otherwise.
+ */
+static BaseType_t prvBuildPayload( RpcRequest_t * pxRequest,
+                                   const char * pcPayload,
+                                   size_t xPayloadLength );
+
+/**
+ * @brief Incoming publish callback of the response subscription.
+ *
+ * @param[in] pvIncomingPublishCallbackContext Not used.
+ * @param[in] pxPublishInfo The response.
+ */
+static void prvIncomingResponseCallback( void * pvIncomingPublishCallbackContext,
+                                         MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Completion callback of the response subscription.
+ */
+static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Completion callback of a request publish.
+ */
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxRequest,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Timer callback expiring requests past their deadline.
+ */
+static void prvRequestTimerCallback( TimerHandle_t xTimer );
+
+/* Static function definitions ************************************************/
+
+static bool prvIsRequestFree( const RpcRequest_t * pxRequest )
+{
+    return ( pxRequest->xAwaitingResponse == false ) && ( pxRequest->xPublishInFlight == false );
+}
+
+static BaseType_t prvBuildPayload( RpcRequest_t * pxRequest,
+                                   const char * pcPayload,
+                                   size_t xPayloadLength )
+{
+    BaseType_t xRet = pdFAIL;
+    size_t xIndex = 0U;
+    size_t xRestIndex;
+    int lLength;
+
+    /* Skip to the opening brace of the object. */
+    while( ( xIndex < xPayloadLength ) && ( pcPayload[ xIndex ] != '{' ) )
+    {
+        xIndex++;
+    }
+
+    if( xIndex < xPayloadLength )
+    {
+        xIndex++;
+
+        /* An empty object takes no separator after the token. */
+        xRestIndex = xIndex;
+
+        while( ( xRestIndex < xPayloadLength ) &&
+               ( ( pcPayload[ xRestIndex ] == ' ' ) || ( pcPayload[ xRestIndex ] == '\n' ) ||
+                 ( pcPayload[ xRestIndex ] == '\r' ) || ( pcPayload[ xRestIndex ] == '\t' ) ) )
+        {
+            xRestIndex++;
+        }
+
+        lLength = snprintf( pxRequest->cPayload,
+                            sizeof( pxRequest->cPayload ),
+                            "{\"" RPC_CLIENT_TOKEN_KEY "\":\"%s\"%s%.*s",
+                            pxRequest->cClientToken,
+                            ( ( xRestIndex < xPayloadLength ) && ( pcPayload[ xRestIndex ] == '}' ) ) ? "" : ",",
+                            ( int ) ( xPayloadLength - xIndex ),
+                            &pcPayload[ xIndex ] );
+
+        if( ( lLength > 0 ) && ( ( size_t ) lLength < sizeof( pxRequest->cPayload ) ) )
+        {
+            pxRequest->xPublishInfo.pPayload = pxRequest->cPayload;
+            pxRequest->xPublishInfo.payloadLength = ( size_t ) lLength;
+            xRet = pdPASS;
+        }
+    }
+
+    return xRet;
+}
+
+static void prvIncomingResponseCallback( void * pvIncomingPublishCallbackContext,
+                                         MQTTPublishInfo_t * pxPublishInfo )
+{
+    RpcRequest_t * pxRequest = NULL;
+    CoreMqttAgentRpcStatus_t xStatus = CORE_MQTT_AGENT_RPC_ACCEPTED;
+    const char * pcSuffix = NULL;
+    char * pcToken = NULL;
+    size_t xTokenLength = 0U;
+    size_t xRequestTopicLength = 0U;
+    size_t xIndex;
+
+    ( void ) pvIncomingPublishCallbackContext;
+
+    if( JSON_Search( ( char * ) pxPublishInfo->pPayload,
+                     pxPublishInfo->payloadLength,
+                     RPC_CLIENT_TOKEN_KEY,
+                     sizeof( RPC_CLIENT_TOKEN_KEY ) - 1U,
+                     &pcToken,
+                     &xTokenLength ) == JSONSuccess )
+    {
+        /* Both suffixes have the same length. */
+        if( pxPublishInfo->topicNameLength > ( sizeof( RPC_ACCEPTED_SUFFIX ) - 1U ) )
+        {
+            xRequestTopicLength = pxPublishInfo->topicNameLength - ( sizeof( RPC_ACCEPTED_SUFFIX ) - 1U );
+            pcSuffix = &pxPublishInfo->pTopicName[ xRequestTopicLength ];
+
+            if( strncmp( pcSuffix, RPC_REJECTED_SUFFIX, sizeof( RPC_REJECTED_SUFFIX ) - 1U ) == 0 )
+            {
+                xStatus = CORE_MQTT_AGENT_RPC_REJECTED;
+            }
+            else if( strncmp( pcSuffix, RPC_ACCEPTED_SUFFIX, sizeof( RPC_ACCEPTED_SUFFIX ) - 1U ) != 0 )
+            {
+                pcSuffix = NULL;
+            }
+        }
+
+        if( pcSuffix != NULL )
+        {
+            xSemaphoreTake( xRequestsMutex, portMAX_DELAY );
+
+            for( xIndex = 0U; xIndex < configMQTT_RPC_MAX_PENDING_REQUESTS; xIndex++ )
+            {
+                if( ( xRequests[ xIndex ].xAwaitingResponse == true ) &&
+                    ( xRequests[ xIndex ].xTopicLength == xRequestTopicLength ) &&
+                    ( strlen( xRequests[ xIndex ].cClientToken ) == xTokenLength ) &&
+                    ( strncmp( xRequests[ xIndex ].cClientToken, pcToken, xTokenLength ) == 0 ) &&
+                    ( strncmp( xRequests[ xIndex ].cTopic, pxPublishInfo->pTopicName, xRequestTopicLength ) == 0 ) )
+                {
+                    pxRequest = &xRequests[ xIndex ];
+                    pxRequest->xAwaitingResponse = false;
+                    break;
+                }
+            }
+
+            xSemaphoreGive( xRequestsMutex );
+        }
+    }
+
+    if( pxRequest != NULL )
+    {
+        pxRequest->xCallback( xStatus, pxPublishInfo, pxRequest->pvContext );
+    }
+    else
+    {
+        ESP_LOGD( TAG,
+                  "Ignoring response on %.*s with no pending request.",
+                  pxPublishInfo->topicNameLength,
+                  pxPublishInfo->pTopicName );
+    }
+}
+
+static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    ( void ) pxCommandContext;
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        /* Route responses to this layer, and have the subscription restored
+         * by the agent manager after a reconnect. */
+        if( addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+                             xResponseSubscribeInfo.pTopicFilter,
+                             xResponseSubscribeInfo.topicFilterLength,
+                             prvIncomingResponseCallback,
+                             NULL ) == false )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to register an incoming publish callback for topic %.*s.",
+                      xResponseSubscribeInfo.topicFilterLength,
+                      xResponseSubscribeInfo.pTopicFilter );
+        }
+    }
+    else
+    {
+        ESP_LOGE( TAG,
+                  "Failed to subscribe to %.*s. xResult=%s.",
+                  xResponseSubscribeInfo.topicFilterLength,
+                  xResponseSubscribeInfo.pTopicFilter,
+                  MQTT_Status_strerror( pxReturnInfo->returnCode ) );
+    }
+}
+
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxRequest,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    bool xFailed = false;
+
+    xSemaphoreTake( xRequestsMutex, portMAX_DELAY );
+
+    pxRequest->xPublishInFlight = false;
+
+    if( ( pxReturnInfo->returnCode != MQTTSuccess ) && ( pxRequest->xAwaitingResponse == true ) )
+    {
+        pxRequest->xAwaitingResponse = false;
+        xFailed = true;
+    }
+
+    xSemaphoreGive( xRequestsMutex );
+
+    if( xFailed == true )
+    {
+        pxRequest->xCallback( CORE_MQTT_AGENT_RPC_PUBLISH_FAILED, NULL, pxRequest->pvContext );
+    }
+}
+
+static void prvRequestTimerCallback( TimerHandle_t xTimer )
+{
+    RpcRequest_t * pxExpired[ configMQTT_RPC_MAX_PENDING_REQUESTS ];
+    size_t xNumExpired = 0U;
+    bool xPending = false;
+    TickType_t xNow = xTaskGetTickCount();
+    size_t xIndex;
+
+    xSemaphoreTake( xRequestsMutex, portMAX_DELAY );
+
+    for( xIndex = 0U; xIndex < configMQTT_RPC_MAX_PENDING_REQUESTS; xIndex++ )
+    {
+        if( ( xRequests[ xIndex ].xAwaitingResponse == true ) &&
+            ( xRequests[ xIndex ].xDeadlineArmed == true ) &&
+            ( ( int32_t ) ( xNow - xRequests[ xIndex ].xDeadline ) >= 0 ) )
+        {
+            xRequests[ xIndex ].xAwaitingResponse = false;
+            pxExpired[ xNumExpired ] = &xRequests[ xIndex ];
+            xNumExpired++;
+        }
+        else if( xRequests[ xIndex ].xAwaitingResponse == true )
+        {
+            xPending = true;
+        }
+    }
+
+    /* Only run while requests are outstanding. Restarted by the next request. */
+    if( xPending == false )
+    {
+        xTimerStop( xTimer, 0 );
+    }
+
+    xSemaphoreGive( xRequestsMutex );
+
+    for( xIndex = 0U; xIndex < xNumExpired; xIndex++ )
+    {
+        ESP_LOGW( TAG,
+                  "Request %s on %s timed out.",
+                  pxExpired[ xIndex ]->cClientToken,
+                  pxExpired[ xIndex ]->cTopic );
+        pxExpired[ xIndex ]->xCallback( CORE_MQTT_AGENT_RPC_TIMEOUT, NULL, pxExpired[ xIndex ]->pvContext );
+    }
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xCoreMqttAgentRpcStart( const char * pcResponseFilter )
+{
+    BaseType_t xRet = pdPASS;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+
+    configASSERT( pcResponseFilter != NULL );
+
+    if( xRequestsMutex == NULL )
+    {
+        xRequestsMutex = xSemaphoreCreateMutex();
+
+        if( xRequestsMutex == NULL )
+        {
+            ESP_LOGE( TAG, "No memory to allocate mutex for MQTT RPC requests." );
+            xRet = pdFAIL;
+        }
+    }
+
+    if( ( xRet == pdPASS ) && ( xRequestTimer == NULL ) )
+    {
+        xRequestTimer = xTimerCreate( "MqttRpc",
+                                      pdMS_TO_TICKS( RPC_TIMER_PERIOD_MS ),
+                                      pdTRUE,
+                                      NULL,
+                                      prvRequestTimerCallback );
+
+        if( xRequestTimer == NULL )
+        {
+            ESP_LOGE( TAG, "Failed to create MQTT RPC timer." );
+            xRet = pdFAIL;
+        }
+    }
+
+    if( xRet == pdPASS )
+    {
+        xResponseSubscribeInfo.pTopicFilter = pcResponseFilter;
+        xResponseSubscribeInfo.topicFilterLength = ( uint16_t ) strlen( pcResponseFilter );
+        xResponseSubscribeInfo.qos = MQTTQoS1;
+        xResponseSubscribeArgs.pSubscribeInfo = &xResponseSubscribeInfo;
+        xResponseSubscribeArgs.numSubscriptions = 1;
+
+        xCommandParams.blockTimeMs = RPC_COMMAND_SEND_BLOCK_TIME_MS;
+        xCommandParams.cmdCompleteCallback = prvSubscribeCommandCallback;
+        xCommandParams.pCmdCompleteCallbackContext = NULL;
+
+        if( MQTTAgent_Subscribe( &xGlobalMqttAgentContext,
+                                 &xResponseSubscribeArgs,
+                                 &xCommandParams ) != MQTTSuccess )
+        {
+            ESP_LOGE( TAG, "Failed to enqueue subscribe to %s.", pcResponseFilter );
+            xRet = pdFAIL;
+        }
+    }
+
+    return xRet;
+}
+
+BaseType_t xCoreMqttAgentRpcRequest( const char * pcTopic,
+                                     const char * pcPayload,
+                                     size_t xPayloadLength,
+                                     uint32_t ulTimeoutMs,
+                                     CoreMqttAgentRpcCallback_t xCallback,
+                                     void * pvContext )
+{
+    BaseType_t xRet = pdPASS;
+    RpcRequest_t * pxRequest = NULL;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    size_t xTopicLength;
+    size_t xIndex;
+
+    configASSERT( ( pcTopic != NULL ) && ( pcPayload != NULL ) && ( xCallback != NULL ) );
+    configASSERT( xRequestsMutex != NULL );
+
+    xTopicLength = strlen( pcTopic );
+
+    if( xTopicLength >= configMQTT_RPC_MAX_TOPIC_LENGTH )
+    {
+        ESP_LOGE( TAG, "Request topic %s is too long.", pcTopic );
+        xRet = pdFAIL;
+    }
+
+    if( xRet == pdPASS )
+    {
+        xSemaphoreTake( xRequestsMutex, portMAX_DELAY );
+
+        for( xIndex = 0U; xIndex < configMQTT_RPC_MAX_PENDING_REQUESTS; xIndex++ )
+        {
+            if( prvIsRequestFree( &xRequests[ xIndex ] ) == true )
+            {
+                pxRequest = &xRequests[ xIndex ];
+                break;
+            }
+        }
+
+        if( pxRequest == NULL )
+        {
+            ESP_LOGW( TAG, "Too many pending requests." );
+            xRet = pdFAIL;
+        }
+        else
+        {
+            snprintf( pxRequest->cClientToken,
+                      sizeof( pxRequest->cClientToken ),
+                      "rpc-%08" PRIx32,
+                      ulNextClientToken );
+            memcpy( pxRequest->cTopic, pcTopic, xTopicLength + 1U );
+
+            xRet = prvBuildPayload( pxRequest, pcPayload, xPayloadLength );
+
+            if( xRet != pdPASS )
+            {
+                ESP_LOGE( TAG, "Request payload on %s is not a JSON object or is too long.", pcTopic );
+            }
+            else
+            {
+                ulNextClientToken++;
+
+                /* Reserve the entry. The deadline is only armed once the
+                 * publish is queued, so a slow enqueue cannot time it out. */
+                pxRequest->xAwaitingResponse = true;
+                pxRequest->xPublishInFlight = true;
+                pxRequest->xDeadlineArmed = false;
+                pxRequest->xCallback = xCallback;
+                pxRequest->pvContext = pvContext;
+                pxRequest->xTopicLength = xTopicLength;
+                pxRequest->xPublishInfo.qos = MQTTQoS1;
+                pxRequest->xPublishInfo.pTopicName = pxRequest->cTopic;
+                pxRequest->xPublishInfo.topicNameLength = ( uint16_t ) xTopicLength;
+            }
+        }
+
+        xSemaphoreGive( xRequestsMutex );
+    }
+
+    if( xRet == pdPASS )
+    {
+        xCommandParams.blockTimeMs = RPC_COMMAND_SEND_BLOCK_TIME_MS;
+        xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
+        xCommandParams.pCmdCompleteCallbackContext = pxRequest;
+
+        if( MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                               &( pxRequest->xPublishInfo ),
+                               &xCommandParams ) != MQTTSuccess )
+        {
+            ESP_LOGE( TAG, "Failed to enqueue request on %s.", pcTopic );
+            xRet = pdFAIL;
+        }
+
+        xSemaphoreTake( xRequestsMutex, portMAX_DELAY );
+
+        if( xRet != pdPASS )
+        {
+            /* Nothing was published, so nothing can have completed it. */
+            pxRequest->xAwaitingResponse = false;
+            pxRequest->xPublishInFlight = false;
+        }
+        else if( pxRequest->xAwaitingResponse == true )
+        {
+            pxRequest->xDeadline = xTaskGetTickCount() + pdMS_TO_TICKS( ulTimeoutMs );
+            pxRequest->xDeadlineArmed = true;
+        }
+
+        xSemaphoreGive( xRequestsMutex );
+
+        if( xRet == pdPASS )
+        {
+            xTimerStart( xRequestTimer, 0 );
+        }
+    }
+
+    return xRet;
+}
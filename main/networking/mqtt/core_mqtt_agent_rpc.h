@@ -0,0 +1,126 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_rpc.h
+ * @brief Asynchronous request/response over MQTT on top of coreMQTT-Agent.
+ *
+ * Requests are published with a generated client token inserted in their JSON
+ * payload. Responses are received on `<request topic>/accepted` or
+ * `<request topic>/rejected` through a single subscription, matched to their
+ * request by client token, and completed through a callback. Requests that get
+ * no response are completed with a timeout.
+ */
+#ifndef CORE_MQTT_AGENT_RPC_H
+#define CORE_MQTT_AGENT_RPC_H
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* coreMQTT include. */
+#include "core_mqtt.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Result of a request.
+ */
+typedef enum CoreMqttAgentRpcStatus
+{
+    CORE_MQTT_AGENT_RPC_ACCEPTED,      /**< Response received on `/accepted`. */
+    CORE_MQTT_AGENT_RPC_REJECTED,      /**< Response received on `/rejected`. */
+    CORE_MQTT_AGENT_RPC_TIMEOUT,       /**< No response before the timeout. */
+    CORE_MQTT_AGENT_RPC_PUBLISH_FAILED /**< The request could not be published. */
+} CoreMqttAgentRpcStatus_t;
+
+/**
+ * @brief Completion callback of a request.
+ *
+ * Runs in the coreMQTT-Agent task for responses and publish failures, and in
+ * the timer task for timeouts. It must not block, and the response is only
+ * valid for the duration of the call.
+ *
+ * @param[in] xStatus Result of the request.
+ * @param[in] pxResponse The response, NULL unless accepted or rejected.
+ * @param[in] pvContext Context passed with the request.
+ */
+typedef void ( * CoreMqttAgentRpcCallback_t )( CoreMqttAgentRpcStatus_t xStatus,
+                                               const MQTTPublishInfo_t * pxResponse,
+                                               void * pvContext );
+
+/**
+ * @brief Start the RPC layer and subscribe to the response topics.
+ *
+ * @note Call after xCoreMqttAgentManagerStart. The filter must cover the
+ * `/accepted` and `/rejected` topics of every request, for example
+ * `$aws/things/<thing name>/shadow/+/+`, and must stay in scope.
+ *
+ * @param[in] pcResponseFilter Topic filter of the responses.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xCoreMqttAgentRpcStart( const char * pcResponseFilter );
+
+/**
+ * @brief Publish a request without waiting for its response.
+ *
+ * The topic and payload are copied, so they can be reused once this returns.
+ * When called from the coreMQTT-Agent task, a full command queue makes this
+ * fail once the send block time has passed, as nothing drains the queue.
+ *
+ * @param[in] pcTopic Topic of the request.
+ * @param[in] pcPayload JSON object of the request. A `clientToken` member is
+ * added to it.
+ * @param[in] xPayloadLength Length of the payload.
+ * @param[in] ulTimeoutMs Time to wait for the response.
+ * @param[in] xCallback Callback invoked once with the result.
+ * @param[in] pvContext Context passed to the callback.
+ *
+ * @return pdPASS if the request was queued, in which case the callback is
+ * always invoked, pdFAIL otherwise.
+ */
+BaseType_t xCoreMqttAgentRpcRequest( const char * pcTopic,
+                                     const char * pcPayload,
+                                     size_t xPayloadLength,
+                                     uint32_t ulTimeoutMs,
+                                     CoreMqttAgentRpcCallback_t xCallback,
+                                     void * pvContext );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* CORE_MQTT_AGENT_RPC_H */
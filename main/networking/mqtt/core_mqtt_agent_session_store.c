@@ -0,0 +1,728 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_session_store.c
+ * @brief Persistence of outstanding QoS1 publishes across reboots.
+ *
+ * Every QoS1 publish dequeued by the coreMQTT-Agent task is copied into a RAM
+ * slot as one record (sequence number, packet ID, topic and payload) before it
+ * is sent. A low priority store task writes the records to NVS in batches,
+ * every configMQTT_AGENT_SESSION_STORE_FLUSH_MS milliseconds or once
+ * configMQTT_AGENT_SESSION_STORE_FLUSH_RECORDS records are waiting, so the
+ * agent task never waits on flash. A record completed before it was written
+ * is dropped without touching NVS, and one completed after is erased by the
+ * store task in the next batch, so the store only ever holds publishes that
+ * were not acknowledged. Records live in a fixed set of keys, one per slot,
+ * and NVS reclaims erased entries through its own page log. After a reboot
+ * the remaining records are published again in sequence order on the first
+ * connection, ahead of any new command.
+ *
+ * A replay is a new publish with a new packet ID, not a retransmission within
+ * an MQTT session, as coreMQTT cannot be given the state of the session of
+ * the previous boot. Delivery is at least once: a publish the broker received
+ * before the reset, but whose PUBACK was lost, is delivered twice, and
+ * subscribers cannot tell the copies apart from the DUP flag.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/* ESP-IDF includes. */
+#include <esp_err.h>
+#include <esp_log.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_session_store.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief NVS namespace holding the session records.
+ */
+#define SESSION_STORE_NAMESPACE          "mqtt_session"
+
+/**
+ * @brief Maximum length of a record key, including the terminator.
+ */
+#define SESSION_STORE_KEY_LENGTH         ( 16U )
+
+/**
+ * @brief Version of the record layout. Records of another version are
+ * discarded on load.
+ */
+#define SESSION_STORE_RECORD_VERSION     ( 1U )
+
+/**
+ * @brief Stack size and priority of the store task, which only waits on NVS.
+ */
+#define SESSION_STORE_TASK_STACK_SIZE    ( 3072U )
+#define SESSION_STORE_TASK_PRIORITY      ( tskIDLE_PRIORITY + 1U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Life cycle of a slot.
+ */
+typedef enum SessionSlotState
+{
+    SESSION_SLOT_FREE,     /**< Available to the agent task. */
+    SESSION_SLOT_UNSAVED,  /**< Record in RAM only, waiting to be written. */
+    SESSION_SLOT_SAVING,   /**< Record being written by the store task. */
+    SESSION_SLOT_SAVED,    /**< Record in NVS. */
+    SESSION_SLOT_RELEASED  /**< Completed, record waiting to be erased. */
+} SessionSlotState_t;
+
+/**
+ * @brief Header stored in front of the topic and payload of every record.
+ */
+typedef struct SessionRecordHeader
+{
+    uint8_t ucVersion;
+    uint8_t ucQoS;
+    uint16_t usPacketId;
+    uint32_t ulSequence;
+    uint16_t usTopicLength;
+    uint16_t usReserved;
+    uint32_t ulPayloadLength;
+} SessionRecordHeader_t;
+
+/**
+ * @brief A slot of the session store. Used as the command context of tracked
+ * and replayed publishes.
+ */
+struct MQTTAgentCommandContext
+{
+    SessionSlotState_t xState;
+    bool xReleasedWhileSaving;
+    bool xReplayPending;
+    uint16_t usPacketId;
+    uint32_t ulSequence;
+    MQTTAgentCommandCallback_t xOriginalCallback;
+    MQTTAgentCommandContext_t * pxOriginalContext;
+    MQTTPublishInfo_t xReplayPublishInfo;
+    size_t xRecordLength;
+    uint8_t ucRecord[ configMQTT_AGENT_SESSION_STORE_MAX_RECORD_SIZE ];
+};
+
+typedef struct MQTTAgentCommandContext SessionSlot_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_session_store";
+
+/**
+ * @brief Slots of the session store. Slot N is persisted under key "recN".
+ */
+static SessionSlot_t xSlots[ configMQTT_AGENT_SESSION_STORE_MAX_RECORDS ];
+
+/**
+ * @brief Lock of the slot states, shared by the agent task and the store task.
+ */
+static portMUX_TYPE xSlotLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Number of records waiting to be written.
+ */
+static uint32_t ulUnsavedRecords = 0U;
+
+/**
+ * @brief Handle of the store task.
+ */
+static TaskHandle_t xStoreTask = NULL;
+
+/**
+ * @brief Handle of the NVS namespace holding the records.
+ */
+static nvs_handle_t xStoreHandle;
+
+/**
+ * @brief Set once the NVS namespace is open.
+ */
+static bool xStoreOpen = false;
+
+/**
+ * @brief Sequence number of the next appended record.
+ */
+static uint32_t ulNextSequence = 0U;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Format the NVS key of a slot.
+ *
+ * @param[in] pxSlot The slot.
+ * @param[out] pcKey Buffer of SESSION_STORE_KEY_LENGTH bytes for the key.
+ */
+static void prvGetSlotKey( const SessionSlot_t * pxSlot,
+                           char * pcKey );
+
+/**
+ * @brief Mark the record of a slot as no longer needed. The slot is available
+ * again once its record, if written, has been erased by the store task.
+ *
+ * @param[in] pxSlot The slot to release.
+ */
+static void prvReleaseSlot( SessionSlot_t * pxSlot );
+
+/**
+ * @brief Write the unsaved records and erase the released ones.
+ */
+static void prvFlushSlots( void );
+
+/**
+ * @brief The store task, flushing the slots in batches.
+ */
+static void prvSessionStoreTask( void * pvParameters );
+
+/**
+ * @brief Load the record of a slot left by the previous boot.
+ *
+ * @param[in] pxSlot The slot to load.
+ */
+static void prvLoadSlot( SessionSlot_t * pxSlot );
+
+/**
+ * @brief Get the oldest record waiting to be replayed.
+ *
+ * @return The slot of the record, NULL if there is none.
+ */
+static SessionSlot_t * prvGetNextReplaySlot( void );
+
+/**
+ * @brief Completion callback installed on tracked publishes. Erases the
+ * record, then chains to the callback of the application.
+ *
+ * @param[in] pxSlot Slot of the publish.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvTrackedCommandCallback( MQTTAgentCommandContext_t * pxSlot,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Completion callback of replayed publishes. The record is erased once
+ * the publish is acknowledged, and replayed again on the next connection
+ * otherwise.
+ *
+ * @param[in] pxSlot Slot of the publish.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvReplayCommandCallback( MQTTAgentCommandContext_t * pxSlot,
+                                      MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/* Static function definitions ************************************************/
+
+static void prvGetSlotKey( const SessionSlot_t * pxSlot,
+                           char * pcKey )
+{
+    snprintf( pcKey,
+              SESSION_STORE_KEY_LENGTH,
+              "rec%u",
+              ( unsigned int ) ( pxSlot - xSlots ) );
+}
+
+static void prvReleaseSlot( SessionSlot_t * pxSlot )
+{
+    pxSlot->xReplayPending = false;
+    pxSlot->xOriginalCallback = NULL;
+    pxSlot->pxOriginalContext = NULL;
+
+    taskENTER_CRITICAL( &xSlotLock );
+    {
+        switch( pxSlot->xState )
+        {
+            case SESSION_SLOT_UNSAVED:
+                /* Never written, so nothing to erase. */
+                pxSlot->xState = SESSION_SLOT_FREE;
+                ulUnsavedRecords--;
+                break;
+
+            case SESSION_SLOT_SAVING:
+                pxSlot->xReleasedWhileSaving = true;
+                break;
+
+            case SESSION_SLOT_SAVED:
+                pxSlot->xState = SESSION_SLOT_RELEASED;
+                break;
+
+            default:
+                break;
+        }
+    }
+    taskEXIT_CRITICAL( &xSlotLock );
+}
+
+static void prvFlushSlots( void )
+{
+    SessionSlot_t * pxSlot;
+    SessionSlotState_t xState;
+    char cKey[ SESSION_STORE_KEY_LENGTH ];
+    bool xChanged = false;
+    uint32_t ulIndex;
+    esp_err_t xEspErrRet;
+
+    for( ulIndex = 0U; ulIndex < configMQTT_AGENT_SESSION_STORE_MAX_RECORDS; ulIndex++ )
+    {
+        pxSlot = &xSlots[ ulIndex ];
+
+        /* The record is stable while the slot is saving or released, the
+         * agent task only changes the state. */
+        taskENTER_CRITICAL( &xSlotLock );
+        {
+            xState = pxSlot->xState;
+
+            if( xState == SESSION_SLOT_UNSAVED )
+            {
+                pxSlot->xState = SESSION_SLOT_SAVING;
+                pxSlot->xReleasedWhileSaving = false;
+                ulUnsavedRecords--;
+            }
+        }
+        taskEXIT_CRITICAL( &xSlotLock );
+
+        prvGetSlotKey( pxSlot, cKey );
+
+        if( xState == SESSION_SLOT_UNSAVED )
+        {
+            xEspErrRet = nvs_set_blob( xStoreHandle, cKey, pxSlot->ucRecord, pxSlot->xRecordLength );
+            xChanged = true;
+
+            if( xEspErrRet != ESP_OK )
+            {
+                ESP_LOGW( TAG,
+                          "Failed to persist session record %s. Error: %s",
+                          cKey,
+                          esp_err_to_name( xEspErrRet ) );
+            }
+
+            taskENTER_CRITICAL( &xSlotLock );
+            {
+                if( pxSlot->xReleasedWhileSaving == true )
+                {
+                    pxSlot->xState = SESSION_SLOT_RELEASED;
+                }
+                else if( xEspErrRet != ESP_OK )
+                {
+                    /* Retried in the next batch. */
+                    pxSlot->xState = SESSION_SLOT_UNSAVED;
+                    ulUnsavedRecords++;
+                }
+                else
+                {
+                    pxSlot->xState = SESSION_SLOT_SAVED;
+                }
+
+                xState = pxSlot->xState;
+            }
+            taskEXIT_CRITICAL( &xSlotLock );
+        }
+
+        if( xState == SESSION_SLOT_RELEASED )
+        {
+            xEspErrRet = nvs_erase_key( xStoreHandle, cKey );
+            xChanged = true;
+
+            if( ( xEspErrRet != ESP_OK ) && ( xEspErrRet != ESP_ERR_NVS_NOT_FOUND ) )
+            {
+                ESP_LOGW( TAG,
+                          "Failed to erase session record %s. Error: %s",
+                          cKey,
+                          esp_err_to_name( xEspErrRet ) );
+            }
+            else
+            {
+                taskENTER_CRITICAL( &xSlotLock );
+                {
+                    pxSlot->xState = SESSION_SLOT_FREE;
+                }
+                taskEXIT_CRITICAL( &xSlotLock );
+            }
+        }
+    }
+
+    if( xChanged == true )
+    {
+        xEspErrRet = nvs_commit( xStoreHandle );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGW( TAG, "Failed to commit session records. Error: %s", esp_err_to_name( xEspErrRet ) );
+        }
+    }
+}
+
+static void prvSessionStoreTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        /* Woken early once enough records are waiting. */
+        ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( configMQTT_AGENT_SESSION_STORE_FLUSH_MS ) );
+        prvFlushSlots();
+    }
+}
+
+static void prvLoadSlot( SessionSlot_t * pxSlot )
+{
+    char cKey[ SESSION_STORE_KEY_LENGTH ];
+    size_t xLength = sizeof( pxSlot->ucRecord );
+    SessionRecordHeader_t xHeader;
+    size_t xDataLength;
+    esp_err_t xEspErrRet;
+
+    prvGetSlotKey( pxSlot, cKey );
+
+    xEspErrRet = nvs_get_blob( xStoreHandle, cKey, pxSlot->ucRecord, &xLength );
+
+    if( xEspErrRet == ESP_OK )
+    {
+        memcpy( &xHeader, pxSlot->ucRecord, sizeof( xHeader ) );
+        xDataLength = ( size_t ) xHeader.usTopicLength + xHeader.ulPayloadLength;
+
+        if( ( xLength < sizeof( xHeader ) ) ||
+            ( xHeader.ucVersion != SESSION_STORE_RECORD_VERSION ) ||
+            ( xHeader.usTopicLength == 0U ) ||
+            ( xLength != sizeof( xHeader ) + xDataLength ) )
+        {
+            ESP_LOGW( TAG, "Discarding malformed session record %s.", cKey );
+            pxSlot->xState = SESSION_SLOT_RELEASED;
+        }
+        else
+        {
+            pxSlot->xState = SESSION_SLOT_SAVED;
+            pxSlot->xReplayPending = true;
+            pxSlot->usPacketId = xHeader.usPacketId;
+            pxSlot->ulSequence = xHeader.ulSequence;
+            pxSlot->xRecordLength = xLength;
+
+            /* Sent under a new packet ID, so it is not a redelivery for the
+             * broker even if it received the publish before the reset. */
+            pxSlot->xReplayPublishInfo.qos = ( MQTTQoS_t ) xHeader.ucQoS;
+            pxSlot->xReplayPublishInfo.dup = false;
+            pxSlot->xReplayPublishInfo.pTopicName = ( const char * ) &pxSlot->ucRecord[ sizeof( xHeader ) ];
+            pxSlot->xReplayPublishInfo.topicNameLength = xHeader.usTopicLength;
+            pxSlot->xReplayPublishInfo.pPayload = &pxSlot->ucRecord[ sizeof( xHeader ) + xHeader.usTopicLength ];
+            pxSlot->xReplayPublishInfo.payloadLength = xHeader.ulPayloadLength;
+
+            if( xHeader.ulSequence >= ulNextSequence )
+            {
+                ulNextSequence = xHeader.ulSequence + 1U;
+            }
+        }
+    }
+    else if( xEspErrRet != ESP_ERR_NVS_NOT_FOUND )
+    {
+        ESP_LOGW( TAG,
+                  "Failed to read session record %s. Error: %s",
+                  cKey,
+                  esp_err_to_name( xEspErrRet ) );
+        pxSlot->xState = SESSION_SLOT_RELEASED;
+    }
+}
+
+static SessionSlot_t * prvGetNextReplaySlot( void )
+{
+    SessionSlot_t * pxOldest = NULL;
+    uint32_t ulIndex;
+
+    for( ulIndex = 0U; ulIndex < configMQTT_AGENT_SESSION_STORE_MAX_RECORDS; ulIndex++ )
+    {
+        if( ( xSlots[ ulIndex ].xReplayPending == true ) &&
+            ( ( pxOldest == NULL ) || ( xSlots[ ulIndex ].ulSequence < pxOldest->ulSequence ) ) )
+        {
+            pxOldest = &xSlots[ ulIndex ];
+        }
+    }
+
+    return pxOldest;
+}
+
+static void prvTrackedCommandCallback( MQTTAgentCommandContext_t * pxSlot,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    MQTTAgentCommandCallback_t xOriginalCallback = pxSlot->xOriginalCallback;
+    MQTTAgentCommandContext_t * pxOriginalContext = pxSlot->pxOriginalContext;
+
+    /* The command is complete, either acknowledged or reported as failed to
+     * the application, so it no longer needs to survive a reboot. The store
+     * task erases the record if it was written. */
+    prvReleaseSlot( pxSlot );
+
+    if( xOriginalCallback != NULL )
+    {
+        xOriginalCallback( pxOriginalContext, pxReturnInfo );
+    }
+}
+
+static void prvReplayCommandCallback( MQTTAgentCommandContext_t * pxSlot,
+                                      MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        ESP_LOGI( TAG,
+                  "Replayed publish %" PRIu32 " acknowledged.",
+                  pxSlot->ulSequence );
+        prvReleaseSlot( pxSlot );
+    }
+    else
+    {
+        pxSlot->xReplayPending = true;
+    }
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xSessionStoreInit( void )
+{
+    BaseType_t xRet = pdPASS;
+    esp_err_t xEspErrRet = ESP_OK;
+    uint32_t ulIndex;
+
+    if( strcmp( configMQTT_AGENT_SESSION_STORE_PARTITION, NVS_DEFAULT_PART_NAME ) != 0 )
+    {
+        xEspErrRet = nvs_flash_init_partition( configMQTT_AGENT_SESSION_STORE_PARTITION );
+    }
+
+    if( xEspErrRet == ESP_OK )
+    {
+        xEspErrRet = nvs_open_from_partition( configMQTT_AGENT_SESSION_STORE_PARTITION,
+                                              SESSION_STORE_NAMESPACE,
+                                              NVS_READWRITE,
+                                              &xStoreHandle );
+    }
+
+    if( xEspErrRet != ESP_OK )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to open session store on partition %s. Error: %s",
+                  configMQTT_AGENT_SESSION_STORE_PARTITION,
+                  esp_err_to_name( xEspErrRet ) );
+        xRet = pdFAIL;
+    }
+    else
+    {
+        for( ulIndex = 0U; ulIndex < configMQTT_AGENT_SESSION_STORE_MAX_RECORDS; ulIndex++ )
+        {
+            prvLoadSlot( &xSlots[ ulIndex ] );
+
+            if( xSlots[ ulIndex ].xReplayPending == true )
+            {
+                ESP_LOGI( TAG,
+                          "Loaded unacknowledged publish %" PRIu32 " (packet ID %u) on topic %.*s.",
+                          xSlots[ ulIndex ].ulSequence,
+                          xSlots[ ulIndex ].usPacketId,
+                          xSlots[ ulIndex ].xReplayPublishInfo.topicNameLength,
+                          xSlots[ ulIndex ].xReplayPublishInfo.pTopicName );
+            }
+        }
+
+        /* Erases the malformed records. */
+        prvFlushSlots();
+
+        xRet = xTaskCreate( prvSessionStoreTask,
+                            "MQTTSessionStore",
+                            SESSION_STORE_TASK_STACK_SIZE,
+                            NULL,
+                            SESSION_STORE_TASK_PRIORITY,
+                            &xStoreTask );
+
+        if( xRet != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to create session store task." );
+        }
+        else
+        {
+            xStoreOpen = true;
+        }
+    }
+
+    return xRet;
+}
+
+BaseType_t xSessionStoreHasPendingReplay( void )
+{
+    return ( prvGetNextReplaySlot() != NULL ) ? pdTRUE : pdFALSE;
+}
+
+void vSessionStoreTrackCommand( MQTTAgentCommand_t * pxCommand,
+                                uint16_t usPacketId )
+{
+    MQTTPublishInfo_t * pxPublishInfo;
+    SessionSlot_t * pxSlot = NULL;
+    SessionRecordHeader_t xHeader = { 0 };
+    size_t xLength;
+    uint32_t ulIndex;
+    uint32_t ulUnsaved = 0U;
+
+    /* Replayed publishes are already in the store. */
+    if( ( xStoreOpen == true ) &&
+        ( pxCommand != NULL ) &&
+        ( pxCommand->commandType == PUBLISH ) &&
+        ( pxCommand->pCommandCompleteCallback != prvReplayCommandCallback ) )
+    {
+        pxPublishInfo = ( MQTTPublishInfo_t * ) pxCommand->pArgs;
+
+        if( pxPublishInfo->qos != MQTTQoS0 )
+        {
+            xLength = sizeof( xHeader ) + pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength;
+
+            taskENTER_CRITICAL( &xSlotLock );
+            {
+                for( ulIndex = 0U; ( ulIndex < configMQTT_AGENT_SESSION_STORE_MAX_RECORDS ) && ( pxSlot == NULL ); ulIndex++ )
+                {
+                    if( xSlots[ ulIndex ].xState == SESSION_SLOT_FREE )
+                    {
+                        pxSlot = &xSlots[ ulIndex ];
+                    }
+                }
+            }
+            taskEXIT_CRITICAL( &xSlotLock );
+
+            if( xLength > configMQTT_AGENT_SESSION_STORE_MAX_RECORD_SIZE )
+            {
+                ESP_LOGW( TAG,
+                          "Publish on %.*s is too large to persist.",
+                          pxPublishInfo->topicNameLength,
+                          pxPublishInfo->pTopicName );
+            }
+            else if( pxSlot == NULL )
+            {
+                ESP_LOGW( TAG,
+                          "Session store full, publish on %.*s is not persisted.",
+                          pxPublishInfo->topicNameLength,
+                          pxPublishInfo->pTopicName );
+            }
+            else
+            {
+                xHeader.ucVersion = SESSION_STORE_RECORD_VERSION;
+                xHeader.ucQoS = ( uint8_t ) pxPublishInfo->qos;
+                xHeader.usPacketId = usPacketId;
+                xHeader.ulSequence = ulNextSequence;
+                xHeader.usTopicLength = pxPublishInfo->topicNameLength;
+                xHeader.ulPayloadLength = ( uint32_t ) pxPublishInfo->payloadLength;
+
+                memcpy( pxSlot->ucRecord, &xHeader, sizeof( xHeader ) );
+                memcpy( &pxSlot->ucRecord[ sizeof( xHeader ) ],
+                        pxPublishInfo->pTopicName,
+                        pxPublishInfo->topicNameLength );
+                memcpy( &pxSlot->ucRecord[ sizeof( xHeader ) + pxPublishInfo->topicNameLength ],
+                        pxPublishInfo->pPayload,
+                        pxPublishInfo->payloadLength );
+
+                ulNextSequence++;
+
+                /* Interpose on the completion so the record is dropped or
+                 * erased once the publish is acknowledged. */
+                pxSlot->xRecordLength = xLength;
+                pxSlot->usPacketId = usPacketId;
+                pxSlot->ulSequence = xHeader.ulSequence;
+                pxSlot->xOriginalCallback = pxCommand->pCommandCompleteCallback;
+                pxSlot->pxOriginalContext = pxCommand->pCmdContext;
+
+                pxCommand->pCommandCompleteCallback = prvTrackedCommandCallback;
+                pxCommand->pCmdContext = pxSlot;
+
+                /* Written to NVS by the store task. */
+                taskENTER_CRITICAL( &xSlotLock );
+                {
+                    pxSlot->xState = SESSION_SLOT_UNSAVED;
+                    ulUnsaved = ++ulUnsavedRecords;
+                }
+                taskEXIT_CRITICAL( &xSlotLock );
+
+                if( ulUnsaved >= configMQTT_AGENT_SESSION_STORE_FLUSH_RECORDS )
+                {
+                    xTaskNotifyGive( xStoreTask );
+                }
+            }
+        }
+    }
+}
+
+MQTTStatus_t xSessionStoreReplay( MQTTAgentContext_t * pxAgentContext )
+{
+    MQTTStatus_t xResult = MQTTSuccess;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    SessionSlot_t * pxSlot;
+
+    /* The block time can be 0 as the command loop is not running at this
+     * point. */
+    xCommandParams.blockTimeMs = 0U;
+    xCommandParams.cmdCompleteCallback = prvReplayCommandCallback;
+
+    while( ( xResult == MQTTSuccess ) &&
+           ( ( pxSlot = prvGetNextReplaySlot() ) != NULL ) )
+    {
+        xCommandParams.pCmdCompleteCallbackContext = pxSlot;
+
+        xResult = MQTTAgent_Publish( pxAgentContext,
+                                     &( pxSlot->xReplayPublishInfo ),
+                                     &xCommandParams );
+
+        if( xResult == MQTTSuccess )
+        {
+            pxSlot->xReplayPending = false;
+
+            ESP_LOGI( TAG,
+                      "Replaying publish %" PRIu32 " (packet ID %u before reboot) on topic %.*s.",
+                      pxSlot->ulSequence,
+                      pxSlot->usPacketId,
+                      pxSlot->xReplayPublishInfo.topicNameLength,
+                      pxSlot->xReplayPublishInfo.pTopicName );
+        }
+        else
+        {
+            ESP_LOGW( TAG,
+                      "Failed to enqueue replay of publish %" PRIu32 ". xResult=%s.",
+                      pxSlot->ulSequence,
+                      MQTT_Status_strerror( xResult ) );
+        }
+    }
+
+    return xResult;
+}
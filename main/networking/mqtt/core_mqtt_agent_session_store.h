@@ -0,0 +1,100 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_session_store.h
+ * @brief Persistence of outstanding QoS1 publishes across reboots.
+ */
+#ifndef CORE_MQTT_AGENT_SESSION_STORE_H
+#define CORE_MQTT_AGENT_SESSION_STORE_H
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Open the session store and load the records left by the previous
+ * boot.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xSessionStoreInit( void );
+
+/**
+ * @brief Check if records from the previous boot are waiting to be replayed.
+ *
+ * @return pdTRUE if there are records to replay, pdFALSE otherwise.
+ */
+BaseType_t xSessionStoreHasPendingReplay( void );
+
+/**
+ * @brief Track a command just dequeued by the coreMQTT-Agent task.
+ *
+ * QoS1 and QoS2 publishes are copied to the store before they are sent and
+ * removed once the agent completes them. The store task writes them to NVS
+ * in batches, so this never waits on flash. Other commands are ignored.
+ *
+ * @note Must be called from the coreMQTT-Agent task, before the command is
+ * processed.
+ *
+ * @param[in] pxCommand The command about to be processed.
+ * @param[in] usPacketId The packet ID the agent will assign to the command.
+ */
+void vSessionStoreTrackCommand( MQTTAgentCommand_t * pxCommand,
+                                uint16_t usPacketId );
+
+/**
+ * @brief Enqueue publishes for every record left by the previous boot.
+ *
+ * Each record is published again under a new packet ID, so a publish the
+ * broker already received before the reset may be delivered twice.
+ *
+ * @note Called once the MQTT connection is up and before the command loop
+ * runs, so replays are processed ahead of any new application command.
+ *
+ * @param[in] pxAgentContext The coreMQTT-Agent context.
+ *
+ * @return `MQTTSuccess` if every pending record was enqueued, else the error
+ * returned by MQTTAgent_Publish. Records that failed to enqueue are retried on
+ * the next connection.
+ */
+MQTTStatus_t xSessionStoreReplay( MQTTAgentContext_t * pxAgentContext );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* CORE_MQTT_AGENT_SESSION_STORE_H */
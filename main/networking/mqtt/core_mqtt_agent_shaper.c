@@ -0,0 +1,269 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_shaper.c
+ * @brief Token bucket traffic shaper sharing the link between OTA and
+ * telemetry.
+ *
+ * Each class has a bucket filled at its share of the link rate. Tokens are
+ * kept in bytes multiplied by configTICK_RATE_HZ, so a refill over any number
+ * of ticks is exact. Buckets may go into debt, which a class pays off by
+ * waiting before its next message.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+/* coreMQTT-Agent manager events include. */
+#include "core_mqtt_agent_manager_events.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_shaper.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Longest single wait, so a waiting class notices the end of an OTA
+ * update or a change of its share soon.
+ */
+#define SHAPER_MAX_WAIT_MS    ( 100U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Token bucket of a traffic class.
+ */
+typedef struct TokenBucket
+{
+    uint32_t ulSharePercent;
+    int64_t llTokens;
+    TickType_t xLastRefill;
+} TokenBucket_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Lock of every variable below. Taken for a few instructions from the
+ * tasks sending traffic.
+ */
+static portMUX_TYPE xShaperLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Link rate in bytes per second. Traffic is not shaped while it is 0.
+ */
+static uint32_t ulLinkRate = configMQTT_AGENT_SHAPER_LINK_RATE;
+
+/**
+ * @brief Buckets of the traffic classes, empty until first refilled.
+ */
+static TokenBucket_t xBuckets[ CORE_MQTT_AGENT_TRAFFIC_CLASS_COUNT ] =
+{
+    [ CORE_MQTT_AGENT_TRAFFIC_OTA ]       = { .ulSharePercent = configMQTT_AGENT_SHAPER_OTA_SHARE       },
+    [ CORE_MQTT_AGENT_TRAFFIC_TELEMETRY ] = { .ulSharePercent = configMQTT_AGENT_SHAPER_TELEMETRY_SHARE }
+};
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Rate of a bucket in bytes per second.
+ */
+static uint32_t prvBucketRate( const TokenBucket_t * pxBucket );
+
+/**
+ * @brief Add the tokens earned since the last refill, up to the burst size.
+ * Called with the lock held.
+ */
+static void prvRefill( TokenBucket_t * pxBucket );
+
+/**
+ * @brief Take the tokens of a message if the bucket is not in debt. Called
+ * with the lock held.
+ *
+ * @return 0 if the tokens were taken, otherwise the ticks until the debt is
+ * paid off.
+ */
+static TickType_t prvTake( TokenBucket_t * pxBucket,
+                           uint32_t ulBytes );
+
+/**
+ * @brief Check whether traffic is shaped: a link rate is set and an OTA
+ * update is using the link.
+ */
+static bool prvShaping( void );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvBucketRate( const TokenBucket_t * pxBucket )
+{
+    return ( uint32_t ) ( ( ( uint64_t ) ulLinkRate * pxBucket->ulSharePercent ) / 100U );
+}
+
+static void prvRefill( TokenBucket_t * pxBucket )
+{
+    TickType_t xNow = xTaskGetTickCount();
+    int64_t llBurst = ( ( int64_t ) prvBucketRate( pxBucket ) * configMQTT_AGENT_SHAPER_BURST_MS * configTICK_RATE_HZ ) / 1000;
+
+    pxBucket->llTokens += ( int64_t ) ( xNow - pxBucket->xLastRefill ) * prvBucketRate( pxBucket );
+    pxBucket->xLastRefill = xNow;
+
+    if( pxBucket->llTokens > llBurst )
+    {
+        pxBucket->llTokens = llBurst;
+    }
+}
+
+static TickType_t prvTake( TokenBucket_t * pxBucket,
+                           uint32_t ulBytes )
+{
+    TickType_t xRet = 0U;
+    uint32_t ulRate = prvBucketRate( pxBucket );
+
+    prvRefill( pxBucket );
+
+    if( pxBucket->llTokens >= 0 )
+    {
+        pxBucket->llTokens -= ( int64_t ) ulBytes * configTICK_RATE_HZ;
+    }
+    else if( ulRate == 0U )
+    {
+        xRet = pdMS_TO_TICKS( SHAPER_MAX_WAIT_MS );
+    }
+    else
+    {
+        xRet = ( TickType_t ) ( ( -pxBucket->llTokens + ulRate - 1 ) / ulRate );
+    }
+
+    return xRet;
+}
+
+static bool prvShaping( void )
+{
+    return ( ulLinkRate != 0U ) &&
+           ( ( xEventGroupGetBits( xCoreMqttAgentManagerGetEventGroup() ) & CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT ) == 0U );
+}
+
+/* Public function definitions ************************************************/
+
+void vCoreMqttAgentShaperSetLinkRate( uint32_t ulBytesPerSecond )
+{
+    uint32_t ulIndex;
+
+    taskENTER_CRITICAL( &xShaperLock );
+
+    /* Settle the tokens earned at the old rate. */
+    for( ulIndex = 0U; ulIndex < CORE_MQTT_AGENT_TRAFFIC_CLASS_COUNT; ulIndex++ )
+    {
+        prvRefill( &xBuckets[ ulIndex ] );
+    }
+
+    ulLinkRate = ulBytesPerSecond;
+    taskEXIT_CRITICAL( &xShaperLock );
+}
+
+void vCoreMqttAgentShaperSetShare( CoreMqttAgentTrafficClass_t xClass,
+                                   uint32_t ulPercent )
+{
+    configASSERT( xClass < CORE_MQTT_AGENT_TRAFFIC_CLASS_COUNT );
+
+    taskENTER_CRITICAL( &xShaperLock );
+    prvRefill( &xBuckets[ xClass ] );
+    xBuckets[ xClass ].ulSharePercent = ( ulPercent < 100U ) ? ulPercent : 100U;
+    taskEXIT_CRITICAL( &xShaperLock );
+}
+
+BaseType_t xCoreMqttAgentShaperAcquire( CoreMqttAgentTrafficClass_t xClass,
+                                        uint32_t ulBytes,
+                                        TickType_t xTicksToWait )
+{
+    BaseType_t xRet = pdFAIL;
+    TickType_t xStartTick = xTaskGetTickCount();
+    TickType_t xElapsed = 0U;
+    TickType_t xDelay = 0U;
+    bool xDone = false;
+
+    configASSERT( xClass < CORE_MQTT_AGENT_TRAFFIC_CLASS_COUNT );
+
+    while( xDone == false )
+    {
+        if( prvShaping() == false )
+        {
+            xRet = pdPASS;
+            xDone = true;
+        }
+        else
+        {
+            taskENTER_CRITICAL( &xShaperLock );
+            xDelay = prvTake( &xBuckets[ xClass ], ulBytes );
+            taskEXIT_CRITICAL( &xShaperLock );
+
+            xElapsed = xTaskGetTickCount() - xStartTick;
+
+            if( xDelay == 0U )
+            {
+                xRet = pdPASS;
+                xDone = true;
+            }
+            else if( xElapsed >= xTicksToWait )
+            {
+                xDone = true;
+            }
+            else
+            {
+                xDelay = ( xDelay < pdMS_TO_TICKS( SHAPER_MAX_WAIT_MS ) ) ? xDelay : pdMS_TO_TICKS( SHAPER_MAX_WAIT_MS );
+                xDelay = ( xDelay < ( xTicksToWait - xElapsed ) ) ? xDelay : ( xTicksToWait - xElapsed );
+                vTaskDelay( ( xDelay > 0U ) ? xDelay : 1U );
+            }
+        }
+    }
+
+    return xRet;
+}
+
+void vCoreMqttAgentShaperConsume( CoreMqttAgentTrafficClass_t xClass,
+                                  uint32_t ulBytes )
+{
+    configASSERT( xClass < CORE_MQTT_AGENT_TRAFFIC_CLASS_COUNT );
+
+    if( prvShaping() == true )
+    {
+        taskENTER_CRITICAL( &xShaperLock );
+        prvRefill( &xBuckets[ xClass ] );
+        xBuckets[ xClass ].llTokens -= ( int64_t ) ulBytes * configTICK_RATE_HZ;
+        taskEXIT_CRITICAL( &xShaperLock );
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_shaper.h
+ * @brief Token bucket traffic shaper sharing the link between OTA and
+ * telemetry.
+ *
+ * While an OTA update is in progress each traffic class may use its share of
+ * the configured link rate, with bursts of up to
+ * configMQTT_AGENT_SHAPER_BURST_MS worth of bytes. While no update is in
+ * progress, or while the link rate is 0, traffic is not shaped.
+ */
+#ifndef CORE_MQTT_AGENT_SHAPER_H
+#define CORE_MQTT_AGENT_SHAPER_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Traffic classes sharing the link.
+ */
+typedef enum CoreMqttAgentTrafficClass
+{
+    CORE_MQTT_AGENT_TRAFFIC_OTA = 0,     /**< OTA requests and the blocks they return. */
+    CORE_MQTT_AGENT_TRAFFIC_TELEMETRY,   /**< Application publishes and subscriptions. */
+    CORE_MQTT_AGENT_TRAFFIC_CLASS_COUNT
+} CoreMqttAgentTrafficClass_t;
+
+/**
+ * @brief Set the link rate the shares are taken from.
+ *
+ * @param[in] ulBytesPerSecond Link rate in bytes per second, or 0 to stop
+ * shaping traffic.
+ */
+void vCoreMqttAgentShaperSetLinkRate( uint32_t ulBytesPerSecond );
+
+/**
+ * @brief Set the share of the link rate of a traffic class.
+ *
+ * @param[in] xClass The traffic class.
+ * @param[in] ulPercent Share in percent, up to 100. A class with no share
+ * cannot send while an OTA update is in progress.
+ */
+void vCoreMqttAgentShaperSetShare( CoreMqttAgentTrafficClass_t xClass,
+                                   uint32_t ulPercent );
+
+/**
+ * @brief Wait until a traffic class may send a message.
+ *
+ * A message may be sent once the bucket of its class is no longer in debt,
+ * so a message larger than the bucket still goes out and delays the next
+ * ones of its class.
+ *
+ * @param[in] xClass The traffic class.
+ * @param[in] ulBytes Size of the message.
+ * @param[in] xTicksToWait Maximum time to wait.
+ *
+ * @return pdPASS if the message may be sent, pdFAIL if the wait timed out.
+ */
+BaseType_t xCoreMqttAgentShaperAcquire( CoreMqttAgentTrafficClass_t xClass,
+                                        uint32_t ulBytes,
+                                        TickType_t xTicksToWait );
+
+/**
+ * @brief Charge traffic that cannot wait, such as received data, to a
+ * traffic class.
+ *
+ * @param[in] xClass The traffic class.
+ * @param[in] ulBytes Size of the traffic.
+ */
+void vCoreMqttAgentShaperConsume( CoreMqttAgentTrafficClass_t xClass,
+                                  uint32_t ulBytes );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* CORE_MQTT_AGENT_SHAPER_H */
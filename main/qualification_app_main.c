@@ -48,6 +48,7 @@
 /* OTACodeSigningDemo demo includes. */
 #include "ota_pal.h"
 #include "ota_over_mqtt_demo.h"
+#include "ota_image_hash.h"
 
 /* ESP Secure Certificate Manager include. */
 #include "esp_secure_cert_read.h"
@@ -522,6 +523,7 @@ BaseType_t xQualificationStart( void )
 
             if( otaPal_SetCodeSigningCertificate( pcAwsCodeSigningCertPem ) )
             {
+                vOtaImageHashSetCertificate( pcAwsCodeSigningCertPem );
                 vStartOTACodeSigningDemo();
             }
             else
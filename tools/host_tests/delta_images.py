@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""
+Create the images and patch of the delta host test.
+
+The new image keeps most of the running image, with the kind of changes a
+rebuild makes: bytes patched in place, code inserted and removed so that the
+rest shifts, and a larger data section at the end. The patch is created with
+tools/ota_delta/ota_delta.py.
+
+Usage:
+    delta_images.py <output directory>
+
+Writes running.bin, new.bin, patch.bin and corrupt.bin, a patch with one
+byte of inserted data flipped.
+"""
+
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "ota_delta"))
+
+import ota_delta  # noqa: E402
+
+IMAGE_SIZE = 300 * 1024
+
+
+def make_images():
+    generator = random.Random(36)
+    running = bytearray(generator.getrandbits(8) for _ in range(IMAGE_SIZE))
+    new = bytearray(running)
+
+    # Constants patched in place.
+    for offset in range(0x1000, IMAGE_SIZE, 0x4000):
+        new[offset:offset + 4] = generator.getrandbits(32).to_bytes(4, "little")
+    # A function added, and one removed further on.
+    new[0x8000:0x8000] = bytes(generator.getrandbits(8) for _ in range(12 * 1024))
+    del new[0x30000:0x30000 + 700]
+    # A larger data section.
+    new.extend(generator.getrandbits(8) for _ in range(24 * 1024))
+    return bytes(running), bytes(new)
+
+
+def main():
+    output = sys.argv[1]
+    running, new = make_images()
+    patch = ota_delta.create_patch(running, new)
+    if ota_delta.apply_patch(running, patch) != new:
+        print("ota_delta.py did not rebuild the new image")
+        return 1
+
+    # Flip a byte of the last INSERT operation, which is literal data.
+    corrupt = bytearray(patch)
+    corrupt[-2] ^= 0xFF
+
+    for name, data in (("running.bin", running), ("new.bin", new),
+                       ("patch.bin", patch), ("corrupt.bin", corrupt)):
+        with open(os.path.join(output, name), "wb") as image:
+            image.write(data)
+    print("patch.bin: %d bytes for a %d byte image" % (len(patch), len(new)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""
+Measure the RAM the image write path takes, with and without direct block
+writes.
+
+Each run is given as NAME=EXECUTABLE=OBJECTS, with the objects of the write
+path modules separated by '|'. The executable streams an image through the
+flash writer and reports the heap the flash writer takes and the most event
+buffers in use at once. The static RAM of the modules is the sum of the sizes
+of their data and bss symbols, as listed by nm.
+
+Usage:
+    direct_write_ram.py <nm> <run> ...
+
+The first run is the reference, and the last one must take less RAM.
+"""
+
+import re
+import subprocess
+import sys
+
+RAM_SYMBOL_TYPES = "bBdDgGsS"
+REPORT = re.compile(r"flash writer heap (\d+) B, event buffers in use (\d+) of (\d+)")
+
+
+def static_ram(nm, objects):
+    total = 0
+    for path in objects:
+        symbols = subprocess.run([nm, "--print-size", path], check=True,
+                                 capture_output=True, text=True).stdout
+        for line in symbols.splitlines():
+            fields = line.split()
+            if len(fields) == 4 and fields[2] in RAM_SYMBOL_TYPES:
+                total += int(fields[1], 16)
+    return total
+
+
+def measure(nm, run):
+    name, executable, objects = run.split("=", 2)
+    output = subprocess.run([executable], check=True, capture_output=True, text=True).stdout
+    print(output, end="")
+    report = REPORT.search(output)
+    static = static_ram(nm, objects.split("|"))
+    heap = int(report.group(1))
+    return name, static, heap, int(report.group(2)), int(report.group(3))
+
+
+def main():
+    nm = sys.argv[1]
+    results = [measure(nm, run) for run in sys.argv[2:]]
+    reference = results[0][1] + results[0][2]
+
+    print("%-10s %8s %8s %8s %8s %s" % ("run", "static", "heap", "total", "delta", "event buffers in use"))
+    for name, static, heap, in_use, capacity in results:
+        print("%-10s %8d %8d %8d %+8d %d of %d" % (name, static, heap, static + heap,
+                                                    static + heap - reference, in_use, capacity))
+
+    if results[-1][1] + results[-1][2] >= reference:
+        print("%s does not take less RAM than %s" % (results[-1][0], results[0][0]))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,141 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file file_pal.c
+ * @brief An OTA PAL on the file backed update slot of file_partition.c.
+ *
+ * Like the esp-aws-iot PAL, creating a file erases the range of the slot it
+ * will take. The signature is not checked on close. Tests compare the slot
+ * with the image they sent instead.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA platform abstraction layer include. */
+#include "ota_pal.h"
+
+/* Public functions include. */
+#include "file_pal.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Erase unit of the flash.
+ */
+#define FILE_PAL_SECTOR_SIZE    ( 4096U )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Image state last set, and the number of resets.
+ */
+static OtaImageState_t xImageState = OtaImageStateUnknown;
+static uint32_t ulResets = 0U;
+
+/* Public function definitions ************************************************/
+
+OtaImageState_t xFilePalGetImageState( void )
+{
+    return xImageState;
+}
+
+uint32_t ulFilePalGetResets( void )
+{
+    return ulResets;
+}
+
+OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t xRet = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+    const esp_partition_t * pxSlot = esp_ota_get_next_update_partition( NULL );
+    uint32_t ulEraseSize = ( ( pFileContext->fileSize + FILE_PAL_SECTOR_SIZE - 1U ) / FILE_PAL_SECTOR_SIZE ) * FILE_PAL_SECTOR_SIZE;
+
+    if( esp_partition_erase_range( pxSlot, 0U, ulEraseSize ) == ESP_OK )
+    {
+        pFileContext->pFile = ( void * ) pxSlot;
+        xRet = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+    }
+
+    return xRet;
+}
+
+int16_t otaPal_WriteBlock( OtaFileContext_t * const pFileContext,
+                           uint32_t ulOffset,
+                           uint8_t * const pData,
+                           uint32_t ulBlockSize )
+{
+    int16_t sRet = -1;
+
+    if( ( pFileContext->pFile != NULL ) &&
+        ( esp_partition_write( ( const esp_partition_t * ) pFileContext->pFile, ulOffset, pData, ulBlockSize ) == ESP_OK ) )
+    {
+        sRet = ( int16_t ) ulBlockSize;
+    }
+
+    return sRet;
+}
+
+OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pFileContext )
+{
+    pFileContext->pFile = NULL;
+
+    return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+}
+
+OtaPalStatus_t otaPal_Abort( OtaFileContext_t * const pFileContext )
+{
+    pFileContext->pFile = NULL;
+
+    return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+}
+
+OtaPalStatus_t otaPal_SetPlatformImageState( OtaFileContext_t * const pFileContext,
+                                             OtaImageState_t eState )
+{
+    ( void ) pFileContext;
+    xImageState = eState;
+
+    return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+}
+
+OtaPalStatus_t otaPal_ResetDevice( OtaFileContext_t * const pFileContext )
+{
+    ( void ) pFileContext;
+    ulResets++;
+
+    return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+}
@@ -0,0 +1,421 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file file_partition.c
+ * @brief The OTA slots of partitions.csv, backed by files on the host.
+ *
+ * The running slot is read from a file. The update slot is read, programmed
+ * and erased in a file with the semantics of NOR flash.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* Public functions include. */
+#include "file_partition.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Erase unit of the flash.
+ */
+#define FILE_PARTITION_SECTOR_SIZE    ( 4096U )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The OTA slots.
+ */
+static const esp_partition_t xRunningSlot = { 0x20000U, 0x190000U, "ota_0" };
+static const esp_partition_t xUpdateSlot = { 0x1b0000U, 0x190000U, "ota_1" };
+
+/**
+ * @brief Files holding the running image and the update slot.
+ */
+static const char * pcRunningImagePath = NULL;
+static FILE * pxUpdateSlotFile = NULL;
+
+/**
+ * @brief Simulated flash programming time.
+ */
+static uint32_t ulWriteCallUs = 0U;
+static uint32_t ulWriteKiBUs = 0U;
+
+/**
+ * @brief Flash operations on the update slot.
+ */
+static FilePartitionStats_t xStats = { 0 };
+
+/**
+ * @brief Partition set to boot from.
+ */
+static const esp_partition_t * pxBootPartition = NULL;
+
+/**
+ * @brief Guards the update slot file and the statistics. The pre-erase task
+ * and the flash writer task use the slot from their own threads.
+ */
+static pthread_mutex_t xSlotLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Read a range of a file, with the part beyond its end read as erased
+ * flash.
+ *
+ * @return true if the range could be read.
+ */
+static bool prvReadFile( FILE * pxFile,
+                         size_t xOffset,
+                         uint8_t * pucData,
+                         size_t xLength );
+
+/**
+ * @brief Write a range of the update slot file.
+ *
+ * @return true if the range was written.
+ */
+static bool prvWriteFile( size_t xOffset,
+                          const uint8_t * pucData,
+                          size_t xLength );
+
+/* Static function definitions ************************************************/
+
+static bool prvReadFile( FILE * pxFile,
+                         size_t xOffset,
+                         uint8_t * pucData,
+                         size_t xLength )
+{
+    bool xRet = false;
+
+    memset( pucData, 0xFF, xLength );
+
+    if( ( pxFile != NULL ) && ( fseek( pxFile, ( long ) xOffset, SEEK_SET ) == 0 ) )
+    {
+        ( void ) fread( pucData, 1, xLength, pxFile );
+        clearerr( pxFile );
+        xRet = true;
+    }
+
+    return xRet;
+}
+
+static bool prvWriteFile( size_t xOffset,
+                          const uint8_t * pucData,
+                          size_t xLength )
+{
+    return ( fseek( pxUpdateSlotFile, ( long ) xOffset, SEEK_SET ) == 0 ) &&
+           ( fwrite( pucData, 1, xLength, pxUpdateSlotFile ) == xLength ) &&
+           ( fflush( pxUpdateSlotFile ) == 0 );
+}
+
+/* Public function definitions ************************************************/
+
+void vFilePartitionSetRunningImage( const char * pcPath )
+{
+    pcRunningImagePath = pcPath;
+}
+
+void vFilePartitionSetUpdateSlot( const char * pcPath )
+{
+    ( void ) pthread_mutex_lock( &xSlotLock );
+
+    if( pxUpdateSlotFile != NULL )
+    {
+        ( void ) fclose( pxUpdateSlotFile );
+    }
+
+    pxUpdateSlotFile = fopen( pcPath, "r+b" );
+
+    if( pxUpdateSlotFile == NULL )
+    {
+        pxUpdateSlotFile = fopen( pcPath, "w+b" );
+    }
+
+    ( void ) pthread_mutex_unlock( &xSlotLock );
+}
+
+void vFilePartitionSetWriteTime( uint32_t ulCallUs,
+                                 uint32_t ulKiBUs )
+{
+    ulWriteCallUs = ulCallUs;
+    ulWriteKiBUs = ulKiBUs;
+}
+
+void vFilePartitionGetStats( FilePartitionStats_t * pxStats )
+{
+    ( void ) pthread_mutex_lock( &xSlotLock );
+    *pxStats = xStats;
+    ( void ) pthread_mutex_unlock( &xSlotLock );
+}
+
+void vFilePartitionResetStats( void )
+{
+    ( void ) pthread_mutex_lock( &xSlotLock );
+    memset( &xStats, 0x00, sizeof( xStats ) );
+    ( void ) pthread_mutex_unlock( &xSlotLock );
+}
+
+const esp_partition_t * pxFilePartitionGetBootPartition( void )
+{
+    return pxBootPartition;
+}
+
+const char * esp_err_to_name( esp_err_t code )
+{
+    const char * pcRet = "ERROR";
+
+    switch( code )
+    {
+        case ESP_OK:
+            pcRet = "ESP_OK";
+            break;
+
+        case ESP_FAIL:
+            pcRet = "ESP_FAIL";
+            break;
+
+        case ESP_ERR_INVALID_ARG:
+            pcRet = "ESP_ERR_INVALID_ARG";
+            break;
+
+        case ESP_ERR_INVALID_SIZE:
+            pcRet = "ESP_ERR_INVALID_SIZE";
+            break;
+
+        case ESP_ERR_NVS_NOT_FOUND:
+            pcRet = "ESP_ERR_NVS_NOT_FOUND";
+            break;
+
+        default:
+            break;
+    }
+
+    return pcRet;
+}
+
+const esp_partition_t * esp_ota_get_running_partition( void )
+{
+    return &xRunningSlot;
+}
+
+const esp_partition_t * esp_ota_get_next_update_partition( const esp_partition_t * start_from )
+{
+    ( void ) start_from;
+
+    return &xUpdateSlot;
+}
+
+esp_err_t esp_ota_get_state_partition( const esp_partition_t * partition,
+                                       esp_ota_img_states_t * ota_state )
+{
+    ( void ) partition;
+
+    /* The running image is confirmed. */
+    *ota_state = ESP_OTA_IMG_VALID;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition( const esp_partition_t * partition )
+{
+    esp_err_t xRet = ESP_ERR_INVALID_ARG;
+
+    if( ( partition == &xRunningSlot ) || ( partition == &xUpdateSlot ) )
+    {
+        pxBootPartition = partition;
+        xRet = ESP_OK;
+    }
+
+    return xRet;
+}
+
+esp_err_t esp_partition_read( const esp_partition_t * partition,
+                              size_t src_offset,
+                              void * dst,
+                              size_t size )
+{
+    esp_err_t xRet = ESP_ERR_INVALID_ARG;
+    FILE * pxFile = NULL;
+
+    if( ( src_offset > partition->size ) || ( size > ( partition->size - src_offset ) ) )
+    {
+        xRet = ESP_ERR_INVALID_SIZE;
+    }
+    else if( partition == &xUpdateSlot )
+    {
+        ( void ) pthread_mutex_lock( &xSlotLock );
+
+        if( prvReadFile( pxUpdateSlotFile, src_offset, dst, size ) == true )
+        {
+            xStats.ulReadBytes += ( uint32_t ) size;
+            xRet = ESP_OK;
+        }
+
+        ( void ) pthread_mutex_unlock( &xSlotLock );
+    }
+    else if( ( partition == &xRunningSlot ) && ( pcRunningImagePath != NULL ) )
+    {
+        pxFile = fopen( pcRunningImagePath, "rb" );
+
+        if( prvReadFile( pxFile, src_offset, dst, size ) == true )
+        {
+            xRet = ESP_OK;
+        }
+
+        if( pxFile != NULL )
+        {
+            ( void ) fclose( pxFile );
+        }
+    }
+    else
+    {
+        /* Not a readable partition. */
+    }
+
+    return xRet;
+}
+
+esp_err_t esp_partition_write( const esp_partition_t * partition,
+                               size_t dst_offset,
+                               const void * src,
+                               size_t size )
+{
+    esp_err_t xRet = ESP_ERR_INVALID_ARG;
+    static uint8_t ucFlash[ 64U * 1024U ];
+    const uint8_t * pucSource = ( const uint8_t * ) src;
+    uint64_t ullNs = ( ( uint64_t ) ulWriteCallUs * 1000U ) + ( ( ( uint64_t ) ulWriteKiBUs * size * 1000U ) / 1024U );
+    struct timespec xDelay;
+    size_t xIndex;
+
+    if( ( partition != &xUpdateSlot ) || ( pxUpdateSlotFile == NULL ) )
+    {
+        /* Only the update slot is written. */
+    }
+    else if( ( dst_offset > partition->size ) || ( size > ( partition->size - dst_offset ) ) || ( size > sizeof( ucFlash ) ) )
+    {
+        xRet = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        ( void ) pthread_mutex_lock( &xSlotLock );
+
+        /* Programming only clears bits. */
+        if( prvReadFile( pxUpdateSlotFile, dst_offset, ucFlash, size ) == true )
+        {
+            for( xIndex = 0U; xIndex < size; xIndex++ )
+            {
+                ucFlash[ xIndex ] &= pucSource[ xIndex ];
+            }
+
+            if( prvWriteFile( dst_offset, ucFlash, size ) == true )
+            {
+                xStats.ulWrites++;
+                xStats.ulBytes += ( uint32_t ) size;
+                xRet = ESP_OK;
+            }
+            else
+            {
+                xRet = ESP_FAIL;
+            }
+        }
+
+        ( void ) pthread_mutex_unlock( &xSlotLock );
+
+        /* The flash is busy, and the calling task blocked, while
+         * programming. */
+        if( ullNs > 0U )
+        {
+            xDelay.tv_sec = ( time_t ) ( ullNs / 1000000000U );
+            xDelay.tv_nsec = ( long ) ( ullNs % 1000000000U );
+            ( void ) nanosleep( &xDelay, NULL );
+        }
+    }
+
+    return xRet;
+}
+
+esp_err_t esp_partition_erase_range( const esp_partition_t * partition,
+                                     size_t offset,
+                                     size_t size )
+{
+    esp_err_t xRet = ESP_ERR_INVALID_ARG;
+    static const uint8_t ucErased[ FILE_PARTITION_SECTOR_SIZE ] = { [ 0 ... FILE_PARTITION_SECTOR_SIZE - 1U ] = 0xFF };
+    long lFileSize = 0;
+    size_t xSector;
+
+    if( ( partition != &xUpdateSlot ) || ( pxUpdateSlotFile == NULL ) )
+    {
+        /* Only the update slot is erased. */
+    }
+    else if( ( ( offset % FILE_PARTITION_SECTOR_SIZE ) != 0U ) ||
+             ( ( size % FILE_PARTITION_SECTOR_SIZE ) != 0U ) ||
+             ( offset > partition->size ) ||
+             ( size > ( partition->size - offset ) ) )
+    {
+        xRet = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        ( void ) pthread_mutex_lock( &xSlotLock );
+
+        xRet = ESP_OK;
+
+        if( fseek( pxUpdateSlotFile, 0, SEEK_END ) == 0 )
+        {
+            lFileSize = ftell( pxUpdateSlotFile );
+        }
+
+        /* Beyond the end of the file the slot already reads as erased. */
+        for( xSector = offset; ( xSector < ( offset + size ) ) && ( xRet == ESP_OK ); xSector += FILE_PARTITION_SECTOR_SIZE )
+        {
+            if( ( ( long ) xSector < lFileSize ) && ( prvWriteFile( xSector, ucErased, FILE_PARTITION_SECTOR_SIZE ) == false ) )
+            {
+                xRet = ESP_FAIL;
+            }
+            else
+            {
+                xStats.ulErasedSectors++;
+            }
+        }
+
+        ( void ) pthread_mutex_unlock( &xSlotLock );
+    }
+
+    return xRet;
+}
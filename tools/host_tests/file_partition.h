@@ -0,0 +1,91 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file file_partition.h
+ * @brief The OTA slots of partitions.csv, backed by files on the host.
+ */
+
+#ifndef FILE_PARTITION_H
+#define FILE_PARTITION_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* ESP-IDF includes. */
+#include "esp_partition.h"
+
+/**
+ * @brief Flash operations on the update slot since the last reset.
+ */
+typedef struct FilePartitionStats
+{
+    uint32_t ulWrites;        /**< Calls to esp_partition_write. */
+    uint32_t ulBytes;         /**< Bytes written. */
+    uint32_t ulErasedSectors; /**< Sectors erased. */
+    uint32_t ulReadBytes;     /**< Bytes read. */
+} FilePartitionStats_t;
+
+/**
+ * @brief Set the file holding the running image. The rest of the running
+ * slot reads as erased flash.
+ */
+void vFilePartitionSetRunningImage( const char * pcPath );
+
+/**
+ * @brief Set the file backing the update slot, keeping its content. The part
+ * of the slot beyond the end of the file reads as erased flash.
+ *
+ * Writes only clear bits, as on NOR flash, so a range programmed without
+ * being erased first reads back wrong.
+ */
+void vFilePartitionSetUpdateSlot( const char * pcPath );
+
+/**
+ * @brief Make every esp_partition_write call take ulCallUs, plus ulKiBUs per
+ * KiB written, as flash programming would. Both are 0 by default.
+ */
+void vFilePartitionSetWriteTime( uint32_t ulCallUs,
+                                 uint32_t ulKiBUs );
+
+/**
+ * @brief Get the flash operations on the update slot since the last reset.
+ */
+void vFilePartitionGetStats( FilePartitionStats_t * pxStats );
+
+/**
+ * @brief Reset the flash operation counts.
+ */
+void vFilePartitionResetStats( void );
+
+/**
+ * @brief Get the partition last passed to esp_ota_set_boot_partition.
+ *
+ * @return The partition, or NULL if none was set.
+ */
+const esp_partition_t * pxFilePartitionGetBootPartition( void );
+
+#endif /* FILE_PARTITION_H */
@@ -0,0 +1,464 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file freertos_host.c
+ * @brief The FreeRTOS tasks, queues, notifications and critical sections used
+ * by the OTA demo modules, on POSIX threads.
+ *
+ * Tasks are detached threads, so tasks that never return are left blocked
+ * when a test exits. Priorities are ignored. Stack sizes and queue storage
+ * are only counted, as the FreeRTOS heap would hold them on target.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+/* Host port include. */
+#include "freertos_host.h"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A task and its notification count.
+ */
+struct HostTask
+{
+    pthread_t xThread;
+    TaskFunction_t pxTaskCode;
+    void * pvParameters;
+    pthread_mutex_t xLock;
+    pthread_cond_t xNotified;
+    uint32_t ulNotifyCount;
+};
+
+/**
+ * @brief A queue, as a ring of uxLength items.
+ */
+struct HostQueue
+{
+    pthread_mutex_t xLock;
+    pthread_cond_t xNotEmpty;
+    pthread_cond_t xNotFull;
+    UBaseType_t uxLength;
+    UBaseType_t uxItemSize;
+    UBaseType_t uxHead;
+    UBaseType_t uxCount;
+    uint8_t * pucStorage;
+};
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The lock shared by every critical section.
+ */
+static pthread_mutex_t xCriticalLock;
+static pthread_once_t xCriticalLockOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief The task running on this thread, created on first use for threads
+ * not started by xTaskCreate.
+ */
+static _Thread_local struct HostTask * pxCurrentTask = NULL;
+
+/**
+ * @brief Bytes of task stacks and queue storage created and not deleted, and
+ * the most there were at once.
+ */
+static size_t xHeapInUse = 0U;
+static size_t xHeapHighWater = 0U;
+
+/**
+ * @brief The simulated clock, once vHostTickSet was called.
+ */
+static volatile bool xSimulatedTicks = false;
+static volatile TickType_t xSimulatedTick = 0U;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Create the recursive lock of the critical sections.
+ */
+static void prvInitCriticalLock( void );
+
+/**
+ * @brief Initialise the notification state of a task.
+ */
+static void prvInitTask( struct HostTask * pxTask );
+
+/**
+ * @brief Thread entry of a task.
+ */
+static void * prvTaskEntry( void * pvTask );
+
+/**
+ * @brief Wait on a condition variable for at most xTicksToWait.
+ *
+ * @return false once the wait timed out.
+ */
+static bool prvWait( pthread_cond_t * pxCond,
+                     pthread_mutex_t * pxLock,
+                     TickType_t xTicksToWait );
+
+/**
+ * @brief Count bytes taken from, or with a negative xBytes returned to, the
+ * FreeRTOS heap.
+ */
+static void prvCountHeap( long xBytes );
+
+/* Static function definitions ************************************************/
+
+static void prvInitCriticalLock( void )
+{
+    pthread_mutexattr_t xAttributes;
+
+    ( void ) pthread_mutexattr_init( &xAttributes );
+    ( void ) pthread_mutexattr_settype( &xAttributes, PTHREAD_MUTEX_RECURSIVE );
+    ( void ) pthread_mutex_init( &xCriticalLock, &xAttributes );
+    ( void ) pthread_mutexattr_destroy( &xAttributes );
+}
+
+static void prvInitTask( struct HostTask * pxTask )
+{
+    ( void ) pthread_mutex_init( &pxTask->xLock, NULL );
+    ( void ) pthread_cond_init( &pxTask->xNotified, NULL );
+    pxTask->ulNotifyCount = 0U;
+}
+
+static void * prvTaskEntry( void * pvTask )
+{
+    pxCurrentTask = ( struct HostTask * ) pvTask;
+    pxCurrentTask->pxTaskCode( pxCurrentTask->pvParameters );
+
+    return NULL;
+}
+
+static bool prvWait( pthread_cond_t * pxCond,
+                     pthread_mutex_t * pxLock,
+                     TickType_t xTicksToWait )
+{
+    bool xRet = true;
+    struct timespec xDeadline;
+    uint64_t ullNs;
+
+    if( xTicksToWait == portMAX_DELAY )
+    {
+        ( void ) pthread_cond_wait( pxCond, pxLock );
+    }
+    else if( xTicksToWait == 0U )
+    {
+        xRet = false;
+    }
+    else
+    {
+        ( void ) clock_gettime( CLOCK_REALTIME, &xDeadline );
+        ullNs = ( uint64_t ) xDeadline.tv_nsec + ( ( uint64_t ) pdTICKS_TO_MS( xTicksToWait ) * 1000000U );
+        xDeadline.tv_sec += ( time_t ) ( ullNs / 1000000000U );
+        xDeadline.tv_nsec = ( long ) ( ullNs % 1000000000U );
+        xRet = ( pthread_cond_timedwait( pxCond, pxLock, &xDeadline ) != ETIMEDOUT );
+    }
+
+    return xRet;
+}
+
+static void prvCountHeap( long xBytes )
+{
+    vPortEnterCritical( NULL );
+    {
+        xHeapInUse = ( size_t ) ( ( long ) xHeapInUse + xBytes );
+
+        if( xHeapInUse > xHeapHighWater )
+        {
+            xHeapHighWater = xHeapInUse;
+        }
+    }
+    vPortExitCritical( NULL );
+}
+
+/* Public function definitions ************************************************/
+
+void vPortEnterCritical( portMUX_TYPE * pxMux )
+{
+    ( void ) pxMux;
+    ( void ) pthread_once( &xCriticalLockOnce, prvInitCriticalLock );
+    ( void ) pthread_mutex_lock( &xCriticalLock );
+}
+
+void vPortExitCritical( portMUX_TYPE * pxMux )
+{
+    ( void ) pxMux;
+    ( void ) pthread_mutex_unlock( &xCriticalLock );
+}
+
+BaseType_t xTaskCreate( TaskFunction_t pxTaskCode,
+                        const char * const pcName,
+                        const uint32_t usStackDepth,
+                        void * const pvParameters,
+                        UBaseType_t uxPriority,
+                        TaskHandle_t * const pxCreatedTask )
+{
+    BaseType_t xRet = pdFAIL;
+    struct HostTask * pxTask = calloc( 1, sizeof( struct HostTask ) );
+
+    ( void ) pcName;
+    ( void ) uxPriority;
+
+    if( pxTask != NULL )
+    {
+        prvInitTask( pxTask );
+        pxTask->pxTaskCode = pxTaskCode;
+        pxTask->pvParameters = pvParameters;
+
+        if( pthread_create( &pxTask->xThread, NULL, prvTaskEntry, pxTask ) == 0 )
+        {
+            ( void ) pthread_detach( pxTask->xThread );
+
+            /* ESP-IDF gives stack depths in bytes. */
+            prvCountHeap( ( long ) usStackDepth );
+
+            if( pxCreatedTask != NULL )
+            {
+                *pxCreatedTask = pxTask;
+            }
+
+            xRet = pdPASS;
+        }
+        else
+        {
+            free( pxTask );
+        }
+    }
+
+    return xRet;
+}
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    struct timespec xDelay;
+    uint32_t ulMs = pdTICKS_TO_MS( xTicksToDelay );
+
+    xDelay.tv_sec = ( time_t ) ( ulMs / 1000U );
+    xDelay.tv_nsec = ( long ) ( ulMs % 1000U ) * 1000000L;
+    ( void ) nanosleep( &xDelay, NULL );
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    TickType_t xRet = xSimulatedTick;
+    struct timespec xNow;
+
+    if( xSimulatedTicks == false )
+    {
+        ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+        xRet = ( TickType_t ) ( ( ( ( uint64_t ) xNow.tv_sec * 1000U ) + ( ( uint64_t ) xNow.tv_nsec / 1000000U ) ) /
+                                ( 1000U / configTICK_RATE_HZ ) );
+    }
+
+    return xRet;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    if( pxCurrentTask == NULL )
+    {
+        pxCurrentTask = calloc( 1, sizeof( struct HostTask ) );
+        configASSERT( pxCurrentTask != NULL );
+        prvInitTask( pxCurrentTask );
+        pxCurrentTask->xThread = pthread_self();
+    }
+
+    return pxCurrentTask;
+}
+
+BaseType_t xTaskNotifyGive( TaskHandle_t xTaskToNotify )
+{
+    ( void ) pthread_mutex_lock( &xTaskToNotify->xLock );
+    xTaskToNotify->ulNotifyCount++;
+    ( void ) pthread_cond_signal( &xTaskToNotify->xNotified );
+    ( void ) pthread_mutex_unlock( &xTaskToNotify->xLock );
+
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake( BaseType_t xClearCountOnExit,
+                           TickType_t xTicksToWait )
+{
+    struct HostTask * pxTask = xTaskGetCurrentTaskHandle();
+    uint32_t ulRet;
+    bool xWaiting = true;
+
+    ( void ) pthread_mutex_lock( &pxTask->xLock );
+
+    while( ( pxTask->ulNotifyCount == 0U ) && ( xWaiting == true ) )
+    {
+        xWaiting = prvWait( &pxTask->xNotified, &pxTask->xLock, xTicksToWait );
+    }
+
+    ulRet = pxTask->ulNotifyCount;
+
+    if( ulRet > 0U )
+    {
+        pxTask->ulNotifyCount = ( xClearCountOnExit == pdTRUE ) ? 0U : ( ulRet - 1U );
+    }
+
+    ( void ) pthread_mutex_unlock( &pxTask->xLock );
+
+    return ulRet;
+}
+
+QueueHandle_t xQueueCreate( UBaseType_t uxQueueLength,
+                            UBaseType_t uxItemSize )
+{
+    struct HostQueue * pxQueue = calloc( 1, sizeof( struct HostQueue ) );
+
+    if( pxQueue != NULL )
+    {
+        pxQueue->pucStorage = calloc( uxQueueLength, uxItemSize );
+
+        if( pxQueue->pucStorage == NULL )
+        {
+            free( pxQueue );
+            pxQueue = NULL;
+        }
+        else
+        {
+            ( void ) pthread_mutex_init( &pxQueue->xLock, NULL );
+            ( void ) pthread_cond_init( &pxQueue->xNotEmpty, NULL );
+            ( void ) pthread_cond_init( &pxQueue->xNotFull, NULL );
+            pxQueue->uxLength = uxQueueLength;
+            pxQueue->uxItemSize = uxItemSize;
+            prvCountHeap( ( long ) ( uxQueueLength * uxItemSize ) );
+        }
+    }
+
+    return pxQueue;
+}
+
+void vQueueDelete( QueueHandle_t xQueue )
+{
+    ( void ) pthread_cond_destroy( &xQueue->xNotFull );
+    ( void ) pthread_cond_destroy( &xQueue->xNotEmpty );
+    ( void ) pthread_mutex_destroy( &xQueue->xLock );
+    prvCountHeap( -( long ) ( xQueue->uxLength * xQueue->uxItemSize ) );
+    free( xQueue->pucStorage );
+    free( xQueue );
+}
+
+BaseType_t xQueueSend( QueueHandle_t xQueue,
+                       const void * pvItemToQueue,
+                       TickType_t xTicksToWait )
+{
+    BaseType_t xRet = pdFAIL;
+    bool xWaiting = true;
+    UBaseType_t uxTail;
+
+    ( void ) pthread_mutex_lock( &xQueue->xLock );
+
+    while( ( xQueue->uxCount == xQueue->uxLength ) && ( xWaiting == true ) )
+    {
+        xWaiting = prvWait( &xQueue->xNotFull, &xQueue->xLock, xTicksToWait );
+    }
+
+    if( xQueue->uxCount < xQueue->uxLength )
+    {
+        uxTail = ( xQueue->uxHead + xQueue->uxCount ) % xQueue->uxLength;
+        memcpy( &xQueue->pucStorage[ uxTail * xQueue->uxItemSize ], pvItemToQueue, xQueue->uxItemSize );
+        xQueue->uxCount++;
+        ( void ) pthread_cond_signal( &xQueue->xNotEmpty );
+        xRet = pdPASS;
+    }
+
+    ( void ) pthread_mutex_unlock( &xQueue->xLock );
+
+    return xRet;
+}
+
+BaseType_t xQueueReceive( QueueHandle_t xQueue,
+                          void * pvBuffer,
+                          TickType_t xTicksToWait )
+{
+    BaseType_t xRet = pdFAIL;
+    bool xWaiting = true;
+
+    ( void ) pthread_mutex_lock( &xQueue->xLock );
+
+    while( ( xQueue->uxCount == 0U ) && ( xWaiting == true ) )
+    {
+        xWaiting = prvWait( &xQueue->xNotEmpty, &xQueue->xLock, xTicksToWait );
+    }
+
+    if( xQueue->uxCount > 0U )
+    {
+        memcpy( pvBuffer, &xQueue->pucStorage[ xQueue->uxHead * xQueue->uxItemSize ], xQueue->uxItemSize );
+        xQueue->uxHead = ( xQueue->uxHead + 1U ) % xQueue->uxLength;
+        xQueue->uxCount--;
+        ( void ) pthread_cond_signal( &xQueue->xNotFull );
+        xRet = pdPASS;
+    }
+
+    ( void ) pthread_mutex_unlock( &xQueue->xLock );
+
+    return xRet;
+}
+
+UBaseType_t uxQueueMessagesWaiting( const QueueHandle_t xQueue )
+{
+    UBaseType_t uxRet;
+
+    ( void ) pthread_mutex_lock( &xQueue->xLock );
+    uxRet = xQueue->uxCount;
+    ( void ) pthread_mutex_unlock( &xQueue->xLock );
+
+    return uxRet;
+}
+
+void vHostTickSet( TickType_t xTick )
+{
+    xSimulatedTick = xTick;
+    xSimulatedTicks = true;
+}
+
+void vHostHeapGetStats( size_t * pxInUse,
+                        size_t * pxHighWater )
+{
+    vPortEnterCritical( NULL );
+    {
+        *pxInUse = xHeapInUse;
+        *pxHighWater = xHeapHighWater;
+    }
+    vPortExitCritical( NULL );
+}
@@ -0,0 +1,57 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file freertos_host.h
+ * @brief Host only controls of the FreeRTOS port in freertos_host.c.
+ */
+
+#ifndef FREERTOS_HOST_H
+#define FREERTOS_HOST_H
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Run the tick count from a simulated clock instead of the monotonic
+ * clock of the host, and set it.
+ *
+ * Simulations call this whenever their clock advances, so that the modules
+ * under test see simulated time. Blocking calls still time out in real time.
+ */
+void vHostTickSet( TickType_t xTick );
+
+/**
+ * @brief Get the bytes of task stacks and queue storage currently created,
+ * and the most there were at once.
+ *
+ * On target these come from the FreeRTOS heap. The queue and task control
+ * blocks are not counted.
+ */
+void vHostHeapGetStats( size_t * pxInUse,
+                        size_t * pxHighWater );
+
+#endif /* FREERTOS_HOST_H */
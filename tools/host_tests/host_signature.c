@@ -0,0 +1,115 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file host_signature.c
+ * @brief The mbedtls certificate and public key calls used by the OTA demo
+ * modules, where the signature of an image is its SHA-256 digest.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* MbedTLS includes. */
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/* Public functions include. */
+#include "host_signature.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Length of a SHA-256 digest.
+ */
+#define HOST_SIGNATURE_LENGTH       ( 32U )
+
+/**
+ * @brief Error of mbedtls_pk_verify for a signature that does not match.
+ */
+#define HOST_SIGNATURE_ERR_VERIFY    ( -0x4380 )
+
+/* Public function definitions ************************************************/
+
+void vHostSignatureSign( Sig_t * pxSignature,
+                         const uint8_t * pucImage,
+                         uint32_t ulLength )
+{
+    mbedtls_sha256_context xContext;
+
+    mbedtls_sha256_init( &xContext );
+    ( void ) mbedtls_sha256_starts( &xContext, 0 );
+    ( void ) mbedtls_sha256_update( &xContext, pucImage, ulLength );
+    ( void ) mbedtls_sha256_finish( &xContext, pxSignature->data );
+    mbedtls_sha256_free( &xContext );
+    pxSignature->size = HOST_SIGNATURE_LENGTH;
+}
+
+void mbedtls_x509_crt_init( mbedtls_x509_crt * crt )
+{
+    memset( crt, 0x00, sizeof( *crt ) );
+}
+
+void mbedtls_x509_crt_free( mbedtls_x509_crt * crt )
+{
+    ( void ) crt;
+}
+
+int mbedtls_x509_crt_parse( mbedtls_x509_crt * chain,
+                            const unsigned char * buf,
+                            size_t buflen )
+{
+    ( void ) chain;
+    ( void ) buf;
+    ( void ) buflen;
+
+    return 0;
+}
+
+int mbedtls_pk_verify( mbedtls_pk_context * ctx,
+                       mbedtls_md_type_t md_alg,
+                       const unsigned char * hash,
+                       size_t hash_len,
+                       const unsigned char * sig,
+                       size_t sig_len )
+{
+    int lRet = HOST_SIGNATURE_ERR_VERIFY;
+
+    ( void ) ctx;
+
+    if( ( md_alg == MBEDTLS_MD_SHA256 ) &&
+        ( hash_len == HOST_SIGNATURE_LENGTH ) &&
+        ( sig_len == HOST_SIGNATURE_LENGTH ) &&
+        ( memcmp( hash, sig, HOST_SIGNATURE_LENGTH ) == 0 ) )
+    {
+        lRet = 0;
+    }
+
+    return lRet;
+}
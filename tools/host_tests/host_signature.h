@@ -0,0 +1,54 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file host_signature.h
+ * @brief Code signing on the host, where the signature of an image is its
+ * SHA-256 digest and any certificate verifies it.
+ */
+
+#ifndef HOST_SIGNATURE_H
+#define HOST_SIGNATURE_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* OTA library includes. */
+#include "ota.h"
+
+/**
+ * @brief Certificate to pass to vOtaImageHashSetCertificate.
+ */
+#define HOST_SIGNATURE_CERTIFICATE    "host code signing certificate"
+
+/**
+ * @brief Sign an image.
+ */
+void vHostSignatureSign( Sig_t * pxSignature,
+                         const uint8_t * pucImage,
+                         uint32_t ulLength );
+
+#endif /* HOST_SIGNATURE_H */
@@ -0,0 +1,105 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file host_test.c
+ * @brief Checks and timing shared by the host tests.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Public functions include. */
+#include "host_test.h"
+
+/* Public function definitions ************************************************/
+
+uint64_t ullHostTestNowUs( void )
+{
+    struct timespec xNow;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( ( uint64_t ) xNow.tv_sec * 1000000U ) + ( ( uint64_t ) xNow.tv_nsec / 1000U );
+}
+
+void vHostTestSleepUs( uint32_t ulUs )
+{
+    struct timespec xDelay;
+
+    xDelay.tv_sec = ( time_t ) ( ulUs / 1000000U );
+    xDelay.tv_nsec = ( long ) ( ulUs % 1000000U ) * 1000L;
+    ( void ) nanosleep( &xDelay, NULL );
+}
+
+void vHostTestFill( uint8_t * pucBuffer,
+                    uint32_t ulLength,
+                    uint32_t ulSeed )
+{
+    uint32_t ulState = ulSeed | 1U;
+    uint32_t ulIndex;
+
+    for( ulIndex = 0U; ulIndex < ulLength; ulIndex++ )
+    {
+        /* xorshift32 */
+        ulState ^= ulState << 13;
+        ulState ^= ulState >> 17;
+        ulState ^= ulState << 5;
+        pucBuffer[ ulIndex ] = ( uint8_t ) ulState;
+    }
+}
+
+uint8_t * pucHostTestReadFile( const char * pcPath,
+                               uint32_t * pulLength )
+{
+    uint8_t * pucRet = NULL;
+    FILE * pxFile = fopen( pcPath, "rb" );
+    long lLength;
+
+    if( pxFile != NULL )
+    {
+        if( ( fseek( pxFile, 0, SEEK_END ) == 0 ) && ( ( lLength = ftell( pxFile ) ) >= 0 ) )
+        {
+            rewind( pxFile );
+            pucRet = malloc( ( size_t ) lLength + 1U );
+
+            if( ( pucRet != NULL ) && ( fread( pucRet, 1, ( size_t ) lLength, pxFile ) != ( size_t ) lLength ) )
+            {
+                free( pucRet );
+                pucRet = NULL;
+            }
+
+            *pulLength = ( uint32_t ) lLength;
+        }
+
+        ( void ) fclose( pxFile );
+    }
+
+    return pucRet;
+}
@@ -0,0 +1,78 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file host_test.h
+ * @brief Checks and timing shared by the host tests.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Fail the test, whatever NDEBUG is, if xCondition does not hold.
+ */
+#define HOST_TEST_CHECK( xCondition )                                   \
+    do {                                                                \
+        if( !( xCondition ) )                                           \
+        {                                                               \
+            printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, # xCondition ); \
+            exit( EXIT_FAILURE );                                       \
+        }                                                               \
+    } while( 0 )
+
+/**
+ * @brief Microseconds of the monotonic clock of the host.
+ */
+uint64_t ullHostTestNowUs( void );
+
+/**
+ * @brief Block the calling thread for ulUs microseconds.
+ */
+void vHostTestSleepUs( uint32_t ulUs );
+
+/**
+ * @brief Fill a buffer with a deterministic pseudo random sequence.
+ */
+void vHostTestFill( uint8_t * pucBuffer,
+                    uint32_t ulLength,
+                    uint32_t ulSeed );
+
+/**
+ * @brief Read a whole file into a new buffer.
+ *
+ * @return The buffer, to be freed by the caller, or NULL if the file could
+ * not be read.
+ */
+uint8_t * pucHostTestReadFile( const char * pcPath,
+                               uint32_t * pulLength );
+
+#endif /* HOST_TEST_H */
@@ -0,0 +1,44 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file esp_log.h
+ * @brief ESP-IDF logging to stdout. Debug and verbose messages are dropped.
+ */
+
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+/* Standard includes. */
+#include <stdio.h>
+
+#define ESP_LOGE( tag, format, ... )    printf( "E (%s) " format "\n", tag, ## __VA_ARGS__ )
+#define ESP_LOGW( tag, format, ... )    printf( "W (%s) " format "\n", tag, ## __VA_ARGS__ )
+#define ESP_LOGI( tag, format, ... )    printf( "I (%s) " format "\n", tag, ## __VA_ARGS__ )
+#define ESP_LOGD( tag, format, ... )    do { ( void ) ( tag ); } while( 0 )
+#define ESP_LOGV( tag, format, ... )    do { ( void ) ( tag ); } while( 0 )
+
+#endif /* ESP_LOG_H */
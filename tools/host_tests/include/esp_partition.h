@@ -0,0 +1,64 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file esp_partition.h
+ * @brief ESP-IDF partitions, backed by files on the host. Implemented by
+ * file_partition.c.
+ */
+
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+
+typedef struct esp_partition_t
+{
+    uint32_t address;
+    uint32_t size;
+    char label[ 17 ];
+} esp_partition_t;
+
+esp_err_t esp_partition_read( const esp_partition_t * partition,
+                              size_t src_offset,
+                              void * dst,
+                              size_t size );
+
+esp_err_t esp_partition_write( const esp_partition_t * partition,
+                               size_t dst_offset,
+                               const void * src,
+                               size_t size );
+
+esp_err_t esp_partition_erase_range( const esp_partition_t * partition,
+                                     size_t offset,
+                                     size_t size );
+
+#endif /* ESP_PARTITION_H */
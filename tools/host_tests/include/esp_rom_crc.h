@@ -0,0 +1,64 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file esp_rom_crc.h
+ * @brief The CRC-32 of the ESP-IDF ROM, computed bit by bit.
+ */
+
+#ifndef ESP_ROM_CRC_H
+#define ESP_ROM_CRC_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/**
+ * @brief CRC-32 of the IEEE 802.3 polynomial, continuing from crc, as
+ * esp_rom_crc32_le on target.
+ */
+static inline uint32_t esp_rom_crc32_le( uint32_t crc,
+                                         const uint8_t * buf,
+                                         uint32_t len )
+{
+    uint32_t ulIndex;
+    uint32_t ulBit;
+
+    crc = ~crc;
+
+    for( ulIndex = 0U; ulIndex < len; ulIndex++ )
+    {
+        crc ^= buf[ ulIndex ];
+
+        for( ulBit = 0U; ulBit < 8U; ulBit++ )
+        {
+            crc = ( crc >> 1 ) ^ ( 0xEDB88320U & ( 0U - ( crc & 1U ) ) );
+        }
+    }
+
+    return ~crc;
+}
+
+#endif /* ESP_ROM_CRC_H */
@@ -0,0 +1,74 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file FreeRTOS.h
+ * @brief The FreeRTOS definitions used by the OTA demo modules, for building
+ * them on a POSIX host. Implemented by freertos_host.c.
+ */
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef long            BaseType_t;
+typedef unsigned long   UBaseType_t;
+typedef uint32_t        TickType_t;
+
+#define pdFALSE                  ( ( BaseType_t ) 0 )
+#define pdTRUE                   ( ( BaseType_t ) 1 )
+#define pdFAIL                   ( pdFALSE )
+#define pdPASS                   ( pdTRUE )
+
+#define portMAX_DELAY            ( ( TickType_t ) 0xffffffffUL )
+
+/* The ESP-IDF default tick rate. */
+#define configTICK_RATE_HZ       ( 100U )
+#define portTICK_PERIOD_MS       ( ( TickType_t ) 1000U / configTICK_RATE_HZ )
+#define pdMS_TO_TICKS( xTimeInMs )    ( ( TickType_t ) ( ( ( uint64_t ) ( xTimeInMs ) * configTICK_RATE_HZ ) / 1000U ) )
+#define pdTICKS_TO_MS( xTicks )       ( ( TickType_t ) ( ( ( uint64_t ) ( xTicks ) * 1000U ) / configTICK_RATE_HZ ) )
+
+#define configASSERT( x )        assert( x )
+
+/**
+ * @brief Spinlock of a critical section. Every critical section of the host
+ * shares one recursive mutex, so the lock itself is unused.
+ */
+typedef struct
+{
+    uint32_t ulUnused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+
+void vPortEnterCritical( portMUX_TYPE * pxMux );
+void vPortExitCritical( portMUX_TYPE * pxMux );
+
+#endif /* FREERTOS_H */
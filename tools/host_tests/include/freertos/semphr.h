@@ -0,0 +1,69 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file semphr.h
+ * @brief FreeRTOS mutexes on POSIX threads, as queues holding one token.
+ */
+
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+    uint8_t ucToken = 0U;
+    QueueHandle_t xQueue = xQueueCreate( 1U, sizeof( ucToken ) );
+
+    if( xQueue != NULL )
+    {
+        ( void ) xQueueSend( xQueue, &ucToken, 0U );
+    }
+
+    return xQueue;
+}
+
+static inline BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                                         TickType_t xTicksToWait )
+{
+    uint8_t ucToken;
+
+    return xQueueReceive( xSemaphore, &ucToken, xTicksToWait );
+}
+
+static inline BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    uint8_t ucToken = 0U;
+
+    return xQueueSend( xSemaphore, &ucToken, 0U );
+}
+
+#endif /* SEMPHR_H */
@@ -0,0 +1,64 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file sha256.h
+ * @brief The mbedtls SHA-256 calls used by the OTA demo modules. Implemented
+ * by sha256.c.
+ */
+
+#ifndef MBEDTLS_SHA256_H
+#define MBEDTLS_SHA256_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct mbedtls_sha256_context
+{
+    uint32_t state[ 8 ];
+    uint64_t total;
+    uint8_t buffer[ 64 ];
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init( mbedtls_sha256_context * ctx );
+
+void mbedtls_sha256_free( mbedtls_sha256_context * ctx );
+
+/**
+ * @note SHA-224 is not supported, is224 must be 0.
+ */
+int mbedtls_sha256_starts( mbedtls_sha256_context * ctx,
+                           int is224 );
+
+int mbedtls_sha256_update( mbedtls_sha256_context * ctx,
+                           const unsigned char * input,
+                           size_t ilen );
+
+int mbedtls_sha256_finish( mbedtls_sha256_context * ctx,
+                           unsigned char * output );
+
+#endif /* MBEDTLS_SHA256_H */
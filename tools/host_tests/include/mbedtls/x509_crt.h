@@ -0,0 +1,55 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file x509_crt.h
+ * @brief The mbedtls certificate calls used by the OTA demo modules.
+ * Implemented by host_signature.c, which accepts any certificate.
+ */
+
+#ifndef MBEDTLS_X509_CRT_H
+#define MBEDTLS_X509_CRT_H
+
+/* Standard includes. */
+#include <stddef.h>
+
+/* MbedTLS includes. */
+#include "mbedtls/pk.h"
+
+typedef struct mbedtls_x509_crt
+{
+    mbedtls_pk_context pk;
+} mbedtls_x509_crt;
+
+void mbedtls_x509_crt_init( mbedtls_x509_crt * crt );
+
+void mbedtls_x509_crt_free( mbedtls_x509_crt * crt );
+
+int mbedtls_x509_crt_parse( mbedtls_x509_crt * chain,
+                            const unsigned char * buf,
+                            size_t buflen );
+
+#endif /* MBEDTLS_X509_CRT_H */
@@ -0,0 +1,79 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file nvs.h
+ * @brief The ESP-IDF NVS calls used by the OTA demo modules. Implemented in
+ * memory by nvs_host.c.
+ */
+
+#ifndef NVS_H
+#define NVS_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+esp_err_t nvs_open( const char * namespace_name,
+                    nvs_open_mode_t open_mode,
+                    nvs_handle_t * out_handle );
+
+void nvs_close( nvs_handle_t handle );
+
+esp_err_t nvs_set_u32( nvs_handle_t handle,
+                       const char * key,
+                       uint32_t value );
+
+esp_err_t nvs_get_u32( nvs_handle_t handle,
+                       const char * key,
+                       uint32_t * out_value );
+
+esp_err_t nvs_set_blob( nvs_handle_t handle,
+                        const char * key,
+                        const void * value,
+                        size_t length );
+
+esp_err_t nvs_get_blob( nvs_handle_t handle,
+                        const char * key,
+                        void * out_value,
+                        size_t * length );
+
+esp_err_t nvs_erase_all( nvs_handle_t handle );
+
+esp_err_t nvs_commit( nvs_handle_t handle );
+
+#endif /* NVS_H */
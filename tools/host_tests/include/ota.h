@@ -0,0 +1,116 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota.h
+ * @brief The parts of the OTA library interface used by the OTA demo modules,
+ * with the library configuration of sdkconfig.defaults.
+ */
+
+#ifndef OTA_H
+#define OTA_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+#define otaconfigLOG2_FILE_BLOCK_SIZE         ( 12U )
+#define otaconfigMAX_NUM_BLOCKS_REQUEST       ( 8U )
+#define otaconfigMAX_NUM_OTA_DATA_BUFFERS     ( 8U )
+#define otaconfigFILE_REQUEST_WAIT_MS         ( 10000U )
+
+#define OTA_FILE_BLOCK_SIZE                   ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE )
+#define OTA_MAX_BLOCK_BITMAP_SIZE             ( 128U )
+#define OTA_REQUEST_URL_MAX_SIZE              ( 1500U )
+#define OTA_DATA_BLOCK_SIZE                   ( OTA_FILE_BLOCK_SIZE + OTA_REQUEST_URL_MAX_SIZE + 30U )
+
+#define kOTA_MaxSignatureSize                 ( 384U )
+
+/**
+ * @brief A code signing signature.
+ */
+typedef struct
+{
+    uint16_t size;
+    uint8_t data[ kOTA_MaxSignatureSize ];
+} Sig_t;
+
+/**
+ * @brief States of an image, set by the OTA agent.
+ */
+typedef enum OtaImageState
+{
+    OtaImageStateUnknown = 0,
+    OtaImageStateTesting = 1,
+    OtaImageStateAccepted = 2,
+    OtaImageStateRejected = 3,
+    OtaImageStateAborted = 4
+} OtaImageState_t;
+
+/**
+ * @brief The fields of a file context used by the demo modules and the file
+ * backed PAL.
+ */
+typedef struct OtaFileContext
+{
+    uint8_t * pFilePath;
+    void * pFile;
+    uint32_t fileSize;
+    uint32_t blocksRemaining;
+    uint32_t serverFileID;
+    uint8_t * pStreamName;
+    uint8_t * pRxBlockBitmap;
+    uint32_t fileType;
+    Sig_t * pSignature;
+} OtaFileContext_t;
+
+/**
+ * @brief An event buffer, holding a message for the OTA agent.
+ */
+typedef struct OtaEventData
+{
+    uint8_t data[ OTA_DATA_BLOCK_SIZE ];
+    uint32_t dataLength;
+    bool bufferUsed;
+} OtaEventData_t;
+
+typedef struct OtaAgentStatistics
+{
+    uint32_t otaPacketsReceived;
+    uint32_t otaPacketsQueued;
+    uint32_t otaPacketsProcessed;
+    uint32_t otaPacketsDropped;
+} OtaAgentStatistics_t;
+
+typedef enum OtaErr
+{
+    OtaErrNone = 0,
+    OtaErrUninitialized
+} OtaErr_t;
+
+OtaErr_t OTA_GetStatistics( OtaAgentStatistics_t * pStatistics );
+
+#endif /* OTA_H */
@@ -0,0 +1,58 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pal.h
+ * @brief The OTA PAL functions used by the flash writer. Implemented on the
+ * file backed update slot by file_pal.c.
+ */
+
+#ifndef OTA_PAL_H
+#define OTA_PAL_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* OTA library includes. */
+#include "ota_platform_interface.h"
+
+OtaPalStatus_t otaPal_Abort( OtaFileContext_t * const pFileContext );
+
+OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pFileContext );
+
+OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pFileContext );
+
+int16_t otaPal_WriteBlock( OtaFileContext_t * const pFileContext,
+                           uint32_t ulOffset,
+                           uint8_t * const pData,
+                           uint32_t ulBlockSize );
+
+OtaPalStatus_t otaPal_SetPlatformImageState( OtaFileContext_t * const pFileContext,
+                                             OtaImageState_t eState );
+
+OtaPalStatus_t otaPal_ResetDevice( OtaFileContext_t * const pFileContext );
+
+#endif /* OTA_PAL_H */
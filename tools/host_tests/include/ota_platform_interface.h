@@ -0,0 +1,69 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_platform_interface.h
+ * @brief The OTA PAL status codes.
+ */
+
+#ifndef OTA_PLATFORM_INTERFACE_H
+#define OTA_PLATFORM_INTERFACE_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* OTA library includes. */
+#include "ota.h"
+
+typedef uint32_t OtaPalStatus_t;
+
+typedef enum OtaPalMainStatus
+{
+    OtaPalSuccess = 0,
+    OtaPalUninitialized,
+    OtaPalOutOfMemory,
+    OtaPalNullFileContext,
+    OtaPalSignatureCheckFailed,
+    OtaPalRxFileCreateFailed,
+    OtaPalRxFileTooLarge,
+    OtaPalBootInfoCreateFailed,
+    OtaPalBadSignerCert,
+    OtaPalBadImageState,
+    OtaPalAbortFailed,
+    OtaPalRejectFailed,
+    OtaPalCommitFailed,
+    OtaPalActivateFailed,
+    OtaPalFileAbort,
+    OtaPalFileClose
+} OtaPalMainStatus_t;
+
+#define OTA_PAL_ERR_MASK    0xffffffUL
+#define OTA_PAL_SUB_BITS    24U
+#define OTA_PAL_MAIN_ERR( err )             ( ( OtaPalMainStatus_t ) ( uint32_t ) ( ( uint32_t ) ( err ) >> ( uint32_t ) OTA_PAL_SUB_BITS ) )
+#define OTA_PAL_SUB_ERR( err )              ( ( ( uint32_t ) ( err ) ) & ( ( uint32_t ) OTA_PAL_ERR_MASK ) )
+#define OTA_PAL_COMBINE_ERR( main, sub )    ( ( ( uint32_t ) ( main ) << ( uint32_t ) OTA_PAL_SUB_BITS ) | ( uint32_t ) ( ( ( uint32_t ) ( sub ) ) & ( ( uint32_t ) OTA_PAL_ERR_MASK ) ) )
+
+#endif /* OTA_PLATFORM_INTERFACE_H */
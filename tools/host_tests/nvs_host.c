@@ -0,0 +1,407 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file nvs_host.c
+ * @brief The ESP-IDF NVS calls used by the OTA demo modules, kept in memory.
+ *
+ * A value can be read back as soon as it is set, as on target. Handles are
+ * namespace indexes plus one. With a file set by vNvsHostSetFile(), commits
+ * write every namespace to it, so a later test process finds the values of an
+ * earlier one, as the device does after a reboot.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+#include "nvs.h"
+
+/* Host test includes. */
+#include "nvs_host.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Longest namespace or key, as on target.
+ */
+#define NVS_HOST_NAME_LENGTH       ( 15U )
+
+/**
+ * @brief Namespaces and entries held.
+ */
+#define NVS_HOST_MAX_NAMESPACES    ( 8U )
+#define NVS_HOST_MAX_ENTRIES       ( 32U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A value of a namespace.
+ */
+typedef struct NvsEntry
+{
+    bool xUsed;
+    nvs_handle_t xHandle;
+    char cKey[ NVS_HOST_NAME_LENGTH + 1U ];
+    size_t xLength;
+    uint8_t * pucValue;
+} NvsEntry_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The namespaces opened so far.
+ */
+static char cNamespaces[ NVS_HOST_MAX_NAMESPACES ][ NVS_HOST_NAME_LENGTH + 1U ];
+static uint32_t ulNamespaceCount = 0U;
+
+/**
+ * @brief The values of every namespace.
+ */
+static NvsEntry_t xEntries[ NVS_HOST_MAX_ENTRIES ];
+
+/**
+ * @brief File the namespaces are committed to, or NULL to keep them in memory
+ * only.
+ */
+static const char * pcNvsPath = NULL;
+
+/**
+ * @brief Guards the variables above.
+ */
+static pthread_mutex_t xNvsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Find the entry of a key, or a free entry for it.
+ *
+ * @return The entry, or NULL if the key is not set and xCreate is false or
+ * every entry is in use.
+ */
+static NvsEntry_t * prvFindEntry( nvs_handle_t xHandle,
+                                  const char * pcKey,
+                                  bool xCreate );
+
+/**
+ * @brief Set a key to a copy of a value.
+ */
+static esp_err_t prvSetValue( nvs_handle_t xHandle,
+                              const char * pcKey,
+                              const void * pvValue,
+                              size_t xLength );
+
+/**
+ * @brief Write every namespace to the file set. Must be called with xNvsLock
+ * held.
+ *
+ * @return true if the file was written.
+ */
+static bool prvSaveFile( void );
+
+/* Static function definitions ************************************************/
+
+static NvsEntry_t * prvFindEntry( nvs_handle_t xHandle,
+                                  const char * pcKey,
+                                  bool xCreate )
+{
+    NvsEntry_t * pxFree = NULL;
+    NvsEntry_t * pxRet = NULL;
+    uint32_t ulIndex;
+
+    for( ulIndex = 0U; ( ulIndex < NVS_HOST_MAX_ENTRIES ) && ( pxRet == NULL ); ulIndex++ )
+    {
+        if( xEntries[ ulIndex ].xUsed == false )
+        {
+            pxFree = ( pxFree == NULL ) ? &xEntries[ ulIndex ] : pxFree;
+        }
+        else if( ( xEntries[ ulIndex ].xHandle == xHandle ) && ( strcmp( xEntries[ ulIndex ].cKey, pcKey ) == 0 ) )
+        {
+            pxRet = &xEntries[ ulIndex ];
+        }
+        else
+        {
+            /* The value of another key. */
+        }
+    }
+
+    if( ( pxRet == NULL ) && ( xCreate == true ) && ( pxFree != NULL ) )
+    {
+        pxRet = pxFree;
+        pxRet->xUsed = true;
+        pxRet->xHandle = xHandle;
+        ( void ) strncpy( pxRet->cKey, pcKey, NVS_HOST_NAME_LENGTH );
+        pxRet->cKey[ NVS_HOST_NAME_LENGTH ] = '\0';
+        pxRet->xLength = 0U;
+        pxRet->pucValue = NULL;
+    }
+
+    return pxRet;
+}
+
+static esp_err_t prvSetValue( nvs_handle_t xHandle,
+                              const char * pcKey,
+                              const void * pvValue,
+                              size_t xLength )
+{
+    esp_err_t xRet = ESP_FAIL;
+    NvsEntry_t * pxEntry;
+    uint8_t * pucValue = malloc( ( xLength > 0U ) ? xLength : 1U );
+
+    ( void ) pthread_mutex_lock( &xNvsLock );
+
+    pxEntry = prvFindEntry( xHandle, pcKey, true );
+
+    if( ( pxEntry != NULL ) && ( pucValue != NULL ) )
+    {
+        memcpy( pucValue, pvValue, xLength );
+        free( pxEntry->pucValue );
+        pxEntry->pucValue = pucValue;
+        pxEntry->xLength = xLength;
+        pucValue = NULL;
+        xRet = ESP_OK;
+    }
+
+    ( void ) pthread_mutex_unlock( &xNvsLock );
+
+    free( pucValue );
+
+    return xRet;
+}
+
+static bool prvSaveFile( void )
+{
+    FILE * pxFile = fopen( pcNvsPath, "wb" );
+    bool xRet = ( pxFile != NULL );
+    uint32_t ulIndex;
+
+    if( xRet == true )
+    {
+        xRet = ( fwrite( &ulNamespaceCount, sizeof( ulNamespaceCount ), 1, pxFile ) == 1U ) &&
+               ( fwrite( cNamespaces, sizeof( cNamespaces ), 1, pxFile ) == 1U );
+
+        for( ulIndex = 0U; ( ulIndex < NVS_HOST_MAX_ENTRIES ) && ( xRet == true ); ulIndex++ )
+        {
+            if( xEntries[ ulIndex ].xUsed == true )
+            {
+                xRet = ( fwrite( &xEntries[ ulIndex ], sizeof( NvsEntry_t ), 1, pxFile ) == 1U ) &&
+                       ( fwrite( xEntries[ ulIndex ].pucValue, 1, xEntries[ ulIndex ].xLength, pxFile ) == xEntries[ ulIndex ].xLength );
+            }
+        }
+
+        xRet = ( fclose( pxFile ) == 0 ) && xRet;
+    }
+
+    return xRet;
+}
+
+/* Public function definitions ************************************************/
+
+void vNvsHostSetFile( const char * pcPath )
+{
+    FILE * pxFile = fopen( pcPath, "rb" );
+    NvsEntry_t xEntry;
+    uint32_t ulIndex = 0U;
+
+    ( void ) pthread_mutex_lock( &xNvsLock );
+
+    pcNvsPath = pcPath;
+
+    if( ( pxFile != NULL ) &&
+        ( fread( &ulNamespaceCount, sizeof( ulNamespaceCount ), 1, pxFile ) == 1U ) &&
+        ( fread( cNamespaces, sizeof( cNamespaces ), 1, pxFile ) == 1U ) )
+    {
+        while( ( ulIndex < NVS_HOST_MAX_ENTRIES ) &&
+               ( fread( &xEntry, sizeof( xEntry ), 1, pxFile ) == 1U ) )
+        {
+            xEntry.pucValue = malloc( ( xEntry.xLength > 0U ) ? xEntry.xLength : 1U );
+
+            if( ( xEntry.pucValue != NULL ) &&
+                ( fread( xEntry.pucValue, 1, xEntry.xLength, pxFile ) == xEntry.xLength ) )
+            {
+                xEntries[ ulIndex ] = xEntry;
+                ulIndex++;
+            }
+            else
+            {
+                free( xEntry.pucValue );
+            }
+        }
+    }
+
+    if( pxFile != NULL )
+    {
+        ( void ) fclose( pxFile );
+    }
+
+    ( void ) pthread_mutex_unlock( &xNvsLock );
+}
+
+esp_err_t nvs_open( const char * namespace_name,
+                    nvs_open_mode_t open_mode,
+                    nvs_handle_t * out_handle )
+{
+    esp_err_t xRet = ESP_OK;
+    uint32_t ulIndex = 0U;
+
+    ( void ) open_mode;
+    ( void ) pthread_mutex_lock( &xNvsLock );
+
+    while( ( ulIndex < ulNamespaceCount ) &&
+           ( strncmp( cNamespaces[ ulIndex ], namespace_name, NVS_HOST_NAME_LENGTH ) != 0 ) )
+    {
+        ulIndex++;
+    }
+
+    if( ulIndex == ulNamespaceCount )
+    {
+        if( ulNamespaceCount == NVS_HOST_MAX_NAMESPACES )
+        {
+            xRet = ESP_FAIL;
+        }
+        else
+        {
+            ( void ) strncpy( cNamespaces[ ulIndex ], namespace_name, NVS_HOST_NAME_LENGTH );
+            ulNamespaceCount++;
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &xNvsLock );
+
+    *out_handle = ulIndex + 1U;
+
+    return xRet;
+}
+
+void nvs_close( nvs_handle_t handle )
+{
+    ( void ) handle;
+}
+
+esp_err_t nvs_set_u32( nvs_handle_t handle,
+                       const char * key,
+                       uint32_t value )
+{
+    return prvSetValue( handle, key, &value, sizeof( value ) );
+}
+
+esp_err_t nvs_get_u32( nvs_handle_t handle,
+                       const char * key,
+                       uint32_t * out_value )
+{
+    size_t xLength = sizeof( *out_value );
+
+    return nvs_get_blob( handle, key, out_value, &xLength );
+}
+
+esp_err_t nvs_set_blob( nvs_handle_t handle,
+                        const char * key,
+                        const void * value,
+                        size_t length )
+{
+    return prvSetValue( handle, key, value, length );
+}
+
+esp_err_t nvs_get_blob( nvs_handle_t handle,
+                        const char * key,
+                        void * out_value,
+                        size_t * length )
+{
+    esp_err_t xRet = ESP_ERR_NVS_NOT_FOUND;
+    NvsEntry_t * pxEntry;
+
+    ( void ) pthread_mutex_lock( &xNvsLock );
+
+    pxEntry = prvFindEntry( handle, key, false );
+
+    if( pxEntry == NULL )
+    {
+        /* Not set. */
+    }
+    else if( out_value == NULL )
+    {
+        *length = pxEntry->xLength;
+        xRet = ESP_OK;
+    }
+    else if( *length < pxEntry->xLength )
+    {
+        xRet = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        memcpy( out_value, pxEntry->pucValue, pxEntry->xLength );
+        *length = pxEntry->xLength;
+        xRet = ESP_OK;
+    }
+
+    ( void ) pthread_mutex_unlock( &xNvsLock );
+
+    return xRet;
+}
+
+esp_err_t nvs_erase_all( nvs_handle_t handle )
+{
+    uint32_t ulIndex;
+
+    ( void ) pthread_mutex_lock( &xNvsLock );
+
+    for( ulIndex = 0U; ulIndex < NVS_HOST_MAX_ENTRIES; ulIndex++ )
+    {
+        if( ( xEntries[ ulIndex ].xUsed == true ) && ( xEntries[ ulIndex ].xHandle == handle ) )
+        {
+            free( xEntries[ ulIndex ].pucValue );
+            memset( &xEntries[ ulIndex ], 0x00, sizeof( NvsEntry_t ) );
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &xNvsLock );
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit( nvs_handle_t handle )
+{
+    esp_err_t xRet = ESP_OK;
+
+    ( void ) handle;
+    ( void ) pthread_mutex_lock( &xNvsLock );
+
+    if( ( pcNvsPath != NULL ) && ( prvSaveFile() == false ) )
+    {
+        xRet = ESP_FAIL;
+    }
+
+    ( void ) pthread_mutex_unlock( &xNvsLock );
+
+    return xRet;
+}
@@ -0,0 +1,184 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file sha256.c
+ * @brief SHA-256 (FIPS 180-4) behind the mbedtls calls of mbedtls/sha256.h.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* mbedtls includes. */
+#include "mbedtls/sha256.h"
+
+/* Preprocessor definitions ***************************************************/
+
+#define SHA256_ROTR( x, n )    ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32U - ( n ) ) ) )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Round constants.
+ */
+static const uint32_t ulRoundConstants[ 64 ] =
+{
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+    0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U, 0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+    0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU, 0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+    0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+    0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U, 0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U, 0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+    0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+    0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U, 0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U
+};
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Hash the 64 byte block in the context buffer.
+ */
+static void prvProcessBlock( mbedtls_sha256_context * ctx );
+
+/* Static function definitions ************************************************/
+
+static void prvProcessBlock( mbedtls_sha256_context * ctx )
+{
+    uint32_t ulSchedule[ 64 ];
+    uint32_t ulWork[ 8 ];
+    uint32_t ulTemp1;
+    uint32_t ulTemp2;
+    uint32_t ulIndex;
+
+    for( ulIndex = 0U; ulIndex < 16U; ulIndex++ )
+    {
+        ulSchedule[ ulIndex ] = ( ( uint32_t ) ctx->buffer[ ulIndex * 4U ] << 24 ) |
+                                ( ( uint32_t ) ctx->buffer[ ( ulIndex * 4U ) + 1U ] << 16 ) |
+                                ( ( uint32_t ) ctx->buffer[ ( ulIndex * 4U ) + 2U ] << 8 ) |
+                                ( uint32_t ) ctx->buffer[ ( ulIndex * 4U ) + 3U ];
+    }
+
+    for( ; ulIndex < 64U; ulIndex++ )
+    {
+        ulSchedule[ ulIndex ] = ulSchedule[ ulIndex - 16U ] +
+                                ( SHA256_ROTR( ulSchedule[ ulIndex - 15U ], 7U ) ^ SHA256_ROTR( ulSchedule[ ulIndex - 15U ], 18U ) ^ ( ulSchedule[ ulIndex - 15U ] >> 3 ) ) +
+                                ulSchedule[ ulIndex - 7U ] +
+                                ( SHA256_ROTR( ulSchedule[ ulIndex - 2U ], 17U ) ^ SHA256_ROTR( ulSchedule[ ulIndex - 2U ], 19U ) ^ ( ulSchedule[ ulIndex - 2U ] >> 10 ) );
+    }
+
+    memcpy( ulWork, ctx->state, sizeof( ulWork ) );
+
+    for( ulIndex = 0U; ulIndex < 64U; ulIndex++ )
+    {
+        ulTemp1 = ulWork[ 7 ] +
+                  ( SHA256_ROTR( ulWork[ 4 ], 6U ) ^ SHA256_ROTR( ulWork[ 4 ], 11U ) ^ SHA256_ROTR( ulWork[ 4 ], 25U ) ) +
+                  ( ( ulWork[ 4 ] & ulWork[ 5 ] ) ^ ( ~ulWork[ 4 ] & ulWork[ 6 ] ) ) +
+                  ulRoundConstants[ ulIndex ] +
+                  ulSchedule[ ulIndex ];
+        ulTemp2 = ( SHA256_ROTR( ulWork[ 0 ], 2U ) ^ SHA256_ROTR( ulWork[ 0 ], 13U ) ^ SHA256_ROTR( ulWork[ 0 ], 22U ) ) +
+                  ( ( ulWork[ 0 ] & ulWork[ 1 ] ) ^ ( ulWork[ 0 ] & ulWork[ 2 ] ) ^ ( ulWork[ 1 ] & ulWork[ 2 ] ) );
+        memmove( &ulWork[ 1 ], &ulWork[ 0 ], 7U * sizeof( uint32_t ) );
+        ulWork[ 4 ] += ulTemp1;
+        ulWork[ 0 ] = ulTemp1 + ulTemp2;
+    }
+
+    for( ulIndex = 0U; ulIndex < 8U; ulIndex++ )
+    {
+        ctx->state[ ulIndex ] += ulWork[ ulIndex ];
+    }
+}
+
+/* Public function definitions ************************************************/
+
+void mbedtls_sha256_init( mbedtls_sha256_context * ctx )
+{
+    memset( ctx, 0x00, sizeof( *ctx ) );
+}
+
+void mbedtls_sha256_free( mbedtls_sha256_context * ctx )
+{
+    memset( ctx, 0x00, sizeof( *ctx ) );
+}
+
+int mbedtls_sha256_starts( mbedtls_sha256_context * ctx,
+                           int is224 )
+{
+    static const uint32_t ulInitialState[ 8 ] =
+    {
+        0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU, 0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U
+    };
+
+    memcpy( ctx->state, ulInitialState, sizeof( ulInitialState ) );
+    ctx->total = 0U;
+
+    return ( is224 == 0 ) ? 0 : -1;
+}
+
+int mbedtls_sha256_update( mbedtls_sha256_context * ctx,
+                           const unsigned char * input,
+                           size_t ilen )
+{
+    size_t xIndex;
+
+    for( xIndex = 0U; xIndex < ilen; xIndex++ )
+    {
+        ctx->buffer[ ctx->total % 64U ] = input[ xIndex ];
+        ctx->total++;
+
+        if( ( ctx->total % 64U ) == 0U )
+        {
+            prvProcessBlock( ctx );
+        }
+    }
+
+    return 0;
+}
+
+int mbedtls_sha256_finish( mbedtls_sha256_context * ctx,
+                           unsigned char * output )
+{
+    static const uint8_t ucPadding[ 64 ] = { 0x80U };
+    uint64_t ullBits = ctx->total * 8U;
+    uint8_t ucLength[ 8 ];
+    uint32_t ulIndex;
+
+    for( ulIndex = 0U; ulIndex < 8U; ulIndex++ )
+    {
+        ucLength[ ulIndex ] = ( uint8_t ) ( ullBits >> ( 56U - ( ulIndex * 8U ) ) );
+    }
+
+    ( void ) mbedtls_sha256_update( ctx, ucPadding, ( ( ctx->total % 64U ) < 56U ) ? ( 56U - ( ctx->total % 64U ) ) : ( 120U - ( ctx->total % 64U ) ) );
+    ( void ) mbedtls_sha256_update( ctx, ucLength, sizeof( ucLength ) );
+
+    for( ulIndex = 0U; ulIndex < 32U; ulIndex++ )
+    {
+        output[ ulIndex ] = ( uint8_t ) ( ctx->state[ ulIndex / 4U ] >> ( 24U - ( ( ulIndex % 4U ) * 8U ) ) );
+    }
+
+    return 0;
+}
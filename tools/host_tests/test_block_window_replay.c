@@ -0,0 +1,574 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_block_window_replay.c
+ * @brief Replays link profiles with latency and loss against the adaptive
+ * block window, and compares it with the fixed window of the OTA library.
+ *
+ * The link, the stream server, the OTA event buffers and the OTA agent are
+ * simulated in virtual time:
+ * - a request reaches the server and its first block comes back after one
+ *   round trip, and every block then takes the link time of its size;
+ * - each block is lost with the loss probability of the profile;
+ * - a block received with no free event buffer is dropped;
+ * - the agent processes its events in order, taking the block processing
+ *   time for each block and no time for a request;
+ * - the agent asks for the next blocks every otaconfigMAX_NUM_BLOCKS_REQUEST
+ *   blocks it accepted, counting across requests as the OTA library does,
+ *   and when its request timer, restarted by each request, expired;
+ * - requests signalled by the demo are queued behind the block that ended
+ *   the round;
+ * - the server sends the first missing blocks of the agent bitmap.
+ *
+ * Profiles are read from the file given as argument, one
+ * "<rtt ms> <loss percent> <block processing ms>" per line, or taken from
+ * the built in table.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library includes. */
+#include "ota.h"
+
+/* OTA demo includes. */
+#include "ota_block_window.h"
+
+/* Host test includes. */
+#include "freertos_host.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Blocks of the image, 1 MiB at the default block size.
+ */
+#define SIM_BLOCKS              ( 256U )
+
+/**
+ * @brief Link time of one block, about 1 MB/s.
+ */
+#define SIM_BLOCK_LINK_US       ( 4000U )
+
+/**
+ * @brief Longest simulated transfer before a run is failed.
+ */
+#define SIM_MAX_US              ( 3600U * 1000000ULL )
+
+/**
+ * @brief Longest adaptive transfer without loss, in percent of the fixed one.
+ */
+#define SIM_MAX_RAMP_COST_PCT   ( 115U )
+
+/**
+ * @brief Most blocks in flight, more than any window can ask for.
+ */
+#define SIM_MAX_IN_FLIGHT       ( 64U )
+
+/**
+ * @brief Most events queued to the agent: every event buffer, and a request
+ * behind each of them.
+ */
+#define SIM_MAX_EVENTS          ( 2U * otaconfigMAX_NUM_OTA_DATA_BUFFERS + 2U )
+
+/**
+ * @brief Queued event asking the agent for a request.
+ */
+#define SIM_EVENT_REQUEST       ( UINT32_MAX )
+
+/**
+ * @brief Maximum number of profiles.
+ */
+#define SIM_MAX_PROFILES        ( 32U )
+
+/**
+ * @brief Stream request topic, matched by the block window.
+ */
+#define SIM_REQUEST_TOPIC       "$aws/things/host/streams/image/get/cbor"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A link profile.
+ */
+typedef struct SimProfile
+{
+    uint32_t ulRttMs;
+    uint32_t ulLossPct;
+    uint32_t ulProcessMs;
+} SimProfile_t;
+
+/**
+ * @brief Outcome of a transfer.
+ */
+typedef struct SimResult
+{
+    uint64_t ullTimeUs;
+    uint32_t ulRequests;
+    uint32_t ulHeldBack;
+    uint32_t ulLost;
+    uint32_t ulDropped;
+    uint32_t ulDuplicates;
+    uint32_t ulTimeouts;
+} SimResult_t;
+
+/**
+ * @brief A block on its way to the device.
+ */
+typedef struct SimArrival
+{
+    uint64_t ullTimeUs;
+    uint32_t ulBlock;
+} SimArrival_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Built in profiles. The first one lets the window reach its maximum.
+ */
+static const SimProfile_t xDefaultProfiles[] =
+{
+    { 50U,  0U, 4U  },
+    { 200U, 0U, 4U  },
+    { 600U, 0U, 4U  },
+    { 200U, 1U, 4U  },
+    { 200U, 5U, 4U  },
+    { 50U,  0U, 20U },
+    { 200U, 0U, 20U },
+    { 200U, 1U, 20U },
+};
+
+/**
+ * @brief Simulation state.
+ */
+static uint64_t ullNowUs;
+static uint64_t ullLinkFreeUs;
+static uint64_t ullTimerUs;
+static uint32_t ulRandomState;
+static bool xMissing[ SIM_BLOCKS ];
+static uint32_t ulMissingCount;
+static uint32_t ulToReceive;
+static SimArrival_t xInFlight[ SIM_MAX_IN_FLIGHT ];
+static uint32_t ulInFlightCount;
+static uint32_t ulEvents[ SIM_MAX_EVENTS ];
+static uint32_t ulEventCount;
+static uint32_t ulBufferedCount;
+static uint64_t ullProcessedUs;
+static OtaAgentStatistics_t xAgentStatistics;
+static SimResult_t xResult;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Run one transfer with the given profile.
+ */
+static void prvRun( const SimProfile_t * pxProfile,
+                    bool xAdaptive );
+
+/**
+ * @brief Send a stream request for the missing blocks, as the OTA agent would.
+ */
+static void prvRequest( const SimProfile_t * pxProfile,
+                        bool xAdaptive );
+
+/**
+ * @brief Queue an event to the agent.
+ */
+static void prvPushEvent( uint32_t ulEvent,
+                          const SimProfile_t * pxProfile );
+
+/**
+ * @brief Take the event at the head of the agent queue.
+ */
+static uint32_t prvPopEvent( const SimProfile_t * pxProfile );
+
+/**
+ * @brief Process a block at the agent.
+ */
+static void prvProcess( uint32_t ulBlock,
+                        const SimProfile_t * pxProfile );
+
+/**
+ * @brief Handle a block arriving at the device.
+ */
+static void prvReceive( uint32_t ulBlock,
+                        const SimProfile_t * pxProfile,
+                        bool xAdaptive );
+
+/**
+ * @brief Roll for a lost block.
+ */
+static bool prvLost( uint32_t ulLossPct );
+
+/* Static function definitions ************************************************/
+
+static bool prvLost( uint32_t ulLossPct )
+{
+    ulRandomState ^= ulRandomState << 13;
+    ulRandomState ^= ulRandomState >> 17;
+    ulRandomState ^= ulRandomState << 5;
+
+    return ( ulRandomState % 100U ) < ulLossPct;
+}
+
+static void prvRequest( const SimProfile_t * pxProfile,
+                        bool xAdaptive )
+{
+    /* {"c":"rdy","f":0,"l":4096,"o":0,"b":<bitmap>,"n":8}, as the OTA agent
+     * encodes it. The server reads the bitmap from the agent state. */
+    static const uint8_t ucRequest[] =
+    {
+        0xA6U,
+        0x61U, 'c', 0x63U, 'r', 'd', 'y',
+        0x61U, 'f', 0x00U,
+        0x61U, 'l', 0x19U, 0x10U, 0x00U,
+        0x61U, 'o', 0x00U,
+        0x61U, 'b', 0x41U, 0xFFU,
+        0x61U, 'n', ( uint8_t ) otaconfigMAX_NUM_BLOCKS_REQUEST
+    };
+    const uint8_t * pucRequest = ucRequest;
+    uint32_t ulBlocks = 0U;
+    uint32_t ulBlock;
+
+    /* The agent starts its request timer before sending. */
+    ullTimerUs = ullNowUs + ( otaconfigFILE_REQUEST_WAIT_MS * 1000U );
+
+    if( xAdaptive == true )
+    {
+        pucRequest = ( const uint8_t * ) pcOtaBlockWindowApply( SIM_REQUEST_TOPIC,
+                                                                sizeof( SIM_REQUEST_TOPIC ) - 1U,
+                                                                ( const char * ) ucRequest,
+                                                                sizeof( ucRequest ) );
+    }
+
+    if( pucRequest == NULL )
+    {
+        xResult.ulHeldBack++;
+    }
+    else
+    {
+        ulBlocks = pucRequest[ sizeof( ucRequest ) - 1U ];
+        xResult.ulRequests++;
+    }
+
+    for( ulBlock = 0U; ( ulBlock < SIM_BLOCKS ) && ( ulBlocks > 0U ); ulBlock++ )
+    {
+        if( xMissing[ ulBlock ] == true )
+        {
+            ulBlocks--;
+            ullLinkFreeUs = ( ullLinkFreeUs > ( ullNowUs + ( pxProfile->ulRttMs * 1000U ) ) ) ?
+                            ullLinkFreeUs : ( ullNowUs + ( pxProfile->ulRttMs * 1000U ) );
+            ullLinkFreeUs += SIM_BLOCK_LINK_US;
+
+            if( prvLost( pxProfile->ulLossPct ) == true )
+            {
+                xResult.ulLost++;
+            }
+            else
+            {
+                HOST_TEST_CHECK( ulInFlightCount < SIM_MAX_IN_FLIGHT );
+                xInFlight[ ulInFlightCount ].ullTimeUs = ullLinkFreeUs;
+                xInFlight[ ulInFlightCount ].ulBlock = ulBlock;
+                ulInFlightCount++;
+            }
+        }
+    }
+
+}
+
+static void prvPushEvent( uint32_t ulEvent,
+                          const SimProfile_t * pxProfile )
+{
+    HOST_TEST_CHECK( ulEventCount < SIM_MAX_EVENTS );
+
+    if( ( ulEventCount == 0U ) && ( ulEvent != SIM_EVENT_REQUEST ) )
+    {
+        ullProcessedUs = ullNowUs + ( pxProfile->ulProcessMs * 1000U );
+    }
+
+    ulEvents[ ulEventCount ] = ulEvent;
+    ulEventCount++;
+}
+
+static uint32_t prvPopEvent( const SimProfile_t * pxProfile )
+{
+    uint32_t ulEvent = ulEvents[ 0 ];
+
+    ulEventCount--;
+    memmove( &ulEvents[ 0 ], &ulEvents[ 1 ], ulEventCount * sizeof( ulEvents[ 0 ] ) );
+
+    if( ( ulEventCount > 0U ) && ( ulEvents[ 0 ] != SIM_EVENT_REQUEST ) )
+    {
+        ullProcessedUs = ullNowUs + ( pxProfile->ulProcessMs * 1000U );
+    }
+
+    return ulEvent;
+}
+
+static void prvProcess( uint32_t ulBlock,
+                        const SimProfile_t * pxProfile )
+{
+    ulBufferedCount--;
+    xAgentStatistics.otaPacketsProcessed++;
+
+    if( xMissing[ ulBlock ] == false )
+    {
+        /* Duplicates are not counted towards the next request. */
+        xResult.ulDuplicates++;
+    }
+    else
+    {
+        xMissing[ ulBlock ] = false;
+        ulMissingCount--;
+
+        if( ulToReceive > 1U )
+        {
+            ulToReceive--;
+        }
+        else if( ulMissingCount > 0U )
+        {
+            ullTimerUs = ullNowUs + ( otaconfigFILE_REQUEST_WAIT_MS * 1000U );
+            prvPushEvent( SIM_EVENT_REQUEST, pxProfile );
+            ulToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+        }
+        else
+        {
+            /* The file is complete. */
+        }
+    }
+}
+
+static void prvReceive( uint32_t ulBlock,
+                        const SimProfile_t * pxProfile,
+                        bool xAdaptive )
+{
+    xAgentStatistics.otaPacketsReceived++;
+
+    if( ulBufferedCount == otaconfigMAX_NUM_OTA_DATA_BUFFERS )
+    {
+        xResult.ulDropped++;
+
+        if( ( xAdaptive == true ) && ( xOtaBlockWindowOnDrop() == true ) )
+        {
+            prvPushEvent( SIM_EVENT_REQUEST, pxProfile );
+        }
+    }
+    else
+    {
+        prvPushEvent( ulBlock, pxProfile );
+        ulBufferedCount++;
+        xAgentStatistics.otaPacketsQueued++;
+
+        /* Signalled behind the block, so processed after it. */
+        if( ( xAdaptive == true ) && ( xOtaBlockWindowOnBlock() == true ) )
+        {
+            prvPushEvent( SIM_EVENT_REQUEST, pxProfile );
+        }
+    }
+}
+
+static void prvRun( const SimProfile_t * pxProfile,
+                    bool xAdaptive )
+{
+    uint32_t ulIndex;
+    uint32_t ulNext;
+    uint32_t ulBlock;
+
+    ullNowUs = 0U;
+    ullLinkFreeUs = 0U;
+    ulRandomState = 0x2545F491U;
+    ulMissingCount = SIM_BLOCKS;
+    ulInFlightCount = 0U;
+    ulEventCount = 0U;
+    ulBufferedCount = 0U;
+    ulToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+    memset( &xAgentStatistics, 0x00, sizeof( xAgentStatistics ) );
+    memset( &xResult, 0x00, sizeof( xResult ) );
+
+    for( ulIndex = 0U; ulIndex < SIM_BLOCKS; ulIndex++ )
+    {
+        xMissing[ ulIndex ] = true;
+    }
+
+    vHostTickSet( 0U );
+    vOtaBlockWindowInit();
+    prvRequest( pxProfile, xAdaptive );
+
+    while( ulMissingCount > 0U )
+    {
+        HOST_TEST_CHECK( ullNowUs < SIM_MAX_US );
+
+        /* Requests at the head of the queue take no time. */
+        while( ( ulEventCount > 0U ) && ( ulEvents[ 0 ] == SIM_EVENT_REQUEST ) )
+        {
+            ( void ) prvPopEvent( pxProfile );
+            prvRequest( pxProfile, xAdaptive );
+        }
+
+        /* The next event is the earliest of the agent finishing a block, a
+         * block arriving, and the request timer. */
+        ulNext = SIM_MAX_IN_FLIGHT;
+
+        for( ulIndex = 0U; ulIndex < ulInFlightCount; ulIndex++ )
+        {
+            if( ( ulNext == SIM_MAX_IN_FLIGHT ) || ( xInFlight[ ulIndex ].ullTimeUs < xInFlight[ ulNext ].ullTimeUs ) )
+            {
+                ulNext = ulIndex;
+            }
+        }
+
+        if( ( ulEventCount > 0U ) &&
+            ( ( ulNext == SIM_MAX_IN_FLIGHT ) || ( ullProcessedUs <= xInFlight[ ulNext ].ullTimeUs ) ) &&
+            ( ullProcessedUs <= ullTimerUs ) )
+        {
+            ullNowUs = ullProcessedUs;
+            vHostTickSet( ( TickType_t ) ( ullNowUs / ( portTICK_PERIOD_MS * 1000U ) ) );
+            prvProcess( prvPopEvent( pxProfile ), pxProfile );
+        }
+        else if( ( ulNext != SIM_MAX_IN_FLIGHT ) && ( xInFlight[ ulNext ].ullTimeUs <= ullTimerUs ) )
+        {
+            ullNowUs = xInFlight[ ulNext ].ullTimeUs;
+            vHostTickSet( ( TickType_t ) ( ullNowUs / ( portTICK_PERIOD_MS * 1000U ) ) );
+
+            ulBlock = xInFlight[ ulNext ].ulBlock;
+            ulInFlightCount--;
+            xInFlight[ ulNext ] = xInFlight[ ulInFlightCount ];
+            prvReceive( ulBlock, pxProfile, xAdaptive );
+        }
+        else
+        {
+            /* The timer runs again once the agent handled the request. */
+            ullNowUs = ullTimerUs;
+            vHostTickSet( ( TickType_t ) ( ullNowUs / ( portTICK_PERIOD_MS * 1000U ) ) );
+            xResult.ulTimeouts++;
+            ullTimerUs = UINT64_MAX;
+            prvPushEvent( SIM_EVENT_REQUEST, pxProfile );
+        }
+    }
+
+    xResult.ullTimeUs = ullNowUs;
+}
+
+/* Public function definitions ************************************************/
+
+OtaErr_t OTA_GetStatistics( OtaAgentStatistics_t * pStatistics )
+{
+    *pStatistics = xAgentStatistics;
+
+    return OtaErrNone;
+}
+
+int main( int argc,
+          char ** argv )
+{
+    SimProfile_t xProfiles[ SIM_MAX_PROFILES ];
+    uint32_t ulProfileCount = 0U;
+    uint32_t ulIndex;
+    SimResult_t xFixed;
+    OtaBlockWindowStats_t xStats;
+    FILE * pxFile;
+
+    if( argc > 1 )
+    {
+        pxFile = fopen( argv[ 1 ], "r" );
+        HOST_TEST_CHECK( pxFile != NULL );
+
+        while( ( ulProfileCount < SIM_MAX_PROFILES ) &&
+               ( fscanf( pxFile, "%" SCNu32 " %" SCNu32 " %" SCNu32,
+                         &xProfiles[ ulProfileCount ].ulRttMs,
+                         &xProfiles[ ulProfileCount ].ulLossPct,
+                         &xProfiles[ ulProfileCount ].ulProcessMs ) == 3 ) )
+        {
+            ulProfileCount++;
+        }
+
+        ( void ) fclose( pxFile );
+    }
+    else
+    {
+        ulProfileCount = sizeof( xDefaultProfiles ) / sizeof( xDefaultProfiles[ 0 ] );
+        memcpy( xProfiles, xDefaultProfiles, sizeof( xDefaultProfiles ) );
+    }
+
+    printf( "%u blocks, %u us link time per block, %u event buffers, window 1 to %u\n\n",
+            SIM_BLOCKS,
+            SIM_BLOCK_LINK_US,
+            ( unsigned ) otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+            ( unsigned ) otaconfigMAX_NUM_BLOCKS_REQUEST );
+    printf( "  RTT  loss  proc |  fixed blk/s  drop  tmo  dup |  adaptive blk/s  drop  tmo  dup  held  window\n" );
+
+    for( ulIndex = 0U; ulIndex < ulProfileCount; ulIndex++ )
+    {
+        prvRun( &xProfiles[ ulIndex ], false );
+        xFixed = xResult;
+        prvRun( &xProfiles[ ulIndex ], true );
+        vOtaBlockWindowGetStats( &xStats );
+
+        printf( "%5" PRIu32 " %4" PRIu32 "%% %5" PRIu32 " | %12.1f %5" PRIu32 " %4" PRIu32 " %4" PRIu32 " | %15.1f %5" PRIu32 " %4" PRIu32 " %4" PRIu32 " %5" PRIu32 " %7" PRIu32 "\n",
+                xProfiles[ ulIndex ].ulRttMs,
+                xProfiles[ ulIndex ].ulLossPct,
+                xProfiles[ ulIndex ].ulProcessMs,
+                ( SIM_BLOCKS * 1e6 ) / ( double ) xFixed.ullTimeUs,
+                xFixed.ulDropped,
+                xFixed.ulTimeouts,
+                xFixed.ulDuplicates,
+                ( SIM_BLOCKS * 1e6 ) / ( double ) xResult.ullTimeUs,
+                xResult.ulDropped,
+                xResult.ulTimeouts,
+                xResult.ulDuplicates,
+                xResult.ulHeldBack,
+                xStats.ulWindow );
+
+        HOST_TEST_CHECK( ( xStats.ulWindow >= 1U ) && ( xStats.ulWindow <= xStats.ulMaxWindow ) );
+        HOST_TEST_CHECK( xResult.ulHeldBack == xStats.ulSuppressed );
+
+        /* Requests of the agent never overlap a round, so without loss no
+         * block comes twice and no round ends short. */
+        if( ( xProfiles[ ulIndex ].ulLossPct == 0U ) && ( xResult.ulDropped == 0U ) )
+        {
+            HOST_TEST_CHECK( xResult.ulDuplicates == 0U );
+            HOST_TEST_CHECK( xStats.ulDecreases == 0U );
+        }
+
+        /* Without loss the window opens fully, and ramping up costs little. */
+        if( xProfiles[ ulIndex ].ulLossPct == 0U )
+        {
+            HOST_TEST_CHECK( xStats.ulWindow == xStats.ulMaxWindow );
+            HOST_TEST_CHECK( ( xResult.ullTimeUs * 100U ) <= ( xFixed.ullTimeUs * SIM_MAX_RAMP_COST_PCT ) );
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_delta_apply.c
+ * @brief Applies patches made by tools/ota_delta/ota_delta.py through the
+ * flash writer, with both OTA slots backed by files.
+ *
+ * Expects running.bin, new.bin, patch.bin and corrupt.bin from
+ * delta_images.py in the working directory.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA demo includes. */
+#include "ota_over_mqtt_demo_config.h"
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+
+/* Host test includes. */
+#include "file_partition.h"
+#include "host_signature.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief File backing the slot the new image is written to.
+ */
+#define TEST_OUTPUT_PATH       "delta_slot.bin"
+
+/**
+ * @brief Blocks are delivered in reverse within groups of this many, so that
+ * all but one of each group are held.
+ */
+#define TEST_REORDER_GROUP     ( 4U )
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Send a patch through the flash writer, in reordered blocks and with
+ * one block delivered twice.
+ *
+ * @return true if every block was accepted and the file was closed.
+ */
+static bool prvSendPatch( const char * pcPatchPath,
+                          Sig_t * pxSignature,
+                          uint32_t * pulImageSize );
+
+/* Static function definitions ************************************************/
+
+static bool prvSendPatch( const char * pcPatchPath,
+                          Sig_t * pxSignature,
+                          uint32_t * pulImageSize )
+{
+    OtaFileContext_t xFileContext = { 0 };
+    bool xAccepted = true;
+    uint8_t * pucPatch;
+    uint32_t ulPatchSize = 0U;
+    uint32_t ulBlocks;
+    uint32_t ulGroup;
+    uint32_t ulIndex;
+    uint32_t ulBlock;
+    uint32_t ulOffset;
+    uint32_t ulLength;
+
+    pucPatch = pucHostTestReadFile( pcPatchPath, &ulPatchSize );
+    HOST_TEST_CHECK( pucPatch != NULL );
+    ulBlocks = ( ulPatchSize + OTA_FILE_BLOCK_SIZE - 1U ) / OTA_FILE_BLOCK_SIZE;
+    HOST_TEST_CHECK( ulBlocks > TEST_REORDER_GROUP );
+
+    xFileContext.fileSize = ulPatchSize;
+    xFileContext.pSignature = pxSignature;
+    xFileContext.fileType = otademoconfigDELTA_FILE_TYPE;
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCreateFile( &xFileContext ) ) == OtaPalSuccess );
+
+    for( ulGroup = 0U; ( ulGroup < ulBlocks ) && ( xAccepted == true ); ulGroup += TEST_REORDER_GROUP )
+    {
+        for( ulIndex = TEST_REORDER_GROUP; ( ulIndex > 0U ) && ( xAccepted == true ); ulIndex-- )
+        {
+            ulBlock = ulGroup + ulIndex - 1U;
+
+            if( ulBlock < ulBlocks )
+            {
+                ulOffset = ulBlock * OTA_FILE_BLOCK_SIZE;
+                ulLength = ( ( ulPatchSize - ulOffset ) < OTA_FILE_BLOCK_SIZE ) ? ( ulPatchSize - ulOffset ) : OTA_FILE_BLOCK_SIZE;
+                xAccepted = ( sOtaFlashWriterWriteBlock( &xFileContext, ulOffset, &pucPatch[ ulOffset ], ulLength ) == ( int16_t ) ulLength );
+            }
+        }
+
+        /* A block delivered again after it was applied is ignored. */
+        if( ( ulGroup == 0U ) && ( xAccepted == true ) )
+        {
+            xAccepted = ( sOtaFlashWriterWriteBlock( &xFileContext, 0U, pucPatch, OTA_FILE_BLOCK_SIZE ) == ( int16_t ) OTA_FILE_BLOCK_SIZE );
+        }
+    }
+
+    if( xAccepted == true )
+    {
+        xAccepted = ( OTA_PAL_MAIN_ERR( xOtaFlashWriterCloseFile( &xFileContext ) ) == OtaPalSuccess );
+        *pulImageSize = xFileContext.fileSize;
+    }
+    else
+    {
+        ( void ) xOtaFlashWriterAbort( &xFileContext );
+    }
+
+    free( pucPatch );
+
+    return xAccepted;
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    static Sig_t xSignature;
+    uint8_t * pucExpected;
+    uint8_t * pucWritten;
+    uint32_t ulExpectedSize = 0U;
+    uint32_t ulImageSize = 0U;
+
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+    vFilePartitionSetRunningImage( "running.bin" );
+    vFilePartitionSetUpdateSlot( TEST_OUTPUT_PATH );
+
+    /* The signature covers the new image, not the patch. */
+    pucExpected = pucHostTestReadFile( "new.bin", &ulExpectedSize );
+    HOST_TEST_CHECK( pucExpected != NULL );
+    vHostSignatureSign( &xSignature, pucExpected, ulExpectedSize );
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+
+    /* The patch rebuilds the new image, and the file context is given its
+     * size. */
+    HOST_TEST_CHECK( prvSendPatch( "patch.bin", &xSignature, &ulImageSize ) == true );
+    pucWritten = malloc( ulExpectedSize );
+    HOST_TEST_CHECK( pucWritten != NULL );
+    HOST_TEST_CHECK( esp_partition_read( esp_ota_get_next_update_partition( NULL ), 0U, pucWritten, ulExpectedSize ) == ESP_OK );
+    HOST_TEST_CHECK( ulImageSize == ulExpectedSize );
+    HOST_TEST_CHECK( memcmp( pucWritten, pucExpected, ulExpectedSize ) == 0 );
+    printf( "patch.bin: %" PRIu32 " byte image rebuilt\n", ulImageSize );
+    free( pucWritten );
+    free( pucExpected );
+
+    /* Corrupt literal data fails the target hash on close. */
+    HOST_TEST_CHECK( prvSendPatch( "corrupt.bin", &xSignature, &ulImageSize ) == false );
+    printf( "corrupt.bin: rejected\n" );
+
+    /* A patch for another running image fails its first block. */
+    vFilePartitionSetRunningImage( "new.bin" );
+    HOST_TEST_CHECK( prvSendPatch( "patch.bin", &xSignature, &ulImageSize ) == false );
+    printf( "patch.bin over new.bin: rejected\n" );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_direct_write_ram.c
+ * @brief Measures the RAM held by the image write path, with and without
+ * programming blocks straight from the OTA event buffers.
+ *
+ * A receive task copies stream data messages into event buffers, as the MQTT
+ * callback of the demo does, and the main task decodes them into its own
+ * memory and writes the blocks through the flash writer, as the OTA agent
+ * does. Flash programming is slower than receiving, so the event buffers fill
+ * up. The test reports the heap the flash writer takes and the most event
+ * buffers in use at once. direct_write_ram.py adds the static RAM of the
+ * modules from their objects.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+/* ESP-IDF includes. */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA demo includes. */
+#include "ota_over_mqtt_demo_config.h"
+#include "ota_cbor.h"
+#include "ota_event_buffer_pool.h"
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+
+#if otademoconfigENABLE_DIRECT_WRITE
+    #include "ota_direct_write.h"
+#endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+/* Host test includes. */
+#include "file_partition.h"
+#include "freertos_host.h"
+#include "host_signature.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of the image sent.
+ */
+#define TEST_IMAGE_SIZE         ( 128U * 1024U )
+
+/**
+ * @brief Time to receive one block.
+ */
+#define TEST_RECEIVE_US         ( 2000U )
+
+/**
+ * @brief Simulated flash programming time, per call and per KiB.
+ */
+#define TEST_WRITE_CALL_US      ( 500U )
+#define TEST_WRITE_KIB_US       ( 1500U )
+
+/**
+ * @brief Wait of the receive task for a free event buffer.
+ */
+#define TEST_BUFFER_RETRY_US    ( 200U )
+
+/**
+ * @brief Size of a stream data message of one block.
+ */
+#define TEST_MESSAGE_SIZE       ( OTA_FILE_BLOCK_SIZE + 32U )
+
+/**
+ * @brief File backing the slot the image is written to.
+ */
+#define TEST_FILE_PATH          "direct_write_ram.bin"
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The image sent, its signature, and the slot read back.
+ */
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static Sig_t xSignature;
+static uint8_t ucWritten[ TEST_IMAGE_SIZE ];
+
+/**
+ * @brief Event buffers on their way to the main task.
+ */
+static QueueHandle_t xAgentQueue;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Encode the stream data message of a block.
+ *
+ * @return Length of the message.
+ */
+static uint32_t prvEncodeBlock( uint32_t ulBlockId,
+                                uint8_t * pucMessage );
+
+/**
+ * @brief Decode the block of a stream data message.
+ *
+ * @return Length of the payload.
+ */
+static uint32_t prvDecodeBlock( const OtaEventData_t * pxBuffer,
+                                uint32_t * pulBlockId,
+                                const uint8_t ** ppucPayload );
+
+/**
+ * @brief Copy every block of the image into an event buffer and queue it.
+ */
+static void prvReceiveTask( void * pvParameters );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvEncodeBlock( uint32_t ulBlockId,
+                                uint8_t * pucMessage )
+{
+    uint32_t ulPosition = 0U;
+
+    vOtaCborWriteHead( pucMessage, &ulPosition, OTA_CBOR_MAJOR_MAP, 4U );
+    vOtaCborWriteUint( pucMessage, &ulPosition, 'f', 0U );
+    vOtaCborWriteUint( pucMessage, &ulPosition, 'i', ulBlockId );
+    vOtaCborWriteUint( pucMessage, &ulPosition, 'l', OTA_FILE_BLOCK_SIZE );
+    pucMessage[ ulPosition++ ] = OTA_CBOR_KEY_HEADER;
+    pucMessage[ ulPosition++ ] = ( uint8_t ) 'p';
+    vOtaCborWriteHead( pucMessage, &ulPosition, OTA_CBOR_MAJOR_BYTES, OTA_FILE_BLOCK_SIZE );
+    memcpy( &pucMessage[ ulPosition ], &ucImage[ ulBlockId * OTA_FILE_BLOCK_SIZE ], OTA_FILE_BLOCK_SIZE );
+
+    return ulPosition + OTA_FILE_BLOCK_SIZE;
+}
+
+static uint32_t prvDecodeBlock( const OtaEventData_t * pxBuffer,
+                                uint32_t * pulBlockId,
+                                const uint8_t ** ppucPayload )
+{
+    uint32_t ulPosition = 0U;
+    uint32_t ulEntry;
+    uint32_t ulPayloadLength = 0U;
+    OtaCborItem_t xMap = { 0 };
+    OtaCborItem_t xKey = { 0 };
+    OtaCborItem_t xValue = { 0 };
+
+    HOST_TEST_CHECK( xOtaCborRead( pxBuffer->data, pxBuffer->dataLength, &ulPosition, &xMap ) == true );
+
+    for( ulEntry = 0U; ulEntry < xMap.ulValue; ulEntry++ )
+    {
+        HOST_TEST_CHECK( xOtaCborRead( pxBuffer->data, pxBuffer->dataLength, &ulPosition, &xKey ) == true );
+        HOST_TEST_CHECK( xOtaCborRead( pxBuffer->data, pxBuffer->dataLength, &ulPosition, &xValue ) == true );
+
+        if( xOtaCborIsKey( &xKey, 'i' ) )
+        {
+            *pulBlockId = xValue.ulValue;
+        }
+        else if( xOtaCborIsKey( &xKey, 'p' ) )
+        {
+            *ppucPayload = xValue.pucData;
+            ulPayloadLength = xValue.ulValue;
+        }
+        else
+        {
+            /* Not needed to write the block. */
+        }
+    }
+
+    return ulPayloadLength;
+}
+
+static void prvReceiveTask( void * pvParameters )
+{
+    static uint8_t ucMessage[ TEST_MESSAGE_SIZE ];
+    OtaEventData_t * pxBuffer;
+    BaseType_t xCopied = pdFAIL;
+    uint32_t ulBlockId;
+    uint32_t ulLength;
+
+    ( void ) pvParameters;
+
+    for( ulBlockId = 0U; ulBlockId < ( TEST_IMAGE_SIZE / OTA_FILE_BLOCK_SIZE ); ulBlockId++ )
+    {
+        vHostTestSleepUs( TEST_RECEIVE_US );
+        ulLength = prvEncodeBlock( ulBlockId, ucMessage );
+
+        /* The demo drops the block and asks for it again, which only
+         * changes the throughput. */
+        while( ( pxBuffer = pxOtaEventBufferGet() ) == NULL )
+        {
+            vHostTestSleepUs( TEST_BUFFER_RETRY_US );
+        }
+
+        #if otademoconfigENABLE_DIRECT_WRITE
+            xCopied = xOtaDirectWriteCopyBlock( ucMessage, ulLength, pxBuffer );
+            HOST_TEST_CHECK( xCopied == pdPASS );
+        #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+        if( xCopied != pdPASS )
+        {
+            memcpy( pxBuffer->data, ucMessage, ulLength );
+            pxBuffer->dataLength = ulLength;
+        }
+
+        ( void ) xQueueSend( xAgentQueue, &pxBuffer, portMAX_DELAY );
+    }
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    static uint8_t ucDecodeMemory[ OTA_FILE_BLOCK_SIZE ];
+    OtaFileContext_t xFileContext = { 0 };
+    OtaEventBufferPoolStats_t xPoolStats;
+    OtaEventData_t * pxBuffer;
+    const uint8_t * pucPayload = NULL;
+    size_t xHeapBefore;
+    size_t xHeapAfter;
+    size_t xHighWater;
+    uint64_t ullStartUs;
+    uint32_t ulBlock;
+    uint32_t ulBlockId = 0U;
+    uint32_t ulLength;
+
+    vHostTestFill( ucImage, sizeof( ucImage ), 49U );
+    vHostSignatureSign( &xSignature, ucImage, sizeof( ucImage ) );
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+    vFilePartitionSetUpdateSlot( TEST_FILE_PATH );
+    vFilePartitionSetWriteTime( TEST_WRITE_CALL_US, TEST_WRITE_KIB_US );
+    vOtaEventBufferPoolInit();
+
+    #if otademoconfigENABLE_DIRECT_WRITE
+        vOtaDirectWriteInit();
+    #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+    vHostHeapGetStats( &xHeapBefore, &xHighWater );
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+    vHostHeapGetStats( &xHeapAfter, &xHighWater );
+
+    xFileContext.fileSize = TEST_IMAGE_SIZE;
+    xFileContext.pSignature = &xSignature;
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCreateFile( &xFileContext ) ) == OtaPalSuccess );
+
+    xAgentQueue = xQueueCreate( otaconfigMAX_NUM_OTA_DATA_BUFFERS, sizeof( OtaEventData_t * ) );
+    HOST_TEST_CHECK( xAgentQueue != NULL );
+
+    ullStartUs = ullHostTestNowUs();
+    HOST_TEST_CHECK( xTaskCreate( prvReceiveTask, "Receive", 4096U, NULL, 1U, NULL ) == pdPASS );
+
+    for( ulBlock = 0U; ulBlock < ( TEST_IMAGE_SIZE / OTA_FILE_BLOCK_SIZE ); ulBlock++ )
+    {
+        ( void ) xQueueReceive( xAgentQueue, &pxBuffer, portMAX_DELAY );
+
+        ulLength = prvDecodeBlock( pxBuffer, &ulBlockId, &pucPayload );
+        memcpy( ucDecodeMemory, pucPayload, ulLength );
+        HOST_TEST_CHECK( sOtaFlashWriterWriteBlock( &xFileContext, ulBlockId * OTA_FILE_BLOCK_SIZE, ucDecodeMemory, ulLength ) == ( int16_t ) ulLength );
+
+        #if otademoconfigENABLE_DIRECT_WRITE
+            vOtaDirectWriteForget( pxBuffer );
+        #endif /* otademoconfigENABLE_DIRECT_WRITE */
+
+        vOtaEventBufferFree( pxBuffer );
+    }
+
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCloseFile( &xFileContext ) ) == OtaPalSuccess );
+    vOtaEventBufferPoolGetStats( &xPoolStats );
+
+    HOST_TEST_CHECK( esp_partition_read( esp_ota_get_next_update_partition( NULL ), 0U, ucWritten, TEST_IMAGE_SIZE ) == ESP_OK );
+    HOST_TEST_CHECK( memcmp( ucWritten, ucImage, TEST_IMAGE_SIZE ) == 0 );
+
+    printf( "direct write %d, %d chunks: flash writer heap %zu B, event buffers in use %" PRIu32 " of %" PRIu32 ", pool empty %" PRIu32 " times, %" PRIu64 " ms\n",
+            otademoconfigENABLE_DIRECT_WRITE,
+            otademoconfigFLASH_WRITER_NUM_CHUNKS,
+            xHeapAfter - xHeapBefore,
+            xPoolStats.ulCapacity - xPoolStats.ulLowWaterMark,
+            xPoolStats.ulCapacity,
+            xPoolStats.ulExhaustedCount,
+            ( ullHostTestNowUs() - ullStartUs ) / 1000U );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_flash_writer_coalescing.c
+ * @brief Counts the flash writes the flash writer makes for blocks received
+ * out of order, against one write per block.
+ *
+ * A 64 KiB image is sent through the flash writer to the file backed slot
+ * in blocks shuffled within windows of 8, as the blocks of one stream request
+ * may arrive. The number of sectors assembled at once is
+ * otademoconfigFLASH_WRITER_OPEN_SECTORS, set per executable.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA demo includes. */
+#include "ota_over_mqtt_demo_config.h"
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+
+/* Host test includes. */
+#include "file_partition.h"
+#include "host_signature.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of the image sent, and of a flash sector.
+ */
+#define TEST_IMAGE_SIZE         ( 64U * 1024U )
+#define TEST_SECTOR_SIZE        ( 4096U )
+
+/**
+ * @brief Blocks are shuffled within windows of this many.
+ */
+#define TEST_SHUFFLE_WINDOW     ( 8U )
+
+/**
+ * @brief Shuffled transfers per block size.
+ */
+#define TEST_TRIALS             ( 20U )
+
+/**
+ * @brief File backing the slot the image is written to.
+ */
+#define TEST_OUTPUT_PATH        "coalescing_slot.bin"
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The image sent, its signature, and the slot read back.
+ */
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static Sig_t xSignature;
+static uint8_t ucWritten[ TEST_IMAGE_SIZE ];
+
+/**
+ * @brief State of the shuffle.
+ */
+static uint32_t ulRandomState = 50U;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Send the image in blocks of ulBlockSize, in order or shuffled.
+ *
+ * @return The number of flash writes.
+ */
+static uint32_t prvSendImage( uint32_t ulBlockSize,
+                              bool xShuffle );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvSendImage( uint32_t ulBlockSize,
+                              bool xShuffle )
+{
+    OtaFileContext_t xFileContext = { 0 };
+    FilePartitionStats_t xStats;
+    uint32_t ulOrder[ TEST_IMAGE_SIZE / 512U ];
+    uint32_t ulBlocks = TEST_IMAGE_SIZE / ulBlockSize;
+    uint32_t ulWindowEnd;
+    uint32_t ulIndex;
+    uint32_t ulSwap;
+    uint32_t ulTemp;
+
+    for( ulIndex = 0U; ulIndex < ulBlocks; ulIndex++ )
+    {
+        ulOrder[ ulIndex ] = ulIndex;
+    }
+
+    for( ulIndex = 0U; ( ulIndex < ulBlocks ) && ( xShuffle == true ); ulIndex++ )
+    {
+        ulWindowEnd = ( ( ulIndex / TEST_SHUFFLE_WINDOW ) + 1U ) * TEST_SHUFFLE_WINDOW;
+        ulWindowEnd = ( ulWindowEnd < ulBlocks ) ? ulWindowEnd : ulBlocks;
+
+        ulRandomState ^= ulRandomState << 13;
+        ulRandomState ^= ulRandomState >> 17;
+        ulRandomState ^= ulRandomState << 5;
+        ulSwap = ulIndex + ( ulRandomState % ( ulWindowEnd - ulIndex ) );
+
+        ulTemp = ulOrder[ ulIndex ];
+        ulOrder[ ulIndex ] = ulOrder[ ulSwap ];
+        ulOrder[ ulSwap ] = ulTemp;
+    }
+
+    vFilePartitionResetStats();
+    xFileContext.fileSize = TEST_IMAGE_SIZE;
+    xFileContext.pSignature = &xSignature;
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCreateFile( &xFileContext ) ) == OtaPalSuccess );
+
+    for( ulIndex = 0U; ulIndex < ulBlocks; ulIndex++ )
+    {
+        HOST_TEST_CHECK( sOtaFlashWriterWriteBlock( &xFileContext,
+                                                    ulOrder[ ulIndex ] * ulBlockSize,
+                                                    &ucImage[ ulOrder[ ulIndex ] * ulBlockSize ],
+                                                    ulBlockSize ) == ( int16_t ) ulBlockSize );
+    }
+
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCloseFile( &xFileContext ) ) == OtaPalSuccess );
+    vFilePartitionGetStats( &xStats );
+
+    HOST_TEST_CHECK( esp_partition_read( esp_ota_get_next_update_partition( NULL ), 0U, ucWritten, TEST_IMAGE_SIZE ) == ESP_OK );
+    HOST_TEST_CHECK( memcmp( ucWritten, ucImage, TEST_IMAGE_SIZE ) == 0 );
+
+    return xStats.ulWrites;
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    static const uint32_t ulBlockSizes[] = { 512U, 1024U, 2048U, 4096U };
+    uint32_t ulSize;
+    uint32_t ulTrial;
+    uint32_t ulWrites;
+    uint32_t ulMostWrites;
+    uint32_t ulTotalWrites;
+
+    vHostTestFill( ucImage, sizeof( ucImage ), 50U );
+    vHostSignatureSign( &xSignature, ucImage, sizeof( ucImage ) );
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+    vFilePartitionSetUpdateSlot( TEST_OUTPUT_PATH );
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+
+    printf( "%u byte image, %u sectors, blocks shuffled within windows of %u, %u open sectors\n\n",
+            TEST_IMAGE_SIZE,
+            TEST_IMAGE_SIZE / TEST_SECTOR_SIZE,
+            TEST_SHUFFLE_WINDOW,
+            ( unsigned ) otademoconfigFLASH_WRITER_OPEN_SECTORS );
+    printf( "  block size  blocks  in order  shuffled (mean)  shuffled (most)\n" );
+
+    for( ulSize = 0U; ulSize < ( sizeof( ulBlockSizes ) / sizeof( ulBlockSizes[ 0 ] ) ); ulSize++ )
+    {
+        /* In order, every sector is programmed with one write. */
+        HOST_TEST_CHECK( prvSendImage( ulBlockSizes[ ulSize ], false ) == ( TEST_IMAGE_SIZE / TEST_SECTOR_SIZE ) );
+
+        ulMostWrites = 0U;
+        ulTotalWrites = 0U;
+
+        for( ulTrial = 0U; ulTrial < TEST_TRIALS; ulTrial++ )
+        {
+            ulWrites = prvSendImage( ulBlockSizes[ ulSize ], true );
+            ulMostWrites = ( ulWrites > ulMostWrites ) ? ulWrites : ulMostWrites;
+            ulTotalWrites += ulWrites;
+        }
+
+        printf( "%10" PRIu32 " B %7" PRIu32 " %9u %16.1f %16" PRIu32 "\n",
+                ulBlockSizes[ ulSize ],
+                TEST_IMAGE_SIZE / ulBlockSizes[ ulSize ],
+                TEST_IMAGE_SIZE / TEST_SECTOR_SIZE,
+                ( double ) ulTotalWrites / TEST_TRIALS,
+                ulMostWrites );
+
+        /* Never more writes than blocks, and one write per sector when a
+         * window of blocks spans no more sectors than are assembled at once. */
+        HOST_TEST_CHECK( ulMostWrites <= ( TEST_IMAGE_SIZE / ulBlockSizes[ ulSize ] ) );
+
+        if( ( ( TEST_SHUFFLE_WINDOW * ulBlockSizes[ ulSize ] ) <= ( TEST_SECTOR_SIZE * otademoconfigFLASH_WRITER_OPEN_SECTORS ) ) ||
+            ( ulBlockSizes[ ulSize ] == TEST_SECTOR_SIZE ) )
+        {
+            HOST_TEST_CHECK( ulMostWrites == ( TEST_IMAGE_SIZE / TEST_SECTOR_SIZE ) );
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_flash_writer_pre_erase.c
+ * @brief Checks that the flash writer programs the sectors erased by the
+ * pre-erase task without erasing them again.
+ *
+ * The file backed slot starts with stale data. Once the pre-erase task has
+ * erased the whole slot, an image is sent through the flash writer, which
+ * must erase no sector, and is activated. A second image, sent after the
+ * first one used up the erased sectors, has each of its sectors erased by the
+ * flash writer. Either image only reads back right if its sectors were erased
+ * before being programmed.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA demo includes. */
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+#include "ota_pre_erase.h"
+
+/* Host test includes. */
+#include "file_pal.h"
+#include "file_partition.h"
+#include "host_signature.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of the images sent, and of a flash sector.
+ */
+#define TEST_IMAGE_SIZE           ( 64U * 1024U )
+#define TEST_SECTOR_SIZE          ( 4096U )
+
+/**
+ * @brief Longest wait for the pre-erase task to erase the slot.
+ */
+#define TEST_PRE_ERASE_WAIT_US    ( 10000000U )
+
+/**
+ * @brief File backing the slot the images are written to.
+ */
+#define TEST_SLOT_PATH            "pre_erase_slot.bin"
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The image sent, its signature, and the slot read back.
+ */
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static Sig_t xSignature;
+static uint8_t ucWritten[ TEST_IMAGE_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Send the image through the flash writer and check the slot.
+ *
+ * @return The number of sectors erased while sending it.
+ */
+static uint32_t prvSendImage( OtaFileContext_t * pxFileContext );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvSendImage( OtaFileContext_t * pxFileContext )
+{
+    FilePartitionStats_t xStats;
+    uint32_t ulOffset;
+
+    vHostSignatureSign( &xSignature, ucImage, TEST_IMAGE_SIZE );
+    memset( pxFileContext, 0x00, sizeof( *pxFileContext ) );
+    pxFileContext->fileSize = TEST_IMAGE_SIZE;
+    pxFileContext->pSignature = &xSignature;
+
+    vFilePartitionResetStats();
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCreateFile( pxFileContext ) ) == OtaPalSuccess );
+
+    for( ulOffset = 0U; ulOffset < TEST_IMAGE_SIZE; ulOffset += OTA_FILE_BLOCK_SIZE )
+    {
+        HOST_TEST_CHECK( sOtaFlashWriterWriteBlock( pxFileContext, ulOffset, &ucImage[ ulOffset ], OTA_FILE_BLOCK_SIZE ) == ( int16_t ) OTA_FILE_BLOCK_SIZE );
+    }
+
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCloseFile( pxFileContext ) ) == OtaPalSuccess );
+    vFilePartitionGetStats( &xStats );
+
+    HOST_TEST_CHECK( esp_partition_read( esp_ota_get_next_update_partition( NULL ), 0U, ucWritten, TEST_IMAGE_SIZE ) == ESP_OK );
+    HOST_TEST_CHECK( memcmp( ucWritten, ucImage, TEST_IMAGE_SIZE ) == 0 );
+
+    return xStats.ulErasedSectors;
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    const esp_partition_t * pxSlot = esp_ota_get_next_update_partition( NULL );
+    OtaFileContext_t xFileContext;
+    uint64_t ullStartUs;
+    uint32_t ulErased;
+
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+    vFilePartitionSetUpdateSlot( TEST_SLOT_PATH );
+
+    /* Stale data of an earlier image. */
+    vHostTestFill( ucImage, TEST_IMAGE_SIZE, 33U );
+    HOST_TEST_CHECK( esp_partition_write( pxSlot, 0U, ucImage, TEST_IMAGE_SIZE ) == ESP_OK );
+
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+    HOST_TEST_CHECK( xOtaPreEraseInit() == pdPASS );
+
+    /* With the whole slot erased, the pre-erase task is idle. */
+    ullStartUs = ullHostTestNowUs();
+
+    while( xOtaPreEraseIsRangeErased( 0U, pxSlot->size ) == false )
+    {
+        HOST_TEST_CHECK( ( ullHostTestNowUs() - ullStartUs ) < TEST_PRE_ERASE_WAIT_US );
+        vHostTestSleepUs( 1000U );
+    }
+
+    printf( "%s pre-erased in %" PRIu64 " ms\n", pxSlot->label, ( ullHostTestNowUs() - ullStartUs ) / 1000U );
+
+    vHostTestFill( ucImage, TEST_IMAGE_SIZE, 34U );
+    ulErased = prvSendImage( &xFileContext );
+    printf( "first image: %" PRIu32 " sectors erased by the flash writer\n", ulErased );
+    HOST_TEST_CHECK( ulErased == 0U );
+
+    /* The image passed its signature check, so it can be booted. */
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterActivateNewImage( &xFileContext ) ) == OtaPalSuccess );
+    HOST_TEST_CHECK( pxFilePartitionGetBootPartition() == pxSlot );
+    HOST_TEST_CHECK( ulFilePalGetResets() == 1U );
+
+    vHostTestFill( ucImage, TEST_IMAGE_SIZE, 35U );
+    ulErased = prvSendImage( &xFileContext );
+    printf( "second image: %" PRIu32 " sectors erased by the flash writer\n", ulErased );
+    HOST_TEST_CHECK( ulErased == ( TEST_IMAGE_SIZE / TEST_SECTOR_SIZE ) );
+
+    /* A rejected image is not activated, and the running image is left
+     * alone. */
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterSetPlatformImageState( &xFileContext, OtaImageStateRejected ) ) == OtaPalSuccess );
+    HOST_TEST_CHECK( xFilePalGetImageState() == OtaImageStateUnknown );
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterActivateNewImage( &xFileContext ) ) == OtaPalActivateFailed );
+    HOST_TEST_CHECK( ulFilePalGetResets() == 1U );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_flash_writer_throughput.c
+ * @brief Measures the OTA throughput of the flash writer stage against a file
+ * backed slot with a simulated flash programming time.
+ *
+ * Blocks are received and decoded at a fixed rate. They are written once with
+ * the PAL on the receiving task, as the OTA agent did before the flash writer
+ * stage, and once through the flash writer, which overlaps programming with
+ * receiving the next blocks and checks the signature at close.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_pal.h"
+
+/* OTA demo includes. */
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+
+/* Host test includes. */
+#include "file_partition.h"
+#include "host_signature.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of the image sent.
+ */
+#define TEST_IMAGE_SIZE         ( 256U * 1024U )
+
+/**
+ * @brief Time to receive and decode one block.
+ */
+#define TEST_RECEIVE_US         ( 5000U )
+
+/**
+ * @brief Simulated flash programming time, per call and per KiB.
+ */
+#define TEST_WRITE_CALL_US      ( 500U )
+#define TEST_WRITE_KIB_US       ( 1000U )
+
+/**
+ * @brief Minimum speedup of the flash writer, in percent.
+ */
+#define TEST_MIN_SPEEDUP_PCT    ( 125U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Writes a block of the file.
+ */
+typedef int16_t ( * WriteBlock_t )( OtaFileContext_t * const pFileContext,
+                                    uint32_t ulOffset,
+                                    uint8_t * const pData,
+                                    uint32_t ulBlockSize );
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The image sent, its signature, and the slot read back.
+ */
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static Sig_t xSignature;
+static uint8_t ucWritten[ TEST_IMAGE_SIZE ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Send the image to a file backed slot through the given functions.
+ *
+ * @return The time from creating the file to closing it, in microseconds.
+ */
+static uint64_t prvSendImage( const char * pcPath,
+                              OtaPalStatus_t ( * pxCreateFile )( OtaFileContext_t * const ),
+                              WriteBlock_t pxWriteBlock,
+                              OtaPalStatus_t ( * pxCloseFile )( OtaFileContext_t * const ) );
+
+/* Static function definitions ************************************************/
+
+static uint64_t prvSendImage( const char * pcPath,
+                              OtaPalStatus_t ( * pxCreateFile )( OtaFileContext_t * const ),
+                              WriteBlock_t pxWriteBlock,
+                              OtaPalStatus_t ( * pxCloseFile )( OtaFileContext_t * const ) )
+{
+    OtaFileContext_t xFileContext = { 0 };
+    FilePartitionStats_t xStats;
+    uint64_t ullStartUs;
+    uint64_t ullElapsedUs;
+    uint32_t ulOffset;
+
+    vFilePartitionSetUpdateSlot( pcPath );
+    vFilePartitionResetStats();
+    xFileContext.fileSize = TEST_IMAGE_SIZE;
+    xFileContext.pSignature = &xSignature;
+
+    ullStartUs = ullHostTestNowUs();
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( pxCreateFile( &xFileContext ) ) == OtaPalSuccess );
+
+    for( ulOffset = 0U; ulOffset < TEST_IMAGE_SIZE; ulOffset += OTA_FILE_BLOCK_SIZE )
+    {
+        vHostTestSleepUs( TEST_RECEIVE_US );
+        HOST_TEST_CHECK( pxWriteBlock( &xFileContext, ulOffset, &ucImage[ ulOffset ], OTA_FILE_BLOCK_SIZE ) == ( int16_t ) OTA_FILE_BLOCK_SIZE );
+    }
+
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( pxCloseFile( &xFileContext ) ) == OtaPalSuccess );
+    ullElapsedUs = ullHostTestNowUs() - ullStartUs;
+    vFilePartitionGetStats( &xStats );
+
+    HOST_TEST_CHECK( esp_partition_read( esp_ota_get_next_update_partition( NULL ), 0U, ucWritten, TEST_IMAGE_SIZE ) == ESP_OK );
+    HOST_TEST_CHECK( memcmp( ucWritten, ucImage, TEST_IMAGE_SIZE ) == 0 );
+
+    printf( "%-22s %" PRIu32 " bytes in %4" PRIu64 " ms, %4" PRIu64 " KiB/s, %" PRIu32 " flash writes\n",
+            pcPath,
+            ( uint32_t ) TEST_IMAGE_SIZE,
+            ullElapsedUs / 1000U,
+            ( ( uint64_t ) TEST_IMAGE_SIZE * 1000000U ) / ( ullElapsedUs * 1024U ),
+            xStats.ulWrites );
+
+    return ullElapsedUs;
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    uint64_t ullInlineUs;
+    uint64_t ullWriterUs;
+
+    vHostTestFill( ucImage, sizeof( ucImage ), 32U );
+    vHostSignatureSign( &xSignature, ucImage, sizeof( ucImage ) );
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+    vFilePartitionSetWriteTime( TEST_WRITE_CALL_US, TEST_WRITE_KIB_US );
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+
+    printf( "%" PRIu32 " byte blocks received every %u us, flash programs in %u us + %u us/KiB\n",
+            ( uint32_t ) OTA_FILE_BLOCK_SIZE,
+            TEST_RECEIVE_US,
+            TEST_WRITE_CALL_US,
+            TEST_WRITE_KIB_US );
+
+    ullInlineUs = prvSendImage( "inline_pal.bin", otaPal_CreateFileForRx, otaPal_WriteBlock, otaPal_CloseFile );
+    ullWriterUs = prvSendImage( "flash_writer.bin", xOtaFlashWriterCreateFile, sOtaFlashWriterWriteBlock, xOtaFlashWriterCloseFile );
+
+    printf( "speedup %" PRIu64 "%%\n", ( ullInlineUs * 100U ) / ullWriterUs );
+    HOST_TEST_CHECK( ( ullInlineUs * 100U ) >= ( ullWriterUs * TEST_MIN_SPEEDUP_PCT ) );
+
+    return EXIT_SUCCESS;
+}
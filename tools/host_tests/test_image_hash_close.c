@@ -0,0 +1,156 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_image_hash_close.c
+ * @brief Counts the bytes of the image the flash writer reads back from flash
+ * to check its signature at close.
+ *
+ * A 64 KiB image is sent through the flash writer in order, then with its
+ * sectors in reverse order, and once more with a signature that does not
+ * match. otademoconfigENABLE_INCREMENTAL_HASH is set per executable. With it,
+ * only the sectors programmed ahead of the hashed prefix are read back.
+ * Without it, the whole image is.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA demo includes. */
+#include "ota_over_mqtt_demo_config.h"
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+
+/* Host test includes. */
+#include "file_partition.h"
+#include "host_signature.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of the image sent, and of a flash sector.
+ */
+#define TEST_IMAGE_SIZE       ( 64U * 1024U )
+#define TEST_SECTOR_SIZE      ( 4096U )
+
+/**
+ * @brief File backing the slot the image is written to.
+ */
+#define TEST_SLOT_PATH        "image_hash_slot.bin"
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The image sent and its signature.
+ */
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static Sig_t xSignature;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Send the image one sector at a time, in order or reversed.
+ *
+ * @return The result of closing the file.
+ */
+static OtaPalMainStatus_t prvSendImage( bool xReverse,
+                                        uint32_t * pulReadBytes );
+
+/* Static function definitions ************************************************/
+
+static OtaPalMainStatus_t prvSendImage( bool xReverse,
+                                        uint32_t * pulReadBytes )
+{
+    OtaFileContext_t xFileContext = { 0 };
+    FilePartitionStats_t xStats;
+    OtaPalMainStatus_t eRet;
+    uint32_t ulSector;
+    uint32_t ulOffset;
+
+    xFileContext.fileSize = TEST_IMAGE_SIZE;
+    xFileContext.pSignature = &xSignature;
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCreateFile( &xFileContext ) ) == OtaPalSuccess );
+
+    vFilePartitionResetStats();
+
+    for( ulSector = 0U; ulSector < ( TEST_IMAGE_SIZE / TEST_SECTOR_SIZE ); ulSector++ )
+    {
+        ulOffset = ( xReverse == true ) ? ( TEST_IMAGE_SIZE - ( ( ulSector + 1U ) * TEST_SECTOR_SIZE ) ) : ( ulSector * TEST_SECTOR_SIZE );
+        HOST_TEST_CHECK( sOtaFlashWriterWriteBlock( &xFileContext, ulOffset, &ucImage[ ulOffset ], TEST_SECTOR_SIZE ) == ( int16_t ) TEST_SECTOR_SIZE );
+    }
+
+    eRet = OTA_PAL_MAIN_ERR( xOtaFlashWriterCloseFile( &xFileContext ) );
+    vFilePartitionGetStats( &xStats );
+    *pulReadBytes = xStats.ulReadBytes;
+
+    return eRet;
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    OtaFileContext_t xFileContext = { 0 };
+    uint32_t ulReadBytes;
+
+    vHostTestFill( ucImage, sizeof( ucImage ), 38U );
+    vHostSignatureSign( &xSignature, ucImage, sizeof( ucImage ) );
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+    vFilePartitionSetUpdateSlot( TEST_SLOT_PATH );
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+
+    printf( "%u byte image, incremental hash %s\n",
+            TEST_IMAGE_SIZE,
+            ( otademoconfigENABLE_INCREMENTAL_HASH == 1 ) ? "on" : "off" );
+
+    HOST_TEST_CHECK( prvSendImage( false, &ulReadBytes ) == OtaPalSuccess );
+    printf( "  in order: %" PRIu32 " bytes read back\n", ulReadBytes );
+    HOST_TEST_CHECK( ulReadBytes == ( ( otademoconfigENABLE_INCREMENTAL_HASH == 1 ) ? 0U : TEST_IMAGE_SIZE ) );
+
+    /* Every sector but the first is programmed ahead of the hashed prefix. */
+    HOST_TEST_CHECK( prvSendImage( true, &ulReadBytes ) == OtaPalSuccess );
+    printf( "  reversed: %" PRIu32 " bytes read back\n", ulReadBytes );
+    HOST_TEST_CHECK( ulReadBytes == ( ( otademoconfigENABLE_INCREMENTAL_HASH == 1 ) ? ( TEST_IMAGE_SIZE - TEST_SECTOR_SIZE ) : TEST_IMAGE_SIZE ) );
+
+    /* An image that does not match its signature cannot be activated. */
+    xSignature.data[ 0 ] ^= 0xFFU;
+    HOST_TEST_CHECK( prvSendImage( false, &ulReadBytes ) == OtaPalSignatureCheckFailed );
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterActivateNewImage( &xFileContext ) ) == OtaPalActivateFailed );
+
+    return EXIT_SUCCESS;
+}
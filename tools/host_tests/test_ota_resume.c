@@ -0,0 +1,303 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_ota_resume.c
+ * @brief Resumes a download interrupted by a reboot, as two test processes
+ * sharing the slot and NVS files.
+ *
+ * Run with "interrupt", the test erases the slot in the background, programs
+ * the first blocks of a 64 KiB image through the flash writer, corrupts one
+ * of them and exits without closing the file, as a power loss would. Run with
+ * "resume", it checks that the slot was not erased in the background after
+ * the reboot, that creating the same file again marks the intact blocks
+ * received, and that only the missing sectors are erased and programmed
+ * before the image passes its signature check.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* ESP-IDF includes. */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+/* OTA library includes. */
+#include "ota.h"
+#include "ota_platform_interface.h"
+
+/* OTA demo includes. */
+#include "ota_flash_writer.h"
+#include "ota_image_hash.h"
+#include "ota_pre_erase.h"
+
+/* Host test includes. */
+#include "file_partition.h"
+#include "host_signature.h"
+#include "host_test.h"
+#include "nvs_host.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Size of the image sent, and its number of blocks, one per sector.
+ */
+#define TEST_IMAGE_SIZE              ( 64U * 1024U )
+#define TEST_BLOCKS                  ( TEST_IMAGE_SIZE / OTA_FILE_BLOCK_SIZE )
+
+/**
+ * @brief Blocks programmed before the interruption, and the one of them
+ * corrupted.
+ */
+#define TEST_PROGRAMMED_BLOCKS       ( 10U )
+#define TEST_CORRUPTED_BLOCK         ( 3U )
+
+/**
+ * @brief Longest wait for the flash writer or the pre-erase task.
+ */
+#define TEST_WAIT_US                 ( 10000000U )
+
+/**
+ * @brief Time left to the pre-erase task after the reboot, in which it would
+ * erase many sectors if it were not suspended.
+ */
+#define TEST_PRE_ERASE_IDLE_US       ( 100000U )
+
+/**
+ * @brief Files backing the slot and NVS across both processes.
+ */
+#define TEST_SLOT_PATH               "resume_slot.bin"
+#define TEST_NVS_PATH                "resume_nvs.bin"
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief The image sent, its signature, and the slot read back.
+ */
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static Sig_t xSignature;
+static uint8_t ucWritten[ TEST_IMAGE_SIZE ];
+
+/**
+ * @brief The file, as the OTA agent creates it for every download of the job.
+ */
+static uint8_t ucStreamName[] = "resume-stream";
+static uint8_t ucRxBlockBitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
+static OtaFileContext_t xFileContext;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Set up the files, the image and the modules, as after each boot.
+ */
+static void prvBoot( void );
+
+/**
+ * @brief Create the file, with every block of it still to receive.
+ */
+static void prvCreateFile( void );
+
+/**
+ * @brief Check whether a block is still to be received.
+ */
+static bool prvIsBlockMissing( uint32_t ulBlock );
+
+/**
+ * @brief Program the first blocks, corrupt one and exit.
+ */
+static void prvInterrupt( void );
+
+/**
+ * @brief Resume the download and check the image.
+ */
+static void prvResume( void );
+
+/* Static function definitions ************************************************/
+
+static void prvBoot( void )
+{
+    vNvsHostSetFile( TEST_NVS_PATH );
+    vFilePartitionSetUpdateSlot( TEST_SLOT_PATH );
+    vHostTestFill( ucImage, TEST_IMAGE_SIZE, 35U );
+    vHostSignatureSign( &xSignature, ucImage, TEST_IMAGE_SIZE );
+    vOtaImageHashSetCertificate( HOST_SIGNATURE_CERTIFICATE );
+
+    HOST_TEST_CHECK( xOtaFlashWriterInit() == pdPASS );
+    HOST_TEST_CHECK( xOtaPreEraseInit() == pdPASS );
+}
+
+static void prvCreateFile( void )
+{
+    uint32_t ulBlock;
+
+    memset( ucRxBlockBitmap, 0x00, sizeof( ucRxBlockBitmap ) );
+
+    for( ulBlock = 0U; ulBlock < TEST_BLOCKS; ulBlock++ )
+    {
+        ucRxBlockBitmap[ ulBlock / 8U ] |= ( uint8_t ) ( 1U << ( ulBlock % 8U ) );
+    }
+
+    memset( &xFileContext, 0x00, sizeof( xFileContext ) );
+    xFileContext.fileSize = TEST_IMAGE_SIZE;
+    xFileContext.blocksRemaining = TEST_BLOCKS;
+    xFileContext.serverFileID = 0U;
+    xFileContext.pStreamName = ucStreamName;
+    xFileContext.pRxBlockBitmap = ucRxBlockBitmap;
+    xFileContext.pSignature = &xSignature;
+
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCreateFile( &xFileContext ) ) == OtaPalSuccess );
+}
+
+static bool prvIsBlockMissing( uint32_t ulBlock )
+{
+    return ( ucRxBlockBitmap[ ulBlock / 8U ] & ( 1U << ( ulBlock % 8U ) ) ) != 0U;
+}
+
+static void prvInterrupt( void )
+{
+    const esp_partition_t * pxSlot = esp_ota_get_next_update_partition( NULL );
+    static const uint8_t ucZeros[ 16 ] = { 0 };
+    FilePartitionStats_t xStats;
+    uint64_t ullStartUs;
+    uint32_t ulBlock;
+
+    ( void ) remove( TEST_SLOT_PATH );
+    ( void ) remove( TEST_NVS_PATH );
+    prvBoot();
+
+    /* Stale data of an earlier image, erased in the background. */
+    ullStartUs = ullHostTestNowUs();
+
+    while( xOtaPreEraseIsRangeErased( 0U, pxSlot->size ) == false )
+    {
+        HOST_TEST_CHECK( ( ullHostTestNowUs() - ullStartUs ) < TEST_WAIT_US );
+        vHostTestSleepUs( 1000U );
+    }
+
+    vFilePartitionResetStats();
+    prvCreateFile();
+
+    for( ulBlock = 0U; ulBlock < TEST_PROGRAMMED_BLOCKS; ulBlock++ )
+    {
+        HOST_TEST_CHECK( sOtaFlashWriterWriteBlock( &xFileContext,
+                                                    ulBlock * OTA_FILE_BLOCK_SIZE,
+                                                    &ucImage[ ulBlock * OTA_FILE_BLOCK_SIZE ],
+                                                    OTA_FILE_BLOCK_SIZE ) == ( int16_t ) OTA_FILE_BLOCK_SIZE );
+    }
+
+    /* Each block is checkpointed once it is programmed. */
+    do
+    {
+        HOST_TEST_CHECK( ( ullHostTestNowUs() - ullStartUs ) < TEST_WAIT_US );
+        vHostTestSleepUs( 1000U );
+        vFilePartitionGetStats( &xStats );
+    } while( xStats.ulWrites < TEST_PROGRAMMED_BLOCKS );
+
+    vHostTestSleepUs( TEST_PRE_ERASE_IDLE_US );
+
+    /* A block that no longer matches its checkpoint. */
+    HOST_TEST_CHECK( esp_partition_write( pxSlot, TEST_CORRUPTED_BLOCK * OTA_FILE_BLOCK_SIZE, ucZeros, sizeof( ucZeros ) ) == ESP_OK );
+
+    printf( "interrupted after %" PRIu32 " of %u blocks\n", xStats.ulWrites, ( unsigned ) TEST_BLOCKS );
+}
+
+static void prvResume( void )
+{
+    const esp_partition_t * pxSlot = esp_ota_get_next_update_partition( NULL );
+    FilePartitionStats_t xStats;
+    uint32_t ulBlock;
+    uint32_t ulMissing = 0U;
+
+    prvBoot();
+
+    /* The unfinished download keeps the slot from being erased. */
+    vFilePartitionResetStats();
+    vHostTestSleepUs( TEST_PRE_ERASE_IDLE_US );
+    vFilePartitionGetStats( &xStats );
+    HOST_TEST_CHECK( xStats.ulErasedSectors == 0U );
+
+    prvCreateFile();
+
+    for( ulBlock = 0U; ulBlock < TEST_BLOCKS; ulBlock++ )
+    {
+        HOST_TEST_CHECK( prvIsBlockMissing( ulBlock ) == ( ( ulBlock == TEST_CORRUPTED_BLOCK ) || ( ulBlock >= TEST_PROGRAMMED_BLOCKS ) ) );
+
+        if( prvIsBlockMissing( ulBlock ) == true )
+        {
+            HOST_TEST_CHECK( sOtaFlashWriterWriteBlock( &xFileContext,
+                                                        ulBlock * OTA_FILE_BLOCK_SIZE,
+                                                        &ucImage[ ulBlock * OTA_FILE_BLOCK_SIZE ],
+                                                        OTA_FILE_BLOCK_SIZE ) == ( int16_t ) OTA_FILE_BLOCK_SIZE );
+            ulMissing++;
+        }
+    }
+
+    HOST_TEST_CHECK( xFileContext.blocksRemaining == ulMissing );
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterCloseFile( &xFileContext ) ) == OtaPalSuccess );
+    vFilePartitionGetStats( &xStats );
+
+    printf( "resumed with %" PRIu32 " of %u blocks missing, %" PRIu32 " sectors erased\n",
+            ulMissing,
+            ( unsigned ) TEST_BLOCKS,
+            xStats.ulErasedSectors );
+
+    /* Only the sectors of the missing blocks are erased. */
+    HOST_TEST_CHECK( xStats.ulErasedSectors == ulMissing );
+
+    HOST_TEST_CHECK( esp_partition_read( pxSlot, 0U, ucWritten, TEST_IMAGE_SIZE ) == ESP_OK );
+    HOST_TEST_CHECK( memcmp( ucWritten, ucImage, TEST_IMAGE_SIZE ) == 0 );
+
+    HOST_TEST_CHECK( OTA_PAL_MAIN_ERR( xOtaFlashWriterActivateNewImage( &xFileContext ) ) == OtaPalSuccess );
+    HOST_TEST_CHECK( pxFilePartitionGetBootPartition() == pxSlot );
+}
+
+/* Public function definitions ************************************************/
+
+int main( int argc,
+          char ** argv )
+{
+    HOST_TEST_CHECK( argc == 2 );
+
+    if( strcmp( argv[ 1 ], "interrupt" ) == 0 )
+    {
+        prvInterrupt();
+    }
+    else
+    {
+        HOST_TEST_CHECK( strcmp( argv[ 1 ], "resume" ) == 0 );
+        prvResume();
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,414 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_stream_pipelines_rtt.c
+ * @brief Benchmarks the stream pipelines against a single request window over
+ * a link with a simulated round trip time.
+ *
+ * The link, the stream server and the OTA agent are simulated in virtual
+ * time:
+ * - the first block of a request comes back after one round trip, and every
+ *   block then takes the link time of its size;
+ * - the server sends the first blocks of the request bitmap, up to its block
+ *   count;
+ * - the agent asks for the next blocks every otaconfigMAX_NUM_BLOCKS_REQUEST
+ *   new blocks it received, counting across requests as the OTA library
+ *   does, when a pipeline emptied its window, and when its request timer,
+ *   restarted by each request, expired.
+ *
+ * The pipeline count is otademoconfigSTREAM_PIPELINES, set per executable.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* OTA library includes. */
+#include "ota.h"
+
+/* OTA demo includes. */
+#include "ota_over_mqtt_demo_config.h"
+#include "ota_cbor.h"
+#include "ota_stream_pipelines.h"
+
+/* Host test includes. */
+#include "freertos_host.h"
+#include "host_test.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Blocks of the image, 2 MiB at the default block size.
+ */
+#define SIM_BLOCKS                ( 512U )
+
+/**
+ * @brief Link time of one block, about 1 MB/s.
+ */
+#define SIM_BLOCK_LINK_US         ( 4000U )
+
+/**
+ * @brief Most blocks in flight.
+ */
+#define SIM_MAX_IN_FLIGHT         ( 4096U )
+
+/**
+ * @brief Round trip times benchmarked.
+ */
+#define SIM_RTT_MS                { 50U, 200U, 600U }
+
+/**
+ * @brief From this round trip time on, the pipelines must be at least
+ * SIM_MIN_SPEEDUP_PCT percent faster.
+ */
+#define SIM_SPEEDUP_RTT_MS        ( 200U )
+#define SIM_MIN_SPEEDUP_PCT       ( 150U )
+
+/**
+ * @brief Stream request topic, matched by the pipelines.
+ */
+#define SIM_REQUEST_TOPIC         "$aws/things/host/streams/image/get/cbor"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Outcome of a transfer.
+ */
+typedef struct SimResult
+{
+    uint64_t ullTimeUs;
+    uint32_t ulAgentRequests;
+    uint32_t ulRequests;
+    uint32_t ulDuplicates;
+} SimResult_t;
+
+/**
+ * @brief A block on its way to the device.
+ */
+typedef struct SimArrival
+{
+    uint64_t ullTimeUs;
+    uint32_t ulBlock;
+} SimArrival_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Simulation state.
+ */
+static uint64_t ullNowUs;
+static uint64_t ullLinkFreeUs;
+static uint64_t ullTimerUs;
+static uint32_t ulRttMs;
+static bool xPipelines;
+static uint8_t ucMissing[ SIM_BLOCKS / 8U ];
+static uint32_t ulMissingCount;
+static uint32_t ulToReceive;
+static SimArrival_t xInFlight[ SIM_MAX_IN_FLIGHT ];
+static uint32_t ulInFlightCount;
+static SimResult_t xResult;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Send a stream request for the missing blocks, as the OTA agent would.
+ */
+static void prvAgentRequest( void );
+
+/**
+ * @brief Handle a request at the stream server.
+ */
+static BaseType_t prvServerRequest( const uint8_t * pucRequest,
+                                    uint32_t ulLength,
+                                    void * pvContext );
+
+/**
+ * @brief Handle a block arriving at the device.
+ */
+static void prvAgentReceive( uint32_t ulBlock );
+
+/**
+ * @brief Run one transfer.
+ */
+static void prvRun( uint32_t ulRtt,
+                    bool xUsePipelines );
+
+/* Static function definitions ************************************************/
+
+static void prvAgentRequest( void )
+{
+    uint8_t ucRequest[ 128 ];
+    uint32_t ulLength = 0U;
+    BaseType_t xSent = pdFAIL;
+
+    vOtaCborWriteHead( ucRequest, &ulLength, OTA_CBOR_MAJOR_MAP, 6U );
+    ucRequest[ ulLength++ ] = OTA_CBOR_KEY_HEADER;
+    ucRequest[ ulLength++ ] = 'c';
+    vOtaCborWriteHead( ucRequest, &ulLength, OTA_CBOR_MAJOR_TEXT, 3U );
+    memcpy( &ucRequest[ ulLength ], "rdy", 3U );
+    ulLength += 3U;
+    vOtaCborWriteUint( ucRequest, &ulLength, 'f', 0U );
+    vOtaCborWriteUint( ucRequest, &ulLength, 'l', OTA_FILE_BLOCK_SIZE );
+    vOtaCborWriteUint( ucRequest, &ulLength, 'o', 0U );
+    ucRequest[ ulLength++ ] = OTA_CBOR_KEY_HEADER;
+    ucRequest[ ulLength++ ] = 'b';
+    vOtaCborWriteHead( ucRequest, &ulLength, OTA_CBOR_MAJOR_BYTES, sizeof( ucMissing ) );
+    memcpy( &ucRequest[ ulLength ], ucMissing, sizeof( ucMissing ) );
+    ulLength += sizeof( ucMissing );
+    vOtaCborWriteUint( ucRequest, &ulLength, 'n', otaconfigMAX_NUM_BLOCKS_REQUEST );
+
+    ullTimerUs = ullNowUs + ( otaconfigFILE_REQUEST_WAIT_MS * 1000U );
+    xResult.ulAgentRequests++;
+
+    if( ( xPipelines == false ) ||
+        ( xOtaStreamPipelinesSend( SIM_REQUEST_TOPIC,
+                                   sizeof( SIM_REQUEST_TOPIC ) - 1U,
+                                   ( const char * ) ucRequest,
+                                   ulLength,
+                                   prvServerRequest,
+                                   NULL,
+                                   &xSent ) == false ) )
+    {
+        xSent = prvServerRequest( ucRequest, ulLength, NULL );
+    }
+
+    HOST_TEST_CHECK( xSent == pdPASS );
+}
+
+static BaseType_t prvServerRequest( const uint8_t * pucRequest,
+                                    uint32_t ulLength,
+                                    void * pvContext )
+{
+    OtaCborItem_t xKey;
+    OtaCborItem_t xValue;
+    const uint8_t * pucBitmap = NULL;
+    uint32_t ulBitmapSize = 0U;
+    uint32_t ulBlocks = 0U;
+    uint32_t ulPosition = 0U;
+    uint32_t ulBlock;
+
+    ( void ) pvContext;
+
+    HOST_TEST_CHECK( xOtaCborRead( pucRequest, ulLength, &ulPosition, &xKey ) == true );
+
+    while( ulPosition < ulLength )
+    {
+        HOST_TEST_CHECK( xOtaCborRead( pucRequest, ulLength, &ulPosition, &xKey ) == true );
+        HOST_TEST_CHECK( xOtaCborRead( pucRequest, ulLength, &ulPosition, &xValue ) == true );
+
+        if( xOtaCborIsKey( &xKey, 'b' ) == true )
+        {
+            pucBitmap = xValue.pucData;
+            ulBitmapSize = xValue.ulValue;
+        }
+        else if( xOtaCborIsKey( &xKey, 'n' ) == true )
+        {
+            ulBlocks = xValue.ulValue;
+        }
+        else
+        {
+            /* Not needed by the simulated server. */
+        }
+    }
+
+    for( ulBlock = 0U; ( ulBlock < ( ulBitmapSize * 8U ) ) && ( ulBlocks > 0U ); ulBlock++ )
+    {
+        if( ( pucBitmap[ ulBlock / 8U ] & ( 1U << ( ulBlock % 8U ) ) ) != 0U )
+        {
+            ulBlocks--;
+            ullLinkFreeUs = ( ullLinkFreeUs > ( ullNowUs + ( ulRttMs * 1000U ) ) ) ?
+                            ullLinkFreeUs : ( ullNowUs + ( ulRttMs * 1000U ) );
+            ullLinkFreeUs += SIM_BLOCK_LINK_US;
+
+            HOST_TEST_CHECK( ulInFlightCount < SIM_MAX_IN_FLIGHT );
+            xInFlight[ ulInFlightCount ].ullTimeUs = ullLinkFreeUs;
+            xInFlight[ ulInFlightCount ].ulBlock = ulBlock;
+            ulInFlightCount++;
+        }
+    }
+
+    xResult.ulRequests++;
+
+    return pdPASS;
+}
+
+static void prvAgentReceive( uint32_t ulBlock )
+{
+    uint8_t ucPayload[ 16 ];
+    uint32_t ulLength = 0U;
+    bool xRequest = false;
+    bool xRefill = false;
+
+    /* {"f":0,"i":<block>}, the fields the pipelines read from a data block. */
+    vOtaCborWriteHead( ucPayload, &ulLength, OTA_CBOR_MAJOR_MAP, 2U );
+    vOtaCborWriteUint( ucPayload, &ulLength, 'f', 0U );
+    vOtaCborWriteUint( ucPayload, &ulLength, 'i', ulBlock );
+
+    if( ( ucMissing[ ulBlock / 8U ] & ( 1U << ( ulBlock % 8U ) ) ) != 0U )
+    {
+        ucMissing[ ulBlock / 8U ] &= ( uint8_t ) ~( 1U << ( ulBlock % 8U ) );
+        ulMissingCount--;
+
+        /* Requests sent in between do not restart the count. */
+        if( ulToReceive > 1U )
+        {
+            ulToReceive--;
+        }
+        else
+        {
+            ulToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+            xRequest = true;
+        }
+    }
+    else
+    {
+        xResult.ulDuplicates++;
+    }
+
+    if( xPipelines == true )
+    {
+        xRefill = xOtaStreamPipelinesOnBlock( ucPayload, ulLength );
+    }
+
+    /* The demo signals a drained pipeline behind the block, ahead of any
+     * request the agent signals once it processed the block. */
+    if( ( xRefill == true ) && ( ulMissingCount > 0U ) )
+    {
+        prvAgentRequest();
+    }
+
+    if( ( xRequest == true ) && ( ulMissingCount > 0U ) )
+    {
+        prvAgentRequest();
+    }
+}
+
+static void prvRun( uint32_t ulRtt,
+                    bool xUsePipelines )
+{
+    uint32_t ulIndex;
+    uint32_t ulNext;
+    uint32_t ulBlock;
+
+    ullNowUs = 0U;
+    ullLinkFreeUs = 0U;
+    ulRttMs = ulRtt;
+    xPipelines = xUsePipelines;
+    ulMissingCount = SIM_BLOCKS;
+    ulInFlightCount = 0U;
+    ulToReceive = otaconfigMAX_NUM_BLOCKS_REQUEST;
+    memset( ucMissing, 0xFF, sizeof( ucMissing ) );
+    memset( &xResult, 0x00, sizeof( xResult ) );
+
+    vHostTickSet( 0U );
+    vOtaStreamPipelinesInit();
+    prvAgentRequest();
+
+    while( ulMissingCount > 0U )
+    {
+        ulNext = SIM_MAX_IN_FLIGHT;
+
+        for( ulIndex = 0U; ulIndex < ulInFlightCount; ulIndex++ )
+        {
+            if( ( ulNext == SIM_MAX_IN_FLIGHT ) || ( xInFlight[ ulIndex ].ullTimeUs < xInFlight[ ulNext ].ullTimeUs ) )
+            {
+                ulNext = ulIndex;
+            }
+        }
+
+        if( ( ulNext != SIM_MAX_IN_FLIGHT ) && ( xInFlight[ ulNext ].ullTimeUs <= ullTimerUs ) )
+        {
+            ullNowUs = xInFlight[ ulNext ].ullTimeUs;
+            vHostTickSet( ( TickType_t ) ( ullNowUs / ( portTICK_PERIOD_MS * 1000U ) ) );
+
+            ulBlock = xInFlight[ ulNext ].ulBlock;
+            ulInFlightCount--;
+            xInFlight[ ulNext ] = xInFlight[ ulInFlightCount ];
+            prvAgentReceive( ulBlock );
+        }
+        else
+        {
+            /* The agent asks again once no block came for a while. */
+            ullNowUs = ullTimerUs;
+            vHostTickSet( ( TickType_t ) ( ullNowUs / ( portTICK_PERIOD_MS * 1000U ) ) );
+            prvAgentRequest();
+        }
+    }
+
+    xResult.ullTimeUs = ullNowUs;
+}
+
+/* Public function definitions ************************************************/
+
+int main( void )
+{
+    static const uint32_t ulRtts[] = SIM_RTT_MS;
+    SimResult_t xSingle;
+    uint32_t ulIndex;
+
+    printf( "%u blocks, window of %u, %u us link time per block, %u pipelines\n\n",
+            SIM_BLOCKS,
+            ( unsigned ) otaconfigMAX_NUM_BLOCKS_REQUEST,
+            SIM_BLOCK_LINK_US,
+            ( unsigned ) otademoconfigSTREAM_PIPELINES );
+    printf( "   RTT | single blk/s  requests | pipelines blk/s  agent requests  sent  duplicates\n" );
+
+    for( ulIndex = 0U; ulIndex < ( sizeof( ulRtts ) / sizeof( ulRtts[ 0 ] ) ); ulIndex++ )
+    {
+        prvRun( ulRtts[ ulIndex ], false );
+        xSingle = xResult;
+        prvRun( ulRtts[ ulIndex ], true );
+
+        printf( "%6" PRIu32 " | %12.1f %9" PRIu32 " | %15.1f %15" PRIu32 " %5" PRIu32 " %11" PRIu32 "\n",
+                ulRtts[ ulIndex ],
+                ( SIM_BLOCKS * 1e6 ) / ( double ) xSingle.ullTimeUs,
+                xSingle.ulRequests,
+                ( SIM_BLOCKS * 1e6 ) / ( double ) xResult.ullTimeUs,
+                xResult.ulAgentRequests,
+                xResult.ulRequests,
+                xResult.ulDuplicates );
+
+        /* Blocks in flight are never asked for again, and the agent is
+         * not asked for requests that would find no pipeline to fill. */
+        HOST_TEST_CHECK( xResult.ulDuplicates == 0U );
+        HOST_TEST_CHECK( xResult.ulAgentRequests == xResult.ulRequests );
+
+        if( ulRtts[ ulIndex ] >= SIM_SPEEDUP_RTT_MS )
+        {
+            HOST_TEST_CHECK( ( xSingle.ullTimeUs * 100U ) >= ( xResult.ullTimeUs * SIM_MIN_SPEEDUP_PCT ) );
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Pack an OTA image and data files into one bundle for the OTA over MQTT demo.
+
+The format is documented in main/demo_tasks/ota_over_mqtt_demo/ota_bundle.h.
+The device writes the image and the data files contiguously to the inactive
+slot, followed by the bundle header, and copies the data files to their
+partitions once the new image runs.
+
+Usage:
+    ota_bundle.py pack <bundle.bin> <slot.bin> --image <image.bin>
+                  [--data <label>:<offset>:<file>]...
+    ota_bundle.py list <bundle.bin>
+
+Data files are written raw to the target partition at the given offset, which
+must be a multiple of 4096, so an NVS partition needs an NVS partition image.
+Use the fileType configured with CONFIG_GRI_OTA_BUNDLE_FILE_TYPE for the
+bundle, and sign the slot file, which holds the bytes the device verifies:
+
+    openssl dgst -sha256 -sign key.pem slot.bin | base64 -w0
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"GRIBUNDL"
+VERSION = 1
+HEADER = struct.Struct("<8sII")
+ENTRY = struct.Struct("<III16sI")
+HEADER_SIZE = 256
+MAX_FILES = 7
+SECTOR_SIZE = 4096
+
+TYPE_IMAGE = 0
+TYPE_DATA = 1
+
+
+def pack(image, data_files):
+    """Returns the bundle and the slot layout for the image and data files,
+    given as (label, offset, payload) tuples."""
+    entries = [(TYPE_IMAGE, 0, b"", image)]
+    for label, offset, payload in data_files:
+        entries.append((TYPE_DATA, offset, label.encode(), payload))
+
+    if len(entries) > MAX_FILES:
+        raise ValueError("at most %d data files" % (MAX_FILES - 1))
+
+    header = bytearray(HEADER.pack(MAGIC, VERSION, len(entries)))
+    for entry_type, offset, label, payload in entries:
+        if not payload:
+            raise ValueError("empty payload")
+        if len(label) > 16:
+            raise ValueError("partition label too long: %s" % label.decode())
+        if offset % SECTOR_SIZE != 0:
+            raise ValueError("offset %d is not a multiple of %d" % (offset, SECTOR_SIZE))
+        header += ENTRY.pack(entry_type, len(payload), offset, label, 0)
+    header += bytes(HEADER_SIZE - len(header))
+
+    payloads = b"".join(entry[3] for entry in entries)
+    return bytes(header) + payloads, payloads + bytes(header)
+
+
+def parse_data(argument):
+    label, offset, path = argument.split(":", 2)
+    with open(path, "rb") as source:
+        return label, int(offset, 0), source.read()
+
+
+def describe(bundle):
+    magic, version, count = HEADER.unpack_from(bundle, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a bundle")
+
+    total = 0
+    for index in range(count):
+        entry_type, length, offset, label, _ = ENTRY.unpack_from(bundle, HEADER.size + index * ENTRY.size)
+        if entry_type == TYPE_IMAGE:
+            print("image: %d bytes" % length)
+        else:
+            print("data: %d bytes to %s at 0x%x" % (length, label.rstrip(b"\0").decode(), offset))
+        total += length
+
+    if HEADER_SIZE + total != len(bundle):
+        raise ValueError("bundle size does not match its header")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    pack_parser = commands.add_parser("pack", help="pack an image and data files")
+    pack_parser.add_argument("bundle")
+    pack_parser.add_argument("slot", help="slot layout to sign")
+    pack_parser.add_argument("--image", required=True)
+    pack_parser.add_argument("--data", action="append", default=[], type=parse_data,
+                             metavar="LABEL:OFFSET:FILE",
+                             help="data file for a partition (repeatable)")
+    list_parser = commands.add_parser("list", help="list the contents of a bundle")
+    list_parser.add_argument("bundle")
+    args = parser.parse_args()
+
+    if args.command == "pack":
+        with open(args.image, "rb") as source:
+            image = source.read()
+        bundle, slot = pack(image, args.data)
+        with open(args.bundle, "wb") as output:
+            output.write(bundle)
+        with open(args.slot, "wb") as output:
+            output.write(slot)
+        print("%s: %d bytes, %d data files; sign %s"
+              % (args.bundle, len(bundle), len(args.data), args.slot))
+    else:
+        with open(args.bundle, "rb") as source:
+            describe(source.read())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Compress and decompress OTA images for the OTA over MQTT demo.
+
+The format is LZSS over a 4 KB window, documented in
+main/demo_tasks/ota_over_mqtt_demo/ota_decompress.h, so the device needs
+only 4 KB of RAM to decompress.
+
+Usage:
+    ota_compress.py compress <image.bin> <image.lz> [--rate <bytes/s>]
+    ota_compress.py decompress <image.lz> <image.bin>
+
+`compress` reports the transfer time saved at the given OTA transfer rate,
+as logged by the device flash writer at the end of a download. Use the
+fileType configured with CONFIG_GRI_OTA_COMPRESSED_FILE_TYPE for the
+compressed file, and sign the uncompressed image.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"GRILZSS1"
+HEADER = struct.Struct("<8sI")
+
+WINDOW_SIZE = 4096
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + 15
+
+# Candidate positions examined per match search.
+MAX_CHAIN = 64
+
+
+def compress(image):
+    output = bytearray(HEADER.pack(MAGIC, len(image)))
+    chains = {}
+    position = 0
+    flags_at = None
+    flag_bit = 8
+
+    while position < len(image):
+        if flag_bit == 8:
+            flags_at = len(output)
+            output.append(0)
+            flag_bit = 0
+
+        best_length = 0
+        best_distance = 0
+        key = image[position:position + MIN_MATCH]
+        if len(key) == MIN_MATCH:
+            candidates = chains.get(key, ())
+            limit = min(MAX_MATCH, len(image) - position)
+            for candidate in reversed(candidates[-MAX_CHAIN:]):
+                distance = position - candidate
+                if distance > WINDOW_SIZE:
+                    break
+                length = MIN_MATCH
+                while length < limit and image[candidate + length] == image[position + length]:
+                    length += 1
+                if length > best_length:
+                    best_length = length
+                    best_distance = distance
+                    if length == limit:
+                        break
+
+        if best_length >= MIN_MATCH:
+            encoded = best_distance - 1
+            output.append(encoded & 0xFF)
+            output.append(((encoded >> 4) & 0xF0) | (best_length - MIN_MATCH))
+            step = best_length
+        else:
+            output[flags_at] |= 1 << flag_bit
+            output.append(image[position])
+            step = 1
+        flag_bit += 1
+
+        for index in range(position, position + step):
+            chain = chains.setdefault(image[index:index + MIN_MATCH], [])
+            chain.append(index)
+            if len(chain) > 4 * MAX_CHAIN:
+                del chain[:-MAX_CHAIN]
+        position += step
+
+    return bytes(output)
+
+
+def decompress(data):
+    magic, size = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a compressed image")
+
+    image = bytearray()
+    position = HEADER.size
+    while len(image) < size:
+        flags = data[position]
+        position += 1
+        for _ in range(8):
+            if len(image) >= size:
+                break
+            if flags & 1:
+                image.append(data[position])
+                position += 1
+            else:
+                low, high = data[position], data[position + 1]
+                position += 2
+                distance = (low | ((high & 0xF0) << 4)) + 1
+                if distance > len(image):
+                    raise ValueError("reference before the start of the image")
+                for _ in range((high & 0x0F) + MIN_MATCH):
+                    image.append(image[-distance])
+            flags >>= 1
+
+    if len(image) != size:
+        raise ValueError("image exceeds its declared size")
+    return bytes(image)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    compress_parser = commands.add_parser("compress", help="compress an image")
+    compress_parser.add_argument("image")
+    compress_parser.add_argument("output")
+    compress_parser.add_argument("--rate", type=float, default=8192.0,
+                                 help="OTA transfer rate in bytes/s (default 8192)")
+    decompress_parser = commands.add_parser("decompress", help="decompress an image")
+    decompress_parser.add_argument("input")
+    decompress_parser.add_argument("output")
+    args = parser.parse_args()
+
+    if args.command == "compress":
+        with open(args.image, "rb") as source:
+            image = source.read()
+        data = compress(image)
+        if decompress(data) != image:
+            raise RuntimeError("round trip failed")
+        with open(args.output, "wb") as output:
+            output.write(data)
+        print("%s: %d bytes for a %d byte image (%.1f%%), saving %.1f s at %.0f B/s"
+              % (args.output, len(data), len(image), 100.0 * len(data) / max(len(image), 1),
+                 (len(image) - len(data)) / args.rate, args.rate))
+    else:
+        with open(args.input, "rb") as source:
+            image = decompress(source.read())
+        with open(args.output, "wb") as output:
+            output.write(image)
+        print("%s: %d bytes" % (args.output, len(image)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
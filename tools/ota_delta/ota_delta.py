@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Create and apply delta OTA patches for the OTA over MQTT demo.
+
+A patch rebuilds a new application image from the image running on the
+device, using COPY operations for ranges found in the running image and
+INSERT operations for new data. The format is documented in
+main/demo_tasks/ota_over_mqtt_demo/ota_delta.h.
+
+Usage:
+    ota_delta.py create <running.bin> <new.bin> <patch.bin>
+    ota_delta.py apply <running.bin> <patch.bin> <new.bin>
+
+`apply` mirrors the device implementation and can be used to check a patch
+on the host before creating the OTA job. Use the fileType configured with
+CONFIG_GRI_OTA_DELTA_FILE_TYPE for the patch file, and sign the new image,
+not the patch.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"GRIDELTA"
+VERSION = 1
+HEADER = struct.Struct("<8sIII32s32s")
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+# Length of the source windows indexed for matching, and their spacing.
+WINDOW = 32
+STRIDE = 16
+
+# Shortest match worth a COPY instead of extending an INSERT.
+MIN_COPY = 48
+
+
+def _index_source(source):
+    index = {}
+    for offset in range(0, len(source) - WINDOW + 1, STRIDE):
+        index.setdefault(source[offset:offset + WINDOW], offset)
+    return index
+
+
+def create_patch(source, target):
+    index = _index_source(source)
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        if literal:
+            ops.extend(struct.pack("<BI", OP_INSERT, len(literal)))
+            ops.extend(literal)
+            literal.clear()
+
+    position = 0
+    while position < len(target):
+        match = index.get(target[position:position + WINDOW])
+        if match is None:
+            literal.append(target[position])
+            position += 1
+            continue
+
+        # Extend the match backwards into pending literal data, then forwards.
+        back = 0
+        while (back < len(literal) and back < match
+               and source[match - back - 1] == literal[-back - 1]):
+            back += 1
+        length = WINDOW
+        while (position + length < len(target) and match + length < len(source)
+               and target[position + length] == source[match + length]):
+            length += 1
+
+        if back + length < MIN_COPY:
+            literal.append(target[position])
+            position += 1
+            continue
+
+        if back:
+            del literal[-back:]
+        flush_literal()
+        ops.extend(struct.pack("<BII", OP_COPY, match - back, back + length))
+        position += length
+
+    flush_literal()
+    ops.append(OP_END)
+
+    header = HEADER.pack(MAGIC, VERSION, len(source), len(target),
+                         hashlib.sha256(source).digest(),
+                         hashlib.sha256(target).digest())
+    return header + bytes(ops)
+
+
+def apply_patch(source, patch):
+    magic, version, source_size, target_size, source_hash, target_hash = \
+        HEADER.unpack_from(patch, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version 1 delta")
+    if source_size > len(source) or \
+            hashlib.sha256(source[:source_size]).digest() != source_hash:
+        raise ValueError("patch does not apply to the running image")
+
+    target = bytearray()
+    position = HEADER.size
+    while True:
+        opcode = patch[position]
+        position += 1
+        if opcode == OP_END:
+            break
+        if opcode == OP_COPY:
+            offset, length = struct.unpack_from("<II", patch, position)
+            position += 8
+            if offset + length > source_size:
+                raise ValueError("copy outside of the source image")
+            target.extend(source[offset:offset + length])
+        elif opcode == OP_INSERT:
+            (length,) = struct.unpack_from("<I", patch, position)
+            position += 4
+            target.extend(patch[position:position + length])
+            position += length
+        else:
+            raise ValueError("unknown operation 0x%02x" % opcode)
+
+    if len(target) != target_size or \
+            hashlib.sha256(target).digest() != target_hash:
+        raise ValueError("new image does not match the target hash")
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    create = commands.add_parser("create", help="create a patch")
+    create.add_argument("running")
+    create.add_argument("new")
+    create.add_argument("patch")
+    apply = commands.add_parser("apply", help="apply a patch")
+    apply.add_argument("running")
+    apply.add_argument("patch")
+    apply.add_argument("new")
+    args = parser.parse_args()
+
+    if args.command == "create":
+        with open(args.running, "rb") as running, open(args.new, "rb") as new:
+            source = running.read()
+            target = new.read()
+        patch = create_patch(source, target)
+        with open(args.patch, "wb") as output:
+            output.write(patch)
+        print("%s: %d bytes for a %d byte image (%.1f%%)"
+              % (args.patch, len(patch), len(target), 100.0 * len(patch) / max(len(target), 1)))
+    else:
+        with open(args.running, "rb") as running, open(args.patch, "rb") as patch:
+            source = running.read()
+            target = apply_patch(source, patch.read())
+        with open(args.new, "wb") as output:
+            output.write(target)
+        print("%s: %d bytes, hash verified" % (args.new, len(target)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+"""
+Stand-in for the AWS IoT Jobs and MQTT file streams services, to benchmark
+the OTA over MQTT demo against a local MQTT broker.
+
+The server offers one OTA job for one thing, serves the image in CBOR stream
+blocks, records the job status updates of the device and reports the
+transfer throughput once every block has been sent:
+
+    blocks/s, KB/s, total time, requests, and blocks sent more than once
+
+Point CONFIG_GRI_MQTT_ENDPOINT and CONFIG_GRI_MQTT_PORT at the broker, for
+example mosquitto with a TLS listener using a server certificate signed by
+the CA in main/certs/root_cert_auth.crt. The device logs the matching
+"OTA transfer" line with the CPU time per block and the peak event buffer
+usage.
+
+Usage:
+    ota_stream_server.py <thing name> <image.bin> --signing-key <key.pem>
+                         [--host localhost] [--port 1883]
+                         [--block-delay-ms 0] [--rtt-ms 0] [--drop 0.0]
+
+The image is signed with openssl using the key matching
+main/certs/aws_codesign.crt, or pass a base64 signature with --signature.
+--block-delay-ms and --drop emulate a slow or lossy link, and --rtt-ms a
+link with a long round trip: the blocks of a request are sent no earlier
+than that long after the request, while requests in flight overlap, so the
+gain of CONFIG_GRI_OTA_STREAM_PIPELINES can be measured. Requires
+paho-mqtt.
+"""
+
+import argparse
+import base64
+import json
+import queue
+import random
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+JOBS_PREFIX = "$aws/things/{thing}/jobs/"
+STREAMS_PREFIX = "$aws/things/{thing}/streams/{stream}/"
+
+TERMINAL_STATUSES = ("SUCCEEDED", "FAILED", "REJECTED", "CANCELED")
+
+
+def cbor_encode(value):
+    def head(major, argument):
+        if argument < 24:
+            return struct.pack(">B", (major << 5) | argument)
+        if argument < 0x100:
+            return struct.pack(">BB", (major << 5) | 24, argument)
+        if argument < 0x10000:
+            return struct.pack(">BH", (major << 5) | 25, argument)
+        return struct.pack(">BI", (major << 5) | 26, argument)
+
+    if isinstance(value, int):
+        return head(0, value) if value >= 0 else head(1, -1 - value)
+    if isinstance(value, bytes):
+        return head(2, len(value)) + value
+    if isinstance(value, str):
+        encoded = value.encode()
+        return head(3, len(encoded)) + encoded
+    if isinstance(value, dict):
+        return head(5, len(value)) + b"".join(cbor_encode(k) + cbor_encode(v) for k, v in value.items())
+    raise TypeError("cannot encode {}".format(type(value)))
+
+
+def cbor_decode(data):
+    def item(position):
+        initial = data[position]
+        major, info = initial >> 5, initial & 0x1F
+        position += 1
+        if info < 24:
+            argument = info
+        else:
+            size = {24: 1, 25: 2, 26: 4, 27: 8}[info]
+            argument = int.from_bytes(data[position:position + size], "big")
+            position += size
+        if major == 0:
+            return argument, position
+        if major == 1:
+            return -1 - argument, position
+        if major in (2, 3):
+            raw = bytes(data[position:position + argument])
+            return (raw if major == 2 else raw.decode()), position + argument
+        if major == 5:
+            result = {}
+            for _ in range(argument):
+                key, position = item(position)
+                result[key], position = item(position)
+            return result, position
+        raise ValueError("unsupported CBOR major type {}".format(major))
+
+    return item(0)[0]
+
+
+def sign(image_path, key_path):
+    signature = subprocess.run(["openssl", "dgst", "-sha256", "-sign", key_path, image_path],
+                               check=True, stdout=subprocess.PIPE).stdout
+    return base64.b64encode(signature).decode()
+
+
+class Transfer:
+    """Throughput of one download, from the first block request."""
+
+    def __init__(self, block_count):
+        self.block_count = block_count
+        self.start = None
+        self.end = None
+        self.requests = 0
+        self.sent = {}
+        self.bytes_sent = 0
+        self.dropped = 0
+
+    def report(self):
+        elapsed = (self.end or time.monotonic()) - self.start
+        blocks = sum(self.sent.values())
+        resent = sum(count - 1 for count in self.sent.values())
+        print("Transfer: {}/{} blocks, {} bytes in {:.2f} s, {:.1f} blocks/s, {:.1f} KB/s, "
+              "{} requests, {} blocks resent, {} dropped".format(
+                  len(self.sent), self.block_count, self.bytes_sent, elapsed,
+                  blocks / elapsed if elapsed > 0 else 0.0,
+                  self.bytes_sent / 1024.0 / elapsed if elapsed > 0 else 0.0,
+                  self.requests, resent, self.dropped))
+
+
+class OtaStreamServer:
+    def __init__(self, args, image, signature):
+        self.args = args
+        self.image = image
+        self.block_size = None
+        self.job_id = "AFR_OTA-bench-{}".format(int(time.time()))
+        self.status = "QUEUED"
+        self.status_details = {}
+        self.version = 1
+        self.jobs = JOBS_PREFIX.format(thing=args.thing)
+        self.streams = STREAMS_PREFIX.format(thing=args.thing, stream=self.job_id)
+        self.transfer = None
+        self.outbox = queue.PriorityQueue()
+        self.sequence = 0
+        self.file = {
+            "filepath": args.file_path,
+            "filesize": len(image),
+            "fileid": 0,
+            "certfile": args.certfile,
+            "fileType": args.file_type,
+            "sig-sha256-ecdsa": signature,
+        }
+
+        try:
+            self.client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION1, client_id="ota_stream_server")
+        except AttributeError:
+            self.client = mqtt.Client(client_id="ota_stream_server")
+
+        if args.tls_ca:
+            self.client.tls_set(ca_certs=args.tls_ca, certfile=args.tls_cert, keyfile=args.tls_key)
+
+        self.client.on_connect = self.on_connect
+        self.client.on_message = self.on_message
+
+    def execution(self):
+        return {
+            "jobId": self.job_id,
+            "status": self.status,
+            "statusDetails": self.status_details,
+            "versionNumber": self.version,
+            "executionNumber": 1,
+            "jobDocument": {"afr_ota": {"protocols": ["MQTT"], "streamname": self.job_id, "files": [self.file]}},
+        }
+
+    def job_message(self, client_token=None):
+        message = {"timestamp": int(time.time())}
+        if client_token is not None:
+            message["clientToken"] = client_token
+        if self.status not in TERMINAL_STATUSES:
+            message["execution"] = self.execution()
+        return json.dumps(message)
+
+    def on_connect(self, client, userdata, flags, rc):
+        client.subscribe(self.jobs + "$next/get")
+        client.subscribe(self.jobs + "+/update")
+        client.subscribe(self.streams + "get/cbor")
+        client.publish(self.jobs + "notify-next", self.job_message())
+        print("Offering job {} with a {} byte image to {}.".format(self.job_id, len(self.image), self.args.thing))
+
+    def on_message(self, client, userdata, message):
+        if message.topic == self.jobs + "$next/get":
+            request = json.loads(message.payload or b"{}")
+            client.publish(self.jobs + "$next/get/accepted", self.job_message(request.get("clientToken")))
+        elif message.topic.startswith(self.jobs) and message.topic.endswith("/update"):
+            self.on_update(client, message)
+        elif message.topic == self.streams + "get/cbor":
+            self.on_block_request(cbor_decode(message.payload))
+
+    def on_update(self, client, message):
+        update = json.loads(message.payload)
+        self.status = update.get("status", self.status)
+        self.status_details = update.get("statusDetails", self.status_details)
+        self.version += 1
+        client.publish(message.topic + "/accepted", json.dumps({"timestamp": int(time.time())}))
+        print("Job status {} {}".format(self.status, json.dumps(self.status_details)))
+
+    def on_block_request(self, request):
+        block_size = request["l"]
+        block_count = (len(self.image) + block_size - 1) // block_size
+
+        if self.transfer is None or self.transfer.end is not None:
+            self.transfer = Transfer(block_count)
+            self.transfer.start = time.monotonic()
+
+        self.transfer.requests += 1
+        bitmap = request["b"]
+        offset = request.get("o", 0)
+        remaining = request.get("n", block_count)
+        due = time.monotonic() + self.args.rtt_ms / 1000.0
+
+        for index in range(len(bitmap) * 8):
+            block = offset + index
+            if remaining == 0 or block >= block_count:
+                break
+            if bitmap[index // 8] & (1 << (index % 8)):
+                self.sequence += 1
+                self.outbox.put((due, self.sequence, request.get("f", 0), block, block_size))
+                remaining -= 1
+
+    def sender(self):
+        while True:
+            due, _, file_id, block, block_size = self.outbox.get()
+            time.sleep(max(0.0, due - time.monotonic()))
+            if self.args.block_delay_ms > 0:
+                time.sleep(self.args.block_delay_ms / 1000.0)
+            if random.random() < self.args.drop:
+                self.transfer.dropped += 1
+                continue
+            payload = self.image[block * block_size:(block + 1) * block_size]
+            self.client.publish(self.streams + "data/cbor",
+                                cbor_encode({"f": file_id, "i": block, "l": len(payload), "p": payload}))
+            self.transfer.sent[block] = self.transfer.sent.get(block, 0) + 1
+            self.transfer.bytes_sent += len(payload)
+
+            if len(self.transfer.sent) == self.transfer.block_count and self.transfer.end is None:
+                self.transfer.end = time.monotonic()
+                self.transfer.report()
+
+    def run(self):
+        threading.Thread(target=self.sender, daemon=True).start()
+        self.client.connect(self.args.host, self.args.port)
+        try:
+            self.client.loop_forever()
+        except KeyboardInterrupt:
+            if self.transfer is not None and self.transfer.end is None:
+                self.transfer.report()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("thing")
+    parser.add_argument("image")
+    signature = parser.add_mutually_exclusive_group(required=True)
+    signature.add_argument("--signing-key", help="PEM key matching the device code signing certificate")
+    signature.add_argument("--signature", help="base64 DER ECDSA signature of the image")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--tls-ca")
+    parser.add_argument("--tls-cert")
+    parser.add_argument("--tls-key")
+    parser.add_argument("--file-path", default="/")
+    parser.add_argument("--file-type", type=int, default=0)
+    parser.add_argument("--certfile", default="Code Verify Key")
+    parser.add_argument("--block-delay-ms", type=float, default=0.0,
+                        help="delay before each block, to emulate a slow link")
+    parser.add_argument("--rtt-ms", type=float, default=0.0,
+                        help="delay between a request and its first block, to emulate a long round trip")
+    parser.add_argument("--drop", type=float, default=0.0,
+                        help="fraction of blocks dropped, to emulate a lossy link")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as image_file:
+        image = image_file.read()
+
+    OtaStreamServer(args, image, args.signature or sign(args.image, args.signing_key)).run()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())